@@ -0,0 +1,409 @@
+#!/bin/sh
+#
+# bench.sh
+#
+# Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Benchmark librlog against synthetic catalogs.
+#
+# Usage: bench.sh BIN_DIR
+#
+# For every size in BENCH_SIZES a catalog is generated with `gencatalog`
+# and a set of scripted sessions is replayed through `benchrun`.  The time
+# of each operation is taken from the command statistics that librlog
+# writes with `-s`, so process startup and the other commands of a session
+# do not count; the peak RSS is that of the whole session.
+#
+# Results are printed to stdout as JSON Lines, one object per operation:
+#
+#   {"rows":10000,"op":"find_author","ops":5,"seconds":0.0123,
+#    "us_per_op":2460.0,"ops_per_sec":406.5,"peak_rss_kb":26312,"status":"ok"}
+#
+# Environment:
+#   BENCH_SIZES    Catalog sizes in rows (default "10000 100000 1000000 10000000").
+#   BENCH_QUERIES  Repetitions of each search and count (default 5).
+#   BENCH_LOANS    Number of books borrowed and returned (default 200).
+#   BENCH_REPEAT   Runs of each session; the fastest is kept (default 3).
+#   BENCH_THREADS  Thread counts to time a full scan with (default: powers
+#                  of two below the number of processors, and that number).
+#   BENCH_DIR      Scratch directory (default: a new directory under /tmp).
+
+set -u
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 BIN_DIR" >&2
+  exit 1
+fi
+
+bin_dir=$(cd "$1" && pwd)
+prog="$bin_dir/librlog"
+gen="$bin_dir/gencatalog"
+run="$bin_dir/benchrun"
+
+sizes=${BENCH_SIZES:-"10000 100000 1000000 10000000"}
+queries=${BENCH_QUERIES:-5}
+loans=${BENCH_LOANS:-200}
+repeat=${BENCH_REPEAT:-3}
+work=${BENCH_DIR:-$(mktemp -d /tmp/librlog-bench.XXXXXX)}
+prog_args=""
+
+threads=${BENCH_THREADS:-}
+if [ -z "$threads" ]; then
+  cpus=$(getconf _NPROCESSORS_ONLN 2> /dev/null || echo 1)
+  n=1
+  while [ "$n" -lt "$cpus" ]; do
+    threads="$threads $n"
+    n=$((n * 2))
+  done
+  threads="$threads $cpus"
+fi
+
+mkdir -p "$work/run/data" || exit 1
+
+# session CATALOG SCRIPT
+#   Replay SCRIPT against a fresh copy of CATALOG BENCH_REPEAT times,
+#   passing librlog the options in `prog_args`,
+#   keeping the statistics of run N in stats.N.json and setting `rss` to
+#   the largest peak RSS.
+session ()
+{
+  rss=0
+  n=0
+  while [ "$n" -lt "$repeat" ]; do
+    cp "$1" "$work/run/data/library_catalog.csv" || exit 1
+    rm -f "$work/stats.$n.json"
+    set -- "$1" "$2" $("$run" "$work/run" "$2" "$prog" $prog_args -s "$work/stats.$n.json")
+    rss=$(echo "$4 $rss" | awk '{ print ($1 > $2 ? $1 : $2) }')
+    n=$((n + 1))
+  done
+}
+
+# report ROWS OP COMMAND
+#   Print the fastest total time spent in COMMAND over the runs of the
+#   last session.  The status is "failed" unless every run wrote its
+#   statistics and COMMAND ran at least once.
+report ()
+{
+  n=0
+  while [ "$n" -lt "$repeat" ]; do
+    if [ -f "$work/stats.$n.json" ]; then
+      grep "\"name\":\"$3\"" "$work/stats.$n.json" \
+        | sed 's/.*"count":\([0-9]*\),"total_ns":\([0-9]*\),.*/\1 \2/'
+    else
+      echo "missing"
+    fi
+    n=$((n + 1))
+  done | awk -v rows="$1" -v op="$2" -v rss="$rss" '
+    $1 == "missing" { failed = 1; next }
+    { ops = $1; if (secs == "" || $2 / 1e9 < secs) secs = $2 / 1e9 }
+    END {
+      printf "{\"rows\":%d,\"op\":\"%s\",\"ops\":%d,\"seconds\":%.6f,", rows, op, ops, secs;
+      printf "\"us_per_op\":%.3f,", (ops > 0 ? secs * 1e6 / ops : 0);
+      printf "\"ops_per_sec\":%.1f,", (secs > 0 ? ops / secs : 0);
+      printf "\"peak_rss_kb\":%d,\"status\":\"%s\"}\n", rss, (!failed && ops > 0) ? "ok" : "failed";
+    }'
+}
+
+printf 'bisu\nq\n' > "$work/save.in"
+
+for rows in $sizes; do
+  echo "bench: generating $rows rows" >&2
+  catalog="$work/catalog-$rows.csv"
+  if ! "$gen" "$rows" > "$catalog"; then
+    echo "bench: failed to generate $rows rows" >&2
+    continue
+  fi
+
+  echo "bench: load/save ($rows rows)" >&2
+  session "$catalog" "$work/save.in"
+  report "$rows" load load_catalog
+  report "$rows" save save_catalog
+
+  # Check a fresh copy of the catalog against the checksum file
+  # the save above left beside it.
+  echo "bench: verify ($rows rows)" >&2
+  printf 'bisu\nv\nq\n' > "$work/verify.in"
+  session "$catalog" "$work/verify.in"
+  report "$rows" verify verify_catalog
+
+  # Export the catalog once in each format.
+  for export in jsonl:l:jsonl json:j:json xml:x:xml pages:p:db; do
+    name=${export%%:*}
+    rest=${export#*:}
+    key=${rest%%:*}
+    ext=${rest#*:}
+
+    echo "bench: export $name ($rows rows)" >&2
+    printf 'bisu\nx\n%s\n\nq\n' "$key" > "$work/export-$name.in"
+    session "$catalog" "$work/export-$name.in"
+    report "$rows" "export_$name" export_catalog
+    rm -f "$work/run/data/library_catalog.$ext"
+  done
+
+  # Export the catalog sorted by author, in memory and then through
+  # runs on disk with the least memory a sort may have.
+  printf 'bisu\nx\ns\na\n\nq\n' > "$work/export-sorted.in"
+  for sort in sorted: sorted_spill:"-m 1"; do
+    echo "bench: export ${sort%%:*} ($rows rows)" >&2
+    prog_args=${sort#*:}
+    session "$catalog" "$work/export-sorted.in"
+    report "$rows" "export_${sort%%:*}" export_catalog
+    rm -f "$work/run/data/library_catalog-sorted.csv"
+  done
+  prog_args=""
+
+  # Overwrite the catalog with a copy sorted by author, which moves every
+  # book, and read it back when the next command starts.
+  echo "bench: reload ($rows rows)" >&2
+  printf 'bisu\nx\ns\na\ndata/library_catalog.csv\nc\nb\nq\n' > "$work/reload.in"
+  session "$catalog" "$work/reload.in"
+  report "$rows" reload reload_catalog
+
+  # Lend 1000 books at the scan station and return them,
+  # committing the changes in groups.
+  echo "bench: scan station ($rows rows)" >&2
+  {
+    printf 'bisu\nk\n\n#0\n'
+    awk -v n="$rows" 'BEGIN { for (k = 0; k < 2; k++) for (i = 1; i <= 1000 && i <= n; i++) print i }'
+    printf '\nq\n'
+  } > "$work/station.in"
+  session "$catalog" "$work/station.in"
+  report "$rows" scan_station scan_station
+
+  # Convert the catalog to MARC 21 records, the authors entered surname
+  # first, and import them into an empty catalog.
+  echo "bench: import marc ($rows rows)" >&2
+  LC_ALL=C awk -F, '
+    function field(tag, body) {
+      dir = dir sprintf ("%s%04d%05d", tag, length (body) + 1, length (data))
+      data = data body ft
+    }
+    BEGIN { sf = sprintf ("%c", 31); ft = sprintf ("%c", 30); rt = sprintf ("%c", 29) }
+    NR > 1 {
+      dir = ""
+      data = ""
+      last = $2
+      sub (/.* /, "", last)
+      first = substr ($2, 1, length ($2) - length (last) - 1)
+      field("008", "230101s" $4 "    xx            000 1 eng d")
+      field("020", "  " sf "a" $5)
+      field("100", "1 " sf "a" last ", " first ",")
+      field("245", "10" sf "a" $1 " /")
+      field("264", " 1" sf "b" $3 "," sf "c" $4 ".")
+      field("650", " 0" sf "a" $7 ".")
+      base = 24 + length (dir) + 1
+      printf "%05dnam a22%05d i 4500%s%s%s%s", base + length (data) + 1, base, dir, ft, data, rt
+    }' "$catalog" > "$work/import.mrc"
+  head -n 1 "$catalog" > "$work/empty.csv"
+  printf 'bisu\ni\n%s\nq\n' "$work/import.mrc" > "$work/import.in"
+  session "$work/empty.csv" "$work/import.in"
+  report "$rows" import_marc import_books
+  rm -f "$work/import.mrc" "$work/empty.csv"
+
+  # Search for the values of a record in the middle of the catalog.
+  sample=$(awk -v n="$rows" 'NR == int (n / 2) + 2 { print; exit }' "$catalog")
+  for search in author:a:2 genre:g:7 publisher:p:3 title:t:1 year:y:4; do
+    name=${search%%:*}
+    rest=${search#*:}
+    key=${rest%%:*}
+    column=${rest#*:}
+    value=$(echo "$sample" | cut -d, -f"$column")
+
+    echo "bench: find $name ($rows rows)" >&2
+    script="$work/find-$name.in"
+    {
+      echo bisu
+      i=0
+      while [ "$i" -lt "$queries" ]; do
+        printf 'f\n%s\n%s\n' "$key" "$value"
+        i=$((i + 1))
+      done
+      echo q
+    } > "$script"
+    session "$catalog" "$script"
+    report "$rows" "find_$name" find_books
+  done
+
+  # Search a range of years within the sampled record's genre.
+  # The first query also builds the year index.
+  echo "bench: find year range ($rows rows)" >&2
+  genre=$(echo "$sample" | cut -d, -f7)
+  script="$work/find-year-range.in"
+  {
+    echo bisu
+    i=0
+    while [ "$i" -lt "$queries" ]; do
+      printf 'f\nr\n1900-1950\n%s\n' "$genre"
+      i=$((i + 1))
+    done
+    echo q
+  } > "$script"
+  session "$catalog" "$script"
+  report "$rows" find_year_range find_books
+
+  # Search the available books of the sampled record's genre.
+  # The first query also builds the bitmaps.
+  echo "bench: find available ($rows rows)" >&2
+  script="$work/find-available.in"
+  {
+    echo bisu
+    i=0
+    while [ "$i" -lt "$queries" ]; do
+      printf 'f\nv\n%s\n' "$genre"
+      i=$((i + 1))
+    done
+    echo q
+  } > "$script"
+  session "$catalog" "$script"
+  report "$rows" find_available find_books
+
+  # Query the available books of the sampled record's genre since 1900.
+  # The planner weighs the bitmaps against the year index.
+  echo "bench: find query ($rows rows)" >&2
+  script="$work/find-query.in"
+  {
+    echo bisu
+    i=0
+    while [ "$i" -lt "$queries" ]; do
+      printf 'f\nq\ngenre="%s" AND year>=1900 AND available\n' "$genre"
+      i=$((i + 1))
+    done
+    echo q
+  } > "$script"
+  session "$catalog" "$script"
+  report "$rows" find_query find_books
+
+  # Query the sampled record's author, which no index answers,
+  # with the scan split across each number of threads.
+  author=$(echo "$sample" | cut -d, -f2)
+  script="$work/find-scan.in"
+  {
+    echo bisu
+    i=0
+    while [ "$i" -lt "$queries" ]; do
+      printf 'f\nq\nauthor="%s"\n' "$author"
+      i=$((i + 1))
+    done
+    echo q
+  } > "$script"
+  for j in $threads; do
+    echo "bench: find scan on $j thread/s ($rows rows)" >&2
+    prog_args="-j $j"
+    session "$catalog" "$script"
+    report "$rows" "find_scan_j$j" find_books
+  done
+  prog_args=""
+
+  # Search the sampled record's author across this branch and three
+  # others of a quarter of its size each.
+  echo "bench: find branches ($rows rows)" >&2
+  mkdir -p "$work/run/data/branches"
+  for branch in east:1 north:2 south:3; do
+    "$gen" $((rows / 4 + 1)) "${branch#*:}" > "$work/run/data/branches/${branch%%:*}.csv"
+  done
+  author=$(echo "$sample" | cut -d, -f2)
+  script="$work/find-branches.in"
+  {
+    echo bisu
+    i=0
+    while [ "$i" -lt "$queries" ]; do
+      printf 'f\nc\na\n%s\n' "$author"
+      i=$((i + 1))
+    done
+    echo q
+  } > "$script"
+  session "$catalog" "$script"
+  report "$rows" find_branches find_books
+
+  # Look up the sampled record's accession number in the same
+  # branches, each turned into a paged catalog.
+  echo "bench: find paged ($rows rows)" >&2
+  mkdir -p "$work/pages/data"
+  for branch in east north south; do
+    cp "$work/run/data/branches/$branch.csv" "$work/pages/data/library_catalog.csv"
+    printf 'bisu\nx\np\n%s\nq\n' "$work/run/data/branches/$branch.db" \
+      | (cd "$work/pages" && "$prog" > /dev/null)
+    rm -f "$work/run/data/branches/$branch.csv"
+  done
+  rm -rf "$work/pages"
+  accession=$(echo "$sample" | cut -d, -f6)
+  script="$work/find-paged.in"
+  {
+    echo bisu
+    i=0
+    while [ "$i" -lt "$queries" ]; do
+      printf 'f\nc\nn\n%s\n' "$accession"
+      i=$((i + 1))
+    done
+    echo q
+  } > "$script"
+  session "$catalog" "$script"
+  report "$rows" find_paged find_books
+  rm -rf "$work/run/data/branches"
+
+  # Count the books by each field of the aggregation reports.
+  for count in author:a genre:g year:y checked_out:c available:v; do
+    name=${count%%:*}
+    key=${count#*:}
+
+    echo "bench: count $name ($rows rows)" >&2
+    script="$work/count-$name.in"
+    {
+      echo bisu
+      i=0
+      while [ "$i" -lt "$queries" ]; do
+        printf 'c\n%s\n' "$key"
+        i=$((i + 1))
+      done
+      echo q
+    } > "$script"
+    session "$catalog" "$script"
+    report "$rows" "count_$name" count_books
+  done
+
+  # Borrow and then return a spread of available books.
+  awk -F, -v n="$rows" -v m="$loans" 'NR > 1 && $8 == "" && (NR - 2) % (int (n / m) + 1) == 0 && found < m { print $6; found++ }' \
+    "$catalog" > "$work/loans.txt"
+  awk '{ printf "b\n%s\nBench Patron\n2023-01-01\n", $1 }' "$work/loans.txt" > "$work/borrows.txt"
+  awk '{ printf "r\n%s\n2023-01-15\n", $1 }' "$work/loans.txt" > "$work/returns.txt"
+
+  # While the books are out, look up the patron's loans;
+  # once they are back, read the history of the first of them
+  # and report the most borrowed titles of the year.
+  echo "bench: borrow/return ($rows rows)" >&2
+  {
+    echo bisu
+    cat "$work/borrows.txt"
+    i=0
+    while [ "$i" -lt "$queries" ]; do
+      printf 'p\nBench Patron\n'
+      i=$((i + 1))
+    done
+    cat "$work/returns.txt"
+    i=0
+    while [ "$i" -lt "$queries" ]; do
+      printf 't\nh\n%s\n2023-01-01\n2023-01-31\n' "$(head -n 1 "$work/loans.txt")"
+      i=$((i + 1))
+    done
+    i=0
+    while [ "$i" -lt "$queries" ]; do
+      printf 'o\nt\n2023\nn\n'
+      i=$((i + 1))
+    done
+    echo q
+  } > "$work/circulation.in"
+  session "$catalog" "$work/circulation.in"
+  report "$rows" borrow borrow_book
+  report "$rows" patron_loans find_patron
+  report "$rows" return return_book
+  report "$rows" book_history show_history
+  report "$rows" popular_titles show_popular
+
+  rm -f "$catalog"
+done
+
+if [ -z "${BENCH_DIR:-}" ]; then
+  rm -rf "$work"
+fi
@@ -0,0 +1,104 @@
+/* benchrun.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Run one scripted librlog session and report its cost.
+ *
+ * Usage: benchrun DIR SCRIPT PROGRAM [ARG]...
+ *
+ * PROGRAM is started with DIR as its working directory and SCRIPT as its
+ * standard input; its output is discarded.  When it exits, a single line
+ *
+ *   SECONDS PEAK_RSS_KB EXIT_STATUS
+ *
+ * is printed to stdout, where SECONDS is the wall-clock time of the run.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+int
+main (int   argc,
+      char *argv[])
+{
+  struct timespec start, end;
+  struct rusage usage;
+  pid_t pid;
+  int status, fd;
+
+  if (argc < 4)
+    {
+      fprintf (stderr, "Usage: %s DIR SCRIPT PROGRAM [ARG]...\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  fd = open (argv[2], O_RDONLY);
+  if (fd < 0)
+    {
+      fprintf (stderr, "Error: Failed to open script \"%s\".\n", argv[2]);
+      return EXIT_FAILURE;
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  pid = fork ();
+  if (pid < 0)
+    {
+      fprintf (stderr, "Error: Failed to fork.\n");
+      return EXIT_FAILURE;
+    }
+
+  if (pid == 0)
+    {
+      int null_fd;
+
+      null_fd = open ("/dev/null", O_WRONLY);
+      if (null_fd < 0 || chdir (argv[1]) != 0)
+        _exit (127);
+
+      dup2 (fd, STDIN_FILENO);
+      dup2 (null_fd, STDOUT_FILENO);
+      dup2 (null_fd, STDERR_FILENO);
+      execv (argv[3], &argv[3]);
+      _exit (127);
+    }
+
+  if (wait4 (pid, &status, 0, &usage) < 0)
+    {
+      fprintf (stderr, "Error: Failed to wait for \"%s\".\n", argv[3]);
+      return EXIT_FAILURE;
+    }
+  clock_gettime (CLOCK_MONOTONIC, &end);
+
+  printf ("%.6f %ld %d\n",
+          (double) (end.tv_sec - start.tv_sec)
+          + (double) (end.tv_nsec - start.tv_nsec) / 1e9,
+          usage.ru_maxrss,
+          WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status));
+
+  return EXIT_SUCCESS;
+}
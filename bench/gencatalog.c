@@ -0,0 +1,257 @@
+/* gencatalog.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Generate a synthetic `library_catalog.csv` for benchmarking.
+ *
+ * Usage: gencatalog ROWS [SEED]
+ *
+ * The catalog is written to stdout.  Rows are copies of "works": a work
+ * fixes the title, author, publisher, publication year, ISBN and genre,
+ * and popular works get several copies, each with its own accession number.
+ * Authors, publishers and genres follow a skewed (Zipf-like) distribution
+ * so that the value repetition resembles a real collection.
+ * About one copy in eight is checked out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HEADER "Title,Author,Publisher,Publication Year,ISBN,Accession Number,Genre,Checked Out By,Checked Out Date,Return Date\n"
+#define LEN(a) (sizeof (a) / sizeof ((a)[0]))
+
+static const char *words[] = {
+  "Shadow", "River", "Silent", "Garden", "Night", "Empire", "Glass", "Winter",
+  "Summer", "House", "Stone", "Fire", "Ocean", "Secret", "Lost", "Golden",
+  "Iron", "Crown", "Forest", "Storm", "Light", "Dark", "Memory", "City",
+  "Journey", "Heart", "Sky", "Blood", "Bridge", "Mountain", "Queen", "King",
+  "War", "Peace", "Letter", "Island", "Road", "Star", "Moon", "Sun",
+  "Song", "Dream", "Echo", "Mirror", "Tide", "Wolf", "Raven", "Orchard",
+  "Harbor", "Lantern", "Promise", "Silence", "Thunder", "Garden", "Widow", "Child",
+  "Machine", "Ghost", "Kingdom", "Voyage", "Winds", "Ashes", "Dust", "Salt",
+  "Paper", "Clock", "Tower", "Valley", "Desert", "Ember", "Frost", "Harvest",
+  "Hunter", "Keeper", "Liar", "Maker", "Healer", "Thief", "Stranger", "Sister",
+  "Brother", "Father", "Mother", "Daughter", "Son", "History", "Science", "Art",
+  "Introduction", "Principles", "Handbook", "Guide", "Theory", "Practice", "Origins", "Nature"
+};
+
+static const char *links[] = {
+  "of the", "and the", "in the", "under the", "beyond the", "for the", "of", "and"
+};
+
+static const char *first_names[] = {
+  "James", "Mary", "John", "Patricia", "Robert", "Jennifer", "Michael", "Linda",
+  "William", "Elizabeth", "David", "Barbara", "Richard", "Susan", "Joseph", "Jessica",
+  "Thomas", "Sarah", "Charles", "Karen", "Maria", "Jose", "Ana", "Juan",
+  "Rosa", "Carlos", "Elena", "Miguel", "Sofia", "Luis", "Haruki", "Yuki",
+  "Chen", "Wei", "Amara", "Kofi", "Ngozi", "Chinua", "Isabel", "Gabriel",
+  "Toni", "Alice", "Virginia", "Ernest", "Leo", "Fyodor", "Jane", "Emily",
+  "Charlotte", "George"
+};
+
+static const char *last_names[] = {
+  "Smith", "Johnson", "Williams", "Brown", "Jones", "Garcia", "Miller", "Davis",
+  "Rodriguez", "Martinez", "Hernandez", "Lopez", "Gonzalez", "Wilson", "Anderson", "Thomas",
+  "Taylor", "Moore", "Jackson", "Martin", "Lee", "Perez", "Thompson", "White",
+  "Harris", "Sanchez", "Clark", "Ramirez", "Lewis", "Robinson", "Walker", "Young",
+  "Allen", "King", "Wright", "Scott", "Torres", "Nguyen", "Hill", "Flores",
+  "Santos", "Reyes", "Cruz", "Bautista", "Mendoza", "Tanaka", "Murakami", "Achebe",
+  "Adichie", "Morrison", "Austen", "Woolf", "Tolstoy", "Orwell", "Bronte", "Eliot"
+};
+
+static const char *publishers[] = {
+  "Penguin Random House", "HarperCollins", "Simon & Schuster", "Macmillan", "Hachette",
+  "Scribner", "Vintage", "Knopf", "Bloomsbury", "Faber & Faber",
+  "Oxford University Press", "Cambridge University Press", "Wiley", "Pearson", "McGraw-Hill",
+  "Springer", "Elsevier", "MIT Press", "Princeton University Press", "Norton",
+  "Anvil Publishing", "Rex Book Store", "Tor Books", "Orbit", "Del Rey",
+  "Allen & Unwin", "Secker & Warburg", "Little Brown", "Houghton Mifflin", "Doubleday",
+  "Bantam", "Ballantine", "Picador", "Granta", "Canongate",
+  "Chronicle Books", "Scholastic", "Candlewick", "Usborne", "DK"
+};
+
+static const char *genres[] = {
+  "Fiction", "Non-fiction", "Mystery", "Romance", "Fantasy",
+  "Science Fiction", "Biography", "History", "Science", "Poetry",
+  "Children", "Young Adult", "Horror", "Thriller", "Self-help",
+  "Reference", "Philosophy", "Religion", "Travel", "Cooking",
+  "Art", "Mathematics", "Computer Science", "Economics", "Law"
+};
+
+/* Function: next_rand
+ * -------------------
+ * Advance a xorshift64* generator and return its next value.
+ *
+ * state: A pointer to the generator state. Must not be zero.
+ *
+ * returns: A pseudo-random 64-bit value.
+ */
+static unsigned long long
+next_rand (unsigned long long *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+/* Function: skewed
+ * ----------------
+ * Pick an index in [0, n) so that small indexes are much more likely
+ * than large ones, approximating a Zipf distribution.
+ *
+ * state: A pointer to the generator state.
+ * n: The number of choices.
+ *
+ * returns: The chosen index.
+ */
+static unsigned long
+skewed (unsigned long long *state,
+        unsigned long n)
+{
+  double u;
+
+  u = (double) (next_rand (state) >> 11) / 9007199254740992.0;
+  return (unsigned long) ((double) n * u * u * u);
+}
+
+/* Function: print_work
+ * --------------------
+ * Print the bibliographic fields shared by every copy of a work.
+ *
+ * The fields are derived from the work number only, so the same work
+ * always produces the same title, author, publisher, year, ISBN and genre.
+ *
+ * work: The work number.
+ * num_authors: The size of the author population.
+ */
+static void
+print_work (unsigned long work,
+            unsigned long num_authors)
+{
+  unsigned long long state;
+  unsigned long author;
+  int num_words, year, i;
+
+  state = 0x9e3779b97f4a7c15ULL ^ ((unsigned long long) work * 0xbf58476d1ce4e5b9ULL);
+  if (state == 0)
+    state = 1;
+
+  num_words = 1 + (int) (next_rand (&state) % 4);
+  for (i = 0; i < num_words; i++)
+    {
+      if (i > 0)
+        printf (" %s ", links[next_rand (&state) % LEN (links)]);
+      printf ("%s", words[next_rand (&state) % LEN (words)]);
+    }
+  if (next_rand (&state) % 4 == 0)
+    printf (" %lu", work % 97 + 2);
+  putchar (',');
+
+  author = skewed (&state, num_authors);
+  printf ("%s %c. %s,",
+          first_names[author % LEN (first_names)],
+          'A' + (int) ((author / LEN (first_names)) % 26),
+          last_names[(author / (LEN (first_names) * 26)) % LEN (last_names)]);
+
+  printf ("%s,", publishers[skewed (&state, LEN (publishers))]);
+
+  if (next_rand (&state) % 10 < 7)
+    year = 1950 + (int) (next_rand (&state) % 76);
+  else
+    year = 1800 + (int) (next_rand (&state) % 150);
+  printf ("%d,", year);
+
+  printf ("978-%010lu,", (unsigned long) (next_rand (&state) % 10000000000ULL));
+
+  /* The genre is printed by the caller after the accession number. */
+}
+
+/* Function: print_genre
+ * ---------------------
+ * Print the genre of a work.
+ *
+ * work: The work number.
+ */
+static void
+print_genre (unsigned long work)
+{
+  unsigned long long state;
+
+  state = 0xd1b54a32d192ed03ULL ^ ((unsigned long long) work * 0x94d049bb133111ebULL);
+  if (state == 0)
+    state = 1;
+
+  printf ("%s,", genres[skewed (&state, LEN (genres))]);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  unsigned long long state;
+  unsigned long rows, num_works, num_authors, num_patrons, i, work;
+  int month, day;
+
+  if (argc < 2)
+    {
+      fprintf (stderr, "Usage: %s ROWS [SEED]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  rows = strtoul (argv[1], NULL, 10);
+  state = argc > 2 ? strtoull (argv[2], NULL, 10) : 42;
+  if (state == 0)
+    state = 1;
+
+  num_works = rows - rows / 5;
+  if (num_works == 0)
+    num_works = 1;
+  num_authors = num_works / 8 + 1;
+  num_patrons = rows / 20 + 1;
+
+  fputs (HEADER, stdout);
+  for (i = 0; i < rows; i++)
+    {
+      work = skewed (&state, num_works);
+      if (next_rand (&state) % 2)
+        work = next_rand (&state) % num_works;
+
+      print_work (work, num_authors);
+      printf ("%lu,", i + 1);
+      print_genre (work);
+
+      month = 1 + (int) (next_rand (&state) % 12);
+      day = 1 + (int) (next_rand (&state) % 28);
+      if (next_rand (&state) % 8 == 0)
+        printf ("Patron %lu,2023-%02d-%02d,\n",
+                skewed (&state, num_patrons) + 1, month, day);
+      else
+        fputs (",,\n", stdout);
+    }
+
+  if (fflush (stdout) != 0)
+    {
+      fprintf (stderr, "Error: Failed to write catalog.\n");
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,737 @@
+/* bitmap.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "bitmap.h"
+#include "mem.h"
+
+/* The number of 64-bit words in a dense container. */
+#define NUM_WORDS 1024
+
+/* The most members a sparse container holds; its array then takes
+ * as much memory as a dense container. */
+#define ARRAY_MAX 4096
+
+/* A key past every container, used when merging two bitmaps. */
+#define KEY_END 0x10000
+
+/* The ways two bitmaps can be combined. */
+typedef enum
+{
+  OP_AND,
+  OP_OR,
+  OP_ANDNOT
+} Op;
+
+/* Function: find_container
+ * ------------------------
+ * Binary search the containers of a bitmap for a key.
+ *
+ * bitmap: The bitmap.
+ * key: The key to search for.
+ * found: Set to 1 if a container has the key, or 0 if not.
+ *
+ * returns: The position of the container with the key,
+ *          or of the first container with a greater key.
+ */
+static unsigned int
+find_container (const Bitmap *bitmap,
+                unsigned int  key,
+                int          *found)
+{
+  unsigned int lo, hi, mid;
+
+  lo = 0;
+  hi = bitmap->count;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (bitmap->containers[mid].key < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  *found = lo < bitmap->count && bitmap->containers[lo].key == key;
+  return lo;
+}
+
+/* Function: find_low
+ * ------------------
+ * Binary search a sparse container for the low 16 bits of a member.
+ *
+ * c: The container.
+ * low: The low bits to search for.
+ *
+ * returns: The position of the first member not less than low.
+ */
+static unsigned int
+find_low (const BitmapContainer *c,
+          unsigned int           low)
+{
+  unsigned int lo, hi, mid;
+
+  lo = 0;
+  hi = c->card;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (c->array[mid] < low)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/* Function: container_free
+ * ------------------------
+ * Release the memory held by a container.
+ */
+static void
+container_free (BitmapContainer *c)
+{
+  mem_free (c->array);
+  mem_free (c->words);
+  c->array = NULL;
+  c->words = NULL;
+  c->array_cap = 0;
+  c->card = 0;
+}
+
+/* Function: container_words
+ * -------------------------
+ * Write the members of a container as a dense array of words.
+ *
+ * c: The container, or NULL for an empty one.
+ * words: Receives NUM_WORDS words.
+ */
+static void
+container_words (const BitmapContainer *c,
+                 unsigned long long    *words)
+{
+  unsigned int i;
+
+  if (c != NULL && c->words != NULL)
+    {
+      memcpy (words, c->words, sizeof (unsigned long long) * NUM_WORDS);
+      return;
+    }
+
+  memset (words, 0, sizeof (unsigned long long) * NUM_WORDS);
+  if (c != NULL)
+    for (i = 0; i < c->card; i++)
+      words[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+}
+
+/* Function: container_from_words
+ * ------------------------------
+ * Fill a container from a dense array of words,
+ * choosing the sparse form if it holds few enough members.
+ *
+ * c: The container, which must not hold memory.
+ * key: The key of the container.
+ * words: NUM_WORDS words.
+ * card: The number of bits set in words.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+static int
+container_from_words (BitmapContainer          *c,
+                      unsigned int              key,
+                      const unsigned long long *words,
+                      unsigned int              card)
+{
+  unsigned long long word;
+  unsigned int i, n;
+
+  memset (c, 0, sizeof (BitmapContainer));
+  c->key = key;
+  c->card = card;
+
+  if (card > ARRAY_MAX)
+    {
+      c->words = (unsigned long long *) mem_alloc (MEM_INDEXES, sizeof (unsigned long long) * NUM_WORDS);
+      if (c->words == NULL)
+        return -1;
+      memcpy (c->words, words, sizeof (unsigned long long) * NUM_WORDS);
+      return 0;
+    }
+
+  c->array = (unsigned short *) mem_alloc (MEM_INDEXES, sizeof (unsigned short) * (card ? card : 1));
+  if (c->array == NULL)
+    return -1;
+  c->array_cap = card;
+
+  n = 0;
+  for (i = 0; i < NUM_WORDS; i++)
+    {
+      for (word = words[i]; word != 0; word &= word - 1)
+        c->array[n++] = (unsigned short) (i * 64 + __builtin_ctzll (word));
+    }
+
+  return 0;
+}
+
+/* Function: append_container
+ * --------------------------
+ * Append a container to a bitmap, taking over its memory.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated,
+ *          in which case the container is freed.
+ */
+static int
+append_container (Bitmap          *bitmap,
+                  BitmapContainer *c)
+{
+  if (bitmap->count == bitmap->cap)
+    {
+      BitmapContainer *containers;
+      unsigned int cap;
+
+      cap = bitmap->cap ? bitmap->cap * 2 : 4;
+      containers = (BitmapContainer *) mem_realloc (MEM_INDEXES, bitmap->containers, sizeof (BitmapContainer) * cap);
+      if (containers == NULL)
+        {
+          container_free (c);
+          return -1;
+        }
+      bitmap->containers = containers;
+      bitmap->cap = cap;
+    }
+
+  bitmap->containers[bitmap->count++] = *c;
+  return 0;
+}
+
+/* Function: remove_container
+ * --------------------------
+ * Remove an empty container from a bitmap.
+ */
+static void
+remove_container (Bitmap       *bitmap,
+                  unsigned int  pos)
+{
+  container_free (&bitmap->containers[pos]);
+  memmove (&bitmap->containers[pos], &bitmap->containers[pos + 1],
+           sizeof (BitmapContainer) * (bitmap->count - pos - 1));
+  bitmap->count--;
+}
+
+/* Function: bitmap_init
+ * ---------------------
+ * Initialize an empty bitmap.
+ *
+ * bitmap: The bitmap to initialize.
+ */
+void
+bitmap_init (Bitmap *bitmap)
+{
+  memset (bitmap, 0, sizeof (Bitmap));
+}
+
+/* Function: bitmap_free
+ * ---------------------
+ * Release the memory held by a bitmap and leave it empty.
+ *
+ * bitmap: The bitmap to free.
+ */
+void
+bitmap_free (Bitmap *bitmap)
+{
+  unsigned int i;
+
+  for (i = 0; i < bitmap->count; i++)
+    container_free (&bitmap->containers[i]);
+  mem_free (bitmap->containers);
+  bitmap_init (bitmap);
+}
+
+/* Function: bitmap_set
+ * --------------------
+ * Add a member to a bitmap.
+ *
+ * bitmap: The bitmap.
+ * x: The member to add.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated,
+ *          in which case the bitmap is unchanged.
+ */
+int
+bitmap_set (Bitmap       *bitmap,
+            unsigned int  x)
+{
+  BitmapContainer *c, empty;
+  unsigned int pos, low, i;
+  int found;
+
+  low = x & 0xffff;
+  pos = find_container (bitmap, x >> 16, &found);
+  if (!found)
+    {
+      memset (&empty, 0, sizeof (BitmapContainer));
+      empty.key = x >> 16;
+      if (append_container (bitmap, &empty) != 0)
+        return -1;
+      memmove (&bitmap->containers[pos + 1], &bitmap->containers[pos],
+               sizeof (BitmapContainer) * (bitmap->count - pos - 1));
+      bitmap->containers[pos] = empty;
+    }
+  c = &bitmap->containers[pos];
+
+  if (c->words != NULL)
+    {
+      if (!(c->words[low >> 6] & (1ULL << (low & 63))))
+        {
+          c->words[low >> 6] |= 1ULL << (low & 63);
+          c->card++;
+        }
+      return 0;
+    }
+
+  i = find_low (c, low);
+  if (i < c->card && c->array[i] == low)
+    return 0;
+
+  if (c->card == ARRAY_MAX)
+    {
+      unsigned long long *words;
+
+      words = (unsigned long long *) mem_alloc (MEM_INDEXES, sizeof (unsigned long long) * NUM_WORDS);
+      if (words == NULL)
+        return -1;
+      container_words (c, words);
+      words[low >> 6] |= 1ULL << (low & 63);
+      mem_free (c->array);
+      c->array = NULL;
+      c->array_cap = 0;
+      c->words = words;
+      c->card++;
+      return 0;
+    }
+
+  if (c->card == c->array_cap)
+    {
+      unsigned short *array;
+      unsigned int array_cap;
+
+      array_cap = c->array_cap ? c->array_cap * 2 : 4;
+      if (array_cap > ARRAY_MAX)
+        array_cap = ARRAY_MAX;
+      array = (unsigned short *) mem_realloc (MEM_INDEXES, c->array, sizeof (unsigned short) * array_cap);
+      if (array == NULL)
+        {
+          if (c->card == 0)
+            remove_container (bitmap, pos);
+          return -1;
+        }
+      c->array = array;
+      c->array_cap = array_cap;
+    }
+
+  memmove (&c->array[i + 1], &c->array[i], sizeof (unsigned short) * (c->card - i));
+  c->array[i] = (unsigned short) low;
+  c->card++;
+  return 0;
+}
+
+/* Function: bitmap_clear
+ * ----------------------
+ * Remove a member from a bitmap.
+ *
+ * A dense container that falls to half of ARRAY_MAX members is turned
+ * back into a sparse one when memory allows.  Waiting until it is well
+ * below ARRAY_MAX keeps a container near the limit from being converted
+ * back and forth.
+ *
+ * bitmap: The bitmap.
+ * x: The member to remove.
+ */
+void
+bitmap_clear (Bitmap       *bitmap,
+              unsigned int  x)
+{
+  BitmapContainer *c, sparse;
+  unsigned int pos, low, i;
+  int found;
+
+  low = x & 0xffff;
+  pos = find_container (bitmap, x >> 16, &found);
+  if (!found)
+    return;
+  c = &bitmap->containers[pos];
+
+  if (c->words != NULL)
+    {
+      if (!(c->words[low >> 6] & (1ULL << (low & 63))))
+        return;
+      c->words[low >> 6] &= ~(1ULL << (low & 63));
+      c->card--;
+
+      if (c->card <= ARRAY_MAX / 2 && container_from_words (&sparse, c->key, c->words, c->card) == 0)
+        {
+          container_free (c);
+          *c = sparse;
+        }
+    }
+  else
+    {
+      i = find_low (c, low);
+      if (i == c->card || c->array[i] != low)
+        return;
+      memmove (&c->array[i], &c->array[i + 1], sizeof (unsigned short) * (c->card - i - 1));
+      c->card--;
+    }
+
+  if (c->card == 0)
+    remove_container (bitmap, pos);
+}
+
+/* Function: bitmap_test
+ * ---------------------
+ * Check whether a bitmap holds a member.
+ *
+ * returns: 1 if x is a member of the bitmap, or 0 if not.
+ */
+int
+bitmap_test (const Bitmap *bitmap,
+             unsigned int  x)
+{
+  const BitmapContainer *c;
+  unsigned int pos, low, i;
+  int found;
+
+  low = x & 0xffff;
+  pos = find_container (bitmap, x >> 16, &found);
+  if (!found)
+    return 0;
+  c = &bitmap->containers[pos];
+
+  if (c->words != NULL)
+    return (c->words[low >> 6] >> (low & 63)) & 1;
+
+  i = find_low (c, low);
+  return i < c->card && c->array[i] == low;
+}
+
+/* Function: bitmap_count
+ * ----------------------
+ * Count the members of a bitmap.
+ *
+ * returns: The number of members.
+ */
+unsigned long
+bitmap_count (const Bitmap *bitmap)
+{
+  unsigned long count;
+  unsigned int i;
+
+  count = 0;
+  for (i = 0; i < bitmap->count; i++)
+    count += bitmap->containers[i].card;
+
+  return count;
+}
+
+/* Function: bitmap_next
+ * ---------------------
+ * Find the smallest member of a bitmap not less than x,
+ * so that the members can be visited in order.
+ *
+ * returns: The member, or BITMAP_NONE if there is none.
+ */
+unsigned int
+bitmap_next (const Bitmap *bitmap,
+             unsigned int  x)
+{
+  const BitmapContainer *c;
+  unsigned long long word;
+  unsigned int pos, low, i;
+  int found;
+
+  if (x == BITMAP_NONE)
+    return BITMAP_NONE;
+
+  pos = find_container (bitmap, x >> 16, &found);
+  low = found ? x & 0xffff : 0;
+  for (; pos < bitmap->count; pos++, low = 0)
+    {
+      c = &bitmap->containers[pos];
+      if (c->words != NULL)
+        {
+          i = low >> 6;
+          word = c->words[i] & (~0ULL << (low & 63));
+          while (word == 0 && ++i < NUM_WORDS)
+            word = c->words[i];
+          if (word != 0)
+            return (c->key << 16) | (i * 64 + __builtin_ctzll (word));
+        }
+      else
+        {
+          i = find_low (c, low);
+          if (i < c->card)
+            return (c->key << 16) | c->array[i];
+        }
+    }
+
+  return BITMAP_NONE;
+}
+
+/* Function: combine
+ * -----------------
+ * Combine two bitmaps a container at a time.
+ *
+ * Containers with the same key are expanded to dense words and
+ * combined a 64-bit word at a time; the members are counted with
+ * a population count of each resulting word.
+ *
+ * dst: Receives the result, or NULL to only count it.
+ *      It must not be a or b, and its previous contents are freed.
+ * a: The first bitmap.
+ * b: The second bitmap.
+ * op: How to combine them.
+ * count: Receives the number of members of the result.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated,
+ *          in which case dst is left empty.
+ */
+static int
+combine (Bitmap         *dst,
+         const Bitmap   *a,
+         const Bitmap   *b,
+         Op              op,
+         unsigned long  *count)
+{
+  unsigned long long wa[NUM_WORDS], wb[NUM_WORDS];
+  const BitmapContainer *ca, *cb;
+  BitmapContainer c;
+  unsigned int i, j, k, ka, kb, card;
+  int keep;
+
+  if (dst != NULL)
+    bitmap_free (dst);
+
+  *count = 0;
+  i = j = 0;
+  while (i < a->count || j < b->count)
+    {
+      ca = i < a->count ? &a->containers[i] : NULL;
+      cb = j < b->count ? &b->containers[j] : NULL;
+      ka = ca != NULL ? ca->key : KEY_END;
+      kb = cb != NULL ? cb->key : KEY_END;
+
+      /* A container found in only one bitmap is kept whole or dropped. */
+      if (ka != kb)
+        {
+          if (ka < kb)
+            {
+              keep = op != OP_AND;
+              cb = NULL;
+              i++;
+            }
+          else
+            {
+              keep = op == OP_OR;
+              ca = NULL;
+              j++;
+            }
+
+          if (!keep)
+            continue;
+          container_words (ca != NULL ? ca : cb, wa);
+          card = (ca != NULL ? ca : cb)->card;
+        }
+      else
+        {
+          container_words (ca, wa);
+          container_words (cb, wb);
+          i++;
+          j++;
+
+          card = 0;
+          for (k = 0; k < NUM_WORDS; k++)
+            {
+              switch (op)
+                {
+                case OP_AND:
+                  wa[k] &= wb[k];
+                  break;
+
+                case OP_OR:
+                  wa[k] |= wb[k];
+                  break;
+
+                case OP_ANDNOT:
+                  wa[k] &= ~wb[k];
+                  break;
+                }
+              card += __builtin_popcountll (wa[k]);
+            }
+        }
+
+      *count += card;
+      if (dst == NULL || card == 0)
+        continue;
+
+      if (container_from_words (&c, ka < kb ? ka : kb, wa, card) != 0 || append_container (dst, &c) != 0)
+        {
+          container_free (&c);
+          bitmap_free (dst);
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+/* Function: bitmap_and
+ * --------------------
+ * Store the members found in both a and b in dst.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+int
+bitmap_and (Bitmap       *dst,
+            const Bitmap *a,
+            const Bitmap *b)
+{
+  unsigned long count;
+
+  return combine (dst, a, b, OP_AND, &count);
+}
+
+/* Function: bitmap_or
+ * -------------------
+ * Store the members found in either a or b in dst.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+int
+bitmap_or (Bitmap       *dst,
+           const Bitmap *a,
+           const Bitmap *b)
+{
+  unsigned long count;
+
+  return combine (dst, a, b, OP_OR, &count);
+}
+
+/* Function: bitmap_andnot
+ * -----------------------
+ * Store the members of a that are not in b in dst.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+int
+bitmap_andnot (Bitmap       *dst,
+               const Bitmap *a,
+               const Bitmap *b)
+{
+  unsigned long count;
+
+  return combine (dst, a, b, OP_ANDNOT, &count);
+}
+
+/* Function: bitmap_and_count
+ * --------------------------
+ * Count the members found in both a and b without storing them.
+ */
+unsigned long
+bitmap_and_count (const Bitmap *a,
+                  const Bitmap *b)
+{
+  unsigned long count;
+
+  combine (NULL, a, b, OP_AND, &count);
+  return count;
+}
+
+/* Function: bitmap_andnot_count
+ * -----------------------------
+ * Count the members of a that are not in b without storing them.
+ */
+unsigned long
+bitmap_andnot_count (const Bitmap *a,
+                     const Bitmap *b)
+{
+  unsigned long count;
+
+  combine (NULL, a, b, OP_ANDNOT, &count);
+  return count;
+}
+
+/* Function: bitmap_not
+ * --------------------
+ * Store the numbers below size that are not members of a in dst.
+ *
+ * dst: Receives the result. It must not be a,
+ *      and its previous contents are freed.
+ * a: The bitmap.
+ * size: The number of possible members.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated,
+ *          in which case dst is left empty.
+ */
+int
+bitmap_not (Bitmap       *dst,
+            const Bitmap *a,
+            unsigned int  size)
+{
+  unsigned long long words[NUM_WORDS];
+  BitmapContainer c;
+  unsigned int key, num_keys, pos, bits, card, k;
+  int found;
+
+  bitmap_free (dst);
+
+  num_keys = (unsigned int) (((unsigned long long) size + 0xffff) >> 16);
+  for (key = 0; key < num_keys; key++)
+    {
+      pos = find_container (a, key, &found);
+      container_words (found ? &a->containers[pos] : NULL, words);
+
+      /* Only the first size numbers belong to the complement. */
+      bits = key == num_keys - 1 && (size & 0xffff) ? size & 0xffff : 0x10000;
+      card = 0;
+      for (k = 0; k < NUM_WORDS; k++)
+        {
+          if (k * 64 >= bits)
+            words[k] = 0;
+          else if (k * 64 + 64 > bits)
+            words[k] = ~words[k] & ((1ULL << (bits & 63)) - 1);
+          else
+            words[k] = ~words[k];
+          card += __builtin_popcountll (words[k]);
+        }
+
+      if (card == 0)
+        continue;
+      if (container_from_words (&c, key, words, card) != 0 || append_container (dst, &c) != 0)
+        {
+          container_free (&c);
+          bitmap_free (dst);
+          return -1;
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,77 @@
+/* bitmap.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+/* The value returned by `bitmap_next` when there are no more members. */
+#define BITMAP_NONE ((unsigned int) -1)
+
+/* The members of a bitmap that share their high 16 bits.
+ *
+ * A sparse container lists the low 16 bits of its members in a sorted
+ * array.  Once it holds more members than fit in the 8 KiB a dense
+ * container takes, it becomes a dense container of 65536 bits. */
+typedef struct
+{
+  unsigned int        key;        /* The high 16 bits of the members. */
+  unsigned int        card;       /* The number of members. */
+  unsigned short     *array;      /* The sorted low 16 bits of a sparse container, or NULL. */
+  unsigned int        array_cap;  /* The capacity of array. */
+  unsigned long long *words;      /* The bits of a dense container, or NULL. */
+} BitmapContainer;
+
+/* A compressed set of unsigned integers in the style of a roaring bitmap. */
+typedef struct
+{
+  BitmapContainer *containers;  /* The non-empty containers, sorted by key. */
+  unsigned int     count;       /* The number of containers. */
+  unsigned int     cap;         /* The capacity of containers. */
+} Bitmap;
+
+void          bitmap_init         (Bitmap       *bitmap);
+void          bitmap_free         (Bitmap       *bitmap);
+int           bitmap_set          (Bitmap       *bitmap,
+                                   unsigned int  x);
+void          bitmap_clear        (Bitmap       *bitmap,
+                                   unsigned int  x);
+int           bitmap_test         (const Bitmap *bitmap,
+                                   unsigned int  x);
+unsigned long bitmap_count        (const Bitmap *bitmap);
+unsigned int  bitmap_next         (const Bitmap *bitmap,
+                                   unsigned int  x);
+int           bitmap_and          (Bitmap       *dst,
+                                   const Bitmap *a,
+                                   const Bitmap *b);
+int           bitmap_or           (Bitmap       *dst,
+                                   const Bitmap *a,
+                                   const Bitmap *b);
+int           bitmap_andnot       (Bitmap       *dst,
+                                   const Bitmap *a,
+                                   const Bitmap *b);
+int           bitmap_not          (Bitmap       *dst,
+                                   const Bitmap *a,
+                                   unsigned int  size);
+unsigned long bitmap_and_count    (const Bitmap *a,
+                                   const Bitmap *b);
+unsigned long bitmap_andnot_count (const Bitmap *a,
+                                   const Bitmap *b);
+
+#endif
@@ -0,0 +1,1108 @@
+/* btree.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "btree.h"
+#include "crc32c.h"
+#include "mem.h"
+
+/* The bytes the file starts with. */
+#define MAGIC "RLB2"
+#define MAGIC_LEN 4
+
+/* The header, in page 0: the magic number, then little-endian
+ * 4-byte words for the page size, the root, the height,
+ * the number of pages, the number of records and the CRC-32C
+ * of the header before it. */
+#define HEAD_PAGE_SIZE 4
+#define HEAD_ROOT 8
+#define HEAD_HEIGHT 12
+#define HEAD_NUM_PAGES 16
+#define HEAD_NUM_RECORDS 20
+#define HEAD_CHECKSUM 24
+#define HEAD_LEN 28
+
+/* The types of page after the header. */
+#define LEAF 1
+#define INTERIOR 2
+
+/* A leaf or interior page starts with its type, the number of cells,
+ * the offset of the lowest cell, a link: the next leaf, or 0 for the
+ * last, or the leftmost child of an interior page, and the CRC-32C of
+ * the rest of the page, set when it is written.  An array of 2-byte
+ * cell offsets in key order follows, and the cells fill the page from
+ * its end.  A leaf cell is the key length, the value length, the key
+ * and the value.  An interior cell is the key length, the child that
+ * holds the keys from this one up to the next, and the key. */
+#define NODE_TYPE 0
+#define NODE_COUNT 2
+#define NODE_CONTENT 4
+#define NODE_LINK 8
+#define NODE_CHECKSUM 12
+#define NODE_SLOTS 16
+
+/* The most cells a page can hold, each taking at least 6 bytes
+ * with its offset, and one more while the page is being split. */
+#define MAX_CELLS ((BTREE_PAGE_SIZE - NODE_SLOTS) / 6 + 1)
+
+/* The most levels a tree of 2^32 pages can have. */
+#define MAX_HEIGHT 32
+
+/* The biggest cell of either kind. */
+#define MAX_CELL_LEN (4 + BTREE_MAX_KEY + BTREE_MAX_VALUE)
+
+/* A step taken from an interior page while descending. */
+typedef struct
+{
+  unsigned int page;   /* The interior page. */
+  int          child;  /* The cell followed, or -1 for the link. */
+} Step;
+
+static unsigned int
+get16 (const unsigned char *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+static void
+put16 (unsigned char *p,
+       unsigned int   v)
+{
+  p[0] = v & 0xff;
+  p[1] = v >> 8 & 0xff;
+}
+
+static unsigned int
+get32 (const unsigned char *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int) p[3] << 24;
+}
+
+static void
+put32 (unsigned char *p,
+       unsigned int   v)
+{
+  p[0] = v & 0xff;
+  p[1] = v >> 8 & 0xff;
+  p[2] = v >> 16 & 0xff;
+  p[3] = v >> 24 & 0xff;
+}
+
+/* Function: cell_at
+ * -----------------
+ * Get the offset of a cell of a page.
+ */
+static unsigned int
+cell_at (const unsigned char *page,
+         int                  i)
+{
+  return get16 (page + NODE_SLOTS + 2 * i);
+}
+
+/* Function: cell_len
+ * ------------------
+ * Get the length of the cell at an offset of a page.
+ */
+static size_t
+cell_len (const unsigned char *page,
+          const unsigned char *cell)
+{
+  if (page[NODE_TYPE] == LEAF)
+    return 4 + get16 (cell) + get16 (cell + 2);
+  else
+    return 6 + get16 (cell);
+}
+
+/* Function: cell_key
+ * ------------------
+ * Get the key of a cell and its length.
+ */
+static const unsigned char *
+cell_key (const unsigned char *page,
+          const unsigned char *cell,
+          size_t              *len)
+{
+  *len = get16 (cell);
+  return cell + (page[NODE_TYPE] == LEAF ? 4 : 6);
+}
+
+/* Function: compare_keys
+ * ----------------------
+ * Compare two keys byte by byte, a shorter key first if it is
+ * a prefix of the other.
+ */
+static int
+compare_keys (const unsigned char *a,
+              size_t               a_len,
+              const unsigned char *b,
+              size_t               b_len)
+{
+  int c;
+
+  c = memcmp (a, b, a_len < b_len ? a_len : b_len);
+  if (c != 0)
+    return c;
+  return a_len < b_len ? -1 : a_len > b_len;
+}
+
+/* Function: search_node
+ * ---------------------
+ * Find where a key falls among the cells of a page.
+ *
+ * after: Whether to skip the cells whose key equals the key.
+ *
+ * returns: The first cell whose key is not less than the key,
+ *          or greater than it if after is set, or the number
+ *          of cells if there is none.
+ */
+static int
+search_node (const unsigned char *page,
+             const unsigned char *key,
+             size_t               len,
+             int                  after)
+{
+  const unsigned char *k;
+  size_t k_len;
+  int lo, hi, mid, c;
+
+  lo = 0;
+  hi = get16 (page + NODE_COUNT);
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      k = cell_key (page, page + cell_at (page, mid), &k_len);
+      c = compare_keys (k, k_len, key, len);
+      if (c < 0 || (after && c == 0))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/* Function: node_init
+ * -------------------
+ * Empty a page and make it a leaf or interior page.
+ */
+static void
+node_init (unsigned char *page,
+           int            type,
+           unsigned int   link)
+{
+  memset (page, 0, BTREE_PAGE_SIZE);
+  page[NODE_TYPE] = type;
+  put16 (page + NODE_CONTENT, BTREE_PAGE_SIZE);
+  put32 (page + NODE_LINK, link);
+}
+
+/* Function: node_free
+ * -------------------
+ * Get the bytes between the cell offsets and the lowest cell.
+ */
+static size_t
+node_free (const unsigned char *page)
+{
+  return get16 (page + NODE_CONTENT) - (NODE_SLOTS + 2 * get16 (page + NODE_COUNT));
+}
+
+/* Function: node_insert
+ * ---------------------
+ * Put a cell before cell i of a page with room for it.
+ */
+static void
+node_insert (unsigned char       *page,
+             int                  i,
+             const unsigned char *cell,
+             size_t               len)
+{
+  unsigned int count, content;
+
+  count = get16 (page + NODE_COUNT);
+  content = get16 (page + NODE_CONTENT) - len;
+  memcpy (page + content, cell, len);
+  memmove (page + NODE_SLOTS + 2 * (i + 1), page + NODE_SLOTS + 2 * i, 2 * (count - i));
+  put16 (page + NODE_SLOTS + 2 * i, content);
+  put16 (page + NODE_COUNT, count + 1);
+  put16 (page + NODE_CONTENT, content);
+}
+
+/* Function: node_compact
+ * ----------------------
+ * Move the cells of a page to its end, closing the gaps
+ * left by deleted cells.
+ *
+ * returns: The free bytes of the page.
+ */
+static size_t
+node_compact (unsigned char *page,
+              unsigned char *scratch)
+{
+  unsigned int count, link;
+  int type, i;
+
+  memcpy (scratch, page, BTREE_PAGE_SIZE);
+  type = page[NODE_TYPE];
+  count = get16 (page + NODE_COUNT);
+  link = get32 (page + NODE_LINK);
+
+  node_init (page, type, link);
+  for (i = 0; i < (int) count; i++)
+    {
+      const unsigned char *cell = scratch + cell_at (scratch, i);
+      node_insert (page, i, cell, cell_len (scratch, cell));
+    }
+
+  return node_free (page);
+}
+
+/* Function: hash_page
+ * -------------------
+ * Get the hash bucket of a page.
+ */
+static unsigned int
+hash_page (const BTree  *tree,
+           unsigned int  page)
+{
+  return (page * 2654435761u) & (tree->num_buckets - 1);
+}
+
+/* Function: lru_unlink
+ * --------------------
+ * Take a frame out of the recency list.
+ */
+static void
+lru_unlink (BTree *tree,
+            int    f)
+{
+  BTreeFrame *frame = &tree->frames[f];
+
+  if (frame->prev >= 0)
+    tree->frames[frame->prev].next = frame->next;
+  else
+    tree->lru_head = frame->next;
+  if (frame->next >= 0)
+    tree->frames[frame->next].prev = frame->prev;
+  else
+    tree->lru_tail = frame->prev;
+}
+
+/* Function: lru_push
+ * ------------------
+ * Make a frame the most recently used.
+ */
+static void
+lru_push (BTree *tree,
+          int    f)
+{
+  BTreeFrame *frame = &tree->frames[f];
+
+  frame->prev = -1;
+  frame->next = tree->lru_head;
+  if (tree->lru_head >= 0)
+    tree->frames[tree->lru_head].prev = f;
+  else
+    tree->lru_tail = f;
+  tree->lru_head = f;
+}
+
+/* Function: page_checksum
+ * -----------------------
+ * Compute the checksum of a page, leaving out the checksum it holds.
+ */
+static unsigned int
+page_checksum (const unsigned char *page)
+{
+  unsigned int crc;
+
+  crc = crc32c (0, page, NODE_CHECKSUM);
+  return crc32c (crc, page + NODE_CHECKSUM + 4, BTREE_PAGE_SIZE - NODE_CHECKSUM - 4);
+}
+
+/* Function: write_frame
+ * ---------------------
+ * Write the page of a frame back to the file.
+ *
+ * returns: 0 on success, or -1 if it could not be written.
+ */
+static int
+write_frame (BTree *tree,
+             int    f)
+{
+  BTreeFrame *frame = &tree->frames[f];
+
+  put32 (frame->data + NODE_CHECKSUM, page_checksum (frame->data));
+  if (pwrite (tree->fd, frame->data, BTREE_PAGE_SIZE, (off_t) frame->page * BTREE_PAGE_SIZE) != BTREE_PAGE_SIZE)
+    {
+      tree->error = 1;
+      return -1;
+    }
+  tree->bytes_written += BTREE_PAGE_SIZE;
+  frame->dirty = 0;
+
+  return 0;
+}
+
+/* Function: take_frame
+ * --------------------
+ * Get a frame to hold another page: an unused one while there are
+ * any, otherwise that of the least recently used page not pinned,
+ * which is written back first if it was changed.
+ *
+ * returns: The frame, made the most recently used and holding no
+ *          page, or -1 if every frame is pinned or a page could
+ *          not be written back.
+ */
+static int
+take_frame (BTree *tree)
+{
+  BTreeFrame *frame;
+  int f, *link;
+
+  if (tree->num_used < tree->num_frames)
+    {
+      f = tree->num_used++;
+      lru_push (tree, f);
+      return f;
+    }
+
+  for (f = tree->lru_tail; f >= 0 && tree->frames[f].pins > 0; f = tree->frames[f].prev) {}
+  if (f < 0)
+    return -1;
+
+  frame = &tree->frames[f];
+  if (frame->dirty && write_frame (tree, f) != 0)
+    return -1;
+
+  /* Page 0 is the header, so a frame holding it holds nothing. */
+  if (frame->page != 0)
+    {
+      for (link = &tree->buckets[hash_page (tree, frame->page)]; *link != f; link = &tree->frames[*link].hash_next) {}
+      *link = frame->hash_next;
+      frame->page = 0;
+    }
+
+  lru_unlink (tree, f);
+  lru_push (tree, f);
+  return f;
+}
+
+/* Function: hold_page
+ * -------------------
+ * Record that a frame holds a page and pin it.
+ */
+static void
+hold_page (BTree        *tree,
+           int           f,
+           unsigned int  page)
+{
+  BTreeFrame *frame = &tree->frames[f];
+  unsigned int bucket = hash_page (tree, page);
+
+  frame->page = page;
+  frame->pins = 1;
+  frame->dirty = 0;
+  frame->hash_next = tree->buckets[bucket];
+  tree->buckets[bucket] = f;
+}
+
+/* Function: pin_page
+ * ------------------
+ * Get a page through the buffer pool, reading it from the file
+ * if the pool does not hold it, and pin it until `unpin_page`.
+ *
+ * frame: Receives the frame holding the page.
+ *
+ * returns: The page, or NULL if it could not be read
+ *          or does not match its checksum.
+ */
+static unsigned char *
+pin_page (BTree        *tree,
+          unsigned int  page,
+          int          *frame)
+{
+  int f;
+
+  for (f = tree->buckets[hash_page (tree, page)]; f >= 0; f = tree->frames[f].hash_next)
+    {
+      if (tree->frames[f].page == page)
+        {
+          tree->hits++;
+          tree->frames[f].pins++;
+          lru_unlink (tree, f);
+          lru_push (tree, f);
+          *frame = f;
+          return tree->frames[f].data;
+        }
+    }
+
+  tree->misses++;
+  f = take_frame (tree);
+  if (f < 0)
+    return NULL;
+
+  if (pread (tree->fd, tree->frames[f].data, BTREE_PAGE_SIZE, (off_t) page * BTREE_PAGE_SIZE) != BTREE_PAGE_SIZE)
+    {
+      tree->error = 1;
+      return NULL;
+    }
+  tree->bytes_read += BTREE_PAGE_SIZE;
+
+  if (get32 (tree->frames[f].data + NODE_CHECKSUM) != page_checksum (tree->frames[f].data))
+    {
+      tree->error = 1;
+      if (tree->bad_page == 0)
+        tree->bad_page = page;
+      return NULL;
+    }
+
+  hold_page (tree, f, page);
+  *frame = f;
+  return tree->frames[f].data;
+}
+
+/* Function: unpin_page
+ * --------------------
+ * Release a page got with `pin_page` or `new_page`.
+ *
+ * dirty: Whether the page was changed.
+ */
+static void
+unpin_page (BTree *tree,
+            int    f,
+            int    dirty)
+{
+  tree->frames[f].pins--;
+  if (dirty)
+    tree->frames[f].dirty = 1;
+}
+
+/* Function: new_page
+ * ------------------
+ * Add a page to the end of the file and pin it.
+ *
+ * page: Receives the number of the page.
+ * frame: Receives the frame holding the page.
+ *
+ * returns: The page, which must be initialized,
+ *          or NULL if no frame could be freed.
+ */
+static unsigned char *
+new_page (BTree        *tree,
+          unsigned int *page,
+          int          *frame)
+{
+  int f;
+
+  f = take_frame (tree);
+  if (f < 0)
+    return NULL;
+
+  *page = tree->num_pages++;
+  tree->header_dirty = 1;
+  hold_page (tree, f, *page);
+  tree->frames[f].dirty = 1;
+  *frame = f;
+  return tree->frames[f].data;
+}
+
+/* Function: write_header
+ * ----------------------
+ * Write the header to page 0.
+ *
+ * returns: 0 on success, or -1 if it could not be written.
+ */
+static int
+write_header (BTree *tree)
+{
+  unsigned char head[HEAD_LEN];
+
+  memcpy (head, MAGIC, MAGIC_LEN);
+  put32 (head + HEAD_PAGE_SIZE, BTREE_PAGE_SIZE);
+  put32 (head + HEAD_ROOT, tree->root);
+  put32 (head + HEAD_HEIGHT, tree->height);
+  put32 (head + HEAD_NUM_PAGES, tree->num_pages);
+  put32 (head + HEAD_NUM_RECORDS, tree->num_records);
+  put32 (head + HEAD_CHECKSUM, crc32c (0, head, HEAD_CHECKSUM));
+
+  if (pwrite (tree->fd, head, HEAD_LEN, 0) != HEAD_LEN)
+    {
+      tree->error = 1;
+      return -1;
+    }
+  tree->bytes_written += HEAD_LEN;
+  tree->header_dirty = 0;
+
+  return 0;
+}
+
+/* Function: btree_open
+ * --------------------
+ * Open a tree kept in a file.
+ *
+ * tree: The tree.
+ * path: The file.
+ * flags: BTREE_WRITE to allow changes, and BTREE_CREATE as well
+ *        to start an empty tree.  Without either, the file is
+ *        only read.
+ * num_frames: The number of pages the buffer pool holds,
+ *             at least BTREE_MIN_FRAMES.
+ *
+ * returns: 0 on success, or -1 if the file could not be opened,
+ *          is not a tree, its header does not match its checksum,
+ *          or memory could not be allocated.
+ */
+int
+btree_open (BTree      *tree,
+            const char *path,
+            int         flags,
+            int         num_frames)
+{
+  unsigned char head[HEAD_LEN];
+  unsigned char *data, *page;
+  unsigned int i;
+  int f;
+
+  if (num_frames < BTREE_MIN_FRAMES)
+    num_frames = BTREE_MIN_FRAMES;
+
+  memset (tree, 0, sizeof (BTree));
+  tree->writable = (flags & (BTREE_WRITE | BTREE_CREATE)) != 0;
+  tree->num_frames = num_frames;
+  tree->lru_head = tree->lru_tail = -1;
+  for (tree->num_buckets = 1; tree->num_buckets < 2 * (unsigned int) num_frames; tree->num_buckets *= 2) {}
+
+  tree->frames = (BTreeFrame *) mem_calloc (MEM_BUFFERS, num_frames, sizeof (BTreeFrame));
+  data = (unsigned char *) mem_alloc (MEM_BUFFERS, (size_t) num_frames * BTREE_PAGE_SIZE);
+  tree->buckets = (int *) mem_alloc (MEM_BUFFERS, sizeof (int) * tree->num_buckets);
+  tree->scratch = (unsigned char *) mem_alloc (MEM_BUFFERS, 2 * BTREE_PAGE_SIZE);
+  if (tree->frames == NULL || data == NULL || tree->buckets == NULL || tree->scratch == NULL)
+    {
+      mem_free (tree->frames);
+      mem_free (data);
+      mem_free (tree->buckets);
+      mem_free (tree->scratch);
+      return -1;
+    }
+  for (f = 0; f < num_frames; f++)
+    tree->frames[f].data = data + (size_t) f * BTREE_PAGE_SIZE;
+  for (i = 0; i < tree->num_buckets; i++)
+    tree->buckets[i] = -1;
+
+  if (flags & BTREE_CREATE)
+    tree->fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  else
+    tree->fd = open (path, tree->writable ? O_RDWR : O_RDONLY);
+  if (tree->fd < 0)
+    goto fail;
+
+  if (flags & BTREE_CREATE)
+    {
+      /* Page 0 is written whole once, so page 1 starts on a page boundary. */
+      memset (tree->scratch, 0, BTREE_PAGE_SIZE);
+      if (write (tree->fd, tree->scratch, BTREE_PAGE_SIZE) != BTREE_PAGE_SIZE)
+        goto fail;
+
+      tree->num_pages = 1;
+      page = new_page (tree, &tree->root, &f);
+      node_init (page, LEAF, 0);
+      unpin_page (tree, f, 1);
+      tree->height = 1;
+      if (write_header (tree) != 0)
+        goto fail;
+    }
+  else
+    {
+      if (pread (tree->fd, head, HEAD_LEN, 0) != HEAD_LEN
+          || memcmp (head, MAGIC, MAGIC_LEN)
+          || get32 (head + HEAD_PAGE_SIZE) != BTREE_PAGE_SIZE
+          || get32 (head + HEAD_CHECKSUM) != crc32c (0, head, HEAD_CHECKSUM))
+        goto fail;
+      tree->root = get32 (head + HEAD_ROOT);
+      tree->height = get32 (head + HEAD_HEIGHT);
+      tree->num_pages = get32 (head + HEAD_NUM_PAGES);
+      tree->num_records = get32 (head + HEAD_NUM_RECORDS);
+      tree->bytes_read += HEAD_LEN;
+      if (tree->root == 0 || tree->root >= tree->num_pages || tree->height < 1 || tree->height > MAX_HEIGHT)
+        goto fail;
+    }
+
+  return 0;
+
+fail:
+  if (tree->fd >= 0)
+    close (tree->fd);
+  mem_free (tree->frames);
+  mem_free (data);
+  mem_free (tree->buckets);
+  mem_free (tree->scratch);
+  return -1;
+}
+
+/* Function: btree_flush
+ * ---------------------
+ * Write every changed page and the header back to the file.
+ *
+ * returns: 0 on success, or -1 if a page could not be read or
+ *          written since the tree was opened.
+ */
+int
+btree_flush (BTree *tree)
+{
+  int f;
+
+  for (f = 0; f < tree->num_used; f++)
+    if (tree->frames[f].dirty)
+      write_frame (tree, f);
+  if (tree->header_dirty)
+    write_header (tree);
+
+  return tree->error ? -1 : 0;
+}
+
+/* Function: btree_close
+ * ---------------------
+ * Write back a tree's changes and release it.
+ *
+ * returns: 0 on success, or -1 if a page could not be read or
+ *          written since the tree was opened.
+ */
+int
+btree_close (BTree *tree)
+{
+  int status;
+
+  status = btree_flush (tree);
+  if (close (tree->fd) != 0)
+    status = -1;
+
+  mem_free (tree->frames[0].data);
+  mem_free (tree->frames);
+  mem_free (tree->buckets);
+  mem_free (tree->scratch);
+
+  return status;
+}
+
+/* Function: btree_check
+ * ---------------------
+ * Check a page of the file against its checksum.
+ *
+ * The page is read from the file, bypassing the buffer pool, and its
+ * cells are not looked at, so each page costs one read and a checksum.
+ * Changes still held in the pool are not seen.
+ *
+ * page: The page, from 1 up to the number of pages.
+ *
+ * returns: 0 if the page matches its checksum, 1 if it does not,
+ *          or -1 if it could not be read.
+ */
+int
+btree_check (BTree        *tree,
+             unsigned int  page)
+{
+  if (pread (tree->fd, tree->scratch, BTREE_PAGE_SIZE, (off_t) page * BTREE_PAGE_SIZE) != BTREE_PAGE_SIZE)
+    return -1;
+  tree->bytes_read += BTREE_PAGE_SIZE;
+
+  return get32 (tree->scratch + NODE_CHECKSUM) != page_checksum (tree->scratch);
+}
+
+/* Function: descend
+ * -----------------
+ * Follow a key from the root to a leaf.
+ *
+ * key: The key, or NULL for the leftmost leaf.
+ * after: Whether to follow keys equal to the key to the right,
+ *        to the leaf where a new record with the key goes.
+ * path: Receives the interior pages passed, from the root,
+ *       or NULL.
+ *
+ * returns: The leaf, or 0 if a page could not be read.
+ */
+static unsigned int
+descend (BTree               *tree,
+         const unsigned char *key,
+         size_t               len,
+         int                  after,
+         Step                *path)
+{
+  unsigned char *data;
+  unsigned int page, next;
+  unsigned int level;
+  int f, i;
+
+  page = tree->root;
+  for (level = 0; level + 1 < tree->height; level++)
+    {
+      data = pin_page (tree, page, &f);
+      if (data == NULL)
+        return 0;
+
+      i = key != NULL ? search_node (data, key, len, after) - 1 : -1;
+      if (i < 0)
+        next = get32 (data + NODE_LINK);
+      else
+        next = get32 (data + cell_at (data, i) + 2);
+      unpin_page (tree, f, 0);
+
+      if (path != NULL)
+        {
+          path[level].page = page;
+          path[level].child = i;
+        }
+      page = next;
+    }
+
+  return page;
+}
+
+/* Function: split_point
+ * ---------------------
+ * Choose where to split the cells of an overfull page
+ * so that the two halves hold about as many bytes.
+ *
+ * returns: The number of cells to keep in the left page.
+ */
+static int
+split_point (const size_t *lens,
+             int           n)
+{
+  size_t total, left, best, worst;
+  int i, k;
+
+  total = 0;
+  for (i = 0; i < n; i++)
+    total += lens[i] + 2;
+
+  k = 1;
+  best = (size_t) -1;
+  left = 0;
+  for (i = 1; i < n; i++)
+    {
+      left += lens[i - 1] + 2;
+      worst = left > total - left ? left : total - left;
+      if (worst < best)
+        {
+          best = worst;
+          k = i;
+        }
+    }
+
+  return k;
+}
+
+/* Function: insert_cell
+ * ---------------------
+ * Put a cell into a page, splitting the page if it is full
+ * and adding the key of the new page to its parent, up to the root.
+ *
+ * path: The interior pages above the page, from the root.
+ * level: The level of the page, 0 for the root.
+ * page: The page.
+ * i: Where the cell goes among the cells of the page.
+ *
+ * returns: 0 on success, or -1 if a page could not be read or written.
+ */
+static int
+insert_cell (BTree         *tree,
+             const Step    *path,
+             int            level,
+             unsigned int   page,
+             int            i,
+             unsigned char *cell,
+             size_t         len)
+{
+  unsigned char *data, *right_data, *root_data;
+  const unsigned char *key;
+  unsigned int right, root, count, link;
+  unsigned int offs[MAX_CELLS + 1];
+  size_t lens[MAX_CELLS + 1], key_len, pos;
+  int f, right_f, root_f, type, n, k, j;
+
+  for (;;)
+    {
+      data = pin_page (tree, page, &f);
+      if (data == NULL)
+        return -1;
+
+      if (node_free (data) >= len + 2
+          || node_compact (data, tree->scratch) >= len + 2)
+        {
+          node_insert (data, i, cell, len);
+          unpin_page (tree, f, 1);
+          return 0;
+        }
+
+      /* Line up the cells, the new one among them, in the scratch space. */
+      type = data[NODE_TYPE];
+      count = get16 (data + NODE_COUNT);
+      link = get32 (data + NODE_LINK);
+      pos = 0;
+      n = 0;
+      for (j = 0; j <= (int) count; j++)
+        {
+          const unsigned char *c;
+
+          if (j == i)
+            {
+              memcpy (tree->scratch + pos, cell, len);
+              offs[n] = pos;
+              lens[n++] = len;
+              pos += len;
+            }
+          if (j == (int) count)
+            break;
+          c = data + cell_at (data, j);
+          offs[n] = pos;
+          lens[n] = cell_len (data, c);
+          memcpy (tree->scratch + pos, c, lens[n]);
+          pos += lens[n++];
+        }
+
+      right_data = new_page (tree, &right, &right_f);
+      if (right_data == NULL)
+        {
+          unpin_page (tree, f, 0);
+          return -1;
+        }
+
+      if (type == LEAF)
+        {
+          /* Records added in key order fill each leaf before the next. */
+          if (i == (int) count && link == 0)
+            k = n - 1;
+          else
+            k = split_point (lens, n);
+
+          node_init (right_data, LEAF, link);
+          node_init (data, LEAF, right);
+          for (j = 0; j < k; j++)
+            node_insert (data, j, tree->scratch + offs[j], lens[j]);
+          for (j = k; j < n; j++)
+            node_insert (right_data, j - k, tree->scratch + offs[j], lens[j]);
+
+          /* The parent gets a copy of the first key of the right page. */
+          key = tree->scratch + offs[k] + 4;
+          key_len = get16 (tree->scratch + offs[k]);
+        }
+      else
+        {
+          /* The middle key moves up, and its child
+           * becomes the leftmost child of the right page. */
+          k = split_point (lens, n);
+          if (k >= n - 1)
+            k = n - 2;
+
+          node_init (right_data, INTERIOR, get32 (tree->scratch + offs[k] + 2));
+          node_init (data, INTERIOR, link);
+          for (j = 0; j < k; j++)
+            node_insert (data, j, tree->scratch + offs[j], lens[j]);
+          for (j = k + 1; j < n; j++)
+            node_insert (right_data, j - k - 1, tree->scratch + offs[j], lens[j]);
+
+          key = tree->scratch + offs[k] + 6;
+          key_len = get16 (tree->scratch + offs[k]);
+        }
+      unpin_page (tree, f, 1);
+      unpin_page (tree, right_f, 1);
+
+      /* The cell for the parent: the key and the new page. */
+      put16 (cell, key_len);
+      put32 (cell + 2, right);
+      memmove (cell + 6, key, key_len);
+      len = 6 + key_len;
+
+      if (level == 0)
+        {
+          root_data = new_page (tree, &root, &root_f);
+          if (root_data == NULL)
+            return -1;
+          node_init (root_data, INTERIOR, page);
+          node_insert (root_data, 0, cell, len);
+          unpin_page (tree, root_f, 1);
+
+          tree->root = root;
+          tree->height++;
+          tree->header_dirty = 1;
+          return 0;
+        }
+
+      level--;
+      page = path[level].page;
+      i = path[level].child + 1;
+    }
+}
+
+/* Function: btree_insert
+ * ----------------------
+ * Add a record to a tree, after any records with the same key.
+ *
+ * key: The key, at most BTREE_MAX_KEY bytes.
+ * value: The value, at most BTREE_MAX_VALUE bytes.
+ *
+ * returns: 0 on success, or -1 if the tree cannot be changed,
+ *          the record is too long, or a page could not be read
+ *          or written.
+ */
+int
+btree_insert (BTree      *tree,
+              const char *key,
+              const char *value,
+              size_t      value_len)
+{
+  unsigned char cell[MAX_CELL_LEN];
+  Step path[MAX_HEIGHT];
+  unsigned char *data;
+  unsigned int leaf;
+  size_t key_len;
+  int f, i;
+
+  key_len = strlen (key);
+  if (!tree->writable || key_len > BTREE_MAX_KEY || value_len > BTREE_MAX_VALUE)
+    return -1;
+
+  leaf = descend (tree, (const unsigned char *) key, key_len, 1, path);
+  if (leaf == 0)
+    return -1;
+
+  data = pin_page (tree, leaf, &f);
+  if (data == NULL)
+    return -1;
+  i = search_node (data, (const unsigned char *) key, key_len, 1);
+  unpin_page (tree, f, 0);
+
+  put16 (cell, key_len);
+  put16 (cell + 2, value_len);
+  memcpy (cell + 4, key, key_len);
+  memcpy (cell + 4 + key_len, value, value_len);
+
+  if (insert_cell (tree, path, tree->height - 1, leaf, i, cell, 4 + key_len + value_len) != 0)
+    return -1;
+
+  tree->num_records++;
+  tree->header_dirty = 1;
+  return 0;
+}
+
+/* Function: btree_seek
+ * --------------------
+ * Place a cursor before the first record whose key is not less than a key.
+ *
+ * key: The key, or NULL for the first record of the tree.
+ *
+ * returns: 0 on success, or -1 if a page could not be read.
+ */
+int
+btree_seek (BTree       *tree,
+            const char  *key,
+            BTreeCursor *cursor)
+{
+  unsigned char *data;
+  size_t key_len;
+  int f;
+
+  key_len = key != NULL ? strlen (key) : 0;
+  cursor->tree = tree;
+  cursor->slot = 0;
+  cursor->page = descend (tree, (const unsigned char *) key, key_len, 0, NULL);
+  if (cursor->page == 0)
+    return -1;
+
+  if (key != NULL)
+    {
+      data = pin_page (tree, cursor->page, &f);
+      if (data == NULL)
+        return -1;
+      cursor->slot = search_node (data, (const unsigned char *) key, key_len, 0);
+      unpin_page (tree, f, 0);
+    }
+
+  return 0;
+}
+
+/* Function: btree_next
+ * --------------------
+ * Read the record after a cursor and move the cursor past it.
+ *
+ * key: Receives the key, terminated, or NULL.
+ *      It must hold BTREE_MAX_KEY + 1 bytes.
+ * value: Receives the value, terminated, or NULL.
+ *        It must hold BTREE_MAX_VALUE + 1 bytes.
+ * value_len: Receives the length of the value, or NULL.
+ *
+ * returns: 1 if a record was read, 0 at the end of the tree,
+ *          or -1 if a page could not be read.
+ */
+int
+btree_next (BTreeCursor *cursor,
+            char        *key,
+            char        *value,
+            size_t      *value_len)
+{
+  BTree *tree = cursor->tree;
+  const unsigned char *cell;
+  unsigned char *data;
+  unsigned int next;
+  size_t k_len, v_len;
+  int f;
+
+  while (cursor->page != 0)
+    {
+      data = pin_page (tree, cursor->page, &f);
+      if (data == NULL)
+        return -1;
+
+      if (cursor->slot < (int) get16 (data + NODE_COUNT))
+        {
+          cell = data + cell_at (data, cursor->slot);
+          k_len = get16 (cell);
+          v_len = get16 (cell + 2);
+          if (key != NULL)
+            {
+              memcpy (key, cell + 4, k_len);
+              key[k_len] = '\0';
+            }
+          if (value != NULL)
+            {
+              memcpy (value, cell + 4 + k_len, v_len);
+              value[v_len] = '\0';
+            }
+          if (value_len != NULL)
+            *value_len = v_len;
+          unpin_page (tree, f, 0);
+
+          cursor->slot++;
+          tree->records_scanned++;
+          return 1;
+        }
+
+      next = get32 (data + NODE_LINK);
+      unpin_page (tree, f, 0);
+      cursor->page = next;
+      cursor->slot = 0;
+    }
+
+  return 0;
+}
@@ -0,0 +1,128 @@
+/* btree.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <stddef.h>
+
+/* The size of a page, in the file and in the buffer pool. */
+#define BTREE_PAGE_SIZE 8192
+
+/* The longest key and value a record can hold, in bytes.
+ * Any two records fit in a page, so a full page can always be split. */
+#define BTREE_MAX_KEY 255
+#define BTREE_MAX_VALUE 2560
+
+/* The fewest pages a buffer pool may hold. */
+#define BTREE_MIN_FRAMES 8
+
+/* Flags for `btree_open`. */
+#define BTREE_WRITE  1  /* Allow changes. */
+#define BTREE_CREATE 2  /* Start a new, empty tree, replacing any file. */
+
+/* A page held in the buffer pool. */
+typedef struct
+{
+  unsigned int   page;       /* The number of the page held. */
+  int            pins;       /* The number of users of the page; a pinned page is never evicted. */
+  int            dirty;      /* Whether the page must be written back before it is evicted. */
+  int            prev;       /* The frame used more recently, or -1. */
+  int            next;       /* The frame used less recently, or -1. */
+  int            hash_next;  /* The next frame in the same hash bucket, or -1. */
+  unsigned char *data;       /* The page, BTREE_PAGE_SIZE bytes. */
+} BTreeFrame;
+
+/* A B+tree of records kept in a file of fixed-size pages.
+ *
+ * Records are a key and a value, ordered by key compared byte by byte.
+ * Several records may share a key; they are kept in the order they
+ * were added.  Values are stored in the leaves, which are chained in
+ * key order, and the interior pages hold only keys, so a lookup reads
+ * one page per level of the tree.
+ *
+ * Pages are read through a pool of a fixed number of frames.  When
+ * every frame is in use, the least recently used page is written back
+ * if it was changed and its frame reused, so the memory a tree holds
+ * does not depend on the size of its file.
+ *
+ * Every page and the header carry a CRC-32C checksum, set when they are
+ * written and compared when they are read, so a damaged page is reported
+ * as an error rather than read as records.
+ *
+ * A tree must not be used by two threads at once. */
+typedef struct
+{
+  int                 fd;               /* The file. */
+  int                 writable;         /* Whether the tree may be changed. */
+  unsigned int        root;             /* The page of the root. */
+  unsigned int        height;           /* The number of levels, 1 for a lone leaf. */
+  unsigned int        num_pages;        /* The number of pages in the file, the header included. */
+  unsigned int        num_records;      /* The number of records. */
+  int                 header_dirty;     /* Whether the header must be written back. */
+  int                 error;            /* Nonzero once a page could not be read or written. */
+  unsigned int        bad_page;         /* The first page read that did not match its checksum, or 0. */
+  BTreeFrame         *frames;           /* The buffer pool. */
+  int                 num_frames;       /* The number of frames. */
+  int                 num_used;         /* The number of frames that hold a page. */
+  int                 lru_head;         /* The frame used most recently, or -1. */
+  int                 lru_tail;         /* The frame used least recently, or -1. */
+  int                *buckets;          /* The first frame of each hash bucket, or -1. */
+  unsigned int        num_buckets;      /* The number of hash buckets, a power of two. */
+  unsigned char      *scratch;          /* Room for the cells of a page being split. */
+  unsigned long long  records_scanned;  /* Records read by cursors; reset by the caller. */
+  unsigned long long  bytes_read;       /* Bytes read from the file; reset by the caller. */
+  unsigned long long  bytes_written;    /* Bytes written to the file; reset by the caller. */
+  unsigned long long  hits;             /* Pages found in the pool. */
+  unsigned long long  misses;           /* Pages read from the file. */
+} BTree;
+
+/* A position in a tree, before a record or at the end.
+ *
+ * A cursor may be copied to come back to a record later,
+ * as long as the tree is not changed in between. */
+typedef struct
+{
+  BTree        *tree;  /* The tree. */
+  unsigned int  page;  /* The leaf, or 0 at the end. */
+  int           slot;  /* The record within the leaf. */
+} BTreeCursor;
+
+int  btree_open   (BTree        *tree,
+                   const char   *path,
+                   int           flags,
+                   int           num_frames);
+int  btree_close  (BTree        *tree);
+int  btree_flush  (BTree        *tree);
+int  btree_insert (BTree        *tree,
+                   const char   *key,
+                   const char   *value,
+                   size_t        value_len);
+int  btree_check  (BTree        *tree,
+                   unsigned int  page);
+int  btree_seek   (BTree        *tree,
+                   const char   *key,
+                   BTreeCursor  *cursor);
+int  btree_next   (BTreeCursor  *cursor,
+                   char         *key,
+                   char         *value,
+                   size_t       *value_len);
+
+#endif
@@ -0,0 +1,180 @@
+/* cache.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include <string.h>
+
+#include "cache.h"
+#include "mem.h"
+
+/* Function: drop_entry
+ * --------------------
+ * Free an entry of a cache.
+ */
+static void
+drop_entry (Cache      *cache,
+            CacheEntry *entry)
+{
+  cache->total_rows -= entry->num_rows;
+  mem_free (entry->rows);
+  entry->rows = NULL;
+  entry->num_rows = 0;
+  entry->key[0] = '\0';
+}
+
+/* Function: cache_init
+ * --------------------
+ * Initialize an empty cache.
+ *
+ * cache: The cache to initialize.
+ */
+void
+cache_init (Cache *cache)
+{
+  memset (cache, 0, sizeof (Cache));
+}
+
+/* Function: cache_free
+ * --------------------
+ * Release the results of a cache, leaving it empty.
+ *
+ * cache: The cache.
+ */
+void
+cache_free (Cache *cache)
+{
+  int e;
+
+  for (e = 0; e < CACHE_ENTRIES; e++)
+    drop_entry (cache, &cache->entries[e]);
+}
+
+/* Function: cache_get
+ * -------------------
+ * Find the result of a search.
+ *
+ * A result stored for another generation is dropped.
+ *
+ * cache: The cache.
+ * key: The search.
+ * generation: The generation of the data now.
+ * rows: Receives the rows of the result, valid until the cache
+ *       is next changed.
+ *
+ * returns: The number of rows, or -1 if the result is not cached.
+ */
+int
+cache_get (Cache              *cache,
+           const char         *key,
+           unsigned long long  generation,
+           const int         **rows)
+{
+  CacheEntry *entry;
+  int e;
+
+  for (e = 0; e < CACHE_ENTRIES; e++)
+    {
+      entry = &cache->entries[e];
+      if (entry->key[0] == '\0' || strcmp (entry->key, key))
+        continue;
+
+      if (entry->generation != generation)
+        {
+          drop_entry (cache, entry);
+          return -1;
+        }
+
+      entry->last_used = ++cache->clock;
+      *rows = entry->rows;
+      return entry->num_rows;
+    }
+
+  return -1;
+}
+
+/* Function: cache_put
+ * -------------------
+ * Store the result of a search, replacing any result of the same search.
+ *
+ * The least recently used results are dropped to make room.  A result
+ * with a key longer than CACHE_MAX_KEY or more than CACHE_MAX_ROWS rows
+ * is not stored.
+ *
+ * cache: The cache.
+ * key: The search.
+ * generation: The generation of the data the search ran on.
+ * rows: The rows found.
+ * num_rows: The number of rows.
+ *
+ * returns: 0 if the result was stored, or -1 if it was not.
+ */
+int
+cache_put (Cache              *cache,
+           const char         *key,
+           unsigned long long  generation,
+           const int          *rows,
+           int                 num_rows)
+{
+  CacheEntry *entry, *oldest;
+  int *copy;
+  int e;
+
+  if (strlen (key) > CACHE_MAX_KEY || key[0] == '\0' || num_rows < 0 || (size_t) num_rows > CACHE_MAX_ROWS)
+    return -1;
+
+  copy = NULL;
+  if (num_rows > 0)
+    {
+      copy = (int *) mem_alloc (MEM_INDEXES, sizeof (int) * num_rows);
+      if (copy == NULL)
+        return -1;
+      memcpy (copy, rows, sizeof (int) * num_rows);
+    }
+
+  for (e = 0; e < CACHE_ENTRIES; e++)
+    if (cache->entries[e].key[0] != '\0' && !strcmp (cache->entries[e].key, key))
+      drop_entry (cache, &cache->entries[e]);
+
+  /* Drop the least recently used results until one entry is free
+   * and the rows fit. */
+  while (1)
+    {
+      entry = oldest = NULL;
+      for (e = 0; e < CACHE_ENTRIES; e++)
+        {
+          if (cache->entries[e].key[0] == '\0')
+            entry = &cache->entries[e];
+          else if (oldest == NULL || cache->entries[e].last_used < oldest->last_used)
+            oldest = &cache->entries[e];
+        }
+      if (entry != NULL && cache->total_rows + num_rows <= CACHE_MAX_ROWS)
+        break;
+      drop_entry (cache, oldest);
+    }
+
+  strcpy (entry->key, key);
+  entry->generation = generation;
+  entry->last_used = ++cache->clock;
+  entry->rows = copy;
+  entry->num_rows = num_rows;
+  cache->total_rows += num_rows;
+
+  return 0;
+}
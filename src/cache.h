@@ -0,0 +1,69 @@
+/* cache.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef CACHE_H
+#define CACHE_H
+
+/* The number of results a cache holds. */
+#define CACHE_ENTRIES 32
+
+/* The rows all the results of a cache may hold together. */
+#define CACHE_MAX_ROWS (1 << 20)
+
+/* The longest key cached, excluding the terminator. */
+#define CACHE_MAX_KEY 255
+
+/* The result of a search, as the rows it found. */
+typedef struct
+{
+  char                key[CACHE_MAX_KEY + 1];  /* The search, or "" if the entry is free. */
+  unsigned long long  generation;              /* The generation of the data the search ran on. */
+  unsigned long long  last_used;               /* When the entry was last stored or found, by the cache's clock. */
+  int                *rows;                    /* The rows found, in order. */
+  int                 num_rows;                /* The number of rows. */
+} CacheEntry;
+
+/* A cache of search results, dropping the least recently used result
+ * when it is full.
+ *
+ * Each result is stored with the generation of the data it was found
+ * in, and is only returned for the same generation, so changing the
+ * data is enough to stop its old results from being used. */
+typedef struct
+{
+  CacheEntry          entries[CACHE_ENTRIES];  /* The results. */
+  size_t              total_rows;              /* The rows of all the results. */
+  unsigned long long  clock;                   /* Counts the stores and lookups. */
+} Cache;
+
+void cache_init (Cache              *cache);
+void cache_free (Cache              *cache);
+int  cache_get  (Cache              *cache,
+                 const char         *key,
+                 unsigned long long  generation,
+                 const int         **rows);
+int  cache_put  (Cache              *cache,
+                 const char         *key,
+                 unsigned long long  generation,
+                 const int          *rows,
+                 int                 num_rows);
+
+#endif
@@ -0,0 +1,2248 @@
+/* catalog.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "btree.h"
+#include "catalog.h"
+#include "crc32c.h"
+#include "marc.h"
+#include "mem.h"
+
+/* The size of the buffers files are read and written through. */
+#define IO_BUF_LEN 65536
+
+/* The size of a buffer that holds the name of any file of a catalog
+ * being written under its temporary name. */
+#define TMP_NAME_LEN (MAX_FIELD_LEN + sizeof (CATALOG_SUMS_SUFFIX) + sizeof (CATALOG_TMP_SUFFIX))
+
+/* The largest block a checksum file may give. */
+#define MAX_BLOCK_SIZE (64 << 20)
+
+/* The number of books the books array first holds. */
+#define INITIAL_MAX_BOOKS 1000
+
+/* The number of books the books array grows by when a book is added. */
+#define ADD_MAX_BOOKS 500
+
+/* Function: fail
+ * --------------
+ * Record the message of an error.
+ *
+ * returns: -1, for the caller to return.
+ */
+static int
+fail (Catalog    *catalog,
+      const char *format,
+      ...)
+{
+  va_list ap;
+
+  va_start (ap, format);
+  vsnprintf (catalog->error, sizeof (catalog->error), format, ap);
+  va_end (ap);
+
+  return -1;
+}
+
+/* Function: phase
+ * ---------------
+ * Tell the catalog's phase hook, if it has one,
+ * that a phase of the work begins or ends.
+ */
+static void
+phase (const Catalog *catalog,
+       const char    *name,
+       int            begin)
+{
+  if (catalog->on_phase != NULL)
+    catalog->on_phase (name, begin);
+}
+
+/* Function: hash_line
+ * --------------------
+ * Hash a line of the catalog file.
+ *
+ * The line is taken eight bytes at a time, each word mixed in with a
+ * multiply and a shift, which keeps saving and loading fast.
+ *
+ * returns: The hash, never 0, which marks a book with no line.
+ */
+static unsigned long long
+hash_line (const char *line,
+           size_t      len)
+{
+  unsigned long long hash, word;
+  size_t i;
+
+  hash = len * 0x9e3779b97f4a7c15ULL;
+  for (i = 0; i + 8 <= len; i += 8)
+    {
+      memcpy (&word, line + i, 8);
+      hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+      hash ^= hash >> 32;
+    }
+  if (i < len)
+    {
+      word = 0;
+      memcpy (&word, line + i, len - i);
+      hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+      hash ^= hash >> 32;
+    }
+  hash = (hash ^ (hash >> 29)) * 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 32;
+
+  return hash != 0 ? hash : 1;
+}
+
+/* Function: stamp_file
+ * --------------------
+ * Read the inode, size and modification time of the catalog file,
+ * which tell whether it was written since it was last read.
+ *
+ * returns: 0 on success, or -1 if the file cannot be read.
+ */
+static int
+stamp_file (const Catalog      *catalog,
+            unsigned long long  stamp[3])
+{
+  struct stat st;
+
+  if (stat (catalog->file_name, &st) != 0)
+    return -1;
+
+  stamp[0] = st.st_ino;
+  stamp[1] = st.st_size;
+  stamp[2] = (unsigned long long) st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+  return 0;
+}
+
+/* Function: grow_books
+ * --------------------
+ * Resize the books array, and the line hashes and change flags
+ * kept beside it, to hold max_books books.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+static int
+grow_books (Catalog *catalog,
+            size_t   max_books)
+{
+  Book *books;
+  unsigned long long *hashes;
+  unsigned char *changed;
+
+  books = (Book *) mem_realloc (MEM_RECORDS, catalog->books, sizeof (Book) * max_books);
+  if (books == NULL)
+    return fail (catalog, "Failed to allocate additional memory for books.");
+  catalog->books = books;
+
+  hashes = (unsigned long long *) mem_realloc (MEM_INDEXES, catalog->row_hashes, sizeof (unsigned long long) * max_books);
+  if (hashes == NULL)
+    return fail (catalog, "Failed to allocate additional memory for books.");
+  catalog->row_hashes = hashes;
+
+  changed = (unsigned char *) mem_realloc (MEM_INDEXES, catalog->row_changed, max_books);
+  if (changed == NULL)
+    return fail (catalog, "Failed to allocate additional memory for books.");
+  catalog->row_changed = changed;
+
+  catalog->max_books = max_books;
+  return 0;
+}
+
+/* Function: next_field
+ * ---------------------
+ * Split the next comma-separated field off a line.
+ *
+ * Unlike `strtok`, consecutive commas yield empty fields,
+ * so a book with an empty field keeps its remaining fields in place.
+ *
+ * cursor: A pointer to the position in the line where the next field starts.
+ *         It is advanced past the field, or set to NULL after the last field.
+ *
+ * returns: A pointer to the null-terminated field,
+ *          or NULL if the line has no more fields.
+ */
+static char *
+next_field (char **cursor)
+{
+  char *field, *end;
+
+  field = *cursor;
+  if (field == NULL)
+    return NULL;
+
+  end = strchr (field, ',');
+  if (end != NULL)
+    {
+      *end = '\0';
+      *cursor = end + 1;
+    }
+  else
+    *cursor = NULL;
+
+  return field;
+}
+
+/* Function: trim_field
+ * --------------------
+ * Cut a field read from the catalog file in place, dropping the
+ * line's trailing newline and truncating the field to
+ * MAX_FIELD_LEN - 1 characters.
+ *
+ * field: The field as split off the line.
+ *
+ * returns: The length of the field.
+ */
+static size_t
+trim_field (char *field)
+{
+  size_t len;
+
+  len = strcspn (field, "\n");
+  if (len > MAX_FIELD_LEN - 1)
+    len = MAX_FIELD_LEN - 1;
+  field[len] = '\0';
+
+  return len;
+}
+
+/* Function: catalog_parse_year
+ * ----------------------------
+ * Parse a publication year.
+ *
+ * s: The year, written as 1 to 4 decimal digits and nothing else.
+ *
+ * returns: The year, or YEAR_NONE if s is not a year.
+ */
+int
+catalog_parse_year (const char *s)
+{
+  int year, i;
+
+  year = 0;
+  for (i = 0; s[i] != '\0'; i++)
+    {
+      if (i == 4 || s[i] < '0' || s[i] > '9')
+        return YEAR_NONE;
+      year = year * 10 + (s[i] - '0');
+    }
+
+  return i > 0 ? year : YEAR_NONE;
+}
+
+/* Function: load_patrons
+ * ----------------------
+ * Read the patrons from the patron file, if it exists,
+ * so that every patron keeps the id it was first given.
+ *
+ * returns: 0 on success, or -1 on error.
+ */
+static int
+load_patrons (Catalog *catalog)
+{
+  FILE *fp;
+  char line[MAX_LINE_LEN];
+  char *name;
+  unsigned int id;
+
+  if (!strcmp (catalog->patron_file_name, ""))
+    return 0;
+
+  fp = fopen (catalog->patron_file_name, "r");
+  if (fp == NULL)
+    return 0;
+
+  if (fgets (line, MAX_LINE_LEN, fp) != NULL)
+    {
+      catalog->bytes_read += strlen (line);
+      if (strcmp (line, "Id,Name\n"))
+        {
+          fclose (fp);
+          return fail (catalog, "Invalid header in file \"%s\". Expected \"%s\" but found \"%.*s\".",
+                       catalog->patron_file_name, "Id,Name", (int) strcspn (line, "\n"), line);
+        }
+    }
+
+  while (fgets (line, MAX_LINE_LEN, fp) != NULL)
+    {
+      catalog->bytes_read += strlen (line);
+      line[strcspn (line, "\n")] = '\0';
+      name = strchr (line, ',');
+      if (name == NULL)
+        continue;
+
+      name++;
+      if (strlen (name) > PATRON_MAX_NAME)
+        name[PATRON_MAX_NAME] = '\0';
+      id = patron_add (&catalog->patrons, name);
+      if (id == PATRON_NONE && name[strspn (name, " \t")] != '\0')
+        {
+          fclose (fp);
+          return fail (catalog, "Failed to allocate memory for patrons.");
+        }
+    }
+
+  if (ferror (fp))
+    {
+      fclose (fp);
+      return fail (catalog, "Failed to read from file \"%s\".", catalog->patron_file_name);
+    }
+
+  fclose (fp);
+  return 0;
+}
+
+/* Function: open_output
+ * ---------------------
+ * Open a file of the catalog for writing.
+ *
+ * When syncing, the file is written under a temporary name and
+ * renamed over the old file by `close_output`, so a crash leaves
+ * either the old file or the new one.
+ *
+ * tmp_name: Receives the name written to.  It must hold
+ *           TMP_NAME_LEN characters.
+ *
+ * returns: The file, or NULL if it could not be opened.
+ */
+static FILE *
+open_output (Catalog    *catalog,
+             const char *file_name,
+             int         sync,
+             char       *tmp_name)
+{
+  FILE *fp;
+
+  snprintf (tmp_name, TMP_NAME_LEN, "%s%s", file_name, sync ? CATALOG_TMP_SUFFIX : "");
+  fp = fopen (tmp_name, "w");
+  if (fp == NULL)
+    fail (catalog, "Failed to open file \"%s\" for writing.", tmp_name);
+  return fp;
+}
+
+/* Function: close_output
+ * ----------------------
+ * Close a file opened by `open_output`.  When syncing, wait until
+ * its contents are on disk and then give it its own name.
+ *
+ * returns: 0 on success, or -1 if the file could not be written.
+ */
+static int
+close_output (Catalog    *catalog,
+              FILE       *fp,
+              const char *file_name,
+              int         sync,
+              const char *tmp_name)
+{
+  int status;
+
+  if (sync)
+    {
+      phase (catalog, "fsync", 1);
+      status = fflush (fp) != 0 || fsync (fileno (fp)) != 0;
+      phase (catalog, "fsync", 0);
+      if (status != 0)
+        {
+          fclose (fp);
+          return fail (catalog, "Failed to write file \"%s\" to disk.", tmp_name);
+        }
+    }
+  if (fclose (fp) != 0)
+    return fail (catalog, "Failed to close file \"%s\".", tmp_name);
+  if (sync && rename (tmp_name, file_name) != 0)
+    return fail (catalog, "Failed to rename file \"%s\" to \"%s\".", tmp_name, file_name);
+
+  return 0;
+}
+
+/* Function: sync_dir
+ * ------------------
+ * Wait until the names given to the files of the catalog
+ * are on disk, by syncing the directory holding the catalog file.
+ *
+ * returns: 0 on success, or -1 if the directory could not be synced.
+ */
+static int
+sync_dir (Catalog *catalog)
+{
+  char dir[MAX_FIELD_LEN];
+  char *slash;
+  int fd, status;
+
+  snprintf (dir, sizeof (dir), "%s", catalog->file_name);
+  slash = strrchr (dir, '/');
+  if (slash == NULL)
+    strcpy (dir, ".");
+  else if (slash == dir)
+    dir[1] = '\0';
+  else
+    *slash = '\0';
+
+  fd = open (dir, O_RDONLY);
+  if (fd < 0)
+    return fail (catalog, "Failed to open directory \"%s\".", dir);
+  phase (catalog, "fsync", 1);
+  status = fsync (fd);
+  phase (catalog, "fsync", 0);
+  close (fd);
+  if (status != 0)
+    return fail (catalog, "Failed to write directory \"%s\" to disk.", dir);
+
+  return 0;
+}
+
+/* Function: save_patrons
+ * ----------------------
+ * Write the patrons to the patron file in order of id.
+ *
+ * returns: 0 on success, or -1 if the file could not be written.
+ */
+static int
+save_patrons (Catalog *catalog,
+              int      sync)
+{
+  char tmp_name[TMP_NAME_LEN];
+  FILE *fp;
+  unsigned int id, num_patrons;
+  int len;
+
+  if (!strcmp (catalog->patron_file_name, ""))
+    return 0;
+
+  fp = open_output (catalog, catalog->patron_file_name, sync, tmp_name);
+  if (fp == NULL)
+    return -1;
+
+  len = fprintf (fp, "Id,Name\n");
+  if (len > 0)
+    catalog->bytes_written += len;
+
+  num_patrons = patron_count (&catalog->patrons);
+  for (id = 0; id < num_patrons; id++)
+    {
+      len = fprintf (fp, "%u,%s\n", id, patron_name (&catalog->patrons, id));
+      if (len > 0)
+        catalog->bytes_written += len;
+    }
+
+  return close_output (catalog, fp, catalog->patron_file_name, sync, tmp_name);
+}
+
+/* Function: read_sums
+ * -------------------
+ * Read the checksum file of a catalog file.
+ *
+ * The checksum file is named after the catalog file with
+ * CATALOG_SUMS_SUFFIX added.  Its first line is "CRC32C", the block
+ * size and the size of the catalog file, and each line after it holds
+ * the checksum of a block in hexadecimal.
+ *
+ * block_size: Receives the size of a block.
+ * size: Receives the size of the catalog file when the sums were taken.
+ * sums: Receives the checksums, to be released with `mem_free`.
+ * num_sums: Receives the number of checksums.
+ *
+ * returns: 1 if the checksums were read, 0 if there is no checksum file,
+ *          or -1 if it is malformed or memory could not be allocated.
+ */
+static int
+read_sums (Catalog             *catalog,
+           size_t              *block_size,
+           unsigned long long  *size,
+           unsigned int       **sums,
+           size_t              *num_sums)
+{
+  char file_name[MAX_FIELD_LEN + sizeof (CATALOG_SUMS_SUFFIX)];
+  unsigned int *new_sums;
+  unsigned long block;
+  unsigned int sum;
+  size_t max_sums;
+  FILE *fp;
+  int status;
+
+  *sums = NULL;
+  *num_sums = 0;
+  snprintf (file_name, sizeof (file_name), "%s%s", catalog->file_name, CATALOG_SUMS_SUFFIX);
+  fp = fopen (file_name, "r");
+  if (fp == NULL)
+    return 0;
+
+  if (fscanf (fp, "CRC32C %lu %llu", &block, size) != 2 || block == 0 || block > MAX_BLOCK_SIZE)
+    {
+      fclose (fp);
+      return fail (catalog, "Invalid checksum file \"%s\".", file_name);
+    }
+  *block_size = block;
+
+  status = 1;
+  max_sums = 0;
+  while (fscanf (fp, "%x", &sum) == 1)
+    {
+      if (*num_sums >= max_sums)
+        {
+          max_sums = max_sums ? max_sums * 2 : 64;
+          new_sums = (unsigned int *) mem_realloc (MEM_BUFFERS, *sums, sizeof (unsigned int) * max_sums);
+          if (new_sums == NULL)
+            {
+              status = fail (catalog, "Failed to allocate memory for checksums.");
+              break;
+            }
+          *sums = new_sums;
+        }
+      (*sums)[(*num_sums)++] = sum;
+    }
+  if (status == 1 && !feof (fp))
+    status = fail (catalog, "Invalid checksum file \"%s\".", file_name);
+
+  fclose (fp);
+  if (status != 1)
+    {
+      mem_free (*sums);
+      *sums = NULL;
+      *num_sums = 0;
+    }
+  return status;
+}
+
+/* Function: write_sums
+ * --------------------
+ * Write the checksum file of a catalog file, as read by `read_sums`.
+ *
+ * returns: 0 on success, or -1 if it could not be written.
+ */
+static int
+write_sums (Catalog            *catalog,
+            const Crc32cBlocks *blocks,
+            int                 sync)
+{
+  char file_name[MAX_FIELD_LEN + sizeof (CATALOG_SUMS_SUFFIX)];
+  char tmp_name[TMP_NAME_LEN];
+  size_t i;
+  FILE *fp;
+  int len;
+
+  snprintf (file_name, sizeof (file_name), "%s%s", catalog->file_name, CATALOG_SUMS_SUFFIX);
+  fp = open_output (catalog, file_name, sync, tmp_name);
+  if (fp == NULL)
+    return -1;
+
+  len = fprintf (fp, "CRC32C %zu %llu\n", blocks->block_size, blocks->size);
+  if (len > 0)
+    catalog->bytes_written += len;
+  for (i = 0; i < blocks->num_sums; i++)
+    if ((len = fprintf (fp, "%08x\n", blocks->sums[i])) > 0)
+      catalog->bytes_written += len;
+
+  return close_output (catalog, fp, file_name, sync, tmp_name);
+}
+
+/* Function: first_bad_block
+ * -------------------------
+ * Compare the checksums of the blocks of a file with those it was saved
+ * with.  A block that is missing from either side does not match.
+ *
+ * returns: The first block that does not match, or -1 if all match.
+ */
+static long long
+first_bad_block (const Crc32cBlocks *blocks,
+                 const unsigned int *sums,
+                 size_t              num_sums)
+{
+  size_t i;
+
+  for (i = 0; i < blocks->num_sums && i < num_sums; i++)
+    if (blocks->sums[i] != sums[i])
+      return i;
+
+  return blocks->num_sums != num_sums ? (long long) i : -1;
+}
+
+/* Function: parse_book
+ * --------------------
+ * Read a book from a line of the catalog file.
+ *
+ * line: The line, which is split in place.
+ * book: Receives the book.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+static int
+parse_book (Catalog *catalog,
+            char    *line,
+            Book    *book)
+{
+  char empty[1] = "";
+  char *field, *cursor;
+  int i;
+
+  cursor = line;
+  for (i = 0; i < MAX_NUM_FIELDS; i++)
+    {
+      field = next_field (&cursor);
+      if (field == NULL)
+        field = empty;
+      catalog->text_bytes += trim_field (field);
+
+      if (catalog_set (catalog, book, i, field) != 0)
+        return -1;
+    }
+
+  return 0;
+}
+
+/* Function: load_books
+ * --------------------
+ * Load the books from the catalog file, creating an empty catalog file
+ * if there is none.
+ *
+ * Every field is encoded into its column as it is read,
+ * and the title column is front-coded once the whole file is read.
+ * The books array is doubled in size whenever the file holds
+ * more books than it can currently fit.  The hash of every line
+ * is kept, for `catalog_reload` to tell which lines have changed.
+ * If the file has a checksum file, the checksum of each block is
+ * taken as the lines are read, and `damaged_offset` is set to the
+ * first block that does not match.
+ *
+ * returns: 0 on success, or -1 on error.
+ */
+static int
+load_books (Catalog *catalog)
+{
+  FILE *fp;
+  char line[MAX_LINE_LEN];
+  char *buf;
+  unsigned int *remap, *sums;
+  Crc32cBlocks blocks;
+  unsigned long long saved_size;
+  size_t block_size, num_sums, len;
+  int has_sums, i, f;
+
+  fp = fopen (catalog->file_name, "r");
+  if (fp == NULL)
+    {
+      fp = fopen (catalog->file_name, "w");
+      if (fp == NULL)
+        return fail (catalog, "Failed to create new catalog file \"%s\".", catalog->file_name);
+
+      fprintf (fp, "%s\n", CATALOG_HEADER);
+
+      if (fclose (fp) != 0)
+        return fail (catalog, "Failed to close newly created catalog file \"%s\".", catalog->file_name);
+
+      if ((fp = fopen (catalog->file_name, "r")) == NULL)
+        return fail (catalog, "Failed to open newly created catalog file \"%s\" for reading.", catalog->file_name);
+    }
+
+  /* A malformed checksum file is no reason not to load the catalog;
+   * the file is then treated as damaged from its start. */
+  catalog->damaged_offset = -1;
+  has_sums = read_sums (catalog, &block_size, &saved_size, &sums, &num_sums);
+  if (has_sums < 0)
+    catalog->damaged_offset = 0;
+  crc32c_blocks_init (&blocks, has_sums > 0 ? block_size : CATALOG_BLOCK_SIZE);
+
+  buf = (char *) mem_alloc (MEM_BUFFERS, IO_BUF_LEN);
+  if (buf != NULL)
+    setvbuf (fp, buf, _IOFBF, IO_BUF_LEN);
+
+  if (fgets (line, MAX_LINE_LEN, fp) != NULL)
+    {
+      len = strlen (line);
+      catalog->bytes_read += len;
+      if (has_sums > 0)
+        crc32c_blocks_add (&blocks, line, len);
+      if (strcmp (line, CATALOG_HEADER "\n"))
+        {
+          fail (catalog, "Invalid header in file \"%s\". Expected \"%s\" but found \"%.*s\".",
+                catalog->file_name, CATALOG_HEADER, (int) strcspn (line, "\n"), line);
+          fclose (fp);
+          mem_free (buf);
+          mem_free (sums);
+          crc32c_blocks_free (&blocks);
+          return -1;
+        }
+    }
+
+  while (fgets (line, MAX_LINE_LEN, fp) != NULL)
+    {
+      if (catalog->num_books >= catalog->max_books
+          && grow_books (catalog, catalog->max_books * 2) != 0)
+        {
+          fclose (fp);
+          mem_free (buf);
+          mem_free (sums);
+          crc32c_blocks_free (&blocks);
+          return -1;
+        }
+
+      len = strlen (line);
+      catalog->bytes_read += len;
+      if (has_sums > 0)
+        crc32c_blocks_add (&blocks, line, len);
+      catalog->row_hashes[catalog->num_books] = hash_line (line, len > 0 && line[len - 1] == '\n' ? len - 1 : len);
+      catalog->row_changed[catalog->num_books] = 0;
+      if (parse_book (catalog, line, &catalog->books[catalog->num_books]) != 0)
+        {
+          fclose (fp);
+          mem_free (buf);
+          mem_free (sums);
+          crc32c_blocks_free (&blocks);
+          return -1;
+        }
+
+      catalog->num_books++;
+    }
+  catalog->records_scanned += catalog->num_books;
+
+  if (ferror (fp))
+    {
+      fail (catalog, "Failed to read from file \"%s\".", catalog->file_name);
+      fclose (fp);
+      mem_free (buf);
+      mem_free (sums);
+      crc32c_blocks_free (&blocks);
+      return -1;
+    }
+
+  if (fclose (fp) != 0)
+    {
+      mem_free (buf);
+      mem_free (sums);
+      crc32c_blocks_free (&blocks);
+      return fail (catalog, "Failed to close file \"%s\".", catalog->file_name);
+    }
+
+  mem_free (buf);
+
+  if (has_sums > 0 && crc32c_blocks_end (&blocks) == 0
+      && (i = first_bad_block (&blocks, sums, num_sums)) >= 0)
+    catalog->damaged_offset = (long long) i * blocks.block_size;
+  mem_free (sums);
+  crc32c_blocks_free (&blocks);
+
+  for (f = 0; f < MAX_NUM_FIELDS; f++)
+    {
+      if (column_seal (&catalog->columns[f], &remap) != 0)
+        return fail (catalog, "Failed to allocate memory for book fields.");
+      if (remap != NULL)
+        {
+          for (i = 0; i < catalog->num_books; i++)
+            catalog->books[i].fields[f] = remap[catalog->books[i].fields[f]];
+          mem_free (remap);
+        }
+    }
+
+  stamp_file (catalog, catalog->file_stamp);
+  return 0;
+}
+
+/* Function: catalog_open
+ * ----------------------
+ * Open a catalog.
+ *
+ * The patrons are read first, so that every borrower in the catalog
+ * keeps the id they were first given.
+ *
+ * file_name: The catalog file. It is created, empty, if it does not exist.
+ * patron_file_name: The patron file, or NULL to keep patrons only
+ *                   in memory.  A missing patron file holds no patrons.
+ * error: Receives the message of the error, if the catalog cannot be opened.
+ * error_len: The size of error.
+ *
+ * returns: The catalog, to be released with `catalog_close`,
+ *          or NULL on error.
+ */
+Catalog *
+catalog_open (const char *file_name,
+              const char *patron_file_name,
+              char       *error,
+              size_t      error_len)
+{
+  Catalog *catalog;
+  int f;
+
+  catalog = (Catalog *) mem_calloc (MEM_RECORDS, 1, sizeof (Catalog));
+  if (catalog == NULL)
+    {
+      snprintf (error, error_len, "Failed to allocate memory.");
+      return NULL;
+    }
+
+  snprintf (catalog->file_name, sizeof (catalog->file_name), "%s", file_name);
+  snprintf (catalog->patron_file_name, sizeof (catalog->patron_file_name), "%s",
+            patron_file_name != NULL ? patron_file_name : "");
+  for (f = 0; f < MAX_NUM_FIELDS; f++)
+    column_init (&catalog->columns[f], f == FIELD_TITLE);
+  patron_init (&catalog->patrons);
+
+  catalog->watch_fd = -1;
+
+  if (grow_books (catalog, INITIAL_MAX_BOOKS) != 0
+      || load_patrons (catalog) != 0 || load_books (catalog) != 0)
+    {
+      snprintf (error, error_len, "%s", catalog->error);
+      catalog_close (catalog);
+      return NULL;
+    }
+
+  return catalog;
+}
+
+/* Function: catalog_close
+ * -----------------------
+ * Release a catalog without saving it.
+ */
+void
+catalog_close (Catalog *catalog)
+{
+  int f;
+
+  if (catalog == NULL)
+    return;
+
+  if (catalog->watch_fd >= 0)
+    close (catalog->watch_fd);
+  mem_free (catalog->books);
+  mem_free (catalog->row_hashes);
+  mem_free (catalog->row_changed);
+  mem_free (catalog->deleted_hashes);
+  mem_free (catalog->accession_heads);
+  mem_free (catalog->accession_next);
+  patron_free (&catalog->patrons);
+  for (f = 0; f < MAX_NUM_FIELDS; f++)
+    column_free (&catalog->columns[f]);
+  mem_free (catalog);
+}
+
+/* Function: format_book
+ * ---------------------
+ * Format a book as a line of the catalog file, as `catalog_format` does.
+ *
+ * book: The book, in the catalog's books array.
+ * titles: Every title indexed by code, from `column_decode`,
+ *         or NULL to decode the title of the book alone.
+ * record: The buffer to format into.  A line longer than the buffer
+ *         is truncated.
+ * size: The size of the buffer, at least 1.
+ *
+ * returns: The length of the line.
+ */
+static int
+format_book (Catalog     *catalog,
+             const Book  *book,
+             const char **titles,
+             char        *record,
+             size_t       size)
+{
+  const char *value;
+  size_t len, n;
+  int f;
+
+  len = 0;
+  for (f = 0; f < MAX_NUM_FIELDS; f++)
+    {
+      if (f > 0 && len < size - 1)
+        record[len++] = ',';
+      if (f == FIELD_TITLE && titles != NULL)
+        value = titles[book->fields[f]];
+      else
+        value = catalog_get (catalog, book, f);
+      n = strlen (value);
+      if (n > size - 1 - len)
+        n = size - 1 - len;
+      memcpy (record + len, value, n);
+      len += n;
+    }
+  record[len] = '\0';
+
+  return (int) len;
+}
+
+/* Function: catalog_format
+ * ------------------------
+ * Format a book as a line of the catalog file, without the newline.
+ *
+ * book: The book, in the catalog's books array.
+ * record: The buffer to format into.  A line longer than the buffer
+ *         is truncated.
+ * size: The size of the buffer, at least 1.
+ *
+ * returns: The length of the line.
+ */
+int
+catalog_format (Catalog    *catalog,
+                const Book *book,
+                char       *record,
+                size_t      size)
+{
+  return format_book (catalog, book, NULL, record, size);
+}
+
+/* Function: save
+ * --------------
+ * Write the books, their checksums and the patrons, as `catalog_save`
+ * and `catalog_sync` do.
+ *
+ * sync: Whether to wait until the files are on disk.
+ *
+ * returns: 0 on success, or -1 if a file could not be written.
+ */
+static int
+save (Catalog *catalog,
+      int      sync)
+{
+  FILE *fp;
+  char *buf;
+  char record[MAX_LINE_LEN + 1];
+  char tmp_name[TMP_NAME_LEN];
+  char *title_heap;
+  const char **titles;
+  Crc32cBlocks blocks;
+  int status, i, len;
+
+  fp = open_output (catalog, catalog->file_name, sync, tmp_name);
+  if (fp == NULL)
+    return -1;
+
+  buf = (char *) mem_alloc (MEM_BUFFERS, IO_BUF_LEN);
+  if (buf != NULL)
+    setvbuf (fp, buf, _IOFBF, IO_BUF_LEN);
+
+  crc32c_blocks_init (&blocks, CATALOG_BLOCK_SIZE);
+  len = fprintf (fp, "%s\n", CATALOG_HEADER);
+  if (len > 0)
+    catalog->bytes_written += len;
+  crc32c_blocks_add (&blocks, CATALOG_HEADER "\n", sizeof (CATALOG_HEADER));
+
+  phase (catalog, "format_output", 1);
+  /* Decoding the titles one by one would restart at a block head for
+     each book; without memory for all of them, fall back to that. */
+  titles = column_decode (&catalog->columns[FIELD_TITLE], &title_heap);
+  for (i = 0; i < catalog->num_books; i++)
+    {
+      len = format_book (catalog, &catalog->books[i], titles, record, sizeof (record) - 1);
+      catalog->row_hashes[i] = hash_line (record, len);
+      catalog->row_changed[i] = 0;
+      record[len++] = '\n';
+      catalog->bytes_written += fwrite (record, 1, len, fp);
+      crc32c_blocks_add (&blocks, record, len);
+    }
+  if (titles != NULL)
+    {
+      mem_free (titles);
+      mem_free (title_heap);
+    }
+  catalog->records_scanned += catalog->num_books;
+  phase (catalog, "format_output", 0);
+
+  phase (catalog, "flush", 1);
+  status = close_output (catalog, fp, catalog->file_name, sync, tmp_name);
+  phase (catalog, "flush", 0);
+  if (status != 0)
+    {
+      mem_free (buf);
+      crc32c_blocks_free (&blocks);
+      return -1;
+    }
+  mem_free (buf);
+  catalog->num_deleted = 0;
+  stamp_file (catalog, catalog->file_stamp);
+
+  if (crc32c_blocks_end (&blocks) != 0)
+    {
+      crc32c_blocks_free (&blocks);
+      return fail (catalog, "Failed to allocate memory for checksums.");
+    }
+  if (write_sums (catalog, &blocks, sync) != 0)
+    {
+      crc32c_blocks_free (&blocks);
+      return -1;
+    }
+  crc32c_blocks_free (&blocks);
+  catalog->damaged_offset = -1;
+
+  if (save_patrons (catalog, sync) != 0)
+    return -1;
+
+  return sync ? sync_dir (catalog) : 0;
+}
+
+/* Function: catalog_save
+ * ----------------------
+ * Write the books to the catalog file in CSV format, with the checksum
+ * of each CATALOG_BLOCK_SIZE bytes to its checksum file,
+ * then the patrons to the patron file.
+ *
+ * Every book is then taken to match its line in the file,
+ * as if the file had just been read.
+ *
+ * returns: 0 on success, or -1 if a file could not be written.
+ */
+int
+catalog_save (Catalog *catalog)
+{
+  return save (catalog, 0);
+}
+
+/* Function: catalog_sync
+ * ----------------------
+ * Save the catalog as `catalog_save` does, and wait until its files
+ * are on disk.
+ *
+ * Each file is written under a name ending in CATALOG_TMP_SUFFIX and
+ * renamed over the old file once it is on disk, so if the system
+ * crashes, each file holds either what it held before or what it
+ * holds after.
+ *
+ * returns: 0 on success, or -1 if a file could not be written.
+ */
+int
+catalog_sync (Catalog *catalog)
+{
+  return save (catalog, 1);
+}
+
+/* Function: catalog_error
+ * -----------------------
+ * Get the message of the last error.
+ */
+const char *
+catalog_error (const Catalog *catalog)
+{
+  return catalog->error;
+}
+
+/* Function: catalog_size
+ * ----------------------
+ * Get the number of books.
+ */
+int
+catalog_size (const Catalog *catalog)
+{
+  return catalog->num_books;
+}
+
+/* Function: catalog_get
+ * ---------------------
+ * Get the value of a field of a book.
+ *
+ * book: The book, in the catalog's books array or built for `catalog_add`.
+ * field: The field, one of FIELD_*.
+ *
+ * returns: The value of the field.  It stays valid until the same field
+ *          is next read or the catalog is next changed.
+ */
+const char *
+catalog_get (Catalog    *catalog,
+             const Book *book,
+             int         field)
+{
+  return column_get (&catalog->columns[field], book->fields[field], catalog->field_bufs[field]);
+}
+
+/* Function: catalog_set
+ * ---------------------
+ * Set a field of a book, adding the value to the field's column
+ * if no other book holds it yet.
+ *
+ * book: The book, in the catalog's books array or built for `catalog_add`.
+ * field: The field, one of FIELD_*.
+ * value: The new value, at most MAX_FIELD_LEN - 1 characters long.
+ *        A borrower's name also adds the borrower to the patrons.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+int
+catalog_set (Catalog    *catalog,
+             Book       *book,
+             int         field,
+             const char *value)
+{
+  unsigned int code, patron;
+
+  /* Borrowers are recorded under the name their patron was first given,
+   * so differences of case and spacing do not make new patrons. */
+  patron = PATRON_NONE;
+  if (field == FIELD_CHECKED_OUT_BY && value[strspn (value, " \t")] != '\0')
+    {
+      patron = patron_add (&catalog->patrons, value);
+      if (patron == PATRON_NONE)
+        return fail (catalog, "Failed to allocate memory for patrons.");
+      value = patron_name (&catalog->patrons, patron);
+    }
+
+  code = column_put (&catalog->columns[field], value);
+  if (code == COLUMN_NONE)
+    return fail (catalog, "Failed to allocate memory for book fields.");
+
+  if (book >= catalog->books && book < catalog->books + catalog->num_books)
+    {
+      catalog->generation++;
+      catalog->row_changed[book - catalog->books] = 1;
+      if (field == FIELD_ACCESSION_NUM && book->fields[field] != code)
+        catalog->accession_index_valid = 0;
+    }
+
+  book->fields[field] = code;
+  if (field == FIELD_CHECKED_OUT_BY)
+    book->patron = patron;
+  if (field == FIELD_PUBLICATION_YEAR)
+    book->year = catalog_parse_year (value);
+
+  return 0;
+}
+
+/* Function: catalog_index_accessions
+ * ----------------------------------
+ * Build the accession index if it is not up to date.
+ *
+ * The index links the books holding each accession code, starting
+ * from `accession_heads` and following `accession_next`.  Adding a book
+ * links it in; deleting a book or changing an accession number clears
+ * `accession_index_valid`, so the index is built again on next use.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+int
+catalog_index_accessions (Catalog *catalog)
+{
+  unsigned int num, code;
+  int *heads, *next;
+  int i;
+
+  if (catalog->accession_index_valid)
+    return 0;
+
+  num = column_size (&catalog->columns[FIELD_ACCESSION_NUM]);
+  heads = (int *) mem_realloc (MEM_INDEXES, catalog->accession_heads, sizeof (int) * (num ? num : 1));
+  if (heads != NULL)
+    catalog->accession_heads = heads;
+  next = (int *) mem_realloc (MEM_INDEXES, catalog->accession_next, sizeof (int) * (catalog->num_books ? catalog->num_books : 1));
+  if (next != NULL)
+    catalog->accession_next = next;
+  if (heads == NULL || next == NULL)
+    return fail (catalog, "Failed to allocate memory for the accession index.");
+  catalog->num_accession_heads = num;
+
+  for (code = 0; code < num; code++)
+    heads[code] = -1;
+
+  /* Linking from the back leaves every chain in the order of the books array. */
+  for (i = catalog->num_books - 1; i >= 0; i--)
+    {
+      code = catalog->books[i].fields[FIELD_ACCESSION_NUM];
+      next[i] = heads[code];
+      heads[code] = i;
+    }
+  catalog->records_scanned += catalog->num_books;
+
+  catalog->accession_index_valid = 1;
+  return 0;
+}
+
+/* Function: link_accession
+ * ------------------------
+ * Add the last book of the books array to the accession index,
+ * if it is built.
+ *
+ * If memory runs out, the index is built again on the next lookup.
+ *
+ * i: The position of the book, which must be after every indexed book.
+ */
+static void
+link_accession (Catalog *catalog,
+                int      i)
+{
+  unsigned int num, code;
+  int *heads, *next, *link;
+
+  if (!catalog->accession_index_valid)
+    return;
+
+  code = catalog->books[i].fields[FIELD_ACCESSION_NUM];
+  if (code >= catalog->num_accession_heads)
+    {
+      num = column_size (&catalog->columns[FIELD_ACCESSION_NUM]);
+      heads = (int *) mem_realloc (MEM_INDEXES, catalog->accession_heads, sizeof (int) * num);
+      if (heads == NULL)
+        {
+          catalog->accession_index_valid = 0;
+          return;
+        }
+      for (; catalog->num_accession_heads < num; catalog->num_accession_heads++)
+        heads[catalog->num_accession_heads] = -1;
+      catalog->accession_heads = heads;
+    }
+
+  next = (int *) mem_realloc (MEM_INDEXES, catalog->accession_next, sizeof (int) * (i + 1));
+  if (next == NULL)
+    {
+      catalog->accession_index_valid = 0;
+      return;
+    }
+  catalog->accession_next = next;
+
+  next[i] = -1;
+  for (link = &catalog->accession_heads[code]; *link != -1; link = &next[*link]) {}
+  *link = i;
+}
+
+/* Function: catalog_add
+ * ---------------------
+ * Add a book at the end of the books array,
+ * growing the array if it is full.
+ *
+ * book: The book, with every field set by `catalog_set`.
+ *
+ * returns: The position of the book, or -1 if memory could not be allocated.
+ */
+int
+catalog_add (Catalog    *catalog,
+             const Book *book)
+{
+  if (catalog->num_books >= catalog->max_books
+      && grow_books (catalog, catalog->max_books + ADD_MAX_BOOKS) != 0)
+    return -1;
+
+  catalog->books[catalog->num_books] = *book;
+  catalog->row_hashes[catalog->num_books] = 0;
+  catalog->row_changed[catalog->num_books] = 1;
+  link_accession (catalog, catalog->num_books);
+  catalog->generation++;
+
+  return catalog->num_books++;
+}
+
+/* Function: catalog_delete
+ * ------------------------
+ * Delete a book, shifting the books after it one position to the left.
+ *
+ * i: The position of the book.
+ *
+ * returns: 0 on success, or -1 if there is no such book
+ *          or memory could not be allocated.
+ */
+int
+catalog_delete (Catalog *catalog,
+                int      i)
+{
+  unsigned long long *hashes;
+  size_t n;
+
+  if (i < 0 || i >= catalog->num_books)
+    return fail (catalog, "Book not found.");
+
+  /* The line of the book is remembered, so that a reload
+   * does not bring back a book deleted since the last save. */
+  if (catalog->row_hashes[i] != 0)
+    {
+      if (catalog->num_deleted >= catalog->max_deleted)
+        {
+          n = catalog->max_deleted ? catalog->max_deleted * 2 : 16;
+          hashes = (unsigned long long *) mem_realloc (MEM_INDEXES, catalog->deleted_hashes, sizeof (unsigned long long) * n);
+          if (hashes == NULL)
+            return fail (catalog, "Failed to allocate memory.");
+          catalog->deleted_hashes = hashes;
+          catalog->max_deleted = n;
+        }
+      catalog->deleted_hashes[catalog->num_deleted++] = catalog->row_hashes[i];
+    }
+
+  n = catalog->num_books - i - 1;
+  memmove (&catalog->books[i], &catalog->books[i + 1], sizeof (Book) * n);
+  memmove (&catalog->row_hashes[i], &catalog->row_hashes[i + 1], sizeof (unsigned long long) * n);
+  memmove (&catalog->row_changed[i], &catalog->row_changed[i + 1], n);
+  catalog->num_books--;
+  catalog->accession_index_valid = 0;
+  catalog->generation++;
+
+  return 0;
+}
+
+/* Function: catalog_put
+ * ---------------------
+ * Replace a book with a copy changed through `catalog_set`.
+ *
+ * i: The position of the book.
+ * book: The new book.
+ *
+ * returns: 0 on success, or -1 if there is no such book.
+ */
+int
+catalog_put (Catalog    *catalog,
+             int         i,
+             const Book *book)
+{
+  if (i < 0 || i >= catalog->num_books)
+    return fail (catalog, "Book not found.");
+
+  if (book->fields[FIELD_ACCESSION_NUM] != catalog->books[i].fields[FIELD_ACCESSION_NUM])
+    catalog->accession_index_valid = 0;
+  catalog->books[i] = *book;
+  catalog->row_changed[i] = 1;
+  catalog->generation++;
+
+  return 0;
+}
+
+/* Function: catalog_find_accession
+ * --------------------------------
+ * Find the book with a given accession number.
+ *
+ * Looks the number up in the accession index, which is built on
+ * first use.  If memory for the index runs out, every book is read.
+ *
+ * accession_num: The accession number.
+ *
+ * returns: The position of the first book with that accession number,
+ *          or -1 if there is none.
+ */
+int
+catalog_find_accession (Catalog    *catalog,
+                        const char *accession_num)
+{
+  unsigned int code;
+  int i;
+
+  code = column_lookup (&catalog->columns[FIELD_ACCESSION_NUM], accession_num);
+  if (code == COLUMN_NONE)
+    return -1;
+
+  if (catalog_index_accessions (catalog) == 0)
+    {
+      i = code < catalog->num_accession_heads ? catalog->accession_heads[code] : -1;
+      catalog->records_scanned += i >= 0;
+      return i;
+    }
+
+  for (i = 0; i < catalog->num_books; i++)
+    {
+      if (catalog->books[i].fields[FIELD_ACCESSION_NUM] == code)
+        break;
+    }
+  catalog->records_scanned += i < catalog->num_books ? i + 1 : catalog->num_books;
+
+  return i < catalog->num_books ? i : -1;
+}
+
+/* Function: catalog_find
+ * ----------------------
+ * Start a search for the books whose field matches a value,
+ * ignoring case.
+ *
+ * field: The field, one of FIELD_*.
+ * value: The value.
+ * iter: Receives the position of the search.
+ *       It must be released with `catalog_find_end`.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+int
+catalog_find (Catalog     *catalog,
+              int          field,
+              const char  *value,
+              CatalogIter *iter)
+{
+  iter->catalog = catalog;
+  iter->field = field;
+  iter->next = 0;
+  iter->codes = column_match (&catalog->columns[field], value, &iter->num_codes);
+  if (iter->codes == NULL)
+    return fail (catalog, "Failed to allocate memory for search.");
+
+  /* No book can match a value that is not in the column. */
+  if (iter->num_codes == 0)
+    iter->next = catalog->num_books;
+
+  return 0;
+}
+
+/* Function: catalog_next
+ * ----------------------
+ * Get the next book of a search.
+ *
+ * returns: The position of the book, or -1 if there are no more.
+ */
+int
+catalog_next (CatalogIter *iter)
+{
+  Catalog *catalog = iter->catalog;
+  unsigned int code;
+  size_t j;
+  int i;
+
+  for (i = iter->next; i < catalog->num_books; i++)
+    {
+      code = catalog->books[i].fields[iter->field];
+      for (j = 0; j < iter->num_codes && iter->codes[j] != code; j++) {}
+      if (j < iter->num_codes)
+        break;
+    }
+  catalog->records_scanned += i - iter->next;
+  if (i < catalog->num_books)
+    catalog->records_scanned++;
+
+  iter->next = i < catalog->num_books ? i + 1 : i;
+  return i < catalog->num_books ? i : -1;
+}
+
+/* Function: catalog_find_end
+ * --------------------------
+ * Release a search.
+ */
+void
+catalog_find_end (CatalogIter *iter)
+{
+  mem_free (iter->codes);
+  iter->codes = NULL;
+}
+
+/* Function: catalog_borrow
+ * ------------------------
+ * Check out a book.
+ *
+ * i: The position of the book.
+ * borrower: The name of the borrower.  A new name adds a patron.
+ * date: The date the book is checked out.
+ *
+ * returns: 0 on success, or -1 if the book is already checked out,
+ *          the name is blank or memory could not be allocated.
+ */
+int
+catalog_borrow (Catalog    *catalog,
+                int         i,
+                const char *borrower,
+                const char *date)
+{
+  Book *book = &catalog->books[i];
+
+  if (strcmp (catalog_get (catalog, book, FIELD_CHECKED_OUT_BY), ""))
+    return fail (catalog, "Book is already checked out.");
+  if (borrower[strspn (borrower, " \t")] == '\0')
+    return fail (catalog, "Invalid name.");
+
+  if (catalog_set (catalog, book, FIELD_CHECKED_OUT_BY, borrower) != 0
+      || catalog_set (catalog, book, FIELD_CHECKED_OUT_DATE, date) != 0)
+    return -1;
+
+  return 0;
+}
+
+/* Function: catalog_return
+ * ------------------------
+ * Return a book, clearing its borrower and recording the return date.
+ *
+ * i: The position of the book.
+ * date: The date the book is returned.
+ *
+ * returns: 0 on success, or -1 if the book is not checked out
+ *          or memory could not be allocated.
+ */
+int
+catalog_return (Catalog    *catalog,
+                int         i,
+                const char *date)
+{
+  Book *book = &catalog->books[i];
+
+  if (!strcmp (catalog_get (catalog, book, FIELD_CHECKED_OUT_BY), ""))
+    return fail (catalog, "Book was already returned.");
+
+  if (catalog_set (catalog, book, FIELD_RETURN_DATE, date) != 0
+      || catalog_set (catalog, book, FIELD_CHECKED_OUT_BY, "") != 0
+      || catalog_set (catalog, book, FIELD_CHECKED_OUT_DATE, "") != 0)
+    return -1;
+
+  return 0;
+}
+
+/* Function: catalog_page_key
+ * --------------------------
+ * Get the key of a book in a paged catalog: its accession number
+ * in lower case, so that lookups ignore case as `catalog_find` does.
+ *
+ * key: Receives the key.  It must hold MAX_FIELD_LEN characters.
+ */
+void
+catalog_page_key (const char *accession_num,
+                  char       *key)
+{
+  int i;
+
+  for (i = 0; accession_num[i] != '\0' && i < MAX_FIELD_LEN - 1; i++)
+    key[i] = tolower ((unsigned char) accession_num[i]);
+  key[i] = '\0';
+}
+
+/* Function: catalog_split_record
+ * ------------------------------
+ * Split a record of a paged catalog into its fields, in place.
+ *
+ * record: The record, a line of the catalog file without its newline.
+ * fields: Receives the fields, indexed by FIELD_*.
+ *         Missing fields are empty.
+ */
+void
+catalog_split_record (char *record,
+                      char *fields[MAX_NUM_FIELDS])
+{
+  char *cursor = record;
+  char *field;
+  int f;
+
+  for (f = 0; f < MAX_NUM_FIELDS; f++)
+    {
+      field = next_field (&cursor);
+      fields[f] = field != NULL ? field : "";
+    }
+}
+
+/* Function: catalog_write_pages
+ * -----------------------------
+ * Write the books to a paged catalog: a B+tree keyed by accession
+ * number whose records are the lines of the catalog file.
+ * Books that share an accession number keep their catalog order.
+ *
+ * file_name: The file, which is replaced.
+ *
+ * returns: 0 on success, or -1 if the file could not be written.
+ */
+int
+catalog_write_pages (Catalog    *catalog,
+                     const char *file_name)
+{
+  BTree tree;
+  char record[MAX_LINE_LEN];
+  char key[MAX_FIELD_LEN];
+  int i, len, status;
+
+  if (btree_open (&tree, file_name, BTREE_CREATE, CATALOG_PAGE_FRAMES) != 0)
+    return fail (catalog, "Failed to open file \"%s\" for writing.", file_name);
+
+  status = 0;
+  for (i = 0; i < catalog->num_books && status == 0; i++)
+    {
+      const Book *book = &catalog->books[i];
+
+      len = catalog_format (catalog, book, record, sizeof (record));
+      catalog_page_key (catalog_get (catalog, book, FIELD_ACCESSION_NUM), key);
+      status = btree_insert (&tree, key, record, len);
+    }
+  catalog->records_scanned += i;
+
+  if (btree_close (&tree) != 0)
+    status = -1;
+  catalog->bytes_written += tree.bytes_written;
+  if (status != 0)
+    return fail (catalog, "Failed to write to file \"%s\".", file_name);
+
+  return 0;
+}
+
+/* Function: clean_marc
+ * --------------------
+ * Make a value taken from a MARC record fit a field of the catalog file:
+ * control characters become spaces, commas are dropped because they
+ * separate the fields, runs of spaces are collapsed, and a multibyte
+ * character cut short by truncation is removed.
+ */
+static void
+clean_marc (char *s)
+{
+  unsigned char *in, *out, *start;
+  int n;
+
+  start = out = (unsigned char *) s;
+  for (in = start; *in != '\0'; in++)
+    {
+      if (*in == ',')
+        continue;
+      if (*in < 0x20 || *in == ' ')
+        {
+          if (out > start && out[-1] != ' ')
+            *out++ = ' ';
+          continue;
+        }
+      *out++ = *in;
+    }
+  while (out > start && out[-1] == ' ')
+    out--;
+
+  /* Find the start of the last character and how long it should be. */
+  for (in = out; in > start && (in[-1] & 0xc0) == 0x80; in--) {}
+  if (in > start && in[-1] >= 0xc0)
+    {
+      in--;
+      n = *in >= 0xf0 ? 4 : *in >= 0xe0 ? 3 : 2;
+      if (out - in < n)
+        out = in;
+    }
+  *out = '\0';
+}
+
+/* Function: trim_marc
+ * -------------------
+ * Strip the spaces and punctuation that end the parts of a MARC field,
+ * as in "The great Gatsby /" or "Scribner,".  A final period is kept
+ * after an initial or a short abbreviation, as in "J.R.R." or "Co.".
+ */
+static void
+trim_marc (char *s)
+{
+  size_t len, word;
+
+  len = strlen (s);
+  for (;;)
+    {
+      while (len > 0 && strchr (" /:;=,", s[len - 1]) != NULL)
+        len--;
+      if (len == 0 || s[len - 1] != '.')
+        break;
+      for (word = len - 1; word > 0 && s[word - 1] != ' '; word--) {}
+      if (len - word <= 4 || (len > 1 && isupper ((unsigned char) s[len - 2])))
+        break;
+      len--;
+    }
+  s[len] = '\0';
+}
+
+/* Function: find_year
+ * -------------------
+ * Find the first run of four digits in a MARC date, as in "c1925." or "[1960]".
+ *
+ * returns: 0 if a year was found and copied into year, or -1 if not.
+ */
+static int
+find_year (const char *s,
+           char       *year)
+{
+  size_t n;
+
+  for (; *s != '\0'; s += n > 0 ? n : 1)
+    {
+      n = strspn (s, "0123456789");
+      if (n == 4)
+        {
+          memcpy (year, s, 4);
+          year[4] = '\0';
+          return 0;
+        }
+    }
+  return -1;
+}
+
+/* Function: catalog_read_marc
+ * ---------------------------
+ * Build a book from the current record of a MARC 21 file.
+ *
+ * The title is taken from field 245, the author from 100, 110 or 111,
+ * the publisher from 264 or 260, the year from 008 or else the date of
+ * publication, the ISBN from 020 and the genre from 655 or else the first
+ * subject in 650.  A personal name entered surname first, as in
+ * "Fitzgerald, F. Scott,", is turned around to match the catalog.
+ * A field the record lacks is left empty.  The book is not checked out.
+ *
+ * reader: The file, positioned on a record by `marc_next`.
+ * book: The book to build.  Every field but the accession number is set,
+ *       which the caller assigns before `catalog_add`.
+ *
+ * returns: 0 on success, 1 if the record has no title,
+ *          or -1 if memory could not be allocated.
+ */
+int
+catalog_read_marc (Catalog          *catalog,
+                   const MarcReader *reader,
+                   Book             *book)
+{
+  char values[MAX_NUM_FIELDS][MAX_FIELD_LEN];
+  char name[MAX_FIELD_LEN];
+  MarcField field;
+  const char *rest;
+  int f, i, found;
+
+  memset (values, 0, sizeof (values));
+
+  if (marc_field (reader, "245", 0, &field) == 0 && field.len >= 2)
+    marc_subfields (&field, "ab", values[FIELD_TITLE], MAX_FIELD_LEN);
+
+  if ((marc_field (reader, "100", 0, &field) == 0
+       || marc_field (reader, "110", 0, &field) == 0
+       || marc_field (reader, "111", 0, &field) == 0)
+      && field.len >= 2)
+    {
+      marc_subfields (&field, "a", name, MAX_FIELD_LEN);
+      trim_marc (name);
+      rest = strchr (name, ',');
+      if (!strcmp (field.tag, "100") && field.data[0] == '1' && rest != NULL)
+        snprintf (values[FIELD_AUTHOR], MAX_FIELD_LEN, "%s %.*s",
+                  rest + strspn (rest, ", "), (int) (rest - name), name);
+      else
+        strcpy (values[FIELD_AUTHOR], name);
+    }
+
+  /* Field 264 also records production, distribution and manufacture;
+   * only a second indicator of 1 names the publisher. */
+  found = 0;
+  for (i = 0; !found && marc_field (reader, "264", i, &field) == 0; i++)
+    found = field.len >= 2 && field.data[1] == '1';
+  if (!found)
+    found = marc_field (reader, "260", 0, &field) == 0 && field.len >= 2;
+  if (found)
+    {
+      marc_subfields (&field, "b", values[FIELD_PUBLISHER], MAX_FIELD_LEN);
+      marc_subfields (&field, "c", name, MAX_FIELD_LEN);
+      find_year (name, values[FIELD_PUBLICATION_YEAR]);
+    }
+
+  /* Date 1 of the fixed-length data elements is the better source. */
+  if (marc_field (reader, "008", 0, &field) == 0 && field.len >= 11
+      && strspn ((const char *) field.data + 7, "0123456789") >= 4)
+    {
+      memcpy (values[FIELD_PUBLICATION_YEAR], field.data + 7, 4);
+      values[FIELD_PUBLICATION_YEAR][4] = '\0';
+    }
+
+  for (i = 0; marc_field (reader, "020", i, &field) == 0; i++)
+    if (field.len >= 2 && marc_subfields (&field, "a", name, MAX_FIELD_LEN) > 0)
+      {
+        name[strcspn (name, " ")] = '\0';
+        strcpy (values[FIELD_ISBN], name);
+        break;
+      }
+
+  if ((marc_field (reader, "655", 0, &field) == 0 || marc_field (reader, "650", 0, &field) == 0)
+      && field.len >= 2)
+    marc_subfields (&field, "a", values[FIELD_GENRE], MAX_FIELD_LEN);
+
+  for (f = 0; f < MAX_NUM_FIELDS; f++)
+    {
+      trim_marc (values[f]);
+      clean_marc (values[f]);
+    }
+  if (values[FIELD_TITLE][0] == '\0')
+    return 1;
+
+  for (f = 0; f < MAX_NUM_FIELDS; f++)
+    if (f != FIELD_ACCESSION_NUM && catalog_set (catalog, book, f, values[f]) != 0)
+      return -1;
+
+  return 0;
+}
+
+/* Function: catalog_watch
+ * -----------------------
+ * Start watching the catalog file for changes made by other programs,
+ * for `catalog_changed` to report.
+ *
+ * The directory of the file is watched rather than the file itself,
+ * so that a file replaced by renaming another over it is still seen.
+ *
+ * returns: 0 on success, or -1 if the file cannot be watched.
+ */
+int
+catalog_watch (Catalog *catalog)
+{
+#ifdef __linux__
+  char dir[MAX_FIELD_LEN];
+  const char *slash;
+  int fd;
+
+  slash = strrchr (catalog->file_name, '/');
+  if (slash == NULL)
+    strcpy (dir, ".");
+  else if (slash == catalog->file_name)
+    strcpy (dir, "/");
+  else
+    snprintf (dir, sizeof (dir), "%.*s", (int) (slash - catalog->file_name), catalog->file_name);
+
+  fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    return fail (catalog, "Failed to watch file \"%s\".", catalog->file_name);
+  if (inotify_add_watch (fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+      close (fd);
+      return fail (catalog, "Failed to watch file \"%s\".", catalog->file_name);
+    }
+
+  if (catalog->watch_fd >= 0)
+    close (catalog->watch_fd);
+  catalog->watch_fd = fd;
+  return 0;
+#else
+  return fail (catalog, "Watching files is not supported on this system.");
+#endif
+}
+
+/* Function: catalog_changed
+ * -------------------------
+ * Tell whether the catalog file was written by another program
+ * since it was last read or saved, without waiting.
+ *
+ * Writes by this catalog are told apart by the inode, size and
+ * modification time of the file, which are recorded on every save.
+ *
+ * returns: 1 if the file was changed, or 0 if it was not,
+ *          is not watched or cannot be read just now.
+ */
+int
+catalog_changed (Catalog *catalog)
+{
+#ifdef __linux__
+  char buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  const struct inotify_event *event;
+  const char *base, *slash;
+  unsigned long long stamp[3];
+  ssize_t len;
+  char *p;
+  int seen;
+
+  if (catalog->watch_fd < 0)
+    return 0;
+
+  slash = strrchr (catalog->file_name, '/');
+  base = slash != NULL ? slash + 1 : catalog->file_name;
+
+  seen = 0;
+  while ((len = read (catalog->watch_fd, buf, sizeof (buf))) > 0)
+    for (p = buf; p < buf + len; p += sizeof (struct inotify_event) + event->len)
+      {
+        event = (const struct inotify_event *) p;
+        if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && !strcmp (event->name, base)))
+          seen = 1;
+      }
+
+  if (!seen || stamp_file (catalog, stamp) != 0)
+    return 0;
+
+  return memcmp (stamp, catalog->file_stamp, sizeof (stamp)) != 0;
+#else
+  (void) catalog;
+  return 0;
+#endif
+}
+
+/* Function: grow_reload
+ * ---------------------
+ * Double the arrays `catalog_reload` builds the new books in.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+static int
+grow_reload (Catalog             *catalog,
+             Book               **books,
+             unsigned long long **hashes,
+             unsigned char      **changed,
+             size_t              *max_books)
+{
+  void *p;
+
+  if ((p = mem_realloc (MEM_RECORDS, *books, sizeof (Book) * *max_books * 2)) == NULL)
+    return fail (catalog, "Failed to allocate additional memory for books.");
+  *books = (Book *) p;
+  if ((p = mem_realloc (MEM_INDEXES, *hashes, sizeof (unsigned long long) * *max_books * 2)) == NULL)
+    return fail (catalog, "Failed to allocate additional memory for books.");
+  *hashes = (unsigned long long *) p;
+  if ((p = mem_realloc (MEM_INDEXES, *changed, *max_books * 2)) == NULL)
+    return fail (catalog, "Failed to allocate additional memory for books.");
+  *changed = (unsigned char *) p;
+
+  *max_books *= 2;
+  return 0;
+}
+
+/* Function: catalog_reload
+ * ------------------------
+ * Read the catalog file again, keeping the books whose lines
+ * have not changed.
+ *
+ * Every line is hashed and looked up among the hashes of the lines
+ * the books were read from or saved as.  A book whose line is found
+ * is kept as it is, changes made here since the last save included,
+ * and only the other lines are parsed into books.  A book changed
+ * here whose line was changed in the file too takes the file's line.  A line that
+ * matches a book deleted here since the last save is skipped, and
+ * books added here since then are kept after those of the file.
+ * The accession index is rebuilt if it was built.
+ *
+ * reload: Receives what changed, to be released with `catalog_reload_end`.
+ *
+ * returns: 0 on success, or -1 on error, leaving the books unchanged.
+ */
+int
+catalog_reload (Catalog       *catalog,
+                CatalogReload *reload)
+{
+  FILE *fp;
+  char line[MAX_LINE_LEN];
+  char record[MAX_LINE_LEN];
+  char *buf;
+  unsigned long long hash;
+  unsigned long long *hashes, *entry_hashes;
+  unsigned char *changed, *kept;
+  int *heads, *next, *link, *rows, *entry_books;
+  Book *books;
+  size_t num_entries, num_heads, max_books, max_rows, h;
+  void *p;
+  int b, e, i, n, m, k, status;
+
+  memset (reload, 0, sizeof (*reload));
+  catalog->generation++;
+
+  fp = fopen (catalog->file_name, "r");
+  if (fp == NULL)
+    return fail (catalog, "Failed to open file \"%s\" for reading.", catalog->file_name);
+
+  buf = (char *) mem_alloc (MEM_BUFFERS, IO_BUF_LEN);
+  if (buf != NULL)
+    setvbuf (fp, buf, _IOFBF, IO_BUF_LEN);
+
+  n = catalog->num_books;
+  num_entries = n + catalog->num_deleted;
+  for (i = 0; i < n; i++)
+    num_entries += catalog->row_changed[i];
+  for (num_heads = 1; num_heads < 2 * num_entries; num_heads *= 2) {}
+
+  max_books = catalog->max_books;
+  max_rows = 16;
+  heads = (int *) mem_alloc (MEM_INDEXES, sizeof (int) * num_heads);
+  next = (int *) mem_alloc (MEM_INDEXES, sizeof (int) * (num_entries ? num_entries : 1));
+  entry_hashes = (unsigned long long *) mem_alloc (MEM_INDEXES, sizeof (unsigned long long) * (num_entries ? num_entries : 1));
+  entry_books = (int *) mem_alloc (MEM_INDEXES, sizeof (int) * (num_entries ? num_entries : 1));
+  kept = (unsigned char *) mem_calloc (MEM_INDEXES, n ? n : 1, 1);
+  books = (Book *) mem_alloc (MEM_RECORDS, sizeof (Book) * max_books);
+  hashes = (unsigned long long *) mem_alloc (MEM_INDEXES, sizeof (unsigned long long) * max_books);
+  changed = (unsigned char *) mem_alloc (MEM_INDEXES, max_books);
+  rows = (int *) mem_alloc (MEM_INDEXES, sizeof (int) * max_rows);
+  status = -1;
+  if (heads == NULL || next == NULL || entry_hashes == NULL || entry_books == NULL
+      || kept == NULL || books == NULL || hashes == NULL || changed == NULL || rows == NULL)
+    {
+      fail (catalog, "Failed to allocate memory.");
+      goto done;
+    }
+
+  if (fgets (line, MAX_LINE_LEN, fp) != NULL)
+    {
+      catalog->bytes_read += strlen (line);
+      if (strcmp (line, CATALOG_HEADER "\n"))
+        {
+          fail (catalog, "Invalid header in file \"%s\". Expected \"%s\" but found \"%.*s\".",
+                catalog->file_name, CATALOG_HEADER, (int) strcspn (line, "\n"), line);
+          goto done;
+        }
+    }
+
+  /* A book is found by the line it was read from or saved as, or,
+   * if it was changed since, by the line it would be saved as now,
+   * so that a file written from this catalog matches it.  The lines
+   * of deleted books come last, so a line that matches a book as well
+   * keeps the book. */
+  e = 0;
+  for (i = 0; i < n; i++, e++)
+    {
+      entry_hashes[e] = catalog->row_hashes[i];
+      entry_books[e] = i;
+    }
+  for (i = 0; i < n; i++)
+    if (catalog->row_changed[i])
+      {
+        entry_hashes[e] = hash_line (record, catalog_format (catalog, &catalog->books[i], record, sizeof (record)));
+        entry_books[e++] = i;
+      }
+  for (h = 0; h < catalog->num_deleted; h++, e++)
+    {
+      entry_hashes[e] = catalog->deleted_hashes[h];
+      entry_books[e] = -1;
+    }
+
+  for (h = 0; h < num_heads; h++)
+    heads[h] = -1;
+  for (e = (int) num_entries - 1; e >= 0; e--)
+    if (entry_hashes[e] != 0)
+      {
+        next[e] = heads[entry_hashes[e] & (num_heads - 1)];
+        heads[entry_hashes[e] & (num_heads - 1)] = e;
+      }
+
+  reload->in_place = 1;
+  m = 0;
+  while (fgets (line, MAX_LINE_LEN, fp) != NULL)
+    {
+      catalog->bytes_read += strlen (line);
+      hash = hash_line (line, strcspn (line, "\n"));
+
+      /* A matched entry is unlinked, and the other entry of a book
+       * kept already is passed over, so that each book is kept once. */
+      for (link = &heads[hash & (num_heads - 1)]; (e = *link) != -1; link = &next[e])
+        if (entry_hashes[e] == hash && (entry_books[e] < 0 || !kept[entry_books[e]]))
+          break;
+      b = -1;
+      if (e != -1)
+        {
+          *link = next[e];
+          b = entry_books[e];
+          if (b < 0)
+            continue;
+        }
+
+      if ((size_t) m >= max_books
+          && grow_reload (catalog, &books, &hashes, &changed, &max_books) != 0)
+        goto done;
+
+      hashes[m] = hash;
+      if (b >= 0)
+        {
+          books[m] = catalog->books[b];
+          changed[m] = e < n ? catalog->row_changed[b] : 0;
+          kept[b] = 1;
+          if (b != m)
+            reload->in_place = 0;
+          reload->num_kept++;
+        }
+      else
+        {
+          if (parse_book (catalog, line, &books[m]) != 0)
+            goto done;
+          changed[m] = 0;
+          if ((size_t) reload->num_added >= max_rows)
+            {
+              if ((p = mem_realloc (MEM_INDEXES, rows, sizeof (int) * max_rows * 2)) == NULL)
+                {
+                  fail (catalog, "Failed to allocate memory.");
+                  goto done;
+                }
+              rows = (int *) p;
+              max_rows *= 2;
+            }
+          rows[reload->num_added++] = m;
+        }
+      m++;
+    }
+
+  if (ferror (fp))
+    {
+      fail (catalog, "Failed to read from file \"%s\".", catalog->file_name);
+      goto done;
+    }
+
+  /* Books never saved have no line to find, so they are kept after the
+   * others.  A changed book whose line has gone was changed on both sides,
+   * and the version in the file wins. */
+  for (i = 0; i < n; i++)
+    {
+      if (kept[i])
+        continue;
+      if (catalog->row_hashes[i] != 0)
+        {
+          reload->num_removed++;
+          if (catalog->row_changed[i])
+            reload->num_conflicts++;
+          continue;
+        }
+
+      if ((size_t) m >= max_books
+          && grow_reload (catalog, &books, &hashes, &changed, &max_books) != 0)
+        goto done;
+      books[m] = catalog->books[i];
+      hashes[m] = 0;
+      changed[m] = 1;
+      if (i != m)
+        reload->in_place = 0;
+      m++;
+    }
+  if (m != n)
+    reload->in_place = 0;
+
+  if (reload->in_place && reload->num_added > 0)
+    {
+      reload->old_books = (Book *) mem_alloc (MEM_RECORDS, sizeof (Book) * reload->num_added);
+      if (reload->old_books == NULL)
+        {
+          fail (catalog, "Failed to allocate memory.");
+          goto done;
+        }
+      for (k = 0; k < reload->num_added; k++)
+        reload->old_books[k] = catalog->books[rows[k]];
+    }
+
+  mem_free (catalog->books);
+  mem_free (catalog->row_hashes);
+  mem_free (catalog->row_changed);
+  catalog->books = books;
+  catalog->row_hashes = hashes;
+  catalog->row_changed = changed;
+  catalog->max_books = max_books;
+  catalog->num_books = m;
+  catalog->num_deleted = 0;
+  catalog->records_scanned += m;
+  books = NULL;
+  hashes = NULL;
+  changed = NULL;
+
+  reload->rows = rows;
+  rows = NULL;
+
+  if (catalog->accession_index_valid)
+    {
+      catalog->accession_index_valid = 0;
+      catalog_index_accessions (catalog);
+    }
+  stamp_file (catalog, catalog->file_stamp);
+  status = 0;
+
+done:
+  if (status != 0)
+    {
+      mem_free (reload->old_books);
+      memset (reload, 0, sizeof (*reload));
+    }
+  fclose (fp);
+  mem_free (buf);
+  mem_free (heads);
+  mem_free (next);
+  mem_free (entry_hashes);
+  mem_free (entry_books);
+  mem_free (kept);
+  mem_free (books);
+  mem_free (hashes);
+  mem_free (changed);
+  mem_free (rows);
+  return status;
+}
+
+/* Function: catalog_reload_end
+ * ----------------------------
+ * Release what `catalog_reload` found.
+ */
+void
+catalog_reload_end (CatalogReload *reload)
+{
+  mem_free (reload->rows);
+  mem_free (reload->old_books);
+  memset (reload, 0, sizeof (*reload));
+}
+
+/* Function: catalog_verify
+ * ------------------------
+ * Check the catalog file against its checksum file, block by block.
+ *
+ * The file is read in blocks straight into a buffer and no line is
+ * parsed, so it is checked about as fast as it can be read.  What is
+ * checked is the file as last saved, not the books in memory.
+ *
+ * verify: Receives the result, to be released with `catalog_verify_end`.
+ *
+ * returns: 0 on success, even if blocks do not match,
+ *          or -1 if a file could not be read.
+ */
+int
+catalog_verify (Catalog       *catalog,
+                CatalogVerify *verify)
+{
+  FILE *fp;
+  char *buf;
+  unsigned int *sums;
+  size_t num_sums, len, max_bad, i;
+  size_t *bad;
+  int has_sums, status;
+
+  memset (verify, 0, sizeof (*verify));
+
+  has_sums = read_sums (catalog, &verify->block_size, &verify->saved_size, &sums, &num_sums);
+  if (has_sums <= 0)
+    return has_sums;
+  verify->has_sums = 1;
+
+  fp = fopen (catalog->file_name, "rb");
+  if (fp == NULL)
+    {
+      mem_free (sums);
+      return fail (catalog, "Failed to open file \"%s\" for reading.", catalog->file_name);
+    }
+  buf = (char *) mem_alloc (MEM_BUFFERS, verify->block_size);
+  if (buf == NULL)
+    {
+      fclose (fp);
+      mem_free (sums);
+      return fail (catalog, "Failed to allocate memory.");
+    }
+
+  /* A block past the end of either the file or the checksums does not match. */
+  status = 0;
+  max_bad = 0;
+  for (i = 0; ; i++)
+    {
+      len = fread (buf, 1, verify->block_size, fp);
+      if (len == 0 && i >= num_sums)
+        break;
+      verify->file_size += len;
+      catalog->bytes_read += len;
+
+      if (len == 0 || i >= num_sums || crc32c (0, buf, len) != sums[i])
+        {
+          if (verify->num_bad >= max_bad)
+            {
+              max_bad = max_bad ? max_bad * 2 : 16;
+              bad = (size_t *) mem_realloc (MEM_BUFFERS, verify->bad_blocks, sizeof (size_t) * max_bad);
+              if (bad == NULL)
+                {
+                  status = fail (catalog, "Failed to allocate memory.");
+                  break;
+                }
+              verify->bad_blocks = bad;
+            }
+          verify->bad_blocks[verify->num_bad++] = i;
+        }
+    }
+  verify->num_blocks = i;
+
+  if (status == 0 && ferror (fp))
+    status = fail (catalog, "Failed to read from file \"%s\".", catalog->file_name);
+
+  fclose (fp);
+  mem_free (buf);
+  mem_free (sums);
+  if (status != 0)
+    catalog_verify_end (verify);
+  return status;
+}
+
+/* Function: catalog_verify_end
+ * ----------------------------
+ * Release what `catalog_verify` found.
+ */
+void
+catalog_verify_end (CatalogVerify *verify)
+{
+  mem_free (verify->bad_blocks);
+  memset (verify, 0, sizeof (*verify));
+}
@@ -0,0 +1,226 @@
+/* catalog.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h>
+
+#include "column.h"
+#include "marc.h"
+#include "patron.h"
+
+/* The number of fields of a book. */
+#define MAX_NUM_FIELDS 10
+
+/* The size of a buffer that holds any field, including the terminator. */
+#define MAX_FIELD_LEN 256
+
+/* The longest line of a catalog file, including the newline. */
+#define MAX_LINE_LEN 2560
+
+/* The size of the blocks the checksum file of a catalog file covers. */
+#define CATALOG_BLOCK_SIZE 65536
+
+/* What the name of the checksum file of a catalog file adds to it. */
+#define CATALOG_SUMS_SUFFIX ".crc"
+
+/* What `catalog_sync` adds to the name of a file while writing it. */
+#define CATALOG_TMP_SUFFIX ".tmp"
+
+/* The year of a book whose publication year is not a year. */
+#define YEAR_NONE -1
+
+/* The first line of a catalog file. */
+#define CATALOG_HEADER "Title,Author,Publisher,Publication Year,ISBN,Accession Number,Genre,Checked Out By,Checked Out Date,Return Date"
+
+/* The fields of a book, in the order of the catalog file. */
+enum
+{
+  FIELD_TITLE,            /* The title of the book. */
+  FIELD_AUTHOR,           /* The author of the book. */
+  FIELD_PUBLISHER,        /* The publisher of the book. */
+  FIELD_PUBLICATION_YEAR, /* The year the book was published. */
+  FIELD_ISBN,             /* The International Standard Book Number (ISBN) of the book. */
+  FIELD_ACCESSION_NUM,    /* The accession number of the book. */
+  FIELD_GENRE,            /* The genre of the book. */
+  FIELD_CHECKED_OUT_BY,   /* The name of the borrower who has checked out the book. */
+  FIELD_CHECKED_OUT_DATE, /* The date the book was checked out. */
+  FIELD_RETURN_DATE       /* The date the book is due to be returned. */
+};
+
+/* A struct representing a book in a library.
+ *
+ * Every field is stored as a code into the column of that field,
+ * so a value shared by many books is stored only once. */
+typedef struct
+{
+  unsigned int fields[MAX_NUM_FIELDS]; /* The code of each field, indexed by FIELD_*. */
+  int          year;                   /* The publication year as a number, or YEAR_NONE. */
+  unsigned int patron;                 /* The id of the borrower, or PATRON_NONE. */
+} Book;
+
+/* A function told as each phase of a save begins (begin nonzero) and
+ * ends, so that the caller can trace it. */
+typedef void (*CatalogPhaseFunc) (const char *phase,
+                                  int         begin);
+
+/* A library's collection, loaded from a catalog file.
+ *
+ * A catalog holds its state in itself, so several can be open at once;
+ * only the memory accounting of mem.c is shared.  It never reads from or writes to the terminal: a function that
+ * fails returns -1 and leaves a message for `catalog_error`.  It is not
+ * safe to change a catalog while another thread uses it, and
+ * `catalog_get` decodes into buffers of the catalog, so only one thread
+ * should read values through it at a time.
+ *
+ * The books and columns may be read directly; they are changed only
+ * through the functions below. */
+typedef struct
+{
+  char               file_name[MAX_FIELD_LEN];         /* The catalog file. */
+  char               patron_file_name[MAX_FIELD_LEN];  /* The patron file, or "" for none. */
+  Column             columns[MAX_NUM_FIELDS];          /* The encoded values of each field, indexed by FIELD_*. */
+  char               field_bufs[MAX_NUM_FIELDS][FRONTCODE_MAX_LEN + 1]; /* The buffers `catalog_get` decodes into. */
+  Book              *books;                            /* The books, in the order of the file. */
+  int                num_books;                        /* The number of books. */
+  size_t             max_books;                        /* The capacity of books. */
+  PatronTable        patrons;                          /* The borrowers ever named. */
+  int               *accession_heads;                  /* The first book of each accession code, or -1. */
+  unsigned int       num_accession_heads;              /* The number of accession codes indexed. */
+  int               *accession_next;                   /* The next book with the same accession number, or -1. */
+  int                accession_index_valid;            /* Whether the accession index is up to date. */
+  unsigned long long *row_hashes;                      /* The hash of the line each book was last read from or saved as, or 0 for none. */
+  unsigned char     *row_changed;                      /* Whether each book was changed since it was last read or saved. */
+  unsigned long long *deleted_hashes;                  /* The lines of the books deleted since the last save. */
+  size_t             num_deleted;                      /* The number of deleted lines. */
+  size_t             max_deleted;                      /* The capacity of deleted_hashes. */
+  int                watch_fd;                         /* The descriptor watching the file, or -1. */
+  unsigned long long file_stamp[3];                    /* The inode, size and modification time of the file when last read or saved. */
+  long long          damaged_offset;                   /* The offset of the first block that did not match its checksum when read, or -1. */
+  unsigned long long generation;                       /* Counts the changes to the books, so results found before one can be told apart. */
+  size_t             text_bytes;                       /* The bytes of field text read by `catalog_open`. */
+  unsigned long long records_scanned;                  /* The books read since last cleared. */
+  unsigned long long bytes_read;                       /* The file bytes read since last cleared. */
+  unsigned long long bytes_written;                    /* The file bytes written since last cleared. */
+  CatalogPhaseFunc   on_phase;                         /* Told of the phases of a save, or NULL; set by the caller. */
+  char               error[MAX_LINE_LEN];              /* The message of the last error. */
+} Catalog;
+
+/* What changed in the books when the catalog file was read again. */
+typedef struct
+{
+  int   num_kept;       /* The books whose line was found unchanged. */
+  int   num_added;      /* The lines read as new books, changed lines included. */
+  int   num_removed;    /* The books whose line has gone, changed lines included. */
+  int   num_conflicts;  /* The removed books that had been changed here too. */
+  int   in_place;       /* Whether every other book kept its position. */
+  int  *rows;           /* The positions of the added books. */
+  Book *old_books;      /* If in_place, the book each added book replaced. */
+} CatalogReload;
+
+/* How the catalog file compares with its checksum file. */
+typedef struct
+{
+  int                 has_sums;    /* Whether the file has a checksum file. */
+  size_t              block_size;  /* The size of a block. */
+  unsigned long long  saved_size;  /* The size of the file when it was saved. */
+  unsigned long long  file_size;   /* The size of the file now. */
+  size_t              num_blocks;  /* The number of blocks checked. */
+  size_t             *bad_blocks;  /* The blocks that do not match, in order. */
+  size_t              num_bad;     /* The number of blocks that do not match. */
+} CatalogVerify;
+
+/* The number of pages of the buffer pool `catalog_write_pages` writes through. */
+#define CATALOG_PAGE_FRAMES 256
+
+/* A position in the books matching a value, as read by `catalog_next`. */
+typedef struct
+{
+  Catalog      *catalog;    /* The catalog searched. */
+  int           field;      /* The field compared. */
+  unsigned int *codes;      /* The codes of the values that match. */
+  size_t        num_codes;  /* The number of codes. */
+  int           next;       /* The position of the next book to test. */
+} CatalogIter;
+
+Catalog    *catalog_open           (const char   *file_name,
+                                    const char   *patron_file_name,
+                                    char         *error,
+                                    size_t        error_len);
+void        catalog_close          (Catalog      *catalog);
+int         catalog_save           (Catalog      *catalog);
+int         catalog_sync           (Catalog      *catalog);
+int         catalog_format         (Catalog      *catalog,
+                                    const Book   *book,
+                                    char         *record,
+                                    size_t        size);
+const char *catalog_error          (const Catalog *catalog);
+int         catalog_size           (const Catalog *catalog);
+const char *catalog_get            (Catalog      *catalog,
+                                    const Book   *book,
+                                    int           field);
+int         catalog_set            (Catalog      *catalog,
+                                    Book         *book,
+                                    int           field,
+                                    const char   *value);
+int         catalog_add            (Catalog      *catalog,
+                                    const Book   *book);
+int         catalog_delete         (Catalog      *catalog,
+                                    int           i);
+int         catalog_put            (Catalog      *catalog,
+                                    int           i,
+                                    const Book   *book);
+int         catalog_index_accessions (Catalog    *catalog);
+int         catalog_find_accession (Catalog      *catalog,
+                                    const char   *accession_num);
+int         catalog_find           (Catalog      *catalog,
+                                    int           field,
+                                    const char   *value,
+                                    CatalogIter  *iter);
+int         catalog_next           (CatalogIter  *iter);
+void        catalog_find_end       (CatalogIter  *iter);
+int         catalog_borrow         (Catalog      *catalog,
+                                    int           i,
+                                    const char   *borrower,
+                                    const char   *date);
+int         catalog_return         (Catalog      *catalog,
+                                    int           i,
+                                    const char   *date);
+int         catalog_parse_year     (const char   *s);
+int         catalog_write_pages    (Catalog      *catalog,
+                                    const char   *file_name);
+void        catalog_page_key       (const char   *accession_num,
+                                    char         *key);
+void        catalog_split_record   (char         *record,
+                                    char         *fields[MAX_NUM_FIELDS]);
+int         catalog_read_marc      (Catalog      *catalog,
+                                    const MarcReader *reader,
+                                    Book         *book);
+int         catalog_watch          (Catalog      *catalog);
+int         catalog_changed        (Catalog      *catalog);
+int         catalog_reload         (Catalog      *catalog,
+                                    CatalogReload *reload);
+void        catalog_reload_end     (CatalogReload *reload);
+int         catalog_verify         (Catalog      *catalog,
+                                    CatalogVerify *verify);
+void        catalog_verify_end     (CatalogVerify *verify);
+
+#endif
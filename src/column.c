@@ -0,0 +1,381 @@
+/* column.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "column.h"
+#include "mem.h"
+
+/* A value being sorted by `column_seal`. */
+typedef struct
+{
+  unsigned long long prefix;  /* The first 8 bytes of the value, folded to lowercase. */
+  const char        *value;   /* The value. */
+  unsigned int       code;    /* The code of the value before sealing. */
+} SortEntry;
+
+/* Function: fold_prefix
+ * ---------------------
+ * Pack the first 8 bytes of a string, folded to lowercase, into an integer
+ * that orders like `strcasecmp` on those bytes.
+ *
+ * `strcasecmp` compares folded bytes as unsigned values with the
+ * terminator as 0, so bytes of 0x80 and above sort after ASCII.
+ *
+ * s: The string.
+ *
+ * returns: The packed prefix.
+ */
+static unsigned long long
+fold_prefix (const char *s)
+{
+  unsigned long long prefix;
+  int i, c;
+
+  prefix = 0;
+  for (i = 0; i < 8; i++)
+    {
+      c = *s ? tolower ((unsigned char) *s++) : 0;
+      prefix = (prefix << 8) | (unsigned char) c;
+    }
+
+  return prefix;
+}
+
+/* Function: compare_entries
+ * -------------------------
+ * Order two sort entries like `frontcode_compare` orders their values.
+ * The packed prefixes settle most comparisons without touching the strings.
+ */
+static int
+compare_entries (const void *a,
+                 const void *b)
+{
+  const SortEntry *x = (const SortEntry *) a;
+  const SortEntry *y = (const SortEntry *) b;
+
+  if (x->prefix != y->prefix)
+    return x->prefix < y->prefix ? -1 : 1;
+
+  return frontcode_compare (x->value, y->value);
+}
+
+/* Function: column_init
+ * ---------------------
+ * Initialize an empty column.
+ *
+ * column: The column to initialize.
+ * front_coded: Nonzero to keep sealed values front-coded,
+ *              or 0 for a plain dictionary column.
+ */
+void
+column_init (Column *column,
+             int     front_coded)
+{
+  column->front_coded = front_coded;
+  memset (&column->sorted, 0, sizeof (FrontCode));
+  dict_init (&column->dict);
+}
+
+/* Function: column_free
+ * ---------------------
+ * Release the memory held by a column and leave it empty.
+ *
+ * column: The column to free.
+ */
+void
+column_free (Column *column)
+{
+  frontcode_free (&column->sorted);
+  dict_free (&column->dict);
+}
+
+/* Function: column_put
+ * --------------------
+ * Get the code of a value, adding the value if it is not present yet.
+ *
+ * column: The column.
+ * value: The value.
+ *
+ * returns: The code of the value,
+ *          or COLUMN_NONE if memory could not be allocated.
+ */
+unsigned int
+column_put (Column     *column,
+            const char *value)
+{
+  unsigned int code;
+
+  if (column->sorted.count > 0)
+    {
+      code = frontcode_lookup (&column->sorted, value);
+      if (code != COLUMN_NONE)
+        return code;
+    }
+
+  code = dict_put (&column->dict, value);
+  if (code == DICT_NONE)
+    return COLUMN_NONE;
+
+  return column->sorted.count + code;
+}
+
+/* Function: column_lookup
+ * -----------------------
+ * Find the code of a value without adding it.
+ *
+ * column: The column.
+ * value: The value, compared exactly.
+ *
+ * returns: The code of the value, or COLUMN_NONE if it is not present.
+ */
+unsigned int
+column_lookup (const Column *column,
+               const char   *value)
+{
+  unsigned int code;
+
+  if (column->sorted.count > 0)
+    {
+      code = frontcode_lookup (&column->sorted, value);
+      if (code != COLUMN_NONE)
+        return code;
+    }
+
+  code = dict_lookup (&column->dict, value);
+  if (code == DICT_NONE)
+    return COLUMN_NONE;
+
+  return column->sorted.count + code;
+}
+
+/* Function: column_match
+ * ----------------------
+ * Find the codes of every value equal to a value when case is ignored.
+ *
+ * column: The column.
+ * value: The value to match.
+ * num_codes: Receives the number of matching codes.
+ *
+ * returns: An array of the matching codes, to be released with `mem_free`,
+ *          or NULL if memory could not be allocated.
+ */
+unsigned int *
+column_match (const Column *column,
+              const char   *value,
+              size_t       *num_codes)
+{
+  unsigned int *codes, first, last, i;
+  size_t n, max_codes;
+
+  first = last = 0;
+  if (column->sorted.count > 0)
+    frontcode_range (&column->sorted, value, &first, &last);
+
+  max_codes = (last - first) + 4;
+  for (;;)
+    {
+      codes = (unsigned int *) mem_alloc (MEM_INDEXES, sizeof (unsigned int) * max_codes);
+      if (codes == NULL)
+        return NULL;
+
+      for (i = first; i < last; i++)
+        codes[i - first] = i;
+
+      n = dict_match (&column->dict, value, codes + (last - first), max_codes - (last - first));
+      if (n <= max_codes - (last - first))
+        break;
+
+      /* More case variants than expected; retry with room for all of them. */
+      mem_free (codes);
+      max_codes = (last - first) + n;
+    }
+
+  for (i = 0; i < n; i++)
+    codes[(last - first) + i] += column->sorted.count;
+
+  *num_codes = (last - first) + n;
+  return codes;
+}
+
+/* Function: column_get
+ * --------------------
+ * Get the value of a code.
+ *
+ * Dictionary values are returned in place; the pointer stays valid
+ * until the column is next changed.  Front-coded values are decoded
+ * into buf.
+ *
+ * column: The column.
+ * code: A code returned by `column_put`.
+ * buf: A buffer of FRONTCODE_MAX_LEN + 1 bytes.
+ *
+ * returns: The value.
+ */
+const char *
+column_get (const Column *column,
+            unsigned int  code,
+            char         *buf)
+{
+  if (code < column->sorted.count)
+    return frontcode_get (&column->sorted, code, buf);
+
+  return dict_get (&column->dict, code - column->sorted.count);
+}
+
+/* Function: column_decode
+ * ------------------------
+ * Get every value of a column at once, for callers that visit most codes.
+ *
+ * column: The column.
+ * heap: Receives the block holding the decoded sorted values,
+ *       to be released with `mem_free` after the array.
+ *
+ * returns: An array of the values indexed by code, to be released with
+ *          `mem_free`, or NULL if memory could not be allocated.
+ */
+const char **
+column_decode (const Column  *column,
+               char         **heap)
+{
+  const char **values;
+  unsigned int i;
+
+  values = (const char **) mem_alloc (MEM_BUFFERS, sizeof (char *) * (column_size (column) + 1));
+  if (values == NULL)
+    return NULL;
+
+  *heap = frontcode_decode (&column->sorted, values);
+  if (*heap == NULL)
+    {
+      mem_free (values);
+      return NULL;
+    }
+
+  for (i = 0; i < column->dict.count; i++)
+    values[column->sorted.count + i] = dict_get (&column->dict, i);
+
+  return values;
+}
+
+/* Function: column_size
+ * ---------------------
+ * Get the number of distinct values in a column.
+ *
+ * column: The column.
+ *
+ * returns: The number of codes; every code is less than this.
+ */
+unsigned int
+column_size (const Column *column)
+{
+  return column->sorted.count + column->dict.count;
+}
+
+/* Function: column_seal
+ * ---------------------
+ * Move every value of a front-coded column into its sorted list.
+ *
+ * Sealing renumbers the values, so the caller must rewrite
+ * every stored code through the returned map.
+ * Dictionary columns are left as they are.
+ *
+ * column: The column.
+ * remap: Receives an array mapping each old code to its new code,
+ *        to be released with `mem_free`, or NULL if nothing changed.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated,
+ *          in which case the column is unchanged.
+ */
+int
+column_seal (Column        *column,
+             unsigned int **remap)
+{
+  char buf[FRONTCODE_MAX_LEN + 1];
+  SortEntry *entries;
+  const char **values;
+  char *decoded, *p;
+  FrontCode sorted;
+  unsigned int count, i;
+  size_t decoded_len;
+
+  *remap = NULL;
+  if (!column->front_coded || column->dict.count == 0)
+    return 0;
+
+  count = column_size (column);
+
+  /* The old sorted values must outlive the old list, so decode them first. */
+  decoded_len = 0;
+  for (i = 0; i < column->sorted.count; i++)
+    decoded_len += strlen (frontcode_get (&column->sorted, i, buf)) + 1;
+
+  decoded = (char *) mem_alloc (MEM_STRINGS, decoded_len ? decoded_len : 1);
+  entries = (SortEntry *) mem_alloc (MEM_INDEXES, sizeof (SortEntry) * count);
+  values = (const char **) mem_alloc (MEM_INDEXES, sizeof (char *) * count);
+  *remap = (unsigned int *) mem_alloc (MEM_INDEXES, sizeof (unsigned int) * count);
+  if (decoded == NULL || entries == NULL || values == NULL || *remap == NULL)
+    goto fail;
+
+  p = decoded;
+  for (i = 0; i < count; i++)
+    {
+      if (i < column->sorted.count)
+        {
+          strcpy (p, frontcode_get (&column->sorted, i, buf));
+          entries[i].value = p;
+          p += strlen (p) + 1;
+        }
+      else
+        entries[i].value = dict_get (&column->dict, i - column->sorted.count);
+
+      entries[i].prefix = fold_prefix (entries[i].value);
+      entries[i].code = i;
+    }
+
+  qsort (entries, count, sizeof (SortEntry), compare_entries);
+  for (i = 0; i < count; i++)
+    {
+      values[i] = entries[i].value;
+      (*remap)[entries[i].code] = i;
+    }
+
+  if (frontcode_build (&sorted, values, count) != 0)
+    goto fail;
+
+  frontcode_free (&column->sorted);
+  dict_free (&column->dict);
+  column->sorted = sorted;
+
+  mem_free (decoded);
+  mem_free (entries);
+  mem_free (values);
+  return 0;
+
+fail:
+  mem_free (decoded);
+  mem_free (entries);
+  mem_free (values);
+  mem_free (*remap);
+  *remap = NULL;
+  return -1;
+}
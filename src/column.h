@@ -0,0 +1,64 @@
+/* column.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <stddef.h>
+
+#include "dict.h"
+#include "frontcode.h"
+
+/* The code returned when a value is not in a column. */
+#define COLUMN_NONE DICT_NONE
+
+/* The encoded values of one book field.
+ *
+ * A dictionary column keeps every value in `dict`.  A front-coded column
+ * keeps the values it held when it was last sealed in the sorted `sorted`
+ * list and the values added since in `dict`; the codes of the latter start
+ * after the last sorted code. */
+typedef struct
+{
+  int       front_coded;  /* Whether sealing moves the values into `sorted`. */
+  FrontCode sorted;       /* The front-coded values. */
+  Dict      dict;         /* The dictionary-encoded values. */
+} Column;
+
+void           column_init   (Column       *column,
+                              int           front_coded);
+void           column_free   (Column       *column);
+unsigned int   column_put    (Column       *column,
+                              const char   *value);
+unsigned int   column_lookup (const Column *column,
+                              const char   *value);
+unsigned int  *column_match  (const Column *column,
+                              const char   *value,
+                              size_t       *num_codes);
+const char    *column_get    (const Column *column,
+                              unsigned int  code,
+                              char         *buf);
+const char   **column_decode (const Column *column,
+                              char        **heap);
+unsigned int   column_size   (const Column *column);
+int            column_seal   (Column       *column,
+                              unsigned int **remap);
+
+#endif
@@ -0,0 +1,274 @@
+/* crc32c.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HAVE_SSE42 1
+#endif
+
+#include "crc32c.h"
+#include "mem.h"
+
+/* The Castagnoli polynomial, bit-reversed. */
+#define POLY 0x82f63b78
+
+/* The number of checksums the sums array first holds. */
+#define INITIAL_MAX_SUMS 64
+
+/* The tables of the software checksum, which takes eight bytes a step:
+ * table[k][b] is the checksum of byte b followed by k zero bytes. */
+static unsigned int table[8][256];
+
+/* Whether the processor has the SSE4.2 CRC32 instruction. */
+static int hardware;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+/* Function: init_crc32c
+ * ---------------------
+ * Build the tables and look for the CRC32 instruction, once.
+ */
+static void
+init_crc32c (void)
+{
+  unsigned int crc;
+  int b, k;
+
+  for (b = 0; b < 256; b++)
+    {
+      crc = b;
+      for (k = 0; k < 8; k++)
+        crc = (crc >> 1) ^ (POLY & (0U - (crc & 1)));
+      table[0][b] = crc;
+    }
+  for (b = 0; b < 256; b++)
+    for (k = 1; k < 8; k++)
+      table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+
+#ifdef HAVE_SSE42
+  hardware = __builtin_cpu_supports ("sse4.2") != 0;
+#endif
+}
+
+/* Function: crc32c_table
+ * ----------------------
+ * Update a checksum in software, eight bytes at a time.
+ */
+static unsigned int
+crc32c_table (unsigned int         crc,
+              const unsigned char *p,
+              size_t               len)
+{
+  uint64_t word;
+
+  for (; len > 0 && ((uintptr_t) p & 7) != 0; len--)
+    crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+
+  for (; len >= 8; len -= 8, p += 8)
+    {
+      memcpy (&word, p, 8);
+      word ^= crc;
+      crc = table[7][word & 0xff]
+            ^ table[6][(word >> 8) & 0xff]
+            ^ table[5][(word >> 16) & 0xff]
+            ^ table[4][(word >> 24) & 0xff]
+            ^ table[3][(word >> 32) & 0xff]
+            ^ table[2][(word >> 40) & 0xff]
+            ^ table[1][(word >> 48) & 0xff]
+            ^ table[0][word >> 56];
+    }
+
+  for (; len > 0; len--)
+    crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+
+  return crc;
+}
+
+#ifdef HAVE_SSE42
+/* Function: crc32c_sse42
+ * ----------------------
+ * Update a checksum with the SSE4.2 CRC32 instruction,
+ * eight bytes at a time.
+ */
+__attribute__ ((target ("sse4.2")))
+static unsigned int
+crc32c_sse42 (unsigned int         crc,
+              const unsigned char *p,
+              size_t               len)
+{
+  unsigned long long crc64;
+  uint64_t word;
+
+  for (; len > 0 && ((uintptr_t) p & 7) != 0; len--)
+    crc = _mm_crc32_u8 (crc, *p++);
+
+  crc64 = crc;
+  for (; len >= 8; len -= 8, p += 8)
+    {
+      memcpy (&word, p, 8);
+      crc64 = _mm_crc32_u64 (crc64, word);
+    }
+  crc = (unsigned int) crc64;
+
+  for (; len > 0; len--)
+    crc = _mm_crc32_u8 (crc, *p++);
+
+  return crc;
+}
+#endif
+
+/* Function: crc32c
+ * ----------------
+ * Compute the CRC-32C (Castagnoli) checksum of some bytes, using the
+ * CRC32 instruction of SSE4.2 where the processor has it and tables
+ * otherwise.  Both give the same checksum.
+ *
+ * crc: The checksum of the bytes before these, or 0 to start.
+ * data: The bytes.
+ * len: The number of bytes.
+ *
+ * returns: The checksum of the bytes before and these.
+ */
+unsigned int
+crc32c (unsigned int  crc,
+        const void   *data,
+        size_t        len)
+{
+  pthread_once (&once, init_crc32c);
+
+#ifdef HAVE_SSE42
+  if (hardware)
+    return ~crc32c_sse42 (~crc, (const unsigned char *) data, len);
+#endif
+  return ~crc32c_table (~crc, (const unsigned char *) data, len);
+}
+
+/* Function: crc32c_hardware
+ * -------------------------
+ * Tell whether checksums are computed with the CRC32 instruction.
+ */
+int
+crc32c_hardware (void)
+{
+  pthread_once (&once, init_crc32c);
+  return hardware;
+}
+
+/* Function: crc32c_blocks_init
+ * ----------------------------
+ * Start taking the checksums of a stream of bytes.
+ *
+ * block_size: The size of a block, at least 1.
+ */
+void
+crc32c_blocks_init (Crc32cBlocks *blocks,
+                    size_t        block_size)
+{
+  memset (blocks, 0, sizeof (Crc32cBlocks));
+  blocks->block_size = block_size;
+}
+
+/* Function: finish_block
+ * ----------------------
+ * Keep the checksum of the current block and start the next.
+ */
+static void
+finish_block (Crc32cBlocks *blocks)
+{
+  unsigned int *sums;
+  size_t max;
+
+  if (blocks->num_sums >= blocks->max_sums)
+    {
+      max = blocks->max_sums ? blocks->max_sums * 2 : INITIAL_MAX_SUMS;
+      sums = (unsigned int *) mem_realloc (MEM_BUFFERS, blocks->sums, sizeof (unsigned int) * max);
+      if (sums == NULL)
+        {
+          blocks->error = 1;
+          return;
+        }
+      blocks->sums = sums;
+      blocks->max_sums = max;
+    }
+
+  blocks->sums[blocks->num_sums++] = blocks->crc;
+  blocks->crc = 0;
+  blocks->fill = 0;
+}
+
+/* Function: crc32c_blocks_add
+ * ---------------------------
+ * Add bytes to the stream.
+ */
+void
+crc32c_blocks_add (Crc32cBlocks *blocks,
+                   const void   *data,
+                   size_t        len)
+{
+  const unsigned char *p = (const unsigned char *) data;
+  size_t n;
+
+  blocks->size += len;
+  while (len > 0)
+    {
+      n = blocks->block_size - blocks->fill;
+      if (n > len)
+        n = len;
+      blocks->crc = crc32c (blocks->crc, p, n);
+      blocks->fill += n;
+      p += n;
+      len -= n;
+      if (blocks->fill == blocks->block_size)
+        finish_block (blocks);
+    }
+}
+
+/* Function: crc32c_blocks_end
+ * ---------------------------
+ * Finish the last block, if it is short.
+ *
+ * returns: 0 on success, or -1 if memory ran out
+ *          while the checksums were taken.
+ */
+int
+crc32c_blocks_end (Crc32cBlocks *blocks)
+{
+  if (blocks->fill > 0)
+    finish_block (blocks);
+
+  return blocks->error ? -1 : 0;
+}
+
+/* Function: crc32c_blocks_free
+ * ----------------------------
+ * Release the checksums.
+ */
+void
+crc32c_blocks_free (Crc32cBlocks *blocks)
+{
+  mem_free (blocks->sums);
+  blocks->sums = NULL;
+  blocks->num_sums = blocks->max_sums = 0;
+}
@@ -0,0 +1,55 @@
+/* crc32c.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+
+/* The checksums of a stream of bytes, one for each block of a fixed size.
+ *
+ * Bytes may be added in pieces of any size; a piece that crosses the end
+ * of a block is split between the blocks.  The last block may be short. */
+typedef struct
+{
+  size_t              block_size;  /* The size of a block. */
+  size_t              fill;        /* The bytes of the current block added so far. */
+  unsigned int        crc;         /* The checksum of those bytes. */
+  unsigned int       *sums;        /* The checksum of each finished block. */
+  size_t              num_sums;    /* The number of finished blocks. */
+  size_t              max_sums;    /* The capacity of sums. */
+  unsigned long long  size;        /* The bytes added. */
+  int                 error;       /* Nonzero once memory could not be allocated. */
+} Crc32cBlocks;
+
+unsigned int crc32c             (unsigned int  crc,
+                                 const void   *data,
+                                 size_t        len);
+int          crc32c_hardware    (void);
+void         crc32c_blocks_init (Crc32cBlocks *blocks,
+                                 size_t        block_size);
+void         crc32c_blocks_add  (Crc32cBlocks *blocks,
+                                 const void   *data,
+                                 size_t        len);
+int          crc32c_blocks_end  (Crc32cBlocks *blocks);
+void         crc32c_blocks_free (Crc32cBlocks *blocks);
+
+#endif
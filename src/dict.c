@@ -0,0 +1,268 @@
+/* dict.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "dict.h"
+#include "mem.h"
+#include "utils.h"
+
+/* Function: hash_nocase
+ * ---------------------
+ * Hash a string with FNV-1a after folding it to lowercase,
+ * so that strings differing only in case get the same hash.
+ *
+ * s: The string to hash.
+ *
+ * returns: The 32-bit hash.
+ */
+static unsigned int
+hash_nocase (const char *s)
+{
+  unsigned int h, c;
+
+  /* The program runs in the C locale, where tolower folds A-Z alone;
+     folding inline keeps the call out of the loop. */
+  h = 2166136261u;
+  while ((c = (unsigned char) *s++) != '\0')
+    {
+      if (c - 'A' < 26u)
+        c += 'a' - 'A';
+      h ^= c;
+      h *= 16777619u;
+    }
+
+  return h;
+}
+
+/* Function: grow_slots
+ * --------------------
+ * Double the hash table and reinsert every code.
+ *
+ * dict: The dictionary.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+static int
+grow_slots (Dict *dict)
+{
+  unsigned int *slots, num_slots, code, i;
+
+  num_slots = dict->num_slots ? dict->num_slots * 2 : 16;
+  slots = (unsigned int *) mem_alloc (MEM_STRINGS, sizeof (unsigned int) * num_slots);
+  if (slots == NULL)
+    return -1;
+  memset (slots, 0xff, sizeof (unsigned int) * num_slots);
+
+  for (code = 0; code < dict->count; code++)
+    {
+      i = hash_nocase (dict->heap + dict->offsets[code]) & (num_slots - 1);
+      while (slots[i] != DICT_NONE)
+        i = (i + 1) & (num_slots - 1);
+      slots[i] = code;
+    }
+
+  mem_free (dict->slots);
+  dict->slots = slots;
+  dict->num_slots = num_slots;
+  return 0;
+}
+
+/* Function: dict_init
+ * -------------------
+ * Initialize an empty dictionary.
+ *
+ * dict: The dictionary to initialize.
+ */
+void
+dict_init (Dict *dict)
+{
+  memset (dict, 0, sizeof (Dict));
+}
+
+/* Function: dict_free
+ * -------------------
+ * Release the memory held by a dictionary and leave it empty.
+ *
+ * dict: The dictionary to free.
+ */
+void
+dict_free (Dict *dict)
+{
+  mem_free (dict->heap);
+  mem_free (dict->offsets);
+  mem_free (dict->slots);
+  dict_init (dict);
+}
+
+/* Function: dict_put
+ * ------------------
+ * Get the code of a string, adding the string if it is not present yet.
+ *
+ * Strings are compared exactly, so values differing only in case
+ * get different codes.
+ *
+ * dict: The dictionary.
+ * s: The string.
+ *
+ * returns: The code of the string,
+ *          or DICT_NONE if memory could not be allocated.
+ */
+unsigned int
+dict_put (Dict       *dict,
+          const char *s)
+{
+  unsigned int h, i, code;
+  size_t len;
+
+  h = hash_nocase (s);
+  if (dict->num_slots > 0)
+    {
+      for (i = h & (dict->num_slots - 1); dict->slots[i] != DICT_NONE; i = (i + 1) & (dict->num_slots - 1))
+        if (!strcmp (dict->heap + dict->offsets[dict->slots[i]], s))
+          return dict->slots[i];
+    }
+
+  len = strlen (s) + 1;
+  if (dict->heap_len + len > (unsigned int) -1 || dict->count == DICT_NONE - 1)
+    return DICT_NONE;
+
+  if (dict->heap_len + len > dict->heap_cap)
+    {
+      size_t heap_cap;
+      char *heap;
+
+      heap_cap = dict->heap_cap ? dict->heap_cap * 2 : 256;
+      while (heap_cap < dict->heap_len + len)
+        heap_cap *= 2;
+      heap = (char *) mem_realloc (MEM_STRINGS, dict->heap, heap_cap);
+      if (heap == NULL)
+        return DICT_NONE;
+      dict->heap = heap;
+      dict->heap_cap = heap_cap;
+    }
+
+  if (dict->count == dict->offsets_cap)
+    {
+      unsigned int offsets_cap, *offsets;
+
+      offsets_cap = dict->offsets_cap ? dict->offsets_cap * 2 : 16;
+      offsets = (unsigned int *) mem_realloc (MEM_STRINGS, dict->offsets, sizeof (unsigned int) * offsets_cap);
+      if (offsets == NULL)
+        return DICT_NONE;
+      dict->offsets = offsets;
+      dict->offsets_cap = offsets_cap;
+    }
+
+  /* Keep the table at most three quarters full. */
+  if ((dict->count + 1) * 4 > dict->num_slots * 3 && grow_slots (dict) != 0)
+    return DICT_NONE;
+
+  code = dict->count++;
+  dict->offsets[code] = (unsigned int) dict->heap_len;
+  memcpy (dict->heap + dict->heap_len, s, len);
+  dict->heap_len += len;
+
+  for (i = h & (dict->num_slots - 1); dict->slots[i] != DICT_NONE; i = (i + 1) & (dict->num_slots - 1))
+    {}
+  dict->slots[i] = code;
+
+  return code;
+}
+
+/* Function: dict_lookup
+ * ---------------------
+ * Find the code of a string without adding it.
+ *
+ * dict: The dictionary.
+ * s: The string, compared exactly.
+ *
+ * returns: The code of the string, or DICT_NONE if it is not present.
+ */
+unsigned int
+dict_lookup (const Dict *dict,
+             const char *s)
+{
+  unsigned int i;
+
+  if (dict->num_slots == 0)
+    return DICT_NONE;
+
+  for (i = hash_nocase (s) & (dict->num_slots - 1); dict->slots[i] != DICT_NONE; i = (i + 1) & (dict->num_slots - 1))
+    if (!strcmp (dict->heap + dict->offsets[dict->slots[i]], s))
+      return dict->slots[i];
+
+  return DICT_NONE;
+}
+
+/* Function: dict_match
+ * --------------------
+ * Find the codes of every string equal to s when case is ignored.
+ *
+ * dict: The dictionary.
+ * s: The string to match.
+ * codes: An array receiving up to max_codes matching codes.
+ * max_codes: The size of codes.
+ *
+ * returns: The number of matching codes, which may exceed max_codes.
+ */
+size_t
+dict_match (const Dict   *dict,
+            const char   *s,
+            unsigned int *codes,
+            size_t        max_codes)
+{
+  unsigned int i;
+  size_t n;
+
+  if (dict->num_slots == 0)
+    return 0;
+
+  n = 0;
+  for (i = hash_nocase (s) & (dict->num_slots - 1); dict->slots[i] != DICT_NONE; i = (i + 1) & (dict->num_slots - 1))
+    {
+      if (!strcasecmp (dict->heap + dict->offsets[dict->slots[i]], s))
+        {
+          if (n < max_codes)
+            codes[n] = dict->slots[i];
+          n++;
+        }
+    }
+
+  return n;
+}
+
+/* Function: dict_get
+ * ------------------
+ * Get the string of a code.
+ *
+ * The pointer stays valid until the next call to `dict_put`.
+ *
+ * dict: The dictionary.
+ * code: A code returned by `dict_put`.
+ *
+ * returns: The string.
+ */
+const char *
+dict_get (const Dict   *dict,
+          unsigned int  code)
+{
+  return dict->heap + dict->offsets[code];
+}
@@ -0,0 +1,59 @@
+/* dict.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef DICT_H
+#define DICT_H
+
+#include <stddef.h>
+
+/* The code returned when a string is not in a dictionary. */
+#define DICT_NONE ((unsigned int) -1)
+
+/* A dictionary mapping distinct strings to dense integer codes.
+ *
+ * Codes are handed out in insertion order, starting at 0, and never change.
+ * The strings live in one heap; the hash table hashes them without regard
+ * to case, so that case-insensitive matches sit in the same probe chain. */
+typedef struct
+{
+  char         *heap;        /* The strings, each followed by a null terminator. */
+  size_t        heap_len;    /* The bytes used in heap. */
+  size_t        heap_cap;    /* The bytes allocated for heap. */
+  unsigned int *offsets;     /* The offset in heap of the string of each code. */
+  unsigned int  count;       /* The number of codes. */
+  unsigned int  offsets_cap; /* The number of offsets allocated. */
+  unsigned int *slots;       /* Open-addressing hash table of codes. */
+  unsigned int  num_slots;   /* The size of slots, a power of two. */
+} Dict;
+
+void          dict_init   (Dict         *dict);
+void          dict_free   (Dict         *dict);
+unsigned int  dict_put    (Dict         *dict,
+                           const char   *s);
+unsigned int  dict_lookup (const Dict   *dict,
+                           const char   *s);
+size_t        dict_match  (const Dict   *dict,
+                           const char   *s,
+                           unsigned int *codes,
+                           size_t        max_codes);
+const char   *dict_get    (const Dict   *dict,
+                           unsigned int  code);
+
+#endif
@@ -0,0 +1,374 @@
+/* export.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "export.h"
+#include "mem.h"
+
+/* The longest escape sequence of a byte, as in "&quot;" or "\u001f". */
+#define MAX_ESCAPE_LEN 6
+
+/* U+FFFD REPLACEMENT CHARACTER, written for each byte of a value
+ * that is not part of a valid UTF-8 sequence. */
+#define REPLACEMENT_CHAR "\xef\xbf\xbd"
+
+/* For each byte, whether it must be escaped in a JSON string
+ * or in XML text, or checked as the start of a UTF-8 sequence.
+ * Filled in by `init_tables`. */
+static unsigned char json_special[256];
+static unsigned char xml_special[256];
+static int tables_ready;
+
+/* Function: init_tables
+ * ---------------------
+ * Mark the bytes that cannot be copied as they are.
+ */
+static void
+init_tables (void)
+{
+  int c;
+
+  for (c = 0; c < 0x20; c++)
+    {
+      json_special[c] = 1;
+      /* XML 1.0 allows no control characters but tab, newline and carriage return. */
+      xml_special[c] = 1;
+    }
+  for (c = 0x80; c < 0x100; c++)
+    {
+      json_special[c] = 1;
+      xml_special[c] = 1;
+    }
+  json_special['"'] = 1;
+  json_special['\\'] = 1;
+  xml_special['&'] = 1;
+  xml_special['<'] = 1;
+  xml_special['>'] = 1;
+  xml_special['"'] = 1;
+  tables_ready = 1;
+}
+
+/* Function: flush
+ * ---------------
+ * Write out the buffer.
+ */
+static void
+flush (Exporter *exporter)
+{
+  if (exporter->len == 0)
+    return;
+
+  if (!exporter->error
+      && fwrite (exporter->buf, 1, exporter->len, exporter->fp) != exporter->len)
+    exporter->error = 1;
+  exporter->bytes_written += exporter->len;
+  exporter->len = 0;
+}
+
+/* Function: put
+ * -------------
+ * Append bytes to the buffer, writing it out first if they do not fit.
+ */
+static void
+put (Exporter   *exporter,
+     const char *s,
+     size_t      n)
+{
+  if (exporter->len + n > EXPORT_BUF_LEN)
+    {
+      flush (exporter);
+      if (n > EXPORT_BUF_LEN)
+        {
+          if (!exporter->error && fwrite (s, 1, n, exporter->fp) != n)
+            exporter->error = 1;
+          exporter->bytes_written += n;
+          return;
+        }
+    }
+
+  memcpy (exporter->buf + exporter->len, s, n);
+  exporter->len += n;
+}
+
+/* Function: put_str
+ * -----------------
+ * Append a null-terminated string to the buffer.
+ */
+static void
+put_str (Exporter   *exporter,
+         const char *s)
+{
+  put (exporter, s, strlen (s));
+}
+
+/* Function: utf8_len
+ * ------------------
+ * Measure the UTF-8 sequence a string starts with.
+ *
+ * Overlong forms, surrogates and code points above U+10FFFF are invalid,
+ * as are U+FFFE and U+FFFF in XML, which does not allow them as characters.
+ *
+ * p: The string, starting with a byte of 0x80 or above.
+ * xml: Whether the sequence is to be written as XML.
+ *
+ * returns: The length of the sequence, or 0 if it is not valid.
+ */
+static int
+utf8_len (const unsigned char *p,
+          int                  xml)
+{
+  unsigned long c;
+  int len, i;
+
+  if (p[0] >= 0xc2 && p[0] <= 0xdf)
+    {
+      len = 2;
+      c = p[0] & 0x1f;
+    }
+  else if (p[0] >= 0xe0 && p[0] <= 0xef)
+    {
+      len = 3;
+      c = p[0] & 0x0f;
+    }
+  else if (p[0] >= 0xf0 && p[0] <= 0xf4)
+    {
+      len = 4;
+      c = p[0] & 0x07;
+    }
+  else
+    return 0;
+
+  /* A terminator is not a continuation byte, so this stops at the end. */
+  for (i = 1; i < len; i++)
+    {
+      if ((p[i] & 0xc0) != 0x80)
+        return 0;
+      c = (c << 6) | (p[i] & 0x3f);
+    }
+
+  if ((len == 3 && c < 0x800) || (len == 4 && (c < 0x10000 || c > 0x10ffff))
+      || (c >= 0xd800 && c <= 0xdfff) || (xml && (c == 0xfffe || c == 0xffff)))
+    return 0;
+
+  return len;
+}
+
+/* Function: put_escaped
+ * ---------------------
+ * Append a value to the buffer, escaped for the exporter's format.
+ *
+ * Runs of bytes that need no escaping, which is usually the whole
+ * value, are found with a table lookup per byte and copied at once.
+ * Valid UTF-8 sequences are copied as they are; every other byte of
+ * 0x80 or above is replaced with U+FFFD, as a catalog file need not
+ * be UTF-8 but JSON and XML must be.
+ */
+static void
+put_escaped (Exporter   *exporter,
+             const char *s)
+{
+  static const char hex[] = "0123456789abcdef";
+  const unsigned char *special, *p, *run;
+  char escape[MAX_ESCAPE_LEN + 1];
+  const char *text;
+  int len;
+
+  special = exporter->format == EXPORT_XML ? xml_special : json_special;
+  p = (const unsigned char *) s;
+
+  for (;;)
+    {
+      run = p;
+      while (*p != '\0' && !special[*p])
+        p++;
+      if (p > run)
+        put (exporter, (const char *) run, p - run);
+      if (*p == '\0')
+        return;
+
+      if (*p >= 0x80)
+        {
+          len = utf8_len (p, exporter->format == EXPORT_XML);
+          if (len > 0)
+            put (exporter, (const char *) p, len);
+          else
+            {
+              put_str (exporter, REPLACEMENT_CHAR);
+              len = 1;
+            }
+          p += len;
+          continue;
+        }
+
+      if (exporter->format == EXPORT_XML)
+        switch (*p)
+          {
+          case '&':  text = "&amp;";  break;
+          case '<':  text = "&lt;";   break;
+          case '>':  text = "&gt;";   break;
+          case '"':  text = "&quot;"; break;
+          case '\t': text = "\t";     break;
+          case '\n': text = "\n";     break;
+          case '\r': text = "&#13;";  break;
+          default:   text = "";       break;
+          }
+      else
+        switch (*p)
+          {
+          case '"':  text = "\\\"";   break;
+          case '\\': text = "\\\\";   break;
+          case '\b': text = "\\b";    break;
+          case '\f': text = "\\f";    break;
+          case '\n': text = "\\n";    break;
+          case '\r': text = "\\r";    break;
+          case '\t': text = "\\t";    break;
+          default:
+            memcpy (escape, "\\u00", 4);
+            escape[4] = hex[*p >> 4];
+            escape[5] = hex[*p & 0xf];
+            escape[6] = '\0';
+            text = escape;
+            break;
+          }
+      put_str (exporter, text);
+      p++;
+    }
+}
+
+/* Function: export_open
+ * ---------------------
+ * Create a file to export records to, and write its header.
+ *
+ * exporter: Receives the state of the export.
+ * path: The file to create. An existing file is replaced.
+ * format: The format to write.
+ * names: The names of the fields, used as JSON keys and XML elements.
+ *        Must outlive the export.
+ * num_fields: The number of fields in a record.
+ *
+ * returns: 0 on success, or -1 if the file could not be created
+ *          or the buffer could not be allocated.
+ */
+int
+export_open (Exporter          *exporter,
+             const char        *path,
+             ExportFormat       format,
+             const char *const *names,
+             int                num_fields)
+{
+  if (!tables_ready)
+    init_tables ();
+
+  memset (exporter, 0, sizeof (Exporter));
+  exporter->format = format;
+  exporter->names = names;
+  exporter->num_fields = num_fields;
+
+  exporter->buf = (char *) mem_alloc (MEM_BUFFERS, EXPORT_BUF_LEN);
+  if (exporter->buf == NULL)
+    return -1;
+
+  exporter->fp = fopen (path, "w");
+  if (exporter->fp == NULL)
+    {
+      mem_free (exporter->buf);
+      return -1;
+    }
+  /* Writes are already batched, so stdio needs no buffer of its own. */
+  setvbuf (exporter->fp, NULL, _IONBF, 0);
+
+  if (format == EXPORT_JSON)
+    put_str (exporter, "[");
+  else if (format == EXPORT_XML)
+    put_str (exporter, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<catalog>\n");
+
+  return 0;
+}
+
+/* Function: export_record
+ * -----------------------
+ * Write one record.
+ *
+ * values: The values of the fields, in the order of their names.
+ *
+ * returns: 0 on success, or -1 if a write has failed.
+ */
+int
+export_record (Exporter          *exporter,
+               const char *const *values)
+{
+  int i;
+
+  if (exporter->format == EXPORT_XML)
+    {
+      put_str (exporter, "  <book>");
+      for (i = 0; i < exporter->num_fields; i++)
+        {
+          put_str (exporter, "<");
+          put_str (exporter, exporter->names[i]);
+          put_str (exporter, ">");
+          put_escaped (exporter, values[i]);
+          put_str (exporter, "</");
+          put_str (exporter, exporter->names[i]);
+          put_str (exporter, ">");
+        }
+      put_str (exporter, "</book>\n");
+    }
+  else
+    {
+      if (exporter->format == EXPORT_JSON)
+        put_str (exporter, exporter->num_records ? ",\n" : "\n");
+      for (i = 0; i < exporter->num_fields; i++)
+        {
+          put_str (exporter, i ? ",\"" : "{\"");
+          put_str (exporter, exporter->names[i]);
+          put_str (exporter, "\":\"");
+          put_escaped (exporter, values[i]);
+          put_str (exporter, "\"");
+        }
+      put_str (exporter, exporter->format == EXPORT_JSONL ? "}\n" : "}");
+    }
+  exporter->num_records++;
+
+  return exporter->error ? -1 : 0;
+}
+
+/* Function: export_close
+ * ----------------------
+ * Write the footer, flush the buffer and close the file.
+ *
+ * returns: 0 on success, or -1 if any write has failed.
+ */
+int
+export_close (Exporter *exporter)
+{
+  if (exporter->format == EXPORT_JSON)
+    put_str (exporter, exporter->num_records ? "\n]\n" : "]\n");
+  else if (exporter->format == EXPORT_XML)
+    put_str (exporter, "</catalog>\n");
+
+  flush (exporter);
+  if (fclose (exporter->fp) != 0)
+    exporter->error = 1;
+  mem_free (exporter->buf);
+
+  return exporter->error ? -1 : 0;
+}
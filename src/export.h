@@ -0,0 +1,64 @@
+/* export.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdio.h>
+
+/* The size of the buffer records are written through. */
+#define EXPORT_BUF_LEN (1 << 20)
+
+/* The formats a catalog can be exported to. */
+typedef enum
+{
+  EXPORT_JSONL,  /* One JSON object per line. */
+  EXPORT_JSON,   /* One JSON array of objects. */
+  EXPORT_XML     /* One <book> element per record. */
+} ExportFormat;
+
+/* A file being exported to, one record at a time.
+ *
+ * Records are encoded straight into a large buffer that is written
+ * out whenever it fills, so memory use does not depend on the number
+ * of records.  Every field is written as a string. */
+typedef struct
+{
+  FILE               *fp;             /* The file written to. */
+  ExportFormat        format;         /* The format written. */
+  const char *const  *names;          /* The names of the fields. */
+  int                 num_fields;     /* The number of fields in a record. */
+  char               *buf;            /* The buffer, EXPORT_BUF_LEN bytes long. */
+  size_t              len;            /* The number of bytes in the buffer. */
+  unsigned long long  num_records;    /* The number of records written. */
+  int                 error;          /* Nonzero once a write has failed. */
+  unsigned long long  bytes_written;  /* The bytes written to the file. */
+} Exporter;
+
+int export_open   (Exporter          *exporter,
+                   const char        *path,
+                   ExportFormat       format,
+                   const char *const *names,
+                   int                num_fields);
+int export_record (Exporter          *exporter,
+                   const char *const *values);
+int export_close  (Exporter          *exporter);
+
+#endif
@@ -0,0 +1,386 @@
+/* frontcode.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "frontcode.h"
+#include "mem.h"
+#include "utils.h"
+
+/* The number of strings per block.  A lookup decodes at most this many. */
+#define BLOCK_SIZE 16
+
+/* Function: frontcode_compare
+ * ---------------------------
+ * Compare two strings in the order of a front-coded list.
+ *
+ * Strings are ordered without regard to case first, so that all case
+ * variants of a string are next to each other, and then exactly.
+ *
+ * a: The first string.
+ * b: The second string.
+ *
+ * returns: A negative value, 0 or a positive value
+ *          if a sorts before, equal to or after b.
+ */
+int
+frontcode_compare (const char *a,
+                   const char *b)
+{
+  int cmp;
+
+  cmp = strcasecmp (a, b);
+  return cmp != 0 ? cmp : strcmp (a, b);
+}
+
+/* Function: frontcode_build
+ * -------------------------
+ * Encode a sorted list of distinct strings.
+ *
+ * fc: The list to build. Any previous contents are not freed.
+ * strings: The strings, sorted by `frontcode_compare`,
+ *          each at most FRONTCODE_MAX_LEN bytes long.
+ * count: The number of strings.
+ *
+ * returns: 0 on success, or -1 if a string is too long
+ *          or memory could not be allocated.
+ */
+int
+frontcode_build (FrontCode         *fc,
+                 const char *const *strings,
+                 unsigned int       count)
+{
+  size_t size, len, shared, num_blocks;
+  unsigned char *p;
+  unsigned int i;
+
+  memset (fc, 0, sizeof (FrontCode));
+
+  size = 0;
+  for (i = 0; i < count; i++)
+    {
+      len = strlen (strings[i]);
+      if (len > FRONTCODE_MAX_LEN)
+        return -1;
+
+      if (i % BLOCK_SIZE == 0)
+        size += 1 + len;
+      else
+        {
+          for (shared = 0; shared < len && strings[i][shared] == strings[i - 1][shared]; shared++)
+            {}
+          size += 2 + len - shared;
+        }
+    }
+
+  num_blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  fc->data = (unsigned char *) mem_alloc (MEM_STRINGS, size ? size : 1);
+  fc->blocks = (size_t *) mem_alloc (MEM_STRINGS, sizeof (size_t) * (num_blocks ? num_blocks : 1));
+  if (fc->data == NULL || fc->blocks == NULL)
+    {
+      frontcode_free (fc);
+      return -1;
+    }
+
+  p = fc->data;
+  for (i = 0; i < count; i++)
+    {
+      len = strlen (strings[i]);
+      if (i % BLOCK_SIZE == 0)
+        {
+          fc->blocks[i / BLOCK_SIZE] = (size_t) (p - fc->data);
+          *p++ = (unsigned char) len;
+          memcpy (p, strings[i], len);
+          p += len;
+        }
+      else
+        {
+          for (shared = 0; shared < len && strings[i][shared] == strings[i - 1][shared]; shared++)
+            {}
+          *p++ = (unsigned char) shared;
+          *p++ = (unsigned char) (len - shared);
+          memcpy (p, strings[i] + shared, len - shared);
+          p += len - shared;
+        }
+    }
+
+  fc->count = count;
+  return 0;
+}
+
+/* Function: frontcode_free
+ * ------------------------
+ * Release the memory held by a front-coded list and leave it empty.
+ *
+ * fc: The list to free.
+ */
+void
+frontcode_free (FrontCode *fc)
+{
+  mem_free (fc->data);
+  mem_free (fc->blocks);
+  memset (fc, 0, sizeof (FrontCode));
+}
+
+/* Function: decode_next
+ * ---------------------
+ * Decode the string following the one in buf within a block.
+ *
+ * p: A pointer to the encoded string. Advanced past it.
+ * buf: Holds the previous string on entry and the decoded string on return.
+ */
+static void
+decode_next (const unsigned char **p,
+             char                 *buf)
+{
+  size_t shared, suffix;
+
+  shared = *(*p)++;
+  suffix = *(*p)++;
+  memcpy (buf + shared, *p, suffix);
+  buf[shared + suffix] = '\0';
+  *p += suffix;
+}
+
+/* Function: decode_head
+ * ---------------------
+ * Decode the first string of a block.
+ *
+ * fc: The list.
+ * block: The block number.
+ * buf: Receives the string. Must hold FRONTCODE_MAX_LEN + 1 bytes.
+ *
+ * returns: A pointer to the encoded string that follows the head.
+ */
+static const unsigned char *
+decode_head (const FrontCode *fc,
+             size_t           block,
+             char            *buf)
+{
+  const unsigned char *p;
+  size_t len;
+
+  p = fc->data + fc->blocks[block];
+  len = *p++;
+  memcpy (buf, p, len);
+  buf[len] = '\0';
+
+  return p + len;
+}
+
+/* Function: frontcode_get
+ * -----------------------
+ * Decode the string of a code.
+ *
+ * fc: The list.
+ * code: The position of the string, less than the number of strings.
+ * buf: Receives the string. Must hold FRONTCODE_MAX_LEN + 1 bytes.
+ *
+ * returns: buf.
+ */
+const char *
+frontcode_get (const FrontCode *fc,
+               unsigned int     code,
+               char            *buf)
+{
+  const unsigned char *p;
+  unsigned int i;
+
+  p = decode_head (fc, code / BLOCK_SIZE, buf);
+  for (i = 0; i < code % BLOCK_SIZE; i++)
+    decode_next (&p, buf);
+
+  return buf;
+}
+
+/* Function: frontcode_decode
+ * --------------------------
+ * Decode every string of the list in order, which costs one step per
+ * string instead of the up to BLOCK_SIZE a `frontcode_get` takes.
+ *
+ * fc: The list.
+ * strings: Receives a pointer to each string, indexed by code.
+ *          Must hold as many pointers as the list has strings.
+ *
+ * returns: The block holding the strings, to be released with `mem_free`,
+ *          or NULL if memory could not be allocated.
+ */
+char *
+frontcode_decode (const FrontCode  *fc,
+                  const char      **strings)
+{
+  const unsigned char *p;
+  char *heap, *s;
+  size_t size, len;
+  unsigned int i;
+
+  size = 0;
+  p = fc->data;
+  for (i = 0; i < fc->count; i++)
+    {
+      if (i % BLOCK_SIZE == 0)
+        {
+          len = *p;
+          p += 1 + len;
+        }
+      else
+        {
+          len = p[0] + p[1];
+          p += 2 + p[1];
+        }
+      size += len + 1;
+    }
+
+  heap = (char *) mem_alloc (MEM_BUFFERS, size ? size : 1);
+  if (heap == NULL)
+    return NULL;
+
+  p = fc->data;
+  s = heap;
+  for (i = 0; i < fc->count; i++)
+    {
+      if (i % BLOCK_SIZE == 0)
+        {
+          len = *p++;
+          memcpy (s, p, len);
+          p += len;
+        }
+      else
+        {
+          memcpy (s, strings[i - 1], p[0]);
+          len = p[0] + p[1];
+          memcpy (s + p[0], p + 2, p[1]);
+          p += 2 + p[1];
+        }
+      s[len] = '\0';
+      strings[i] = s;
+      s += len + 1;
+    }
+
+  return heap;
+}
+
+/* Function: bound
+ * ---------------
+ * Find the first string that does not sort before s,
+ * or with upper set, the first string that sorts after s.
+ *
+ * The blocks are binary searched on their first strings,
+ * then the one candidate block is decoded in order.
+ *
+ * fc: The list.
+ * s: The string to search for.
+ * cmp: The comparison the list is sorted by, or a coarser one.
+ * upper: 0 for a lower bound, 1 for an upper bound.
+ *
+ * returns: The position found, between 0 and the number of strings.
+ */
+static unsigned int
+bound (const FrontCode *fc,
+       const char      *s,
+       int            (*cmp) (const char *, const char *),
+       int              upper)
+{
+  char buf[FRONTCODE_MAX_LEN + 1];
+  const unsigned char *p;
+  size_t lo, hi, mid, num_blocks;
+  unsigned int i, end;
+  int c;
+
+  num_blocks = (fc->count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+  /* Find the last block whose first string is before the bound. */
+  lo = 0;
+  hi = num_blocks;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      decode_head (fc, mid, buf);
+      c = cmp (buf, s);
+      if (c < 0 || (upper && c == 0))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  if (lo == 0)
+    return 0;
+
+  i = (unsigned int) (lo - 1) * BLOCK_SIZE;
+  end = i + BLOCK_SIZE < fc->count ? i + BLOCK_SIZE : fc->count;
+  p = decode_head (fc, lo - 1, buf);
+  for (i++; i < end; i++)
+    {
+      decode_next (&p, buf);
+      c = cmp (buf, s);
+      if (!(c < 0 || (upper && c == 0)))
+        return i;
+    }
+
+  return end;
+}
+
+/* Function: frontcode_lookup
+ * --------------------------
+ * Find the code of a string.
+ *
+ * fc: The list.
+ * s: The string, compared exactly.
+ *
+ * returns: The code of the string, or (unsigned int) -1 if it is not present.
+ */
+unsigned int
+frontcode_lookup (const FrontCode *fc,
+                  const char      *s)
+{
+  char buf[FRONTCODE_MAX_LEN + 1];
+  unsigned int i;
+
+  if (strlen (s) > FRONTCODE_MAX_LEN)
+    return (unsigned int) -1;
+
+  i = bound (fc, s, frontcode_compare, 0);
+  if (i < fc->count && !strcmp (frontcode_get (fc, i, buf), s))
+    return i;
+
+  return (unsigned int) -1;
+}
+
+/* Function: frontcode_range
+ * -------------------------
+ * Find the codes of every string equal to s when case is ignored.
+ *
+ * Because the list is sorted without regard to case first,
+ * the matching codes form one contiguous range.
+ *
+ * fc: The list.
+ * s: The string to match.
+ * first: Receives the first matching code.
+ * last: Receives one past the last matching code.
+ */
+void
+frontcode_range (const FrontCode *fc,
+                 const char      *s,
+                 unsigned int    *first,
+                 unsigned int    *last)
+{
+  *first = bound (fc, s, strcasecmp, 0);
+  *last = bound (fc, s, strcasecmp, 1);
+}
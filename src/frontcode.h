@@ -0,0 +1,60 @@
+/* frontcode.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FRONTCODE_H
+#define FRONTCODE_H
+
+#include <stddef.h>
+
+/* The longest string a front-coded list can hold, excluding the terminator. */
+#define FRONTCODE_MAX_LEN 255
+
+/* A sorted list of distinct strings stored with front coding.
+ *
+ * The strings are grouped in blocks.  The first string of a block is stored
+ * whole; every other string is stored as the length of the prefix it shares
+ * with the string before it, followed by the rest of its bytes.  The code of
+ * a string is its position in the list. */
+typedef struct
+{
+  unsigned char *data;       /* The encoded blocks. */
+  size_t        *blocks;     /* The offset in data of each block. */
+  unsigned int   count;      /* The number of strings. */
+} FrontCode;
+
+int           frontcode_compare (const char         *a,
+                                 const char         *b);
+int           frontcode_build   (FrontCode          *fc,
+                                 const char *const  *strings,
+                                 unsigned int        count);
+void          frontcode_free    (FrontCode          *fc);
+char         *frontcode_decode  (const FrontCode    *fc,
+                                 const char        **strings);
+const char   *frontcode_get     (const FrontCode    *fc,
+                                 unsigned int        code,
+                                 char               *buf);
+unsigned int  frontcode_lookup  (const FrontCode    *fc,
+                                 const char         *s);
+void          frontcode_range   (const FrontCode    *fc,
+                                 const char         *s,
+                                 unsigned int       *first,
+                                 unsigned int       *last);
+
+#endif
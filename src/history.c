@@ -0,0 +1,472 @@
+/* history.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "history.h"
+
+/* The bytes every segment starts with. */
+#define MAGIC "RLH1"
+#define MAGIC_LEN 4
+
+/* The bytes of a record before its accession number. */
+#define HEAD_LEN 7
+
+/* Function: segment_path
+ * ----------------------
+ * Get the file name of the segment of a month.
+ */
+static void
+segment_path (const char   *dir,
+              unsigned int  month,
+              char         *path,
+              size_t        len)
+{
+  snprintf (path, len, "%s/%04u-%02u.log", dir, month / 100, month % 100);
+}
+
+/* Function: next_month
+ * --------------------
+ * Get the month after a month, both as YYYYMM.
+ */
+static unsigned int
+next_month (unsigned int month)
+{
+  return month % 100 == 12 ? (month / 100 + 1) * 100 + 1 : month + 1;
+}
+
+/* Function: parse_segment_name
+ * ----------------------------
+ * Get the month of a segment from its file name.
+ *
+ * name: A file name such as "2023-05.log".
+ *
+ * returns: The month as YYYYMM, or 0 if name is not the name of a segment.
+ */
+static unsigned int
+parse_segment_name (const char *name)
+{
+  int i;
+
+  for (i = 0; i < 7; i++)
+    if (i == 4 ? name[i] != '-' : (name[i] < '0' || name[i] > '9'))
+      return 0;
+  if (strcmp (name + 7, ".log"))
+    return 0;
+
+  return ((name[0] - '0') * 1000 + (name[1] - '0') * 100 + (name[2] - '0') * 10 + (name[3] - '0')) * 100
+         + (name[5] - '0') * 10 + (name[6] - '0');
+}
+
+/* Function: trim_segment
+ * -----------------------
+ * Cut off a record left unfinished at the end of a segment by a crash
+ * while appending, so that the records appended after it can be read.
+ *
+ * path: The segment, which need not exist.
+ *
+ * returns: 0 on success, or -1 if the segment could not be read or cut.
+ */
+static int
+trim_segment (const char *path)
+{
+  unsigned char head[HEAD_LEN];
+  char magic[MAGIC_LEN];
+  struct stat st;
+  off_t end;
+  FILE *fp;
+
+  fp = fopen (path, "rb");
+  if (fp == NULL)
+    return errno == ENOENT ? 0 : -1;
+  if (fstat (fileno (fp), &st) != 0)
+    {
+      fclose (fp);
+      return -1;
+    }
+
+  end = 0;
+  if (fread (magic, 1, MAGIC_LEN, fp) == MAGIC_LEN)
+    {
+      /* Not a segment; history_next reports it rather than lose it. */
+      if (memcmp (magic, MAGIC, MAGIC_LEN))
+        {
+          fclose (fp);
+          return 0;
+        }
+      end = MAGIC_LEN;
+      while (end + HEAD_LEN <= st.st_size && fread (head, 1, HEAD_LEN, fp) == HEAD_LEN
+             && end + HEAD_LEN + head[6] <= st.st_size && fseek (fp, head[6], SEEK_CUR) == 0)
+        end += HEAD_LEN + head[6];
+    }
+  fclose (fp);
+
+  if (end < st.st_size && truncate (path, end) != 0)
+    return -1;
+
+  return 0;
+}
+
+/* Function: history_parse_date
+ * ----------------------------
+ * Parse a date written as YYYY-MM-DD.
+ *
+ * s: The date.
+ *
+ * returns: The date as YYYYMMDD, or 0 if s is not a date.
+ */
+unsigned int
+history_parse_date (const char *s)
+{
+  unsigned int year, month, day;
+  int i;
+
+  for (i = 0; i < 10; i++)
+    if (i == 4 || i == 7 ? s[i] != '-' : (s[i] < '0' || s[i] > '9'))
+      return 0;
+  if (s[10] != '\0')
+    return 0;
+
+  year = (s[0] - '0') * 1000 + (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0');
+  month = (s[5] - '0') * 10 + (s[6] - '0');
+  day = (s[8] - '0') * 10 + (s[9] - '0');
+  if (month < 1 || month > 12 || day < 1 || day > 31)
+    return 0;
+
+  return year * 10000 + month * 100 + day;
+}
+
+/* Function: history_init
+ * ----------------------
+ * Initialize a history kept in a directory.
+ * The directory is created when the first record is appended.
+ *
+ * history: The history to initialize.
+ * dir: The directory of the segments.
+ */
+void
+history_init (History    *history,
+              const char *dir)
+{
+  snprintf (history->dir, sizeof (history->dir), "%s", dir);
+  history->fp = NULL;
+  history->month = 0;
+  history->bytes_written = 0;
+}
+
+/* Function: history_close
+ * -----------------------
+ * Close the segment open for appending, if any.
+ *
+ * history: The history.
+ */
+void
+history_close (History *history)
+{
+  if (history->fp != NULL)
+    fclose (history->fp);
+  history->fp = NULL;
+  history->month = 0;
+}
+
+/* Function: history_sync
+ * ----------------------
+ * Wait until the records appended so far are on disk.
+ *
+ * history: The history.
+ *
+ * returns: 0 on success, or -1 if the segment could not be synced.
+ */
+int
+history_sync (History *history)
+{
+  if (history->fp == NULL)
+    return 0;
+
+  return fsync (fileno (history->fp)) == 0 ? 0 : -1;
+}
+
+/* Function: history_append
+ * ------------------------
+ * Append a record to the segment of its month.
+ *
+ * The segment stays open until a record of another month is appended
+ * or the history is closed, and every record is flushed to the file
+ * so that readers see it at once.  A record left unfinished by a crash
+ * is cut off when the segment is opened.
+ *
+ * history: The history.
+ * record: The record.
+ *
+ * returns: 0 on success, or -1 if the record could not be written.
+ */
+int
+history_append (History             *history,
+                const HistoryRecord *record)
+{
+  unsigned char buf[HEAD_LEN + HISTORY_MAX_ACCESSION];
+  char path[sizeof (history->dir) + 16];
+  unsigned int month;
+  size_t len;
+
+  month = record->date / 100;
+  if (history->fp == NULL || history->month != month)
+    {
+      history_close (history);
+      if (mkdir (history->dir, 0777) != 0 && errno != EEXIST)
+        return -1;
+
+      segment_path (history->dir, month, path, sizeof (path));
+      if (trim_segment (path) != 0)
+        return -1;
+      history->fp = fopen (path, "ab");
+      if (history->fp == NULL)
+        return -1;
+      history->month = month;
+
+      if (fseek (history->fp, 0, SEEK_END) != 0)
+        {
+          history_close (history);
+          return -1;
+        }
+      if (ftell (history->fp) == 0)
+        {
+          if (fwrite (MAGIC, 1, MAGIC_LEN, history->fp) != MAGIC_LEN)
+            {
+              history_close (history);
+              return -1;
+            }
+          history->bytes_written += MAGIC_LEN;
+        }
+    }
+
+  len = strlen (record->accession_num);
+  if (len > HISTORY_MAX_ACCESSION)
+    len = HISTORY_MAX_ACCESSION;
+
+  buf[0] = (unsigned char) record->event;
+  buf[1] = (unsigned char) (record->date % 100);
+  buf[2] = (unsigned char) record->patron;
+  buf[3] = (unsigned char) (record->patron >> 8);
+  buf[4] = (unsigned char) (record->patron >> 16);
+  buf[5] = (unsigned char) (record->patron >> 24);
+  buf[6] = (unsigned char) len;
+  memcpy (buf + HEAD_LEN, record->accession_num, len);
+
+  if (fwrite (buf, 1, HEAD_LEN + len, history->fp) != HEAD_LEN + len || fflush (history->fp) != 0)
+    {
+      history_close (history);
+      return -1;
+    }
+  history->bytes_written += HEAD_LEN + len;
+
+  return 0;
+}
+
+/* Function: history_seek
+ * ----------------------
+ * Start reading the records of a range of dates.
+ *
+ * Only the segments of the months in the range are opened, and the
+ * range is first narrowed to the months that have a segment.
+ *
+ * history: The history.
+ * cursor: Receives the position, to be passed to `history_next`
+ *         and released with `history_end`.
+ * first_date: The first date to read, as YYYYMMDD, or 0 for the earliest.
+ * last_date: The last date to read, as YYYYMMDD.
+ *
+ * returns: 0 on success, or -1 if the directory could not be read.
+ */
+int
+history_seek (const History *history,
+              HistoryCursor *cursor,
+              unsigned int   first_date,
+              unsigned int   last_date)
+{
+  struct dirent *entry;
+  unsigned int month, first_month, last_month;
+  DIR *dir;
+
+  cursor->history = history;
+  cursor->first_date = first_date;
+  cursor->last_date = last_date;
+  cursor->fp = NULL;
+  cursor->num_segments = 0;
+  cursor->bytes_read = 0;
+  cursor->month = 1;
+  cursor->end_month = 0;
+
+  dir = opendir (history->dir);
+  if (dir == NULL)
+    return errno == ENOENT ? 0 : -1;
+
+  first_month = (unsigned int) -1;
+  last_month = 0;
+  while ((entry = readdir (dir)) != NULL)
+    {
+      month = parse_segment_name (entry->d_name);
+      if (month == 0)
+        continue;
+      if (month < first_month)
+        first_month = month;
+      if (month > last_month)
+        last_month = month;
+    }
+  closedir (dir);
+
+  cursor->month = first_date / 100 > first_month ? first_date / 100 : first_month;
+  cursor->end_month = last_date / 100 < last_month ? last_date / 100 : last_month;
+  return 0;
+}
+
+/* Function: history_next
+ * ----------------------
+ * Read the next record of a range.
+ *
+ * Records are read in the order they were appended within each month.
+ * A record cut short at the end of a segment, as left by a crash
+ * while appending, ends that segment.
+ *
+ * cursor: The position, as set by `history_seek`.
+ * record: Receives the record.
+ *
+ * returns: 1 if a record was read, 0 at the end of the range,
+ *          or -1 if a segment is not a history segment.
+ */
+int
+history_next (HistoryCursor *cursor,
+              HistoryRecord *record)
+{
+  unsigned char head[HEAD_LEN];
+  char path[sizeof (cursor->history->dir) + 16];
+  char magic[MAGIC_LEN];
+  size_t len;
+
+  for (;;)
+    {
+      if (cursor->fp == NULL)
+        {
+          if (cursor->month > cursor->end_month)
+            return 0;
+
+          segment_path (cursor->history->dir, cursor->month, path, sizeof (path));
+          cursor->fp = fopen (path, "rb");
+          if (cursor->fp == NULL)
+            {
+              cursor->month = next_month (cursor->month);
+              continue;
+            }
+          cursor->num_segments++;
+
+          if (fread (magic, 1, MAGIC_LEN, cursor->fp) != MAGIC_LEN || memcmp (magic, MAGIC, MAGIC_LEN))
+            {
+              history_end (cursor);
+              return -1;
+            }
+          cursor->bytes_read += MAGIC_LEN;
+        }
+
+      len = 0;
+      if (fread (head, 1, HEAD_LEN, cursor->fp) == HEAD_LEN)
+        {
+          len = head[6];
+          if (fread (record->accession_num, 1, len, cursor->fp) != len)
+            len = (size_t) -1;
+        }
+      else
+        len = (size_t) -1;
+
+      if (len == (size_t) -1)
+        {
+          fclose (cursor->fp);
+          cursor->fp = NULL;
+          cursor->month = next_month (cursor->month);
+          continue;
+        }
+      cursor->bytes_read += HEAD_LEN + len;
+
+      record->accession_num[len] = '\0';
+      record->event = head[0];
+      record->date = cursor->month * 100 + head[1];
+      record->patron = (unsigned int) head[2] | (unsigned int) head[3] << 8
+                       | (unsigned int) head[4] << 16 | (unsigned int) head[5] << 24;
+
+      if (record->date >= cursor->first_date && record->date <= cursor->last_date)
+        return 1;
+    }
+}
+
+/* Function: history_end
+ * ---------------------
+ * Stop reading a range and close its segment.
+ *
+ * cursor: The position.
+ */
+void
+history_end (HistoryCursor *cursor)
+{
+  if (cursor->fp != NULL)
+    fclose (cursor->fp);
+  cursor->fp = NULL;
+  cursor->month = 1;
+  cursor->end_month = 0;
+}
+
+/* Function: history_size
+ * ----------------------
+ * Get the size of the history, which grows with every record appended.
+ *
+ * history: The history.
+ *
+ * returns: The total bytes of the segments, or 0 if there are none.
+ */
+unsigned long long
+history_size (const History *history)
+{
+  char path[sizeof (history->dir) + 16];
+  struct dirent *entry;
+  unsigned long long size;
+  unsigned int month;
+  struct stat st;
+  DIR *dir;
+
+  dir = opendir (history->dir);
+  if (dir == NULL)
+    return 0;
+
+  size = 0;
+  while ((entry = readdir (dir)) != NULL)
+    {
+      month = parse_segment_name (entry->d_name);
+      if (month == 0)
+        continue;
+      segment_path (history->dir, month, path, sizeof (path));
+      if (stat (path, &st) == 0)
+        size += (unsigned long long) st.st_size;
+    }
+  closedir (dir);
+
+  return size;
+}
@@ -0,0 +1,85 @@
+/* history.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdio.h>
+
+/* The events recorded in the circulation history. */
+#define HISTORY_BORROW 'B'
+#define HISTORY_RETURN 'R'
+
+/* The longest accession number a record can hold, excluding the terminator. */
+#define HISTORY_MAX_ACCESSION 255
+
+/* One borrow or return. */
+typedef struct
+{
+  int          event;                                /* HISTORY_BORROW or HISTORY_RETURN. */
+  unsigned int date;                                 /* The date, as YYYYMMDD. */
+  unsigned int patron;                               /* The id of the borrower. */
+  char         accession_num[HISTORY_MAX_ACCESSION + 1]; /* The accession number of the book. */
+} HistoryRecord;
+
+/* A circulation history split into one segment file per month.
+ *
+ * Segments are named YYYY-MM.log and hold a magic number followed by
+ * variable-length records: the event, the day of the month, the patron
+ * id in 4 little-endian bytes, and the accession number prefixed by its
+ * length.  The month is implied by the segment. */
+typedef struct
+{
+  char                dir[256];       /* The directory holding the segments. */
+  FILE               *fp;             /* The segment open for appending, or NULL. */
+  unsigned int        month;          /* The month of that segment, as YYYYMM. */
+  unsigned long long  bytes_written;  /* The bytes appended since last cleared. */
+} History;
+
+/* A position in a range of the history, as read by `history_next`. */
+typedef struct
+{
+  const History      *history;       /* The history being read. */
+  unsigned int        first_date;    /* The first date of the range, as YYYYMMDD. */
+  unsigned int        last_date;     /* The last date of the range, as YYYYMMDD. */
+  unsigned int        month;         /* The month of the next segment to read, as YYYYMM. */
+  unsigned int        end_month;     /* The last month to read, as YYYYMM. */
+  FILE               *fp;            /* The segment being read, or NULL. */
+  unsigned int        num_segments;  /* The number of segments opened so far. */
+  unsigned long long  bytes_read;    /* The bytes read so far. */
+} HistoryCursor;
+
+void               history_init       (History             *history,
+                                       const char          *dir);
+void               history_close      (History             *history);
+int                history_append     (History             *history,
+                                       const HistoryRecord *record);
+int                history_sync       (History             *history);
+int                history_seek       (const History       *history,
+                                       HistoryCursor       *cursor,
+                                       unsigned int         first_date,
+                                       unsigned int         last_date);
+int                history_next       (HistoryCursor       *cursor,
+                                       HistoryRecord       *record);
+void               history_end        (HistoryCursor       *cursor);
+unsigned int       history_parse_date (const char          *s);
+unsigned long long history_size       (const History       *history);
+
+#endif
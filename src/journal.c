@@ -0,0 +1,331 @@
+/* journal.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "journal.h"
+
+/* The bytes every journal starts with. */
+#define MAGIC "RLJ1"
+#define MAGIC_LEN 4
+
+/* The bytes of a record before its values. */
+#define HEAD_LEN 4
+
+/* The bytes of the checksum that ends a record. */
+#define SUM_LEN 4
+
+/* Function: trim
+ * ---------------
+ * Cut off the records after the first one that fails its checksum,
+ * as left by a crash while appending, so that the records appended
+ * after them can be read.  A file that is not a journal is emptied.
+ *
+ * path: The journal file, which need not exist.
+ *
+ * returns: 0 on success, or -1 if the file could not be read or cut.
+ */
+static int
+trim (const char *path)
+{
+  JournalCursor cursor;
+  JournalRecord record;
+  struct stat st;
+  int status;
+
+  status = journal_start (path, &cursor);
+  if (status == 0)
+    return 0;
+  if (status > 0)
+    while (journal_next (&cursor, &record)) {}
+  journal_end (&cursor);
+
+  if (stat (path, &st) != 0)
+    return -1;
+  if ((unsigned long long) st.st_size > cursor.bytes_read && truncate (path, cursor.bytes_read) != 0)
+    return -1;
+
+  return 0;
+}
+
+/* Function: journal_init
+ * ----------------------
+ * Initialize a journal kept in a file.
+ * The file is created when the first record is appended.
+ *
+ * journal: The journal to initialize.
+ * path: The file.
+ */
+void
+journal_init (Journal    *journal,
+              const char *path)
+{
+  snprintf (journal->path, sizeof (journal->path), "%s", path);
+  journal->fp = NULL;
+  journal->bytes_written = 0;
+}
+
+/* Function: journal_close
+ * -----------------------
+ * Close the file open for appending, if any.
+ *
+ * journal: The journal.
+ */
+void
+journal_close (Journal *journal)
+{
+  if (journal->fp != NULL)
+    fclose (journal->fp);
+  journal->fp = NULL;
+}
+
+/* Function: journal_append
+ * ------------------------
+ * Append a record to the journal.
+ *
+ * Every record is flushed to the file, so it survives the program
+ * being killed; `journal_sync` makes it survive the system crashing.
+ * When the file is opened, a torn record at its end is cut off first.
+ *
+ * journal: The journal.
+ * record: The record.  Values longer than JOURNAL_MAX_VALUE are cut short.
+ *
+ * returns: 0 on success, or -1 if the record could not be written.
+ */
+int
+journal_append (Journal             *journal,
+                const JournalRecord *record)
+{
+  unsigned char buf[HEAD_LEN + 3 * JOURNAL_MAX_VALUE + SUM_LEN];
+  const char *values[3];
+  unsigned int sum;
+  size_t len, n;
+  int v;
+
+  if (journal->fp == NULL)
+    {
+      if (trim (journal->path) != 0)
+        return -1;
+      journal->fp = fopen (journal->path, "ab");
+      if (journal->fp == NULL)
+        return -1;
+      if (fseek (journal->fp, 0, SEEK_END) != 0)
+        {
+          journal_close (journal);
+          return -1;
+        }
+      if (ftell (journal->fp) == 0)
+        {
+          if (fwrite (MAGIC, 1, MAGIC_LEN, journal->fp) != MAGIC_LEN)
+            {
+              journal_close (journal);
+              return -1;
+            }
+          journal->bytes_written += MAGIC_LEN;
+        }
+    }
+
+  values[0] = record->accession_num;
+  values[1] = record->date;
+  values[2] = record->borrower;
+  buf[0] = (unsigned char) record->event;
+  len = HEAD_LEN;
+  for (v = 0; v < 3; v++)
+    {
+      n = strlen (values[v]);
+      if (n > JOURNAL_MAX_VALUE)
+        n = JOURNAL_MAX_VALUE;
+      buf[1 + v] = (unsigned char) n;
+      memcpy (buf + len, values[v], n);
+      len += n;
+    }
+  sum = crc32c (0, buf, len);
+  buf[len++] = (unsigned char) sum;
+  buf[len++] = (unsigned char) (sum >> 8);
+  buf[len++] = (unsigned char) (sum >> 16);
+  buf[len++] = (unsigned char) (sum >> 24);
+
+  if (fwrite (buf, 1, len, journal->fp) != len || fflush (journal->fp) != 0)
+    {
+      journal_close (journal);
+      return -1;
+    }
+  journal->bytes_written += len;
+
+  return 0;
+}
+
+/* Function: journal_sync
+ * ----------------------
+ * Wait until the records appended so far are on disk.
+ *
+ * journal: The journal.
+ *
+ * returns: 0 on success, or -1 if the file could not be synced.
+ */
+int
+journal_sync (Journal *journal)
+{
+  if (journal->fp == NULL)
+    return 0;
+
+  return fsync (fileno (journal->fp)) == 0 ? 0 : -1;
+}
+
+/* Function: journal_rename
+ * ------------------------
+ * Move the journal's file to another name, once the records appended
+ * so far are on disk, and wait until the new name is on disk too.
+ * Records appended afterwards start a new file under the old name.
+ *
+ * journal: The journal.
+ * path: The new name, in the same directory.
+ *
+ * returns: 0 on success, including when there is no file yet,
+ *          or -1 if the file could not be synced or renamed.
+ */
+int
+journal_rename (Journal    *journal,
+                const char *path)
+{
+  char dir[sizeof (journal->path)];
+  char *slash;
+  int fd, status;
+
+  status = journal_sync (journal);
+  journal_close (journal);
+  if (status != 0)
+    return -1;
+  if (rename (journal->path, path) != 0)
+    return errno == ENOENT ? 0 : -1;
+
+  snprintf (dir, sizeof (dir), "%s", journal->path);
+  slash = strrchr (dir, '/');
+  if (slash == NULL)
+    strcpy (dir, ".");
+  else if (slash == dir)
+    dir[1] = '\0';
+  else
+    *slash = '\0';
+
+  fd = open (dir, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  status = fsync (fd);
+  close (fd);
+
+  return status == 0 ? 0 : -1;
+}
+
+/* Function: journal_start
+ * -----------------------
+ * Start reading the records of a journal file.
+ *
+ * path: The file.
+ * cursor: Receives the position before the first record.
+ *
+ * returns: 1 if the file was opened, 0 if there is no such file,
+ *          or -1 if it could not be read or is not a journal.
+ */
+int
+journal_start (const char    *path,
+               JournalCursor *cursor)
+{
+  char magic[MAGIC_LEN];
+
+  cursor->bytes_read = 0;
+  cursor->fp = fopen (path, "rb");
+  if (cursor->fp == NULL)
+    return access (path, F_OK) == 0 ? -1 : 0;
+
+  if (fread (magic, 1, MAGIC_LEN, cursor->fp) != MAGIC_LEN || memcmp (magic, MAGIC, MAGIC_LEN))
+    {
+      journal_end (cursor);
+      return -1;
+    }
+  cursor->bytes_read += MAGIC_LEN;
+
+  return 1;
+}
+
+/* Function: journal_next
+ * ----------------------
+ * Read the next record.
+ *
+ * cursor: The position, moved past the record.
+ * record: Receives the record.
+ *
+ * returns: 1 if a record was read, or 0 at the end of the journal,
+ *          which is also where a record cut short ends it.
+ */
+int
+journal_next (JournalCursor *cursor,
+              JournalRecord *record)
+{
+  unsigned char buf[HEAD_LEN + 3 * JOURNAL_MAX_VALUE + SUM_LEN];
+  char *values[3];
+  unsigned int sum;
+  size_t len, n;
+  int v;
+
+  if (cursor->fp == NULL || fread (buf, 1, HEAD_LEN, cursor->fp) != HEAD_LEN)
+    return 0;
+
+  n = buf[1] + buf[2] + buf[3] + SUM_LEN;
+  if (fread (buf + HEAD_LEN, 1, n, cursor->fp) != n)
+    return 0;
+  len = HEAD_LEN + n - SUM_LEN;
+  sum = (unsigned int) buf[len] | (unsigned int) buf[len + 1] << 8
+        | (unsigned int) buf[len + 2] << 16 | (unsigned int) buf[len + 3] << 24;
+  if (sum != crc32c (0, buf, len))
+    return 0;
+  cursor->bytes_read += len + SUM_LEN;
+
+  record->event = buf[0];
+  values[0] = record->accession_num;
+  values[1] = record->date;
+  values[2] = record->borrower;
+  len = HEAD_LEN;
+  for (v = 0; v < 3; v++)
+    {
+      memcpy (values[v], buf + len, buf[1 + v]);
+      values[v][buf[1 + v]] = '\0';
+      len += buf[1 + v];
+    }
+
+  return 1;
+}
+
+/* Function: journal_end
+ * ---------------------
+ * Stop reading a journal.
+ */
+void
+journal_end (JournalCursor *cursor)
+{
+  if (cursor->fp != NULL)
+    fclose (cursor->fp);
+  cursor->fp = NULL;
+}
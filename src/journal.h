@@ -0,0 +1,77 @@
+/* journal.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+
+/* The changes recorded in a journal. */
+#define JOURNAL_LEND 'L'
+#define JOURNAL_RETURN 'R'
+
+/* The longest value a record can hold, excluding the terminator. */
+#define JOURNAL_MAX_VALUE 255
+
+/* One loan or return. */
+typedef struct
+{
+  int   event;                                 /* JOURNAL_LEND or JOURNAL_RETURN. */
+  char  accession_num[JOURNAL_MAX_VALUE + 1];  /* The accession number of the book. */
+  char  date[JOURNAL_MAX_VALUE + 1];           /* The date the book was lent or returned. */
+  char  borrower[JOURNAL_MAX_VALUE + 1];       /* The name of the borrower, or "" for a return. */
+} JournalRecord;
+
+/* A log of the loans and returns made since the catalog file was last
+ * written, from which they can be made again after a crash.
+ *
+ * The file holds a magic number followed by records: the event, the
+ * lengths of the accession number, date and borrower, those values,
+ * and a CRC-32C checksum of all of it in 4 little-endian bytes.  A
+ * record cut short by a crash fails its checksum and ends the journal. */
+typedef struct
+{
+  char                path[256];      /* The file. */
+  FILE               *fp;             /* The file open for appending, or NULL. */
+  unsigned long long  bytes_written;  /* The bytes appended since last cleared. */
+} Journal;
+
+/* A position in a journal, as read by `journal_next`. */
+typedef struct
+{
+  FILE               *fp;          /* The file being read, or NULL. */
+  unsigned long long  bytes_read;  /* The bytes read so far. */
+} JournalCursor;
+
+void journal_init   (Journal             *journal,
+                     const char          *path);
+void journal_close  (Journal             *journal);
+int  journal_append (Journal             *journal,
+                     const JournalRecord *record);
+int  journal_sync   (Journal             *journal);
+int  journal_rename (Journal             *journal,
+                     const char          *path);
+int  journal_start  (const char          *path,
+                     JournalCursor       *cursor);
+int  journal_next   (JournalCursor       *cursor,
+                     JournalRecord       *record);
+void journal_end    (JournalCursor       *cursor);
+
+#endif
@@ -18,68 +18,368 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "btree.h"
+#include "cache.h"
+#include "catalog.h"
+#include "column.h"
+#include "export.h"
+#include "history.h"
+#include "journal.h"
+#include "marc.h"
+#include "mem.h"
+#include "patron.h"
+#include "pool.h"
+#include "query.h"
+#include "sketch.h"
+#include "sort.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 
 #define FILE_NAME "data/library_catalog.csv"
+#define EXPORT_FILE_NAME "data/library_catalog"
+#define PATRON_FILE_NAME "data/patrons.csv"
+#define HISTORY_DIR "data/history"
+#define BRANCH_DIR "data/branches"
+#define LOCAL_BRANCH "local"
+#define MAX_BRANCH_LEN 64
+#define BRANCH_FRAMES 64
+#define SCAN_MIN_PARALLEL 65536
+#define SORT_MEMORY_MB 64
+#define SCAN_GROUP_OPS 1000
+#define SCAN_GROUP_MS 200
+#define AUTOSAVE_SECONDS 60
+#define AUTOSAVE_CHANGES 100
+#define CHECKPOINT_SUFFIX ".ckpt"
+#define JOURNAL_FILE_NAME FILE_NAME ".journal"
+#define OLD_JOURNAL_FILE_NAME JOURNAL_FILE_NAME ".old"
+#define POPULARITY_FILE_NAME "data/popularity.dat"
+#define POPULARITY_MAGIC "RLP2"
+#define TOP_N 10
 #define PROG_VER "librlog 0.5"
-#define MAX_LINE_LEN 2560
-#define MAX_FIELD_LEN 256
-#define MAX_NUM_FIELDS 10
+#define MAX_YEAR 9999
 #define EOF_ERR -1
 #define IO_ERR -2
 
-/* A struct representing a book in a library. */
+/* The catalog of another branch, from BRANCH_DIR, for searches across
+ * all branches.  A catalog file is loaded whole; a paged catalog is read
+ * through a buffer pool of BRANCH_FRAMES pages.  A shard is never
+ * changed or saved. */
 typedef struct
 {
-  char title[MAX_FIELD_LEN];            /* The title of the book. */
-  char author[MAX_FIELD_LEN];           /* The author of the book. */
-  char publisher[MAX_FIELD_LEN];        /* The publisher of the book. */
-  char publication_year[MAX_FIELD_LEN]; /* The year the book was published. */
-  char isbn[MAX_FIELD_LEN];             /* The International Standard Book Number (ISBN) of the book. */
-  char accession_num[MAX_FIELD_LEN];    /* The accession number of the book. */
-  char genre[MAX_FIELD_LEN];            /* The genre of the book. */
-  char checked_out_by[MAX_FIELD_LEN];   /* The name of the borrower who has checked out the book. */
-  char checked_out_date[MAX_FIELD_LEN]; /* The date the book was checked out. */
-  char return_date[MAX_FIELD_LEN];      /* The date the book is due to be returned. */
-} Book;
-
-/* Variable: books
- * ---------------
- * A pointer to an array of Book structs.
- *
- * This variable is used to store the library's collection of books.
- * The `load_catalog` function reads the contents of a file in CSV format and
- * populates the `books` array with the details of the books.
- * The `add_book`, `delete_book`, `borrow_book`, and `return_book` functions
- * modify the contents of the `books` array.
- */
-static Book *books;
-
-/* Variable: num_books
- * -------------------
- * An integer indicating the number of books in the library's collection.
+  char     branch[MAX_BRANCH_LEN];  /* The name of the branch, from the file name. */
+  Catalog *catalog;                 /* The catalog of the branch, or NULL if it is paged. */
+  BTree   *pages;                   /* The paged catalog of the branch, or NULL. */
+} Shard;
+
+/* The search of one branch, run by `search_branch` on a worker thread. */
+typedef struct
+{
+  Catalog     *catalog;      /* The catalog searched, or NULL. */
+  BTree       *pages;        /* The paged catalog searched, or NULL. */
+  const char  *branch;       /* The name of its branch. */
+  int          field;        /* The field compared, one of FIELD_*. */
+  const char  *value;        /* The value searched for. */
+  int         *matches;      /* The positions of the matching books of a catalog, in order. */
+  BTreeCursor *cursors;      /* The matching records of a paged catalog, in order. */
+  int          num_matches;  /* The number of matching books. */
+  int          error;        /* Whether memory ran out or a page could not be read. */
+} BranchSearch;
+
+/* A test of the book at a position, given the argument of its scan. */
+typedef int (*ScanMatch) (const void *arg,
+                          int         i);
+
+/* A scan of the books array by `scan_books`, split into one range
+ * of positions per task.  Each task keeps its own list of matches,
+ * so the tasks share nothing they write. */
+typedef struct
+{
+  ScanMatch    match;                          /* The test. */
+  const void  *arg;                            /* The argument of the test. */
+  int          num_tasks;                      /* The number of ranges. */
+  int         *matches[POOL_MAX_THREADS];      /* The matches of each range, in order. */
+  int          num_matches[POOL_MAX_THREADS];  /* The number of matches of each range. */
+  int          errors[POOL_MAX_THREADS];       /* Whether memory ran out in each range. */
+} Scan;
+
+/* The codes a field must hold, tested by `match_codes`. */
+typedef struct
+{
+  int                 field;      /* The field, one of FIELD_*. */
+  const unsigned int *codes;      /* The codes that match. */
+  size_t              num_codes;  /* The number of codes. */
+} CodeMatch;
+
+/* The ways `run_query` can reach the books a query might match. */
+typedef enum
+{
+  PATH_ACCESSION,  /* Follow the accession index for one accession number. */
+  PATH_BITMAPS,    /* Combine the genre and availability bitmaps. */
+  PATH_YEAR,       /* Read a span of the year index. */
+  PATH_SCAN,       /* Read every book. */
+  NUM_PATHS
+} AccessPath;
+
+/* A term of a query, resolved against the columns by `plan_query`. */
+typedef struct
+{
+  const QueryTerm *term;       /* The term as parsed. */
+  unsigned int    *codes;      /* The codes matching the value of a field term, or NULL. */
+  size_t           num_codes;  /* The number of codes. */
+  int              year;       /* The year compared by a year term. */
+  AccessPath       path;       /* The index able to answer the term, or PATH_SCAN. */
+  int              indexed;    /* Whether the chosen path answers the term. */
+} PlanTerm;
+
+/* The plan `plan_query` makes for a query. */
+typedef struct
+{
+  PlanTerm     terms[QUERY_MAX_TERMS];  /* The resolved terms of the query. */
+  int          num_terms;               /* The number of terms. */
+  int          estimates[NUM_PATHS];    /* The rows each path would read, or -1 if it cannot be used. */
+  AccessPath   path;                    /* The chosen path. */
+  int          accession_term;          /* The term the accession path looks up. */
+  int          first_year;              /* The first year of the year path. */
+  int          last_year;               /* The last year of the year path. */
+  unsigned int available;               /* The borrower code of books that are not checked out. */
+} Plan;
+
+/* The loans of one year, as counted by `count_loan`. */
+typedef struct
+{
+  unsigned int year;    /* The year. */
+  Sketch       titles;  /* The titles borrowed. */
+  Sketch       genres;  /* The genres borrowed. */
+} Period;
+
+/* A group of books sharing the value of a field, as counted by `count_books`. */
+typedef struct
+{
+  const char *value;  /* The value of the field. */
+  int         count;  /* The number of books holding the value. */
+} Group;
+
+/* The stream of scans read by `scan_station`: the terminal, or a file
+ * or FIFO read through a buffer of its own, so that the wait for the
+ * next scan can time out when a group is waiting to be committed. */
+typedef struct
+{
+  int    fd;                   /* The file read, or -1 to read stdin. */
+  char   buf[MAX_LINE_LEN];    /* The bytes read but not yet returned. */
+  size_t start;                /* The first of them. */
+  size_t end;                  /* The end of them. */
+} ScanStream;
+
+/* Variable: catalog
+ * -----------------
+ * The library's collection, opened from FILE_NAME at startup
+ * and saved back to it on quit.
+ *
+ * The catalog library keeps the books, the encoded values of their
+ * fields, the patrons and the accession index.  The indexes below are
+ * those only the REPL uses; every command that changes the books
+ * keeps them up to date or clears their valid flags.
+ */
+static Catalog *catalog;
+
+/* The names of the fields in exported files, indexed by FIELD_*.
+ * They match the field names of the query language. */
+static const char *const field_keys[MAX_NUM_FIELDS] = {
+  "title",
+  "author",
+  "publisher",
+  "year",
+  "isbn",
+  "accession",
+  "genre",
+  "borrower",
+  "checked_out_date",
+  "return_date"
+};
+
+/* The labels `print_book` prints the fields under, indexed by FIELD_*. */
+static const char *const field_labels[MAX_NUM_FIELDS] = {
+  "Title:           ",
+  "Author:          ",
+  "Publisher:       ",
+  "Publication Year:",
+  "ISBN:            ",
+  "Accession Number:",
+  "Genre:           ",
+  "Checked Out By:  ",
+  "Checked Out Date:",
+  "Return Date:     "
+};
+
+/* Variable: year_index
+ * --------------------
+ * The indexes of the books with a publication year,
+ * sorted by year and then by position in the books array.
+ *
+ * The index is rebuilt by `build_year_index` on the first range query
+ * after a book is added, deleted or given a new publication year,
+ * which clears `year_index_valid`.
+ */
+static int *year_index;
+static int  year_index_len;
+static int  year_index_valid;
+
+/* Variable: available_books
+ * -------------------------
+ * A bitmap of the positions in the books array of the books
+ * that are not checked out.
  *
- * This variable is used to keep track of the number of books
- * in the `books` array.
- * It is initialized to 0 at startup and updated by the
- * `load_catalog`, `add_book`, `delete_book`, `borrow_book`,
- * and `return_book` functions.
+ * Together with `genre_bitmaps`, which holds a bitmap of the positions
+ * of the books of each genre indexed by genre code, it is built by
+ * `build_bitmaps` on first use.  Borrowing, returning, adding and
+ * editing books keep the bitmaps up to date; deleting a book moves
+ * the books after it, so the bitmaps are dropped and built again.
  */
-static int num_books;
+static Bitmap       available_books;
+static Bitmap      *genre_bitmaps;
+static unsigned int num_genre_bitmaps;
+static int          bitmaps_valid;
 
-/* Variable: max_books
- * -------------------
- * An unsigned integer indicating the maximum number of books that the library can hold.
+/* Variable: loans_valid
+ * ----------------------
+ * Whether the loan lists of the catalog's patrons are up to date.
+ *
+ * The patrons are read from PATRON_FILE_NAME when the catalog is
+ * opened, so their ids stay the same from one run to the next.
+ * The loan lists are built by `build_loans` on first use and kept up
+ * to date by borrowing and returning books; deleting a book or
+ * changing its borrower clears this flag, so the lists are built again.
+ */
+static int loans_valid;
+
+/* Variable: history
+ * ------------------
+ * The log of every borrow and return, kept in HISTORY_DIR
+ * as one binary segment file per month.
+ *
+ * Returning a book clears its borrower, so this log is
+ * the only record of past loans.
+ */
+static History history;
+
+/* Variable: journal
+ * ------------------
+ * The loans and returns made since the catalog file was last written,
+ * kept in JOURNAL_FILE_NAME so that they are made again by
+ * `replay_journal` if the program does not quit cleanly.
+ *
+ * When a checkpoint is taken, the journal is moved to
+ * OLD_JOURNAL_FILE_NAME by `rotate_journal`, and removed from there
+ * once the checkpoint holding its changes is written.
+ */
+static Journal journal;
+
+/* Variable: periods
+ * ------------------
+ * The sketches of the titles and genres borrowed in each year
+ * with loans, in the order the years were first seen.
+ *
+ * Every borrow adds its title and genre to the sketches of its year,
+ * so the most borrowed titles and genres of a year can be reported
+ * without reading the history.  The sketches are kept in
+ * POPULARITY_FILE_NAME between runs, with the size of the history
+ * they were counted from; if that file is missing, was written by
+ * another build or does not match the history, they are rebuilt
+ * from the history.
+ */
+static Period       *periods;
+static unsigned int  num_periods;
+
+/* Variable: shards
+ * -----------------
+ * The catalogs of the other branches, sorted by branch name.
+ *
+ * They are loaded from the CSV files in BRANCH_DIR after this branch's
+ * catalog and are never changed, so edits to those files take effect
+ * the next time the program starts.
+ */
+static Shard *shards;
+static int    num_shards;
+
+/* Variable: pool
+ * --------------
+ * The worker threads that searches across branches and scans of
+ * large catalogs run on, started on first use with `max_threads`
+ * threads, or one per processor if it is 0.
+ * `pool_threads` is 0 until then.
+ */
+static Pool pool;
+static int  pool_threads;
+static int  max_threads;
+
+/* Variable: sort_memory
+ * ---------------------
+ * The bytes a sorted export may hold, SORT_MEMORY_MB MiB unless set
+ * with -m.  Books beyond it are sorted in runs on disk.
+ */
+static size_t sort_memory = (size_t) SORT_MEMORY_MB << 20;
+
+/* Variable: query_cache
+ * ---------------------
+ * The books found by the latest field searches, keyed by the field
+ * and the value searched for in lower case.
+ *
+ * Kiosks tend to repeat the same few searches, each of which reads
+ * every book.  The results are stored with the catalog's generation,
+ * which every change to the books advances, so a result is only
+ * reused while the books are as they were when it was found.
+ */
+static Cache query_cache;
+
+/* Variable: catalog_lock
+ * ----------------------
+ * Held by the REPL while a command runs, and by the autosave thread
+ * while it takes a snapshot, so a snapshot never sees half a change.
+ *
+ * The REPL releases the lock while a command waits for input, through
+ * `begin_wait` and `end_wait`, so a snapshot is not held up by a prompt
+ * or a scan station waiting for scans.  A snapshot may therefore fall
+ * between two changes made by one command, such as two scans, but
+ * every change is either wholly in it or not at all.
  *
- * This variable is used to set the initial capacity of the `books` array.
- * It is initialized to a default value at startup and will be updated
- * automatically if the library needs to hold more books.
+ * The autosave thread wakes every `autosave_seconds` seconds, or once
+ * `autosave_changes` books were added, edited, deleted, lent or
+ * returned since the last checkpoint, and writes the catalog to the
+ * files named with CHECKPOINT_SUFFIX.  The snapshot is a child process
+ * forked while the lock is held: the child holds a copy-on-write image
+ * of the catalog and writes it out with `catalog_sync`, while the REPL
+ * carries on.  `book_changes` counts the changes to books and
+ * `checkpoint_changes` is its value when the last checkpoint was
+ * taken.  A clean quit saves the catalog and removes the checkpoint,
+ * so finding one at startup means the last session ended without
+ * saving.
  */
-static size_t max_books;
+static pthread_mutex_t    catalog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t     autosave_wake = PTHREAD_COND_INITIALIZER;
+static pthread_t          autosave_thread;
+static int                autosave_running;
+static int                autosave_stop;
+static int                autosave_seconds = AUTOSAVE_SECONDS;
+static unsigned long long autosave_changes = AUTOSAVE_CHANGES;
+static unsigned long long book_changes;
+static unsigned long long checkpoint_changes;
+static int                catalog_held;
 
 /* Variable: d
  * -----------
@@ -94,44 +394,545 @@ static int   d;
 
 static int   verify_user                     (void);
 static void  print_info                      (void);
-static int   load_catalog                    (void);
+static void  print_encoding                  (size_t text_bytes);
+static void  free_catalog                    (void);
+static void  end_command                     (StatsCommand command);
+static void  reload_catalog                  (void);
+static void  warn_damaged                    (const Catalog *cat);
+static void  verify_file                     (Catalog *cat);
+static int   verify_catalogs                 (void);
 static void  print_help                      (void);
-static int   save_catalog                    (void);
+static int   export_catalog                  (void);
+static int   import_books                    (void);
+static int   export_sorted                   (const char *file_name,
+                                              int field);
 static int   add_book                        (void);
 static int   edit_book                       (void);
 static int   delete_book                     (void);
 static int   borrow_book                     (void);
 static int   return_book                     (void);
+static int   return_at                       (int i,
+                                              const char *date);
+static int   lend_at                         (int i,
+                                              const char *borrower,
+                                              const char *date);
+static int   scan_station                    (void);
+static int   next_scan                       (ScanStream *stream,
+                                              char *line,
+                                              int timeout_ms);
+static int   commit_group                    (void);
+static void  record_change                   (int event,
+                                              int i,
+                                              const char *date);
+static void  replay_journal                  (void);
+static void  rotate_journal                  (void);
+static void  start_autosave                  (void);
+static void  stop_autosave                   (void);
+static void *autosave_main                   (void *arg);
+static int   write_checkpoint                (void);
+static void  recover_checkpoint              (void);
+static void  remove_checkpoint               (void);
+static void  begin_repl_command              (void);
+static void  end_repl_command                (void);
+static int   begin_wait                      (void);
+static void  end_wait                        (int held);
+static void  trace_phase                     (const char *name,
+                                              int begin);
+static long long now_ms                      (void);
 static int   find_books                      (void);
+static int   search_field                    (int field,
+                                              const char *value,
+                                              int **matches);
+static int   find_year_range                 (void);
+static int   find_available                  (void);
+static int   find_query                      (int explain);
+static int   find_branches                   (void);
+static void  search_branch                   (void *arg,
+                                              int task);
+static void  search_pages                    (BranchSearch *search);
+static int   start_pool                      (void);
+static int   scan_books                      (ScanMatch match,
+                                              const void *arg,
+                                              int **matches);
+static void  scan_range                      (void *arg,
+                                              int task);
+static int   match_codes                     (const void *arg,
+                                              int i);
+static int   match_plan_at                   (const void *plan,
+                                              int i);
+static int   load_shards                     (void);
+static int   compare_branches                (const void *a,
+                                              const void *b);
+static int   plan_query                      (const Query *query,
+                                              Plan *plan);
+static void  free_plan                       (Plan *plan);
+static int   match_plan                      (const Plan *plan,
+                                              int i);
+static int   run_query                       (const Query *query,
+                                              int explain);
+static int   combine_bitmaps                 (const Plan *plan,
+                                              Bitmap *result);
+static int   compare_positions               (const void *a,
+                                              const void *b);
+static int   count_books                     (void);
+static int   find_patron                     (void);
+static int   show_history                    (void);
+static int   show_popular                    (void);
+static Period *get_period                    (unsigned int year,
+                                              int create);
+static void  count_loan                      (int i,
+                                              unsigned int date);
+static int   load_popularity                 (void);
+static int   save_popularity                 (void);
+static unsigned int record_event             (int event,
+                                              int i,
+                                              unsigned int patron,
+                                              const char *date);
+static unsigned int parse_patron             (const char *s);
+static int   build_loans                     (void);
+static int   compare_groups                  (const void *a,
+                                              const void *b);
 static int   list_books                      (void);
 static void  print_warranty                  (void);
-static int   print_book                      (const Book book);
+static void  print_memory                    (void);
+static int   print_book                      (const Book *book);
+static const char *get_field                 (const Book *book,
+                                              int field);
+static int   set_field                       (Book *book,
+                                              int field,
+                                              const char *value);
+static int   find_accession_num              (const char *accession_num);
+static int   parse_year_range                (const char *s,
+                                              int *first_year,
+                                              int *last_year);
+static int   build_year_index                (void);
+static int   bound_year                      (int year);
+static int   build_bitmaps                   (void);
+static void  drop_bitmaps                    (void);
+static void  index_book                      (int i);
+static void  unindex_book                    (int i);
+static char *read_input                      (char *buffer,
+                                              int size);
+static int   read_choice                     (char *c);
+static int   stdin_buffered                  (void);
+
+/* Function: read_input
+ * --------------------
+ * Read a line from stdin, as `fgets` does, traced as the "read_input" phase.
+ * `catalog_lock` is released while waiting.
+ *
+ * buffer: Where the line is stored.
+ * size: The size of the buffer.
+ *
+ * returns: The buffer, or NULL on end of file or error.
+ */
+static char *
+read_input (char *buffer,
+            int   size)
+{
+  char *line;
+  int held;
+
+  held = begin_wait ();
+  TRACE_BEGIN ("read_input");
+  line = fgets (buffer, size, stdin);
+  TRACE_END ("read_input");
+  end_wait (held);
+  return line;
+}
+
+/* Function: stdin_buffered
+ * ------------------------
+ * Check whether stdio holds input from stdin that was not read yet,
+ * which polling the descriptor would not see.
+ *
+ * Only the C library of GNU can tell; elsewhere, input is assumed to
+ * be held, so that callers read rather than poll.
+ *
+ * returns: 1 if input is held, or 0 if it is not.
+ */
+static int
+stdin_buffered (void)
+{
+#ifdef __GLIBC__
+  return stdin->_IO_read_ptr < stdin->_IO_read_end;
+#else
+  return 1;
+#endif
+}
+
+/* Function: read_choice
+ * ---------------------
+ * Read the next character from stdin that is not white space,
+ * traced as the "read_input" phase.
+ * `catalog_lock` is released while waiting.
+ *
+ * c: Where the character is stored.
+ *
+ * returns: 1 on success, or EOF on end of file or error.
+ */
+static int
+read_choice (char *c)
+{
+  int n, held;
+
+  held = begin_wait ();
+  TRACE_BEGIN ("read_input");
+  n = scanf (" %c", c);
+  TRACE_END ("read_input");
+  end_wait (held);
+  return n;
+}
+
+/* Function: get_field
+ * -------------------
+ * Get the value of a field of a book.
+ *
+ * The value stays valid until the field's column is next changed
+ * or `get_field` is next called for the same field.
+ *
+ * book: The book.
+ * field: The field, one of FIELD_*.
+ *
+ * returns: The value of the field.
+ */
+static const char *
+get_field (const Book *book,
+           int         field)
+{
+  return catalog_get (catalog, book, field);
+}
+
+/* Function: set_field
+ * -------------------
+ * Set a field of a book, adding the value to the field's column
+ * if no other book holds it yet.
+ *
+ * book: The book.
+ * field: The field, one of FIELD_*.
+ * value: The new value, at most MAX_FIELD_LEN - 1 characters long.
+ *        A borrower's name also adds the borrower to the patrons.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+set_field (Book       *book,
+           int         field,
+           const char *value)
+{
+  if (catalog_set (catalog, book, field, value) != 0)
+    {
+      fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+      return IO_ERR;
+    }
+
+  if (field == FIELD_PUBLICATION_YEAR)
+    year_index_valid = 0;
+
+  return 0;
+}
+
+/* Function: parse_year_range
+ * --------------------------
+ * Parse a range of publication years such as "1900-1950".
+ *
+ * Either end may be left out to leave the range open on that side,
+ * and a single year is a range of one year.
+ *
+ * s: The range.
+ * first_year: Receives the first year of the range.
+ * last_year: Receives the last year of the range.
+ *
+ * returns: 0 on success, or -1 if s is not a range of years.
+ */
+static int
+parse_year_range (const char *s,
+                  int        *first_year,
+                  int        *last_year)
+{
+  char first[MAX_FIELD_LEN];
+  const char *dash;
+
+  dash = strchr (s, '-');
+  if (dash == NULL)
+    {
+      *first_year = *last_year = catalog_parse_year (s);
+      return *first_year == YEAR_NONE ? -1 : 0;
+    }
+
+  memcpy (first, s, dash - s);
+  first[dash - s] = '\0';
+
+  *first_year = strcmp (first, "") ? catalog_parse_year (first) : 0;
+  *last_year = strcmp (dash + 1, "") ? catalog_parse_year (dash + 1) : MAX_YEAR;
+  if (*first_year == YEAR_NONE || *last_year == YEAR_NONE || *first_year > *last_year)
+    return -1;
+
+  return 0;
+}
+
+/* Function: build_year_index
+ * --------------------------
+ * Rebuild the year index if the catalog has changed since it was built.
+ *
+ * The books are placed with a counting sort over the possible years,
+ * which keeps books of the same year in the order of the books array.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+build_year_index (void)
+{
+  int *starts, *index;
+  int year, i;
+
+  if (year_index_valid)
+    return 0;
+
+  starts = (int *) mem_calloc (MEM_INDEXES, MAX_YEAR + 2, sizeof (int));
+  index = (int *) mem_realloc (MEM_INDEXES, year_index, sizeof (int) * (catalog->num_books ? catalog->num_books : 1));
+  if (starts == NULL || index == NULL)
+    {
+      fprintf (stderr, "Error: Failed to allocate memory for the year index.\n");
+      mem_free (starts);
+      if (index != NULL)
+        year_index = index;
+      return IO_ERR;
+    }
+  year_index = index;
+
+  TRACE_BEGIN ("lookup");
+  for (i = 0; i < catalog->num_books; i++)
+    if (catalog->books[i].year != YEAR_NONE)
+      starts[catalog->books[i].year + 1]++;
+  for (year = 0; year <= MAX_YEAR; year++)
+    starts[year + 1] += starts[year];
+
+  year_index_len = starts[MAX_YEAR + 1];
+  for (i = 0; i < catalog->num_books; i++)
+    if (catalog->books[i].year != YEAR_NONE)
+      year_index[starts[catalog->books[i].year]++] = i;
+  stats_records_scanned += catalog->num_books;
+  TRACE_END ("lookup");
+
+  mem_free (starts);
+  year_index_valid = 1;
+  return 0;
+}
+
+/* Function: bound_year
+ * --------------------
+ * Binary search the year index for the first book
+ * published in or after a given year.
+ *
+ * year: The year to search for.
+ *
+ * returns: The position found, between 0 and year_index_len.
+ */
+static int
+bound_year (int year)
+{
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = year_index_len;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (catalog->books[year_index[mid]].year < year)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/* Function: find_accession_num
+ * ----------------------------
+ * Find the book with a given accession number.
+ *
+ * The number is looked up in its column and then in the catalog's
+ * accession index, so neither a known nor an unknown number needs a scan.
+ *
+ * accession_num: The accession number, compared exactly.
+ *
+ * returns: The index of the book in the books array,
+ *          or num_books if there is no such book.
+ */
+static int
+find_accession_num (const char *accession_num)
+{
+  int i;
+
+  TRACE_BEGIN ("lookup");
+  i = catalog_find_accession (catalog, accession_num);
+  TRACE_END ("lookup");
+  return i >= 0 ? i : catalog->num_books;
+}
+
+/* Function: drop_bitmaps
+ * -----------------------
+ * Release the availability and genre bitmaps,
+ * so that they are built again on next use.
+ */
+static void
+drop_bitmaps (void)
+{
+  unsigned int code;
+
+  for (code = 0; code < num_genre_bitmaps; code++)
+    bitmap_free (&genre_bitmaps[code]);
+  mem_free (genre_bitmaps);
+  genre_bitmaps = NULL;
+  num_genre_bitmaps = 0;
+
+  bitmap_free (&available_books);
+  bitmaps_valid = 0;
+}
+
+/* Function: build_bitmaps
+ * -----------------------
+ * Build the availability and genre bitmaps if they are not up to date.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+build_bitmaps (void)
+{
+  unsigned int available, code;
+  int i;
+
+  if (bitmaps_valid)
+    return 0;
+
+  drop_bitmaps ();
+  num_genre_bitmaps = column_size (&catalog->columns[FIELD_GENRE]);
+  genre_bitmaps = (Bitmap *) mem_calloc (MEM_INDEXES, num_genre_bitmaps ? num_genre_bitmaps : 1, sizeof (Bitmap));
+  if (genre_bitmaps == NULL)
+    {
+      num_genre_bitmaps = 0;
+      fprintf (stderr, "Error: Failed to allocate memory for bitmaps.\n");
+      return IO_ERR;
+    }
+
+  /* Books that are available hold the code of the empty borrower. */
+  available = column_lookup (&catalog->columns[FIELD_CHECKED_OUT_BY], "");
+
+  TRACE_BEGIN ("lookup");
+  for (i = 0; i < catalog->num_books; i++)
+    {
+      code = catalog->books[i].fields[FIELD_GENRE];
+      if (bitmap_set (&genre_bitmaps[code], i) != 0
+          || (catalog->books[i].fields[FIELD_CHECKED_OUT_BY] == available && bitmap_set (&available_books, i) != 0))
+        {
+          TRACE_END ("lookup");
+          drop_bitmaps ();
+          fprintf (stderr, "Error: Failed to allocate memory for bitmaps.\n");
+          return IO_ERR;
+        }
+    }
+  stats_records_scanned += catalog->num_books;
+  TRACE_END ("lookup");
+
+  bitmaps_valid = 1;
+  return 0;
+}
+
+/* Function: index_book
+ * --------------------
+ * Add a book to the bitmaps, if they are built.
+ *
+ * If memory runs out, the bitmaps are dropped
+ * and built again on next use.
+ *
+ * i: The position of the book in the books array.
+ */
+static void
+index_book (int i)
+{
+  unsigned int code;
+
+  if (!bitmaps_valid)
+    return;
+
+  code = catalog->books[i].fields[FIELD_GENRE];
+  if (code >= num_genre_bitmaps)
+    {
+      unsigned int num;
+      Bitmap *bitmaps;
+
+      num = column_size (&catalog->columns[FIELD_GENRE]);
+      bitmaps = (Bitmap *) mem_realloc (MEM_INDEXES, genre_bitmaps, sizeof (Bitmap) * num);
+      if (bitmaps == NULL)
+        {
+          drop_bitmaps ();
+          return;
+        }
+      memset (&bitmaps[num_genre_bitmaps], 0, sizeof (Bitmap) * (num - num_genre_bitmaps));
+      genre_bitmaps = bitmaps;
+      num_genre_bitmaps = num;
+    }
+
+  if (bitmap_set (&genre_bitmaps[code], i) != 0
+      || (!strcmp (get_field (&catalog->books[i], FIELD_CHECKED_OUT_BY), "") && bitmap_set (&available_books, i) != 0))
+    drop_bitmaps ();
+}
+
+/* Function: unindex_book
+ * ----------------------
+ * Remove a book from the bitmaps, if they are built.
+ *
+ * i: The position of the book in the books array.
+ */
+static void
+unindex_book (int i)
+{
+  if (!bitmaps_valid)
+    return;
+
+  bitmap_clear (&genre_bitmaps[catalog->books[i].fields[FIELD_GENRE]], i);
+  bitmap_clear (&available_books, i);
+}
 
 /* Function: print_book
  * --------------------
  * Print the details of a book to the console in a formatted manner.
  *
- * book: A Book struct containing the details of a book.
+ * book: A pointer to the book.
  *
  * returns: An integer indicating the success of the function (always 0).
  */
 static int
-print_book (const Book book)
-{
-  printf ("Title:            %s\n", book.title);
-  printf ("Author:           %s\n", book.author);
-  printf ("Publisher:        %s\n", book.publisher);
-  printf ("Publication Year: %s\n", book.publication_year);
-  printf ("ISBN:             %s\n", book.isbn);
-  printf ("Accession Number: %s\n", book.accession_num);
-  printf ("Genre:            %s\n", book.genre);
-  printf ("Checked Out By:   %s\n", book.checked_out_by);
-  printf ("Checked Out Date: %s\n", book.checked_out_date);
-  printf ("Return Date:      %s\n", book.return_date);
+print_book (const Book *book)
+{
+  int f;
+
+  for (f = 0; f < MAX_NUM_FIELDS; f++)
+    printf ("%s %s\n", field_labels[f], get_field (book, f));
 
   return 0;
 }
 
+/* Function: print_memory
+ * ----------------------
+ * Print the live bytes, peak bytes and live bytes per book of each
+ * subsystem to the console, followed by the spare capacity of the
+ * books array.
+ */
+static void
+print_memory (void)
+{
+  int i;
+
+  printf ("%-12s %14s %14s %12s\n", "subsystem", "live bytes", "peak bytes", "per record");
+  for (i = 0; i <= MEM_NUM_TAGS; i++)
+    printf ("%-12s %14zu %14zu %12.1f\n", mem_tag_name (i), mem_live (i), mem_peak (i),
+            catalog->num_books > 0 ? (double) mem_live (i) / (double) catalog->num_books : 0.0);
+  printf ("Books array: %d of %zu slots used, %zu bytes of headroom.\n",
+          catalog->num_books, catalog->max_books, (catalog->max_books - catalog->num_books) * sizeof (Book));
+}
+
 /* Function: print_warranty
  * ------------------------
  * Print the program's warranty and licensing information to the console.
@@ -176,12 +977,15 @@ list_books (void)
   int i, num_books_found;
 
   num_books_found = 0;
-  for (i = 0; i < num_books; i++)
+  TRACE_BEGIN ("format_output");
+  for (i = 0; i < catalog->num_books; i++)
     {
       num_books_found++;
-      print_book (books[i]);
+      print_book (&catalog->books[i]);
       putchar ('\n');
     }
+  stats_records_scanned += catalog->num_books;
+  TRACE_END ("format_output");
 
   if (num_books_found < 1)
     puts ("Empty library :/");
@@ -191,47 +995,1891 @@ list_books (void)
   return 0;
 }
 
-/* Function: find_books
- * --------------------
- * Find books in the library's collection that match a given search criteria.
- *
- * This function prompts the user to enter a search criteria from a menu of options,
- * and then prompts for the specific value to search for.
- * It then searches the books array for books that match the criteria, and prints them to the console.
+/* Function: find_year_range
+ * ---------------------------
+ * Find the books published within a range of years,
+ * optionally of a given genre.
  *
- * If no books are found that match the criteria, a message is printed to the console.
+ * The span of the year index holding the range is found with two
+ * binary searches, and the genre is then checked only within that span.
+ * The books are printed in order of publication year.
  *
  * returns: An integer indicating the success of the function.
  * If an error occurs, the appropriate error code is returned.
  */
 static int
-find_books (void)
+find_year_range (void)
 {
-  char c;
   char buffer[MAX_FIELD_LEN];
-  int num_books_found, i;
+  unsigned int *codes, code;
+  size_t num_codes, j;
+  int first_year, last_year, first, last, num_books_found, i;
 
-  puts ("Finding books..");
-
-get_book_field:
-  puts (" a - author");
-  puts (" b - back");
-  puts (" g - genre");
-  puts (" p - publisher");
-  puts (" t - title");
-  puts (" y - publication year");
-  printf (">> ");
+get_year_range:
+  printf ("Enter publication years (from-to): ");
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (scanf (" %c", &c) == EOF)
-    return EOF_ERR;
-  while ((d = getchar ()) != '\n' && d != EOF) {}
+  if (parse_year_range (buffer, &first_year, &last_year) != 0)
+    {
+      puts ("Invalid range of years. Try again.");
+      goto get_year_range;
+    }
 
-  num_books_found = 0;
-  switch (c)
+  printf ("Enter book genre (all): ");
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  codes = NULL;
+  num_codes = 0;
+  if (strcmp (buffer, ""))
+    {
+      codes = column_match (&catalog->columns[FIELD_GENRE], buffer, &num_codes);
+      if (codes == NULL)
+        {
+          fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+          return IO_ERR;
+        }
+    }
+
+  if (build_year_index () != 0)
+    {
+      mem_free (codes);
+      return IO_ERR;
+    }
+
+  first = bound_year (first_year);
+  last = bound_year (last_year + 1);
+
+  num_books_found = 0;
+  if (codes == NULL || num_codes > 0)
+    {
+      TRACE_BEGIN ("format_output");
+      for (i = first; i < last; i++)
+        {
+          if (codes != NULL)
+            {
+              code = catalog->books[year_index[i]].fields[FIELD_GENRE];
+              for (j = 0; j < num_codes && codes[j] != code; j++) {}
+              if (j == num_codes)
+                continue;
+            }
+          num_books_found++;
+          print_book (&catalog->books[year_index[i]]);
+        }
+      stats_records_scanned += last - first;
+      TRACE_END ("format_output");
+    }
+  mem_free (codes);
+
+  putchar ('\n');
+  if (num_books_found < 1)
+    puts ("No match found.");
+  else
+    printf ("Found %d match/s.\n", num_books_found);
+
+  return 0;
+}
+
+/* Function: find_available
+ * --------------------------
+ * Find the books that are not checked out, optionally of a given genre.
+ *
+ * The bitmaps of the genres matching the input are ORed together and
+ * ANDed with the availability bitmap a word at a time; only the books
+ * in the result are read.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+find_available (void)
+{
+  char buffer[MAX_FIELD_LEN];
+  Bitmap genres, matches, next;
+  unsigned int *codes, x;
+  size_t num_codes, j;
+  int num_books_found;
+
+  printf ("Enter book genre (all): ");
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  if (build_bitmaps () != 0)
+    return IO_ERR;
+
+  bitmap_init (&genres);
+  bitmap_init (&matches);
+  bitmap_init (&next);
+  if (strcmp (buffer, ""))
+    {
+      codes = column_match (&catalog->columns[FIELD_GENRE], buffer, &num_codes);
+      if (codes == NULL)
+        {
+          fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+          return IO_ERR;
+        }
+
+      for (j = 0; j < num_codes; j++)
+        {
+          if (codes[j] >= num_genre_bitmaps)
+            continue;
+          if (bitmap_or (&next, &genres, &genre_bitmaps[codes[j]]) != 0)
+            {
+              mem_free (codes);
+              fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+              return IO_ERR;
+            }
+          bitmap_free (&genres);
+          genres = next;
+          bitmap_init (&next);
+        }
+      mem_free (codes);
+
+      if (bitmap_and (&matches, &available_books, &genres) != 0)
+        {
+          bitmap_free (&genres);
+          fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+          return IO_ERR;
+        }
+      bitmap_free (&genres);
+    }
+  /* ORing with the empty genres bitmap copies the availability bitmap. */
+  else if (bitmap_or (&matches, &available_books, &genres) != 0)
+    {
+      fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+      return IO_ERR;
+    }
+
+  num_books_found = 0;
+  TRACE_BEGIN ("format_output");
+  for (x = bitmap_next (&matches, 0); x != BITMAP_NONE; x = bitmap_next (&matches, x + 1))
+    {
+      num_books_found++;
+      print_book (&catalog->books[x]);
+    }
+  stats_records_scanned += num_books_found;
+  TRACE_END ("format_output");
+  bitmap_free (&matches);
+
+  putchar ('\n');
+  if (num_books_found < 1)
+    puts ("No match found.");
+  else
+    printf ("Found %d match/s.\n", num_books_found);
+
+  return 0;
+}
+
+/* Function: compare_positions
+ * ---------------------------
+ * Order positions in the books array.
+ */
+static int
+compare_positions (const void *a,
+                   const void *b)
+{
+  int x = *(const int *) a;
+  int y = *(const int *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* Function: free_plan
+ * -------------------
+ * Release the codes held by a plan.
+ */
+static void
+free_plan (Plan *plan)
+{
+  int k;
+
+  for (k = 0; k < plan->num_terms; k++)
+    mem_free (plan->terms[k].codes);
+}
+
+/* Function: plan_query
+ * --------------------
+ * Resolve the terms of a query against the columns
+ * and choose the access path that reads the fewest books.
+ *
+ * Each path is estimated by the number of books it would read:
+ * the books holding the accession number, the span of the year index
+ * between the tightest bounds, the smallest bitmap, or every book.
+ * Ties go to the scan.  Terms that the chosen path does not answer
+ * are checked on each book it reads.
+ *
+ * query: The query.
+ * plan: Receives the plan, to be released with `free_plan`.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+plan_query (const Query *query,
+            Plan        *plan)
+{
+  const QueryTerm *term;
+  PlanTerm *t;
+  unsigned long count, available;
+  size_t j;
+  int path, uses[NUM_PATHS], link, k;
+
+  memset (plan, 0, sizeof (Plan));
+  memset (uses, 0, sizeof (uses));
+  plan->available = column_lookup (&catalog->columns[FIELD_CHECKED_OUT_BY], "");
+  plan->accession_term = -1;
+  plan->first_year = 0;
+  plan->last_year = MAX_YEAR;
+
+  for (k = 0; k < query->num_terms; k++)
+    {
+      term = &query->terms[k];
+      t = &plan->terms[k];
+      t->term = term;
+      t->path = PATH_SCAN;
+      plan->num_terms++;
+
+      if (term->field == QUERY_STATUS)
+        t->path = PATH_BITMAPS;
+      else if (term->field == FIELD_PUBLICATION_YEAR)
+        {
+          /* Years are compared as numbers; the parser only accepts valid years. */
+          t->year = catalog_parse_year (term->value);
+          if (!term->negated && term->op != QUERY_NE)
+            {
+              t->path = PATH_YEAR;
+              if ((term->op == QUERY_EQ || term->op == QUERY_GE) && t->year > plan->first_year)
+                plan->first_year = t->year;
+              if (term->op == QUERY_GT && t->year + 1 > plan->first_year)
+                plan->first_year = t->year + 1;
+              if ((term->op == QUERY_EQ || term->op == QUERY_LE) && t->year < plan->last_year)
+                plan->last_year = t->year;
+              if (term->op == QUERY_LT && t->year - 1 < plan->last_year)
+                plan->last_year = t->year - 1;
+            }
+        }
+      else
+        {
+          t->codes = column_match (&catalog->columns[term->field], term->value, &t->num_codes);
+          if (t->codes == NULL)
+            {
+              free_plan (plan);
+              fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+              return IO_ERR;
+            }
+
+          if (!term->negated && term->op == QUERY_EQ)
+            {
+              if (term->field == FIELD_GENRE)
+                t->path = PATH_BITMAPS;
+              else if (term->field == FIELD_ACCESSION_NUM && plan->accession_term < 0)
+                {
+                  t->path = PATH_ACCESSION;
+                  plan->accession_term = k;
+                }
+            }
+        }
+      uses[t->path] = 1;
+    }
+
+  for (path = 0; path < NUM_PATHS; path++)
+    plan->estimates[path] = -1;
+  plan->estimates[PATH_SCAN] = catalog->num_books;
+
+  /* A path whose index cannot be built is left out, and its terms become filters. */
+  if (uses[PATH_ACCESSION] && catalog_index_accessions (catalog) == 0)
+    {
+      t = &plan->terms[plan->accession_term];
+      plan->estimates[PATH_ACCESSION] = 0;
+      for (j = 0; j < t->num_codes; j++)
+        if (t->codes[j] < catalog->num_accession_heads)
+          for (link = catalog->accession_heads[t->codes[j]]; link != -1; link = catalog->accession_next[link])
+            plan->estimates[PATH_ACCESSION]++;
+    }
+
+  if (uses[PATH_YEAR] && build_year_index () == 0)
+    plan->estimates[PATH_YEAR] = plan->first_year > plan->last_year ? 0
+      : bound_year (plan->last_year + 1) - bound_year (plan->first_year);
+
+  if (uses[PATH_BITMAPS] && build_bitmaps () == 0)
+    {
+      plan->estimates[PATH_BITMAPS] = catalog->num_books;
+      available = bitmap_count (&available_books);
+      for (k = 0; k < plan->num_terms; k++)
+        {
+          t = &plan->terms[k];
+          if (t->path != PATH_BITMAPS)
+            continue;
+
+          if (t->term->field == QUERY_STATUS)
+            count = (t->term->op == QUERY_AVAILABLE) != t->term->negated ? available : catalog->num_books - available;
+          else
+            for (count = 0, j = 0; j < t->num_codes; j++)
+              if (t->codes[j] < num_genre_bitmaps)
+                count += bitmap_count (&genre_bitmaps[t->codes[j]]);
+
+          if (count < (unsigned long) plan->estimates[PATH_BITMAPS])
+            plan->estimates[PATH_BITMAPS] = count;
+        }
+    }
+
+  plan->path = PATH_SCAN;
+  for (path = 0; path < NUM_PATHS; path++)
+    if (plan->estimates[path] >= 0 && plan->estimates[path] < plan->estimates[plan->path])
+      plan->path = path;
+
+  for (k = 0; k < plan->num_terms; k++)
+    plan->terms[k].indexed = plan->path != PATH_SCAN && plan->terms[k].path == plan->path;
+
+  return 0;
+}
+
+/* Function: combine_bitmaps
+ * -------------------------
+ * Combine the bitmaps of the terms a plan answers with bitmaps.
+ *
+ * The bitmaps of the genres matching a genre term are ORed together;
+ * the terms are then ANDed, and a term asking for the books that are
+ * checked out is applied as AND NOT the availability bitmap.
+ *
+ * plan: A plan whose path is PATH_BITMAPS.
+ * result: Receives the positions of the books matching those terms,
+ *         to be released with `bitmap_free`.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+combine_bitmaps (const Plan *plan,
+                 Bitmap     *result)
+{
+  const PlanTerm *t;
+  const Bitmap *b;
+  Bitmap genres, next, empty;
+  size_t j;
+  int k, have, negate, failed;
+
+  bitmap_init (result);
+  bitmap_init (&genres);
+  bitmap_init (&next);
+  bitmap_init (&empty);
+
+  have = 0;
+  for (k = 0; k < plan->num_terms; k++)
+    {
+      t = &plan->terms[k];
+      if (!t->indexed)
+        continue;
+
+      if (t->term->field == QUERY_STATUS)
+        {
+          b = &available_books;
+          negate = (t->term->op == QUERY_AVAILABLE) == t->term->negated;
+        }
+      else
+        {
+          for (j = 0; j < t->num_codes; j++)
+            {
+              if (t->codes[j] >= num_genre_bitmaps)
+                continue;
+              if (bitmap_or (&next, &genres, &genre_bitmaps[t->codes[j]]) != 0)
+                goto fail;
+              bitmap_free (&genres);
+              genres = next;
+              bitmap_init (&next);
+            }
+          b = &genres;
+          negate = 0;
+        }
+
+      /* ORing with the empty bitmap copies the first bitmap. */
+      if (!have)
+        failed = negate ? bitmap_not (&next, b, catalog->num_books) : bitmap_or (&next, b, &empty);
+      else
+        failed = negate ? bitmap_andnot (&next, result, b) : bitmap_and (&next, result, b);
+      bitmap_free (&genres);
+      if (failed)
+        goto fail;
+
+      bitmap_free (result);
+      *result = next;
+      bitmap_init (&next);
+      have = 1;
+    }
+
+  return 0;
+
+fail:
+  bitmap_free (&genres);
+  bitmap_free (&next);
+  bitmap_free (result);
+  fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+  return IO_ERR;
+}
+
+/* Function: match_plan
+ * --------------------
+ * Check a book against the terms of a plan that its path does not answer.
+ *
+ * plan: The plan.
+ * i: The position of the book in the books array.
+ *
+ * returns: 1 if the book matches, or 0 if it does not.
+ */
+static int
+match_plan (const Plan *plan,
+            int         i)
+{
+  const PlanTerm *t;
+  const QueryTerm *term;
+  unsigned int code;
+  size_t j;
+  int k, year, match;
+
+  year = catalog->books[i].year;
+  for (k = 0; k < plan->num_terms; k++)
+    {
+      t = &plan->terms[k];
+      if (t->indexed)
+        continue;
+      term = t->term;
+
+      if (term->field == QUERY_STATUS)
+        match = (catalog->books[i].fields[FIELD_CHECKED_OUT_BY] == plan->available) == (term->op == QUERY_AVAILABLE);
+      else if (term->field == FIELD_PUBLICATION_YEAR)
+        {
+          /* YEAR_NONE is below every year, so books without one only match !=. */
+          switch (term->op)
+            {
+            case QUERY_EQ: match = year == t->year; break;
+            case QUERY_NE: match = year != t->year; break;
+            case QUERY_LT: match = year != YEAR_NONE && year < t->year; break;
+            case QUERY_LE: match = year != YEAR_NONE && year <= t->year; break;
+            case QUERY_GT: match = year > t->year; break;
+            case QUERY_GE: match = year >= t->year; break;
+            default:       match = 0; break;
+            }
+        }
+      else
+        {
+          code = catalog->books[i].fields[term->field];
+          for (j = 0; j < t->num_codes && t->codes[j] != code; j++) {}
+          match = (j < t->num_codes) == (term->op == QUERY_EQ);
+        }
+
+      if (match == term->negated)
+        return 0;
+    }
+
+  return 1;
+}
+
+/* Function: match_plan_at
+ * -----------------------
+ * Check a book against a plan, as a test for `scan_books`.
+ */
+static int
+match_plan_at (const void *plan,
+               int         i)
+{
+  return match_plan ((const Plan *) plan, i);
+}
+
+/* Function: match_codes
+ * ---------------------
+ * Check whether a field of a book holds one of a set of codes,
+ * as a test for `scan_books`.
+ */
+static int
+match_codes (const void *arg,
+             int         i)
+{
+  const CodeMatch *m = (const CodeMatch *) arg;
+  unsigned int code;
+  size_t j;
+
+  code = catalog->books[i].fields[m->field];
+  for (j = 0; j < m->num_codes && m->codes[j] != code; j++) {}
+
+  return j < m->num_codes;
+}
+
+/* Function: start_pool
+ * --------------------
+ * Start the worker pool if it is not running.
+ *
+ * returns: The number of threads it runs jobs on.
+ */
+static int
+start_pool (void)
+{
+  if (pool_threads == 0)
+    pool_threads = pool_init (&pool, max_threads > 0 ? max_threads : pool_cpus ());
+
+  return pool_threads;
+}
+
+/* Function: scan_range
+ * --------------------
+ * Test the books of one range of a scan.
+ *
+ * Runs on a worker thread.  The test only reads the books,
+ * and the matches go to the range's own list.
+ *
+ * arg: The scan.
+ * task: The range.
+ */
+static void
+scan_range (void *arg,
+            int   task)
+{
+  Scan *scan = (Scan *) arg;
+  int *matches, *new_matches, num_matches, max_matches, first, last, i;
+
+  first = (int) ((long long) catalog->num_books * task / scan->num_tasks);
+  last = (int) ((long long) catalog->num_books * (task + 1) / scan->num_tasks);
+
+  matches = NULL;
+  num_matches = max_matches = 0;
+  TRACE_BEGIN ("lookup");
+  for (i = first; i < last; i++)
+    {
+      if (!scan->match (scan->arg, i))
+        continue;
+
+      if (num_matches == max_matches)
+        {
+          max_matches = max_matches > 0 ? 2 * max_matches : 64;
+          new_matches = (int *) mem_realloc (MEM_INDEXES, matches, sizeof (int) * max_matches);
+          if (new_matches == NULL)
+            {
+              scan->errors[task] = 1;
+              break;
+            }
+          matches = new_matches;
+        }
+      matches[num_matches++] = i;
+    }
+  TRACE_END ("lookup");
+
+  scan->matches[task] = matches;
+  scan->num_matches[task] = num_matches;
+}
+
+/* Function: scan_books
+ * --------------------
+ * Find the positions of the books that pass a test by reading every book.
+ *
+ * A catalog of SCAN_MIN_PARALLEL books or more is split into one range
+ * per thread of the worker pool, and the ranges are tested at the same
+ * time.  Their matches are then joined in range order, so the result is
+ * in the order of the books array however the threads were scheduled.
+ * A smaller catalog is scanned on this thread, since waking the workers
+ * would cost more than they save.
+ *
+ * match: The test.  It is called from several threads at once,
+ *        so it must not change anything.
+ * arg: The argument of the test.
+ * matches: Receives the positions, to be released with `mem_free`.
+ *
+ * returns: The number of positions, or IO_ERR if memory could not be
+ *          allocated.
+ */
+static int
+scan_books (ScanMatch    match,
+            const void  *arg,
+            int        **matches)
+{
+  Scan scan;
+  int total, t, error;
+
+  scan.match = match;
+  scan.arg = arg;
+  scan.num_tasks = catalog->num_books >= SCAN_MIN_PARALLEL ? start_pool () : 1;
+  memset (scan.errors, 0, sizeof (scan.errors));
+
+  if (scan.num_tasks > 1)
+    pool_run (&pool, scan_range, &scan, scan.num_tasks);
+  else
+    scan_range (&scan, 0);
+
+  total = 0;
+  error = 0;
+  for (t = 0; t < scan.num_tasks; t++)
+    {
+      total += scan.num_matches[t];
+      error |= scan.errors[t];
+    }
+
+  *matches = NULL;
+  if (!error)
+    {
+      *matches = (int *) mem_alloc (MEM_INDEXES, sizeof (int) * (total + 1));
+      total = 0;
+      for (t = 0; t < scan.num_tasks && *matches != NULL; t++)
+        {
+          if (scan.num_matches[t] > 0)
+            memcpy (*matches + total, scan.matches[t], sizeof (int) * scan.num_matches[t]);
+          total += scan.num_matches[t];
+        }
+    }
+  for (t = 0; t < scan.num_tasks; t++)
+    mem_free (scan.matches[t]);
+
+  if (*matches == NULL)
+    {
+      fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+      return IO_ERR;
+    }
+
+  return total;
+}
+
+/* Function: run_query
+ * -------------------
+ * Plan a query, read the books its access path yields and print
+ * those matching every term in the order of the books array.
+ *
+ * query: The query.
+ * explain: Nonzero to print the plan and the rows it estimated,
+ *          examined and matched instead of the books.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+run_query (const Query *query,
+           int          explain)
+{
+  static const char *path_names[NUM_PATHS] = { "accession index", "bitmaps", "year index", "scan" };
+  char buffer[QUERY_MAX_VALUE + 64];
+  const PlanTerm *t;
+  Bitmap result;
+  Plan plan;
+  size_t j;
+  unsigned int x;
+  int *candidates, num_candidates, first, last, link, examined, matched, path, shown, i, k;
+
+  if (plan_query (query, &plan) != 0)
+    return IO_ERR;
+
+  candidates = NULL;
+  num_candidates = 0;
+  bitmap_init (&result);
+  if (plan.path == PATH_ACCESSION || plan.path == PATH_YEAR)
+    {
+      candidates = (int *) mem_alloc (MEM_INDEXES, sizeof (int) * (plan.estimates[plan.path] + 1));
+      if (candidates == NULL)
+        {
+          free_plan (&plan);
+          fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+          return IO_ERR;
+        }
+
+      if (plan.path == PATH_ACCESSION)
+        {
+          t = &plan.terms[plan.accession_term];
+          for (j = 0; j < t->num_codes; j++)
+            if (t->codes[j] < catalog->num_accession_heads)
+              for (link = catalog->accession_heads[t->codes[j]]; link != -1; link = catalog->accession_next[link])
+                candidates[num_candidates++] = link;
+        }
+      else if (plan.first_year <= plan.last_year)
+        {
+          first = bound_year (plan.first_year);
+          last = bound_year (plan.last_year + 1);
+          for (i = first; i < last; i++)
+            candidates[num_candidates++] = year_index[i];
+        }
+
+      /* Both indexes list books out of catalog order. */
+      qsort (candidates, num_candidates, sizeof (int), compare_positions);
+    }
+  else if (plan.path == PATH_SCAN)
+    {
+      num_candidates = scan_books (match_plan_at, &plan, &candidates);
+      if (num_candidates < 0)
+        {
+          free_plan (&plan);
+          return IO_ERR;
+        }
+    }
+  else if (plan.path == PATH_BITMAPS && combine_bitmaps (&plan, &result) != 0)
+    {
+      free_plan (&plan);
+      return IO_ERR;
+    }
+
+  /* A scan has already tested every book, and yields only its matches. */
+  examined = plan.path == PATH_SCAN ? catalog->num_books : 0;
+  matched = 0;
+  x = plan.path == PATH_BITMAPS ? bitmap_next (&result, 0) : BITMAP_NONE;
+  TRACE_BEGIN ("format_output");
+  for (k = 0; ; k++)
+    {
+      if (plan.path == PATH_BITMAPS)
+        {
+          if (x == BITMAP_NONE)
+            break;
+          i = x;
+          x = bitmap_next (&result, x + 1);
+        }
+      else
+        {
+          if (k == num_candidates)
+            break;
+          i = candidates[k];
+        }
+
+      if (plan.path != PATH_SCAN)
+        {
+          examined++;
+          if (!match_plan (&plan, i))
+            continue;
+        }
+
+      matched++;
+      if (!explain)
+        print_book (&catalog->books[i]);
+    }
+  TRACE_END ("format_output");
+  stats_records_scanned += examined;
+  mem_free (candidates);
+  bitmap_free (&result);
+
+  if (!explain)
+    {
+      putchar ('\n');
+      if (matched < 1)
+        puts ("No match found.");
+      else
+        printf ("Found %d match/s.\n", matched);
+
+      free_plan (&plan);
+      return 0;
+    }
+
+  printf ("Query:");
+  for (k = 0; k < plan.num_terms; k++)
+    {
+      query_format_term (plan.terms[k].term, buffer, sizeof (buffer));
+      printf ("%s %s", k > 0 ? " AND" : "", buffer);
+    }
+  putchar ('\n');
+
+  puts ("Access paths:");
+  for (path = 0; path < NUM_PATHS; path++)
+    {
+      if (plan.estimates[path] < 0)
+        continue;
+
+      printf ("  %-15s %8d row/s", path_names[path], plan.estimates[path]);
+      shown = 0;
+      for (k = 0; k < plan.num_terms; k++)
+        {
+          t = &plan.terms[k];
+          if (path == PATH_SCAN || t->path != path)
+            continue;
+          query_format_term (t->term, buffer, sizeof (buffer));
+          printf ("%s %s", shown++ > 0 ? " AND" : " ", buffer);
+        }
+      printf ("%s\n", path == plan.path ? "  <- chosen" : "");
+    }
+
+  printf ("Filters:");
+  shown = 0;
+  for (k = 0; k < plan.num_terms; k++)
+    {
+      if (plan.terms[k].indexed)
+        continue;
+      query_format_term (plan.terms[k].term, buffer, sizeof (buffer));
+      printf ("%s %s", shown++ > 0 ? " AND" : "", buffer);
+    }
+  printf ("%s\n", shown > 0 ? "" : " none");
+
+  printf ("Estimated rows: %d\n", plan.estimates[plan.path]);
+  printf ("Examined rows:  %d\n", examined);
+  printf ("Matched rows:   %d\n", matched);
+
+  free_plan (&plan);
+  return 0;
+}
+
+/* Function: find_query
+ * --------------------
+ * Find the books matching a filter expression such as
+ * `genre=Fiction AND year>=1900 AND available`.
+ *
+ * explain: Nonzero to print how the query was answered instead of the books.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+find_query (int explain)
+{
+  char buffer[MAX_LINE_LEN];
+  char error[MAX_FIELD_LEN];
+  Query query;
+
+get_query:
+  printf ("Enter query: ");
+  if (read_input (buffer, MAX_LINE_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  if (query_parse (buffer, &query, error, sizeof (error)) != 0)
+    {
+      printf ("Invalid query: %s. Try again.\n", error);
+      goto get_query;
+    }
+
+  return run_query (&query, explain);
+}
+
+/* Function: search_field
+ * ----------------------
+ * Find the books whose field matches a value.
+ *
+ * The value is first matched against the field's column, ignoring case,
+ * and the books array is then scanned comparing integer codes,
+ * on the worker pool if the catalog is large.
+ *
+ * field: The field, one of FIELD_*.
+ * value: The value searched for.
+ * matches: Receives the positions of the books in order, to be released
+ *          with `mem_free`, or NULL if there are none.
+ *
+ * returns: The number of books found, or IO_ERR if memory could not
+ *          be allocated.
+ */
+static int
+search_field (int          field,
+              const char  *value,
+              int        **matches)
+{
+  unsigned int *codes;
+  size_t num_codes;
+  CodeMatch m;
+  int num_found;
+
+  *matches = NULL;
+  codes = column_match (&catalog->columns[field], value, &num_codes);
+  if (codes == NULL)
+    {
+      fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+      return IO_ERR;
+    }
+
+  /* No book can match a value that is not in the column. */
+  num_found = 0;
+  if (num_codes > 0)
+    {
+      m.field = field;
+      m.codes = codes;
+      m.num_codes = num_codes;
+      num_found = scan_books (match_codes, &m, matches);
+      if (num_found >= 0)
+        stats_records_scanned += catalog->num_books;
+    }
+
+  mem_free (codes);
+  return num_found;
+}
+
+/* Function: find_books
+ * --------------------
+ * Find books in the library's collection that match a given search criteria.
+ *
+ * This function prompts the user to enter a search criteria from a menu of options,
+ * and then prompts for the specific value to search for.
+ * It then searches the books array for books that match the criteria, and prints them to the console.
+ *
+ * The books matching a value are found by `search_field`, unless
+ * the same search was made since the books last changed, in which case
+ * they are taken from the query cache.
+ *
+ * If no books are found that match the criteria, a message is printed to the console.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+find_books (void)
+{
+  char c;
+  char buffer[MAX_FIELD_LEN];
+  char key[MAX_FIELD_LEN + 16];
+  const int *rows;
+  int *matches, num_books_found, field, n, i;
+
+  puts ("Finding books..");
+
+get_book_field:
+  puts (" a - author");
+  puts (" b - back");
+  puts (" c - search all branches");
+  puts (" e - explain query");
+  puts (" g - genre");
+  puts (" p - publisher");
+  puts (" q - query");
+  puts (" r - publication year range");
+  puts (" t - title");
+  puts (" v - available books");
+  puts (" y - publication year");
+  printf (">> ");
+
+  if (read_choice (&c) == EOF)
+    return EOF_ERR;
+  while ((d = getchar ()) != '\n' && d != EOF) {}
+
+  switch (c)
+    {
+    case 'a':
+      field = FIELD_AUTHOR;
+      printf ("Enter book author (all): ");
+      break;
+
+    case 'b':
+      return 0;
+
+    case 'c':
+      return find_branches ();
+
+    case 'e':
+      return find_query (1);
+
+    case 'g':
+      field = FIELD_GENRE;
+      printf ("Enter book genre (all): ");
+      break;
+
+    case 'p':
+      field = FIELD_PUBLISHER;
+      printf ("Enter book publisher (all): ");
+      break;
+
+    case 'q':
+      return find_query (0);
+
+    case 'r':
+      return find_year_range ();
+
+    case 'v':
+      return find_available ();
+
+
+    case 't':
+      field = FIELD_TITLE;
+      printf ("Enter book title (all): ");
+      break;
+
+    case 'y':
+      field = FIELD_PUBLICATION_YEAR;
+      printf ("Enter publication year (all): ");
+      break;
+
+    default:
+      puts ("Invalid input. Try again.");
+      goto get_book_field;
+    }
+
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  num_books_found = 0;
+  if (!strcmp (buffer, ""))
+    {
+      TRACE_BEGIN ("format_output");
+      for (i = 0; i < catalog->num_books; i++)
+        {
+          num_books_found++;
+          printf ("%s\n", get_field (&catalog->books[i], field));
+        }
+      stats_records_scanned += catalog->num_books;
+      TRACE_END ("format_output");
+    }
+  else
+    {
+      n = snprintf (key, sizeof (key), "%d:", field);
+      for (i = 0; buffer[i] != '\0'; i++)
+        key[n++] = tolower ((unsigned char) buffer[i]);
+      key[n] = '\0';
+
+      matches = NULL;
+      num_books_found = cache_get (&query_cache, key, catalog->generation, &rows);
+      if (num_books_found >= 0)
+        stats_cache_hits++;
+      else
+        {
+          stats_cache_misses++;
+          num_books_found = search_field (field, buffer, &matches);
+          if (num_books_found < 0)
+            return IO_ERR;
+          cache_put (&query_cache, key, catalog->generation, matches, num_books_found);
+          rows = matches;
+        }
+
+      TRACE_BEGIN ("format_output");
+      for (i = 0; i < num_books_found; i++)
+        print_book (&catalog->books[rows[i]]);
+      TRACE_END ("format_output");
+      mem_free (matches);
+    }
+
+  putchar ('\n');
+  if (num_books_found < 1)
+    puts ("No match found.");
+  else
+    printf ("Found %d match/s.\n", num_books_found);
+
+  return 0;
+}
+
+/* Function: compare_branches
+ * ---------------------------
+ * Order shards by branch name.
+ */
+static int
+compare_branches (const void *a,
+                  const void *b)
+{
+  return strcmp (((const Shard *) a)->branch, ((const Shard *) b)->branch);
+}
+
+/* Function: load_shards
+ * ---------------------
+ * Load the catalog of every other branch from BRANCH_DIR.
+ *
+ * Each file named BRANCH.csv holds the catalog of BRANCH, and each file
+ * named BRANCH.db a paged catalog, which is opened but not read.
+ * A missing directory means there are no other branches.
+ * A file that cannot be loaded is skipped with an error message.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+load_shards (void)
+{
+  DIR *dir;
+  struct dirent *entry;
+  char file_name[sizeof (BRANCH_DIR) + 1 + MAX_LINE_LEN];
+  char error[MAX_LINE_LEN];
+  Shard *new_shards;
+  size_t len, ext_len;
+  int n, s;
+
+  dir = opendir (BRANCH_DIR);
+  if (dir == NULL)
+    return 0;
+
+  while ((entry = readdir (dir)) != NULL)
+    {
+      len = strlen (entry->d_name);
+      if (len > 4 && !strcmp (entry->d_name + len - 4, ".csv"))
+        ext_len = 4;
+      else if (len > 3 && !strcmp (entry->d_name + len - 3, ".db"))
+        ext_len = 3;
+      else
+        continue;
+      if (len - ext_len >= MAX_BRANCH_LEN)
+        continue;
+
+      new_shards = (Shard *) mem_realloc (MEM_RECORDS, shards, sizeof (Shard) * (num_shards + 1));
+      if (new_shards == NULL)
+        {
+          fprintf (stderr, "Error: Failed to allocate memory for branches.\n");
+          closedir (dir);
+          return IO_ERR;
+        }
+      shards = new_shards;
+
+      memcpy (shards[num_shards].branch, entry->d_name, len - ext_len);
+      shards[num_shards].branch[len - ext_len] = '\0';
+      snprintf (file_name, sizeof (file_name), "%s/%s", BRANCH_DIR, entry->d_name);
+
+      shards[num_shards].catalog = NULL;
+      shards[num_shards].pages = NULL;
+      if (ext_len == 3)
+        {
+          shards[num_shards].pages = (BTree *) mem_alloc (MEM_INDEXES, sizeof (BTree));
+          if (shards[num_shards].pages == NULL
+              || btree_open (shards[num_shards].pages, file_name, 0, BRANCH_FRAMES) != 0)
+            {
+              mem_free (shards[num_shards].pages);
+              fprintf (stderr, "Error: Failed to open paged catalog \"%s\".\n", file_name);
+              continue;
+            }
+        }
+      else
+        {
+          shards[num_shards].catalog = catalog_open (file_name, NULL, error, sizeof (error));
+          if (shards[num_shards].catalog == NULL)
+            {
+              fprintf (stderr, "Error: %s\n", error);
+              continue;
+            }
+          warn_damaged (shards[num_shards].catalog);
+        }
+      num_shards++;
+    }
+  closedir (dir);
+
+  /* Directory order varies between file systems; branch order does not. */
+  qsort (shards, num_shards, sizeof (Shard), compare_branches);
+
+  if (num_shards > 0)
+    {
+      n = 0;
+      for (s = 0; s < num_shards; s++)
+        n += shards[s].pages != NULL ? (int) shards[s].pages->num_records : catalog_size (shards[s].catalog);
+      printf ("Loaded %d book/s from %d other branch/es.\n", n, num_shards);
+    }
+
+  return 0;
+}
+
+/* Function: search_pages
+ * ----------------------
+ * Find the records of a paged branch whose field matches a value.
+ *
+ * An accession number is looked up in the B+tree, which reads one page
+ * per level.  Any other field is compared on every record, read leaf by
+ * leaf through the buffer pool.  A cursor to each match is kept, so the
+ * matches can be read again to print them.
+ */
+static void
+search_pages (BranchSearch *search)
+{
+  BTreeCursor cursor, match, *new_cursors;
+  char key[MAX_FIELD_LEN], record_key[BTREE_MAX_KEY + 1];
+  char record[BTREE_MAX_VALUE + 1];
+  char *fields[MAX_NUM_FIELDS];
+  int status;
+
+  if (search->field == FIELD_ACCESSION_NUM)
+    {
+      catalog_page_key (search->value, key);
+      status = btree_seek (search->pages, key, &cursor);
+    }
+  else
+    status = btree_seek (search->pages, NULL, &cursor);
+  if (status != 0)
+    {
+      search->error = 1;
+      return;
+    }
+
+  for (;;)
+    {
+      match = cursor;
+      status = btree_next (&cursor, record_key, record, NULL);
+      if (status <= 0)
+        break;
+
+      if (search->field == FIELD_ACCESSION_NUM)
+        {
+          /* The records with the key are next to each other. */
+          if (strcmp (record_key, key))
+            break;
+        }
+      else
+        {
+          catalog_split_record (record, fields);
+          if (strcasecmp (fields[search->field], search->value))
+            continue;
+        }
+
+      if (search->num_matches % 64 == 0)
+        {
+          new_cursors = (BTreeCursor *) mem_realloc (MEM_INDEXES, search->cursors,
+                                                     sizeof (BTreeCursor) * (search->num_matches + 64));
+          if (new_cursors == NULL)
+            {
+              status = -1;
+              break;
+            }
+          search->cursors = new_cursors;
+        }
+      search->cursors[search->num_matches++] = match;
+    }
+
+  if (status < 0)
+    search->error = 1;
+}
+
+/* Function: search_branch
+ * -----------------------
+ * Find the books of one branch whose field matches a value,
+ * as `find_books` does for this branch.
+ *
+ * Runs on a worker thread.  No two searches share a catalog,
+ * so each touches only its own catalog and BranchSearch.
+ *
+ * arg: The array of searches.
+ * task: The index of the search to run.
+ */
+static void
+search_branch (void *arg,
+               int   task)
+{
+  BranchSearch *search = (BranchSearch *) arg + task;
+  CatalogIter iter;
+  int *new_matches, i;
+
+  search->matches = NULL;
+  search->cursors = NULL;
+  search->num_matches = 0;
+  search->error = 0;
+
+  TRACE_BEGIN ("lookup");
+  if (search->pages != NULL)
+    {
+      search_pages (search);
+      TRACE_END ("lookup");
+      return;
+    }
+
+  if (catalog_find (search->catalog, search->field, search->value, &iter) != 0)
+    {
+      search->error = 1;
+      TRACE_END ("lookup");
+      return;
+    }
+
+  while ((i = catalog_next (&iter)) >= 0)
+    {
+      if (search->num_matches % 64 == 0)
+        {
+          new_matches = (int *) mem_realloc (MEM_INDEXES, search->matches,
+                                             sizeof (int) * (search->num_matches + 64));
+          if (new_matches == NULL)
+            {
+              search->error = 1;
+              break;
+            }
+          search->matches = new_matches;
+        }
+      search->matches[search->num_matches++] = i;
+    }
+
+  catalog_find_end (&iter);
+  TRACE_END ("lookup");
+}
+
+/* Function: find_branches
+ * -----------------------
+ * Find the books of every branch whose field matches a value.
+ *
+ * This branch and each branch in BRANCH_DIR are searched at the same
+ * time on the worker pool.  The matches are printed under the name of
+ * their branch: this branch's first, as LOCAL_BRANCH, then the other
+ * branches by name, each in catalog order, or in accession number order
+ * for a paged catalog, so the output does not depend on which search
+ * finishes first.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+find_branches (void)
+{
+  char c;
+  char buffer[MAX_FIELD_LEN];
+  char record[BTREE_MAX_VALUE + 1];
+  char *fields[MAX_NUM_FIELDS];
+  BranchSearch *searches;
+  Catalog *branch;
+  const Book *book;
+  int field, num_searches, num_found, num_branches_found, error, s, i, f;
+
+  puts ("Searching all branches..");
+
+get_branch_field:
+  puts (" a - author");
+  puts (" b - back");
+  puts (" g - genre");
+  puts (" n - accession number");
+  puts (" p - publisher");
+  puts (" t - title");
+  puts (" y - publication year");
+  printf (">> ");
+
+  if (read_choice (&c) == EOF)
+    return EOF_ERR;
+  while ((d = getchar ()) != '\n' && d != EOF) {}
+
+  switch (c)
     {
     case 'a':
-      printf ("Enter book author (all): ");
-      if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+      field = FIELD_AUTHOR;
+      printf ("Enter book author: ");
+      break;
+
+    case 'b':
+      return 0;
+
+    case 'g':
+      field = FIELD_GENRE;
+      printf ("Enter book genre: ");
+      break;
+
+    case 'n':
+      field = FIELD_ACCESSION_NUM;
+      printf ("Enter accession number: ");
+      break;
+
+    case 'p':
+      field = FIELD_PUBLISHER;
+      printf ("Enter book publisher: ");
+      break;
+
+    case 't':
+      field = FIELD_TITLE;
+      printf ("Enter book title: ");
+      break;
+
+    case 'y':
+      field = FIELD_PUBLICATION_YEAR;
+      printf ("Enter publication year: ");
+      break;
+
+    default:
+      puts ("Invalid input. Try again.");
+      goto get_branch_field;
+    }
+
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  start_pool ();
+
+  num_searches = num_shards + 1;
+  searches = (BranchSearch *) mem_calloc (MEM_INDEXES, num_searches, sizeof (BranchSearch));
+  if (searches == NULL)
+    {
+      fprintf (stderr, "Error: Failed to allocate memory for search.\n");
+      return IO_ERR;
+    }
+  for (s = 0; s < num_searches; s++)
+    {
+      searches[s].catalog = s > 0 ? shards[s - 1].catalog : catalog;
+      searches[s].pages = s > 0 ? shards[s - 1].pages : NULL;
+      searches[s].branch = s > 0 ? shards[s - 1].branch : LOCAL_BRANCH;
+      searches[s].field = field;
+      searches[s].value = buffer;
+    }
+
+  pool_run (&pool, search_branch, searches, num_searches);
+
+  num_found = 0;
+  num_branches_found = 0;
+  error = 0;
+  TRACE_BEGIN ("format_output");
+  for (s = 0; s < num_searches; s++)
+    {
+      branch = searches[s].catalog;
+      error |= searches[s].error;
+
+      for (i = 0; i < searches[s].num_matches && searches[s].pages != NULL; i++)
+        {
+          if (btree_next (&searches[s].cursors[i], NULL, record, NULL) != 1)
+            {
+              error = 1;
+              break;
+            }
+          catalog_split_record (record, fields);
+          printf ("Branch:           %s\n", searches[s].branch);
+          for (f = 0; f < MAX_NUM_FIELDS; f++)
+            printf ("%s %s\n", field_labels[f], fields[f]);
+        }
+      for (i = 0; i < searches[s].num_matches && searches[s].pages == NULL; i++)
+        {
+          printf ("Branch:           %s\n", searches[s].branch);
+          book = &branch->books[searches[s].matches[i]];
+          for (f = 0; f < MAX_NUM_FIELDS; f++)
+            printf ("%s %s\n", field_labels[f], catalog_get (branch, book, f));
+        }
+      num_found += searches[s].num_matches;
+      num_branches_found += searches[s].num_matches > 0;
+      mem_free (searches[s].matches);
+      mem_free (searches[s].cursors);
+    }
+  TRACE_END ("format_output");
+  mem_free (searches);
+
+  if (error)
+    {
+      for (s = 0; s < num_shards; s++)
+        if (shards[s].pages != NULL && shards[s].pages->bad_page != 0)
+          fprintf (stderr, "Error: Page %u of \"%s/%s.db\" does not match its checksum.\n",
+                   shards[s].pages->bad_page, BRANCH_DIR, shards[s].branch);
+      fprintf (stderr, "Error: Failed to search all branches.\n");
+      return IO_ERR;
+    }
+
+  putchar ('\n');
+  if (num_found < 1)
+    printf ("No match found in %d branch/es.\n", num_searches);
+  else
+    printf ("Found %d match/s in %d of %d branch/es.\n", num_found, num_branches_found, num_searches);
+
+  return 0;
+}
+
+/* Function: compare_groups
+ * -------------------------
+ * Order groups by descending count, then by value.
+ */
+static int
+compare_groups (const void *a,
+                const void *b)
+{
+  const Group *x = (const Group *) a;
+  const Group *y = (const Group *) b;
+
+  if (x->count != y->count)
+    return x->count > y->count ? -1 : 1;
+
+  return frontcode_compare (x->value, y->value);
+}
+
+/* Function: count_books
+ * ---------------------
+ * Count the books in the library's collection by the value of a field.
+ *
+ * This function prompts the user to choose a field from a menu of options,
+ * and then prints the number of books holding each value of the field,
+ * largest count first.  The checked out report counts only the books
+ * that are checked out, grouped by genre.
+ *
+ * Books are counted in one pass over the books array, indexing an array
+ * of counters by the field's code, so no values are compared.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+count_books (void)
+{
+  char c;
+  int *counts;
+  Group *groups;
+  unsigned int num_codes, code;
+  int num_books_counted, num_groups, checked_out_only, available_only, field, i;
+
+  puts ("Counting books..");
+
+get_book_field:
+  puts (" a - author");
+  puts (" b - back");
+  puts (" c - checked out by genre");
+  puts (" g - genre");
+  puts (" p - publisher");
+  puts (" v - available by genre");
+  puts (" y - publication year");
+  printf (">> ");
+
+  if (read_choice (&c) == EOF)
+    return EOF_ERR;
+  while ((d = getchar ()) != '\n' && d != EOF) {}
+
+  checked_out_only = 0;
+  available_only = 0;
+  switch (c)
+    {
+    case 'a':
+      field = FIELD_AUTHOR;
+      break;
+
+    case 'b':
+      return 0;
+
+    case 'c':
+      field = FIELD_GENRE;
+      checked_out_only = 1;
+      break;
+
+    case 'g':
+      field = FIELD_GENRE;
+      break;
+
+    case 'p':
+      field = FIELD_PUBLISHER;
+      break;
+
+    case 'v':
+      field = FIELD_GENRE;
+      available_only = 1;
+      break;
+
+    case 'y':
+      field = FIELD_PUBLICATION_YEAR;
+      break;
+
+    default:
+      puts ("Invalid input. Try again.");
+      goto get_book_field;
+    }
+
+  num_codes = column_size (&catalog->columns[field]);
+  counts = (int *) mem_calloc (MEM_INDEXES, num_codes ? num_codes : 1, sizeof (int));
+  if (counts == NULL)
+    {
+      fprintf (stderr, "Error: Failed to allocate memory for counts.\n");
+      return IO_ERR;
+    }
+
+  num_books_counted = 0;
+  if (checked_out_only || available_only)
+    {
+      /* Count each genre's books from the bitmaps without reading any books. */
+      if (build_bitmaps () != 0)
+        {
+          mem_free (counts);
+          return IO_ERR;
+        }
+
+      for (code = 0; code < num_genre_bitmaps; code++)
+        {
+          if (checked_out_only)
+            counts[code] = bitmap_andnot_count (&genre_bitmaps[code], &available_books);
+          else
+            counts[code] = bitmap_and_count (&genre_bitmaps[code], &available_books);
+          num_books_counted += counts[code];
+        }
+    }
+  else
+    {
+      for (i = 0; i < catalog->num_books; i++)
+        counts[catalog->books[i].fields[field]]++;
+      num_books_counted = catalog->num_books;
+      stats_records_scanned += catalog->num_books;
+    }
+
+  num_groups = 0;
+  for (code = 0; code < num_codes; code++)
+    if (counts[code] > 0)
+      num_groups++;
+
+  groups = (Group *) mem_alloc (MEM_INDEXES, sizeof (Group) * (num_groups ? num_groups : 1));
+  if (groups == NULL)
+    {
+      fprintf (stderr, "Error: Failed to allocate memory for counts.\n");
+      mem_free (counts);
+      return IO_ERR;
+    }
+
+  /* The counted fields are dictionary-encoded, so their values
+   * are returned in place and stay valid while the groups are sorted. */
+  num_groups = 0;
+  for (code = 0; code < num_codes; code++)
+    {
+      if (counts[code] > 0)
+        {
+          groups[num_groups].value = column_get (&catalog->columns[field], code, catalog->field_bufs[field]);
+          groups[num_groups].count = counts[code];
+          num_groups++;
+        }
+    }
+  qsort (groups, num_groups, sizeof (Group), compare_groups);
+
+  putchar ('\n');
+  for (i = 0; i < num_groups; i++)
+    printf ("%8d  %s\n", groups[i].count, strcmp (groups[i].value, "") ? groups[i].value : "(empty)");
+
+  putchar ('\n');
+  if (num_books_counted < 1)
+    puts ("No books to count.");
+  else
+    printf ("Counted %d books in %d group/s.\n", num_books_counted, num_groups);
+
+  mem_free (groups);
+  mem_free (counts);
+  return 0;
+}
+
+/* Function: parse_patron
+ * ----------------------
+ * Find the patron a user refers to, either by name or as "#id".
+ *
+ * s: The name or id.
+ *
+ * returns: The id of the patron, or PATRON_NONE if there is no such patron.
+ */
+static unsigned int
+parse_patron (const char *s)
+{
+  unsigned long id;
+  char *end;
+
+  if (s[0] != '#')
+    return patron_find (&catalog->patrons, s);
+
+  if (s[1] < '0' || s[1] > '9')
+    return PATRON_NONE;
+  id = strtoul (s + 1, &end, 10);
+  if (*end != '\0' || id >= patron_count (&catalog->patrons))
+    return PATRON_NONE;
+
+  return id;
+}
+
+/* Function: build_loans
+ * ---------------------
+ * Build the loan list of every patron if the lists are not up to date.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+build_loans (void)
+{
+  int i;
+
+  if (loans_valid)
+    return 0;
+
+  TRACE_BEGIN ("lookup");
+  patron_clear_loans (&catalog->patrons);
+  for (i = 0; i < catalog->num_books; i++)
+    {
+      if (catalog->books[i].patron != PATRON_NONE && patron_lend (&catalog->patrons, catalog->books[i].patron, i) != 0)
+        {
+          TRACE_END ("lookup");
+          fprintf (stderr, "Error: Failed to allocate memory for patron loans.\n");
+          return IO_ERR;
+        }
+    }
+  stats_records_scanned += catalog->num_books;
+  TRACE_END ("lookup");
+
+  loans_valid = 1;
+  return 0;
+}
+
+/* Function: find_patron
+ * ---------------------
+ * Print the books a patron has out, or list every patron.
+ *
+ * The books are read from the patron's loan list,
+ * so the catalog is not scanned.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+find_patron (void)
+{
+  char buffer[MAX_FIELD_LEN];
+  const PatronLoans *loans;
+  unsigned int id, num_patrons, j;
+
+  puts ("Finding patron's loans..");
+  printf ("Enter patron name or #id (all): ");
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  if (build_loans () != 0)
+    return IO_ERR;
+
+  if (!strcmp (buffer, ""))
+    {
+      num_patrons = patron_count (&catalog->patrons);
+      for (id = 0; id < num_patrons; id++)
+        printf ("#%-5u %s (%u book/s out)\n", id, patron_name (&catalog->patrons, id), patron_loans (&catalog->patrons, id)->count);
+
+      putchar ('\n');
+      if (num_patrons < 1)
+        puts ("No patrons yet.");
+      else
+        printf ("Found %u patron/s.\n", num_patrons);
+      return 0;
+    }
+
+  id = parse_patron (buffer);
+  if (id == PATRON_NONE)
+    {
+      puts ("Patron not found.");
+      return 0;
+    }
+
+  loans = patron_loans (&catalog->patrons, id);
+  TRACE_BEGIN ("format_output");
+  for (j = 0; j < loans->count; j++)
+    print_book (&catalog->books[loans->books[j]]);
+  stats_records_scanned += loans->count;
+  TRACE_END ("format_output");
+
+  putchar ('\n');
+  printf ("Patron #%u, %s, has %u book/s out.\n", id, patron_name (&catalog->patrons, id), loans->count);
+
+  return 0;
+}
+
+/* Function: record_event
+ * ----------------------
+ * Append a borrow or return to the circulation history.
+ *
+ * A failure to write the history is reported
+ * but does not undo the borrow or return.
+ *
+ * event: HISTORY_BORROW or HISTORY_RETURN.
+ * i: The position of the book in the books array.
+ * patron: The id of the borrower.
+ * date: The date entered for the event. A date that is not
+ *       written as YYYY-MM-DD is recorded as today.
+ *
+ * returns: The date recorded, as YYYYMMDD.
+ */
+static unsigned int
+record_event (int           event,
+              int           i,
+              unsigned int  patron,
+              const char   *date)
+{
+  HistoryRecord record;
+  char today[MAX_FIELD_LEN];
+
+  record.event = event;
+  record.patron = patron;
+  record.date = history_parse_date (date);
+  if (record.date == 0)
+    {
+      get_current_date (today);
+      record.date = history_parse_date (today);
+    }
+  snprintf (record.accession_num, sizeof (record.accession_num), "%s",
+            get_field (&catalog->books[i], FIELD_ACCESSION_NUM));
+
+  if (history_append (&history, &record) != 0)
+    fprintf (stderr, "Warning: Failed to record the %s in \"%s\".\n",
+             event == HISTORY_BORROW ? "loan" : "return", HISTORY_DIR);
+
+  return record.date;
+}
+
+/* Function: show_history
+ * ----------------------
+ * Print part of the circulation history: the events of a book or
+ * of a patron within a range of dates, or the loans per day in a month.
+ *
+ * Only the segments of the months in the range are read.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+show_history (void)
+{
+  char c;
+  char buffer[MAX_FIELD_LEN];
+  char accession_num[MAX_FIELD_LEN];
+  int loans_per_day[32];
+  HistoryCursor cursor;
+  HistoryRecord record;
+  unsigned int patron, first_date, last_date;
+  int num_events, num_days, status, day;
+
+  puts ("Showing circulation history..");
+
+get_history_kind:
+  puts (" b - back");
+  puts (" d - loans per day in a month");
+  puts (" h - history of a book");
+  puts (" p - history of a patron");
+  printf (">> ");
+
+  if (read_choice (&c) == EOF)
+    return EOF_ERR;
+  while ((d = getchar ()) != '\n' && d != EOF) {}
+
+  patron = PATRON_NONE;
+  accession_num[0] = '\0';
+  first_date = last_date = 0;
+  switch (c)
+    {
+    case 'b':
+      return 0;
+
+    case 'd':
+get_month:
+      printf ("Enter month (YYYY-MM): ");
+      if (read_input (buffer, MAX_FIELD_LEN) == NULL)
         {
           if (feof (stdin))
             return EOF_ERR;
@@ -244,33 +2892,43 @@ get_book_field:
       if (strchr (buffer, '\n') == NULL)
         while ((d = getchar ()) != '\n' && d != EOF) {}
       buffer[strcspn(buffer, "\n")] = '\0';
-      if (!strcmp (buffer, ""))
+
+      /* A month is read as the first day of that month. */
+      if (strlen (buffer) != 7 || (first_date = history_parse_date (strcat (buffer, "-01"))) == 0)
         {
-          for (i = 0; i < num_books; i++)
-            {
-              num_books_found++;
-              printf ("%s\n", books[i].author);
-            }
+          puts ("Invalid month. Try again.");
+          goto get_month;
         }
-      else
+      last_date = first_date + 30;
+      break;
+
+    case 'h':
+get_accession_num:
+      printf ("Enter accession number: ");
+      if (read_input (accession_num, MAX_FIELD_LEN) == NULL)
         {
-          for (i = 0; i < num_books; i++)
+          if (feof (stdin))
+            return EOF_ERR;
+          else
             {
-              if (!strcasecmp (buffer, books[i].author))
-                {
-                  num_books_found++;
-                  print_book (books[i]);
-                }
+              fprintf (stderr, "Error: Failed to read input from stdin.\n");
+              return IO_ERR;
             }
         }
-      break;
+      if (strchr (accession_num, '\n') == NULL)
+        while ((d = getchar ()) != '\n' && d != EOF) {}
+      accession_num[strcspn (accession_num, "\n")] = '\0';
 
-    case 'b':
-      return 0;
+      if (!strcmp (accession_num, ""))
+        {
+          puts ("Invalid accession number. Try again.");
+          goto get_accession_num;
+        }
+      break;
 
-    case 'g':
-      printf ("Enter book genre (all): ");
-      if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+    case 'p':
+      printf ("Enter patron name or #id: ");
+      if (read_input (buffer, MAX_FIELD_LEN) == NULL)
         {
           if (feof (stdin))
             return EOF_ERR;
@@ -283,30 +2941,25 @@ get_book_field:
       if (strchr (buffer, '\n') == NULL)
         while ((d = getchar ()) != '\n' && d != EOF) {}
       buffer[strcspn(buffer, "\n")] = '\0';
-      if (!strcmp (buffer, ""))
-        {
-          for (i = 0; i < num_books; i++)
-            {
-              num_books_found++;
-              printf ("%s\n", books[i].genre);
-            }
-        }
-      else
+
+      patron = parse_patron (buffer);
+      if (patron == PATRON_NONE)
         {
-          for (i = 0; i < num_books; i++)
-            {
-              if (!strcasecmp (buffer, books[i].genre))
-                {
-                  num_books_found++;
-                  print_book (books[i]);
-                }
-            }
+          puts ("Patron not found.");
+          return 0;
         }
       break;
 
-    case 'p':
-      printf ("Enter book publisher (all): ");
-      if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+    default:
+      puts ("Invalid input. Try again.");
+      goto get_history_kind;
+    }
+
+  if (c != 'd')
+    {
+get_first_date:
+      printf ("Enter first date (earliest): ");
+      if (read_input (buffer, MAX_FIELD_LEN) == NULL)
         {
           if (feof (stdin))
             return EOF_ERR;
@@ -319,30 +2972,18 @@ get_book_field:
       if (strchr (buffer, '\n') == NULL)
         while ((d = getchar ()) != '\n' && d != EOF) {}
       buffer[strcspn(buffer, "\n")] = '\0';
-      if (!strcmp (buffer, ""))
-        {
-          for (i = 0; i < num_books; i++)
-            {
-              num_books_found++;
-              printf ("%s\n", books[i].publisher);
-            }
-        }
-      else
+
+      first_date = strcmp (buffer, "") ? history_parse_date (buffer) : 0;
+      if (strcmp (buffer, "") && first_date == 0)
         {
-          for (i = 0; i < num_books; i++)
-            {
-              if (!strcasecmp (buffer, books[i].publisher))
-                {
-                  num_books_found++;
-                  print_book (books[i]);
-                }
-            }
+          puts ("Invalid date. Try again.");
+          goto get_first_date;
         }
-      break;
 
-    case 't':
-      printf ("Enter book title (all): ");
-      if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+get_last_date:
+      get_current_date (buffer);
+      printf ("Enter last date (%s): ", buffer);
+      if (read_input (buffer, MAX_FIELD_LEN) == NULL)
         {
           if (feof (stdin))
             return EOF_ERR;
@@ -355,74 +2996,477 @@ get_book_field:
       if (strchr (buffer, '\n') == NULL)
         while ((d = getchar ()) != '\n' && d != EOF) {}
       buffer[strcspn(buffer, "\n")] = '\0';
+
       if (!strcmp (buffer, ""))
+        get_current_date (buffer);
+      last_date = history_parse_date (buffer);
+      if (last_date == 0 || last_date < first_date)
         {
-          for (i = 0; i < num_books; i++)
-            {
-              num_books_found++;
-              printf ("%s\n", books[i].title);
-            }
+          puts ("Invalid date. Try again.");
+          goto get_last_date;
+        }
+    }
+
+  if (history_seek (&history, &cursor, first_date, last_date) != 0)
+    {
+      fprintf (stderr, "Error: Failed to read directory \"%s\".\n", HISTORY_DIR);
+      return 0;
+    }
+
+  num_events = 0;
+  memset (loans_per_day, 0, sizeof (loans_per_day));
+  while ((status = history_next (&cursor, &record)) > 0)
+    {
+      if (c == 'd')
+        {
+          if (record.event == HISTORY_BORROW)
+            loans_per_day[record.date % 100]++;
+          continue;
         }
+      if (c == 'h' ? strcmp (record.accession_num, accession_num) : record.patron != patron)
+        continue;
+
+      num_events++;
+      printf ("%04u-%02u-%02u  %-8s  accession %s by ", record.date / 10000, record.date / 100 % 100,
+              record.date % 100, record.event == HISTORY_BORROW ? "borrowed" : "returned", record.accession_num);
+      if (record.patron < patron_count (&catalog->patrons))
+        printf ("#%u %s\n", record.patron, patron_name (&catalog->patrons, record.patron));
       else
+        puts ("an unknown patron");
+    }
+  history_end (&cursor);
+  stats_bytes_read += cursor.bytes_read;
+  if (status < 0)
+    fprintf (stderr, "Error: Invalid segment in \"%s\".\n", HISTORY_DIR);
+
+  if (c == 'd')
+    {
+      num_days = 0;
+      for (day = 1; day <= 31; day++)
+        {
+          if (loans_per_day[day] == 0)
+            continue;
+          num_days++;
+          num_events += loans_per_day[day];
+          printf ("%04u-%02u-%02d  %d loan/s\n", first_date / 10000, first_date / 100 % 100, day, loans_per_day[day]);
+        }
+      putchar ('\n');
+      printf ("Counted %d loan/s on %d day/s in %u segment/s.\n", num_events, num_days, cursor.num_segments);
+      return 0;
+    }
+
+  putchar ('\n');
+  printf ("Found %d event/s in %u segment/s.\n", num_events, cursor.num_segments);
+  return 0;
+}
+
+/* Function: get_period
+ * --------------------
+ * Find the sketches of a year.
+ *
+ * year: The year.
+ * create: Nonzero to add empty sketches for the year if it has none.
+ *
+ * returns: The sketches of the year, or NULL if it has none
+ *          and they were not or could not be added.
+ */
+static Period *
+get_period (unsigned int year,
+            int          create)
+{
+  Period *new_periods;
+  unsigned int j;
+
+  for (j = 0; j < num_periods; j++)
+    if (periods[j].year == year)
+      return &periods[j];
+
+  if (!create)
+    return NULL;
+
+  new_periods = (Period *) mem_realloc (MEM_INDEXES, periods, sizeof (Period) * (num_periods + 1));
+  if (new_periods == NULL)
+    return NULL;
+  periods = new_periods;
+
+  periods[num_periods].year = year;
+  sketch_init (&periods[num_periods].titles);
+  sketch_init (&periods[num_periods].genres);
+  return &periods[num_periods++];
+}
+
+/* Function: count_loan
+ * --------------------
+ * Add a loan to the sketches of its year.
+ *
+ * i: The position of the book borrowed in the books array.
+ * date: The date of the loan, as YYYYMMDD.
+ */
+static void
+count_loan (int          i,
+            unsigned int date)
+{
+  Period *period;
+
+  period = get_period (date / 10000, 1);
+  if (period == NULL)
+    {
+      fprintf (stderr, "Warning: Failed to allocate memory for popularity reports.\n");
+      return;
+    }
+
+  sketch_add (&period->titles, get_field (&catalog->books[i], FIELD_TITLE));
+  sketch_add (&period->genres, get_field (&catalog->books[i], FIELD_GENRE));
+}
+
+/* Function: load_popularity
+ * -------------------------
+ * Read the sketches of every year from POPULARITY_FILE_NAME,
+ * or rebuild them from the circulation history if the file is missing,
+ * was written by another build, or was written when the history had
+ * another size.  The file is only written by a clean quit, so loans
+ * made by a session that ended otherwise are only in the history.
+ *
+ * Must be called after the catalog is loaded,
+ * since a rebuild looks up the books in the history.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+load_popularity (void)
+{
+  FILE *fp;
+  char magic[sizeof (POPULARITY_MAGIC) - 1];
+  unsigned int header[2];
+  unsigned long long history_bytes;
+  HistoryCursor cursor;
+  HistoryRecord record;
+  int i;
+
+  fp = fopen (POPULARITY_FILE_NAME, "rb");
+  if (fp != NULL)
+    {
+      if (fread (magic, 1, sizeof (magic), fp) == sizeof (magic)
+          && !memcmp (magic, POPULARITY_MAGIC, sizeof (magic))
+          && fread (header, sizeof (unsigned int), 2, fp) == 2
+          && header[0] == sizeof (Period)
+          && fread (&history_bytes, sizeof (history_bytes), 1, fp) == 1
+          && history_bytes == history_size (&history))
         {
-          for (i = 0; i < num_books; i++)
+          periods = (Period *) mem_alloc (MEM_INDEXES, sizeof (Period) * (header[1] ? header[1] : 1));
+          if (periods == NULL)
             {
-              if (!strcasecmp (buffer, books[i].title))
-                {
-                  num_books_found++;
-                  print_book (books[i]);
-                }
+              fprintf (stderr, "Error: Failed to allocate memory for popularity reports.\n");
+              fclose (fp);
+              return IO_ERR;
+            }
+
+          if (fread (periods, sizeof (Period), header[1], fp) == header[1])
+            {
+              num_periods = header[1];
+              stats_bytes_read += sizeof (magic) + sizeof (header) + sizeof (history_bytes)
+                                  + sizeof (Period) * num_periods;
+              fclose (fp);
+              return 0;
             }
+
+          mem_free (periods);
+          periods = NULL;
         }
+      fclose (fp);
+    }
+
+  /* The sketches are only a summary of the history, so they can always be rebuilt. */
+  if (history_seek (&history, &cursor, 0, (unsigned int) -1) != 0)
+    return 0;
+  while (history_next (&cursor, &record) > 0)
+    {
+      if (record.event != HISTORY_BORROW)
+        continue;
+      i = find_accession_num (record.accession_num);
+      if (i < catalog->num_books)
+        count_loan (i, record.date);
+    }
+  history_end (&cursor);
+  stats_bytes_read += cursor.bytes_read;
+
+  return 0;
+}
+
+/* Function: save_popularity
+ * -------------------------
+ * Write the sketches of every year to POPULARITY_FILE_NAME.
+ *
+ * returns: 0 on success, or IO_ERR if the file could not be written.
+ */
+static int
+save_popularity (void)
+{
+  FILE *fp;
+  unsigned int header[2];
+  unsigned long long history_bytes;
+
+  fp = fopen (POPULARITY_FILE_NAME, "wb");
+  if (fp == NULL)
+    {
+      fprintf (stderr, "Error: Failed to open file \"%s\" for writing.\n", POPULARITY_FILE_NAME);
+      return IO_ERR;
+    }
+
+  header[0] = sizeof (Period);
+  header[1] = num_periods;
+  history_bytes = history_size (&history);
+  if (fwrite (POPULARITY_MAGIC, 1, sizeof (POPULARITY_MAGIC) - 1, fp) != sizeof (POPULARITY_MAGIC) - 1
+      || fwrite (header, sizeof (unsigned int), 2, fp) != 2
+      || fwrite (&history_bytes, sizeof (history_bytes), 1, fp) != 1
+      || (num_periods > 0 && fwrite (periods, sizeof (Period), num_periods, fp) != num_periods))
+    {
+      fprintf (stderr, "Error: Failed to write to file \"%s\".\n", POPULARITY_FILE_NAME);
+      fclose (fp);
+      return IO_ERR;
+    }
+  stats_bytes_written += sizeof (POPULARITY_MAGIC) - 1 + sizeof (header) + sizeof (history_bytes)
+                         + sizeof (Period) * num_periods;
+
+  if (fclose (fp) != 0)
+    {
+      fprintf (stderr, "Error: Failed to close file \"%s\".\n", POPULARITY_FILE_NAME);
+      return IO_ERR;
+    }
+
+  return 0;
+}
+
+/* Function: show_popular
+ * ----------------------
+ * Print the most borrowed titles or the most active genres of a year.
+ *
+ * The report is read from the sketches of the year, so its cost does
+ * not depend on the number of loans.  The estimates never undercount.
+ * On request, the exact counts are also computed from the circulation
+ * history of the year and printed beside the estimates.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+show_popular (void)
+{
+  char c;
+  char buffer[MAX_FIELD_LEN];
+  SketchItem items[TOP_N];
+  HistoryCursor cursor;
+  HistoryRecord record;
+  const Sketch *sketch;
+  const Period *period;
+  unsigned int *exact, num_items, num_codes = 0, code, j;
+  int field, year, verify, num_loans, i;
+
+  puts ("Showing popular books..");
+
+get_popular_kind:
+  puts (" b - back");
+  puts (" g - most active genres");
+  puts (" t - most borrowed titles");
+  printf (">> ");
+
+  if (read_choice (&c) == EOF)
+    return EOF_ERR;
+  while ((d = getchar ()) != '\n' && d != EOF) {}
+
+  switch (c)
+    {
+    case 'b':
+      return 0;
+
+    case 'g':
+      field = FIELD_GENRE;
       break;
 
-    case 'y':
-      printf ("Enter publication year (all): ");
-      if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+    case 't':
+      field = FIELD_TITLE;
+      break;
+
+    default:
+      puts ("Invalid input. Try again.");
+      goto get_popular_kind;
+    }
+
+get_year:
+  printf ("Enter year (blank for this year): ");
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  if (!strcmp (buffer, ""))
+    {
+      get_current_date (buffer);
+      buffer[4] = '\0';
+    }
+  year = catalog_parse_year (buffer);
+  if (year == YEAR_NONE)
+    {
+      puts ("Invalid year. Try again.");
+      goto get_year;
+    }
+
+get_verify:
+  printf ("Verify with exact counts? [y/n]: ");
+  if (read_choice (&c) == EOF)
+    return EOF_ERR;
+  while ((d = getchar ()) != '\n' && d != EOF) {}
+
+  if (c != 'y' && c != 'n')
+    {
+      puts ("Invalid input choice. Try again.");
+      goto get_verify;
+    }
+  verify = c == 'y';
+
+  period = get_period (year, 0);
+  if (period == NULL)
+    {
+      printf ("No loans recorded in %d.\n", year);
+      return 0;
+    }
+  sketch = field == FIELD_TITLE ? &period->titles : &period->genres;
+  num_items = sketch_top (sketch, items, TOP_N);
+
+  exact = NULL;
+  num_loans = 0;
+  if (verify)
+    {
+      num_codes = column_size (&catalog->columns[field]);
+      exact = (unsigned int *) mem_calloc (MEM_INDEXES, num_codes ? num_codes : 1, sizeof (unsigned int));
+      if (exact == NULL)
         {
-          if (feof (stdin))
-            return EOF_ERR;
-          else
-            {
-              fprintf (stderr, "Error: Failed to read input from stdin.\n");
-              return IO_ERR;
-            }
+          fprintf (stderr, "Error: Failed to allocate memory for exact counts.\n");
+          return IO_ERR;
         }
-      if (strchr (buffer, '\n') == NULL)
-        while ((d = getchar ()) != '\n' && d != EOF) {}
-      buffer[strcspn(buffer, "\n")] = '\0';
-      if (!strcmp (buffer, ""))
+
+      if (history_seek (&history, &cursor, year * 10000 + 101, year * 10000 + 1231) != 0)
+        fprintf (stderr, "Error: Failed to read directory \"%s\".\n", HISTORY_DIR);
+      else
         {
-          for (i = 0; i < num_books; i++)
+          while (history_next (&cursor, &record) > 0)
             {
-              num_books_found++;
-              printf ("%s\n", books[i].publication_year);
+              if (record.event != HISTORY_BORROW)
+                continue;
+              num_loans++;
+              i = find_accession_num (record.accession_num);
+              if (i < catalog->num_books)
+                exact[catalog->books[i].fields[field]]++;
             }
+          history_end (&cursor);
+          stats_bytes_read += cursor.bytes_read;
         }
-      else
+    }
+
+  printf ("Most %s of %d, estimated from %llu loan/s:\n",
+          field == FIELD_TITLE ? "borrowed titles" : "active genres", year, sketch->total);
+  printf ("  Estimate%s  %s\n", verify ? "     Exact" : "", field == FIELD_TITLE ? "Title" : "Genre");
+  for (j = 0; j < num_items; j++)
+    {
+      printf ("  %8u", items[j].count);
+      if (verify)
         {
-          for (i = 0; i < num_books; i++)
-            {
-              if (!strcasecmp (buffer, books[i].publication_year))
-                {
-                  num_books_found++;
-                  print_book (books[i]);
-                }
-            }
+          code = column_lookup (&catalog->columns[field], items[j].key);
+          printf ("  %8u", code != COLUMN_NONE && code < num_codes ? exact[code] : 0);
         }
-      break;
+      printf ("  %s\n", strcmp (items[j].key, "") ? items[j].key : "(empty)");
+    }
 
-    default:
-      puts ("Invalid input. Try again.");
-      goto get_book_field;
+  if (verify)
+    {
+      putchar ('\n');
+      printf ("Counted %d loan/s exactly from %u segment/s of history.\n", num_loans, cursor.num_segments);
+      mem_free (exact);
     }
 
-  putchar ('\n');
-  if (num_books_found < 1)
-    puts ("No match found.");
-  else
-    printf ("Found %d match/s.\n", num_books_found);
+  return 0;
+}
+
+/* Function: return_at
+ * -------------------
+ * Return the book at a position, which must be checked out.
+ *
+ * i: The position of the book in the books array.
+ * date: The return date.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+return_at (int         i,
+           const char *date)
+{
+  unsigned int patron;
+
+  TRACE_BEGIN ("mutate");
+  patron = catalog->books[i].patron;
+  if (loans_valid && patron != PATRON_NONE)
+    patron_unlend (&catalog->patrons, patron, i);
+
+  if (catalog_return (catalog, i, date) != 0)
+    {
+      TRACE_END ("mutate");
+      fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+      return IO_ERR;
+    }
+  record_event (HISTORY_RETURN, i, patron, get_field (&catalog->books[i], FIELD_RETURN_DATE));
+  record_change (JOURNAL_RETURN, i, date);
+  book_changes++;
+
+  if (bitmaps_valid && bitmap_set (&available_books, i) != 0)
+    drop_bitmaps ();
+  TRACE_END ("mutate");
+  return 0;
+}
+
+/* Function: lend_at
+ * -----------------
+ * Lend the book at a position, which must not be checked out.
+ *
+ * i: The position of the book in the books array.
+ * borrower: The name of the borrower.  A new name adds a patron.
+ * date: The checked out date.
+ *
+ * returns: 0 on success, or IO_ERR if memory could not be allocated.
+ */
+static int
+lend_at (int         i,
+         const char *borrower,
+         const char *date)
+{
+  unsigned int day;
+
+  TRACE_BEGIN ("mutate");
+  if (catalog_borrow (catalog, i, borrower, date) != 0)
+    {
+      TRACE_END ("mutate");
+      fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+      return IO_ERR;
+    }
+
+  if (bitmaps_valid)
+    bitmap_clear (&available_books, i);
+  if (loans_valid && patron_lend (&catalog->patrons, catalog->books[i].patron, i) != 0)
+    loans_valid = 0;
 
+  day = record_event (HISTORY_BORROW, i, catalog->books[i].patron, date);
+  record_change (JOURNAL_LEND, i, date);
+  book_changes++;
+  count_loan (i, day);
+  TRACE_END ("mutate");
   return 0;
 }
 
@@ -454,7 +3498,7 @@ return_book (void)
 
 get_accession_num:
   printf ("Enter accession number: ");
-  if (fgets (accession_num, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (accession_num, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -475,19 +3519,15 @@ get_accession_num:
       goto get_accession_num;
     }
 
-  for (i = 0; i < num_books; i++)
-    {
-      if (!strcmp (accession_num, books[i].accession_num))
-        break;
-    }
+  i = find_accession_num (accession_num);
 
-  if (i == num_books)
+  if (i == catalog->num_books)
     {
       puts ("Book not found.");
       return 0;
     }
 
-  if (!strcmp (books[i].checked_out_by, ""))
+  if (!strcmp (get_field (&catalog->books[i], FIELD_CHECKED_OUT_BY), ""))
     {
       puts ("Book was already returned.");
       return 0;
@@ -495,7 +3535,7 @@ get_accession_num:
 
   get_current_date (date_now);
   printf ("Enter return date (%s): ", date_now);
-  if (fgets (return_date, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (return_date, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -510,15 +3550,11 @@ get_accession_num:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   return_date[strcspn (return_date, "\n")] = '\0';
 
-  if (!strcmp (return_date, ""))
-    strncpy (books[i].return_date, date_now, MAX_FIELD_LEN);
-  else
-    strncpy (books[i].return_date, return_date, MAX_FIELD_LEN);
-
-  strncpy (books[i].checked_out_by, "", MAX_FIELD_LEN - 1);
-  strncpy (books[i].checked_out_date, "", MAX_FIELD_LEN - 1);
+  if (return_at (i, strcmp (return_date, "") ? return_date : date_now) != 0)
+    return IO_ERR;
 
-  printf ("%s has been returned on %s.\n", books[i].title, books[i].return_date);
+  printf ("%s has been returned on %s.\n",
+          get_field (&catalog->books[i], FIELD_TITLE), get_field (&catalog->books[i], FIELD_RETURN_DATE));
   return 0;
 }
 
@@ -541,7 +3577,8 @@ get_accession_num:
 static int
 borrow_book (void)
 {
-  int i;
+  unsigned int patron;
+  int i, new_patron;
   char accession_num[MAX_FIELD_LEN];
   char checked_out_by[MAX_FIELD_LEN];
   char date_now[MAX_FIELD_LEN];
@@ -551,7 +3588,7 @@ borrow_book (void)
 
 get_accession_num:
   printf ("Enter accession number: ");
-  if (fgets (accession_num, MAX_FIELD_LEN, stdin) ==  NULL)
+  if (read_input (accession_num, MAX_FIELD_LEN) ==  NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -572,73 +3609,517 @@ get_accession_num:
       goto get_accession_num;
     }
 
-  for (i = 0; i < num_books; i++)
-    {
-      if (!strcmp (accession_num, books[i].accession_num))
-        break;
-    }
+  i = find_accession_num (accession_num);
 
-  if (i == num_books)
+  if (i == catalog->num_books)
     {
       puts ("Book not found.");
       return 0;
     }
 
-  if (strcmp (books[i].checked_out_by, ""))
+  if (strcmp (get_field (&catalog->books[i], FIELD_CHECKED_OUT_BY), ""))
     {
       puts ("Book is already checked out.");
       return 0;
     }
 
-get_checked_out_by:
-  printf ("Enter borrower's name: ");
-  if (fgets (checked_out_by, MAX_FIELD_LEN, stdin) == NULL)
-    {
-      if (feof (stdin))
-        return EOF_ERR;
-      else
+get_checked_out_by:
+  printf ("Enter borrower's name or #id: ");
+  if (read_input (checked_out_by, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+
+  if (strchr (checked_out_by, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  checked_out_by[strcspn (checked_out_by, "\n")] = '\0';
+
+  if (checked_out_by[0] == '#')
+    {
+      patron = parse_patron (checked_out_by);
+      if (patron == PATRON_NONE)
+        {
+          puts ("Patron not found. Try again.");
+          goto get_checked_out_by;
+        }
+      strcpy (checked_out_by, patron_name (&catalog->patrons, patron));
+    }
+
+  if (checked_out_by[strspn (checked_out_by, " \t")] == '\0')
+    {
+      puts ("Invalid name. Try again.");
+      goto get_checked_out_by;
+    }
+
+  get_current_date (date_now);
+  printf ("Enter checked out date (%s): ", date_now);
+  if (read_input (checked_out_date, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+
+  if (strchr (checked_out_date, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  checked_out_date[strcspn (checked_out_date, "\n")] = '\0';
+
+  new_patron = patron_find (&catalog->patrons, checked_out_by) == PATRON_NONE;
+  if (lend_at (i, checked_out_by, strcmp (checked_out_date, "") ? checked_out_date : date_now) != 0)
+    return IO_ERR;
+  if (new_patron)
+    printf ("Registered %s as patron #%u.\n", get_field (&catalog->books[i], FIELD_CHECKED_OUT_BY), catalog->books[i].patron);
+
+  printf ("%s has been borrowed on %s.\n",
+          get_field (&catalog->books[i], FIELD_TITLE), get_field (&catalog->books[i], FIELD_CHECKED_OUT_DATE));
+  return 0;
+}
+
+/* Function: now_ms
+ * -----------------
+ * Read the monotonic clock.
+ *
+ * returns: The current monotonic time in milliseconds.
+ */
+static long long
+now_ms (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Function: next_scan
+ * -------------------
+ * Read the next scan from a stream, without its newline.
+ *
+ * stream: The stream.
+ * line: Receives the scan.  It must hold MAX_FIELD_LEN characters;
+ *       a longer scan is cut short.
+ * timeout_ms: How long to wait for a scan, or -1 to wait for as long
+ *             as it takes.  Once the first character of a scan from
+ *             stdin has arrived, the rest of its line is waited for.
+ *
+ * returns: 1 if a scan was read, 0 if the wait timed out,
+ *          EOF_ERR at the end of the stream, or IO_ERR on error.
+ */
+static int
+next_scan (ScanStream *stream,
+           char       *line,
+           int         timeout_ms)
+{
+  struct pollfd pfd;
+  char *newline;
+  size_t len;
+  ssize_t n;
+  int held;
+
+  if (stream->fd < 0)
+    {
+      /* Wait no longer than the group allows, unless stdio
+       * already holds the next scan. */
+      if (timeout_ms >= 0 && !stdin_buffered ())
+        {
+          pfd.fd = STDIN_FILENO;
+          pfd.events = POLLIN;
+          held = begin_wait ();
+          n = poll (&pfd, 1, timeout_ms);
+          end_wait (held);
+          if (n == 0)
+            return 0;
+        }
+      if (read_input (line, MAX_FIELD_LEN) == NULL)
+        {
+          if (feof (stdin))
+            return EOF_ERR;
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+      if (strchr (line, '\n') == NULL)
+        while ((d = getchar ()) != '\n' && d != EOF) {}
+      line[strcspn (line, "\n")] = '\0';
+      return 1;
+    }
+
+  while ((newline = memchr (stream->buf + stream->start, '\n', stream->end - stream->start)) == NULL)
+    {
+      /* A line longer than the buffer is cut short. */
+      if (stream->start == 0 && stream->end == sizeof (stream->buf))
+        {
+          newline = stream->buf + stream->end - 1;
+          break;
+        }
+      memmove (stream->buf, stream->buf + stream->start, stream->end - stream->start);
+      stream->end -= stream->start;
+      stream->start = 0;
+
+      pfd.fd = stream->fd;
+      pfd.events = POLLIN;
+      held = begin_wait ();
+      n = poll (&pfd, 1, timeout_ms);
+      end_wait (held);
+      if (n == 0)
+        return 0;
+      if (n > 0)
+        n = read (stream->fd, stream->buf + stream->end, sizeof (stream->buf) - stream->end);
+      if (n < 0)
+        {
+          fprintf (stderr, "Error: Failed to read scans.\n");
+          return IO_ERR;
+        }
+      if (n == 0)
+        {
+          /* The last scan need not end with a newline. */
+          if (stream->end == 0)
+            return EOF_ERR;
+          newline = stream->buf + stream->end;
+          break;
+        }
+      stream->end += n;
+    }
+
+  len = newline - (stream->buf + stream->start);
+  snprintf (line, MAX_FIELD_LEN, "%.*s", (int) len, stream->buf + stream->start);
+  stream->start += len + (newline < stream->buf + stream->end);
+  return 1;
+}
+
+/* Function: commit_group
+ * ----------------------
+ * Wait until the changes of a group of scans are on disk:
+ * the journal, and the circulation history.
+ *
+ * The catalog file itself is only written when the program quits,
+ * so a commit costs the same however large the catalog is.
+ *
+ * returns: 0 on success, or IO_ERR if the changes could not be written.
+ */
+static int
+commit_group (void)
+{
+  TRACE_BEGIN ("fsync");
+  if (journal_sync (&journal) != 0)
+    {
+      TRACE_END ("fsync");
+      fprintf (stderr, "Error: Failed to write the journal \"%s\" to disk.\n", JOURNAL_FILE_NAME);
+      return IO_ERR;
+    }
+  if (history_sync (&history) != 0)
+    {
+      TRACE_END ("fsync");
+      fprintf (stderr, "Error: Failed to write the circulation history to disk.\n");
+      return IO_ERR;
+    }
+  TRACE_END ("fsync");
+
+  return 0;
+}
+
+/* Function: record_change
+ * -----------------------
+ * Append a loan or return to the journal.
+ *
+ * A failure to write the journal is reported
+ * but does not undo the loan or return.
+ *
+ * event: JOURNAL_LEND or JOURNAL_RETURN.
+ * i: The position of the book in the books array.
+ * date: The date entered for the change.
+ */
+static void
+record_change (int         event,
+               int         i,
+               const char *date)
+{
+  JournalRecord record;
+
+  record.event = event;
+  snprintf (record.accession_num, sizeof (record.accession_num), "%s",
+            get_field (&catalog->books[i], FIELD_ACCESSION_NUM));
+  snprintf (record.date, sizeof (record.date), "%s", date);
+  snprintf (record.borrower, sizeof (record.borrower), "%s",
+            event == JOURNAL_LEND ? get_field (&catalog->books[i], FIELD_CHECKED_OUT_BY) : "");
+
+  if (journal_append (&journal, &record) != 0)
+    fprintf (stderr, "Warning: Failed to record the %s in \"%s\".\n",
+             event == JOURNAL_LEND ? "loan" : "return", JOURNAL_FILE_NAME);
+}
+
+/* Function: replay_journal
+ * ------------------------
+ * Make again the loans and returns in the journal of a session that
+ * did not quit cleanly, which the catalog file does not hold yet.
+ *
+ * The records are only applied to the catalog: they are already in
+ * the circulation history and stay in the journal until the catalog
+ * is saved.  A loan of a book that is checked out, a return of one
+ * that is not, and a book that no longer exists are skipped.
+ */
+static void
+replay_journal (void)
+{
+  static const char *const paths[] = { OLD_JOURNAL_FILE_NAME, JOURNAL_FILE_NAME };
+  JournalCursor cursor;
+  JournalRecord record;
+  size_t p;
+  int num_changes, num_journals, status, i;
+
+  num_changes = num_journals = 0;
+  for (p = 0; p < sizeof (paths) / sizeof (paths[0]); p++)
+    {
+      status = journal_start (paths[p], &cursor);
+      if (status < 0)
+        fprintf (stderr, "Warning: Failed to read the journal \"%s\".\n", paths[p]);
+      if (status <= 0)
+        continue;
+
+      num_journals++;
+      while (journal_next (&cursor, &record))
+        {
+          i = catalog_find_accession (catalog, record.accession_num);
+          if (i < 0)
+            continue;
+          if (strcmp (get_field (&catalog->books[i], FIELD_CHECKED_OUT_BY), ""))
+            {
+              if (record.event != JOURNAL_RETURN || catalog_return (catalog, i, record.date) != 0)
+                continue;
+            }
+          else if (record.event != JOURNAL_LEND
+                   || catalog_borrow (catalog, i, record.borrower, record.date) != 0)
+            continue;
+          num_changes++;
+        }
+      stats_bytes_read += cursor.bytes_read;
+      journal_end (&cursor);
+    }
+
+  if (num_journals > 0)
+    fprintf (stderr, "Warning: Made %d loan/s and return/s of the last session again from \"%s\".\n",
+             num_changes, JOURNAL_FILE_NAME);
+}
+
+/* Function: rotate_journal
+ * ------------------------
+ * Move the journal to OLD_JOURNAL_FILE_NAME when a checkpoint is taken,
+ * so that the changes made after it start a new journal.
+ *
+ * If the old journal is still there because the last checkpoint
+ * failed, the records are appended to it instead, as neither
+ * checkpoint holds them.
+ *
+ * The journal is synced before it is moved: a group of scans that
+ * is not committed yet would otherwise never reach the disk, since
+ * committing it syncs only the new journal.
+ *
+ * Called with `catalog_lock` held.
+ */
+static void
+rotate_journal (void)
+{
+  JournalCursor cursor;
+  JournalRecord record;
+  Journal old;
+  int status;
+
+  if (access (OLD_JOURNAL_FILE_NAME, F_OK) != 0)
+    {
+      if (journal_rename (&journal, OLD_JOURNAL_FILE_NAME) != 0)
+        fprintf (stderr, "Warning: Failed to move the journal \"%s\" to \"%s\".\n",
+                 JOURNAL_FILE_NAME, OLD_JOURNAL_FILE_NAME);
+      return;
+    }
+
+  if (journal_sync (&journal) != 0)
+    fprintf (stderr, "Warning: Failed to write the journal \"%s\" to disk.\n", JOURNAL_FILE_NAME);
+  journal_close (&journal);
+
+  if (journal_start (JOURNAL_FILE_NAME, &cursor) <= 0)
+    return;
+  journal_init (&old, OLD_JOURNAL_FILE_NAME);
+  status = 0;
+  while (status == 0 && journal_next (&cursor, &record))
+    status = journal_append (&old, &record);
+  if (status == 0)
+    status = journal_sync (&old);
+  journal_close (&old);
+  journal_end (&cursor);
+
+  if (status == 0)
+    remove (JOURNAL_FILE_NAME);
+  else
+    fprintf (stderr, "Warning: Failed to write to file \"%s\".\n", OLD_JOURNAL_FILE_NAME);
+}
+
+/* Function: scan_station
+ * ----------------------
+ * Lend and return books as fast as they are scanned at a self-check station.
+ *
+ * The scans are read from stdin or from a file such as a FIFO, one per
+ * line, until an empty line or the end of the stream.  A scan starting
+ * with '#' is the id of a patron's card, and the books scanned after it
+ * are lent to that patron.  Any other scan is an accession number: a
+ * book that is checked out is returned, and one that is not is lent.
+ * Both are dated today.
+ *
+ * Nothing is synced after each scan.  Instead, the changes are committed
+ * to the journal in groups, once SCAN_GROUP_OPS books were lent or returned or
+ * SCAN_GROUP_MS milliseconds after the first change of the group,
+ * whichever comes first, so the cost of writing to disk is shared by
+ * the whole group.  A scan is only safe from a crash once its group is
+ * committed.  While reading stdin, a group that is due is committed
+ * with the next scan or at the end of the stream.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+scan_station (void)
+{
+  char line[MAX_FIELD_LEN];
+  char date_now[MAX_FIELD_LEN];
+  ScanStream stream;
+  unsigned int patron;
+  long long group_start;
+  int num_scans, num_groups, pending, status, timeout, i;
+
+  puts ("Running scan station..");
+  printf ("Enter file of scans (stdin): ");
+  if (read_input (line, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (line, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  line[strcspn (line, "\n")] = '\0';
+
+  stream.fd = -1;
+  stream.start = stream.end = 0;
+  if (strcmp (line, ""))
+    {
+      stream.fd = open (line, O_RDONLY);
+      if (stream.fd < 0)
+        {
+          fprintf (stderr, "Error: Failed to open file \"%s\" for reading.\n", line);
+          return 0;
+        }
+    }
+  else
+    puts ("Scan patron cards (#id) and accession numbers. An empty line ends the scans.");
+
+  patron = PATRON_NONE;
+  num_scans = num_groups = pending = 0;
+  group_start = 0;
+  while (1)
+    {
+      timeout = -1;
+      if (pending > 0)
+        {
+          timeout = (int) (group_start + SCAN_GROUP_MS - now_ms ());
+          if (timeout < 0)
+            timeout = 0;
+        }
+
+      status = next_scan (&stream, line, timeout);
+      if (status == 0)
+        {
+          status = commit_group ();
+          if (status != 0)
+            break;
+          num_groups++;
+          pending = 0;
+          continue;
+        }
+      if (status < 0)
+        break;
+
+      line[strcspn (line, "\r")] = '\0';
+      if (!strcmp (line, ""))
+        {
+          status = 0;
+          break;
+        }
+
+      num_scans++;
+      if (line[0] == '#')
+        {
+          patron = parse_patron (line);
+          if (patron == PATRON_NONE)
+            printf ("Patron %s not found.\n", line);
+          else
+            printf ("Patron #%u, %s.\n", patron, patron_name (&catalog->patrons, patron));
+          continue;
+        }
+
+      i = find_accession_num (line);
+      if (i == catalog->num_books)
         {
-          fprintf (stderr, "Error: Failed to read input from stdin.\n");
-          return IO_ERR;
+          printf ("Book %s not found.\n", line);
+          continue;
         }
-    }
 
-  if (strchr (checked_out_by, '\n') == NULL)
-    while ((d = getchar ()) != '\n' && d != EOF) {}
-  checked_out_by[strcspn (checked_out_by, "\n")] = '\0';
+      get_current_date (date_now);
+      if (strcmp (get_field (&catalog->books[i], FIELD_CHECKED_OUT_BY), ""))
+        {
+          status = return_at (i, date_now);
+          if (status == 0)
+            printf ("Returned %s.\n", get_field (&catalog->books[i], FIELD_TITLE));
+        }
+      else if (patron == PATRON_NONE)
+        {
+          printf ("Scan a patron card before lending book %s.\n", line);
+          continue;
+        }
+      else
+        {
+          status = lend_at (i, patron_name (&catalog->patrons, patron), date_now);
+          if (status == 0)
+            printf ("Lent %s to patron #%u.\n", get_field (&catalog->books[i], FIELD_TITLE), patron);
+        }
+      if (status != 0)
+        break;
 
-  if (!strcmp (checked_out_by, ""))
-    {
-      puts ("Invalid name. Try again.");
-      goto get_checked_out_by;
+      if (pending++ == 0)
+        group_start = now_ms ();
+      if (pending >= SCAN_GROUP_OPS || now_ms () - group_start >= SCAN_GROUP_MS)
+        {
+          status = commit_group ();
+          if (status != 0)
+            break;
+          num_groups++;
+          pending = 0;
+        }
     }
-  else
-    strncpy (books[i].checked_out_by, checked_out_by, MAX_FIELD_LEN);
 
-  get_current_date (date_now);
-  printf ("Enter checked out date (%s): ", date_now);
-  if (fgets (checked_out_date, MAX_FIELD_LEN, stdin) == NULL)
+  if (pending > 0 && status != IO_ERR)
     {
-      if (feof (stdin))
-        return EOF_ERR;
+      if (commit_group () == 0)
+        num_groups++;
       else
-        {
-          fprintf (stderr, "Error: Failed to read input from stdin.\n");
-          return IO_ERR;
-        }
+        status = IO_ERR;
     }
+  if (stream.fd >= 0)
+    close (stream.fd);
 
-  if (strchr (checked_out_date, '\n') == NULL)
-    while ((d = getchar ()) != '\n' && d != EOF) {}
-  checked_out_date[strcspn (checked_out_date, "\n")] = '\0';
-
-  if (!strcmp (checked_out_date, ""))
-    strncpy (books[i].checked_out_date, date_now, MAX_FIELD_LEN);
-  else
-    strncpy (books[i].checked_out_date, checked_out_date, MAX_FIELD_LEN);
-
-  printf ("%s has been borrowed on %s.\n", books[i].title, books[i].checked_out_date);
-  return 0;
+  printf ("Processed %d scan/s in %d group commit/s.\n", num_scans, num_groups);
+  /* The end of a file of scans is not the end of stdin. */
+  return stream.fd >= 0 && status == EOF_ERR ? 0 : status;
 }
 
 /* Function: delete_book
@@ -661,13 +4142,13 @@ delete_book (void)
 {
   char accession_num[MAX_FIELD_LEN];
   char c;
-  int i, j;
+  int i;
 
   puts ("Deleting book..");
 
 get_accession_num:
   printf ("Enter accession number: ");
-  if (fgets (accession_num, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (accession_num, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -688,23 +4169,19 @@ get_accession_num:
       goto get_accession_num;
     }
 
-  for (i = 0; i < num_books; i++)
-    {
-      if (!strcmp (accession_num, books[i].accession_num))
-        break;
-    }
+  i = find_accession_num (accession_num);
 
-  if (i == num_books)
+  if (i == catalog->num_books)
     {
       puts ("Book not found.");
       return 0;
     }
 
-  print_book (books[i]);
+  print_book (&catalog->books[i]);
 
 get_del_confirmation:
   printf ("Are you sure you want to delete this book? [y/n]: ");
-  if (scanf (" %c", &c) == EOF)
+  if (read_choice (&c) == EOF)
     return EOF_ERR;
   while ((d = getchar ()) != '\n' && d != EOF) {}
 
@@ -719,10 +4196,18 @@ get_del_confirmation:
       goto get_del_confirmation;
     }
 
-  for (j = i; j < num_books - 1; j++)
-    books[j] = books[j + 1];
-
-  num_books--;
+  TRACE_BEGIN ("mutate");
+  if (catalog_delete (catalog, i) != 0)
+    {
+      TRACE_END ("mutate");
+      fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+      return IO_ERR;
+    }
+  year_index_valid = 0;
+  loans_valid = 0;
+  drop_bitmaps ();
+  book_changes++;
+  TRACE_END ("mutate");
   puts ("Book deleted.");
   return 0;
 }
@@ -756,7 +4241,7 @@ edit_book (void)
 
 get_accession_num:
   printf ("Enter accession number: ");
-  if (fgets (accession_num, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (accession_num, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -776,23 +4261,19 @@ get_accession_num:
       goto get_accession_num;
     }
 
-  for (i = 0; i < num_books; i++)
-    {
-      if (!strcmp (accession_num, books[i].accession_num))
-        break;
-    }
+  i = find_accession_num (accession_num);
 
-  if (i == num_books)
+  if (i == catalog->num_books)
     {
       puts ("Book not found.");
       return 0;
     }
 
-  print_book (books[i]);
+  print_book (&catalog->books[i]);
 
 get_edit_confirmation:
   printf ("Do you want to continue editing? [y/n]: ");
-  if (scanf (" %c", &c) == EOF)
+  if (read_choice (&c) == EOF)
     return EOF_ERR;
   while ((d = getchar ()) != '\n' && d != EOF) {}
 
@@ -807,8 +4288,10 @@ get_edit_confirmation:
       goto get_edit_confirmation;
     }
 
-  printf ("Enter book title (%s): ", books[i].title);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  book = catalog->books[i];
+
+  printf ("Enter book title (%s): ", get_field (&catalog->books[i], FIELD_TITLE));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -823,13 +4306,11 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.title, books[i].title, MAX_FIELD_LEN);
-  else
-    strncpy (book.title, buffer, MAX_FIELD_LEN);
+  if (strcmp (buffer, "") && set_field (&book, FIELD_TITLE, buffer) != 0)
+    return IO_ERR;
 
-  printf ("Enter book author (%s): ", books[i].author);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter book author (%s): ", get_field (&catalog->books[i], FIELD_AUTHOR));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -844,13 +4325,11 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.author, books[i].author, MAX_FIELD_LEN);
-  else
-    strncpy (book.author, buffer, MAX_FIELD_LEN);
+  if (strcmp (buffer, "") && set_field (&book, FIELD_AUTHOR, buffer) != 0)
+    return IO_ERR;
 
-  printf ("Enter book publisher (%s): ", books[i].publisher);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter book publisher (%s): ", get_field (&catalog->books[i], FIELD_PUBLISHER));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -865,13 +4344,11 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.publisher, books[i].publisher, MAX_FIELD_LEN);
-  else
-    strncpy (book.publisher, buffer, MAX_FIELD_LEN);
+  if (strcmp (buffer, "") && set_field (&book, FIELD_PUBLISHER, buffer) != 0)
+    return IO_ERR;
 
-  printf ("Enter publication year (%s): ", books[i].publication_year);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter publication year (%s): ", get_field (&catalog->books[i], FIELD_PUBLICATION_YEAR));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -886,13 +4363,11 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.publication_year, books[i].publication_year, MAX_FIELD_LEN);
-  else
-    strncpy (book.publication_year, buffer, MAX_FIELD_LEN);
+  if (strcmp (buffer, "") && set_field (&book, FIELD_PUBLICATION_YEAR, buffer) != 0)
+    return IO_ERR;
 
-  printf ("Enter book ISBN (%s): ", books[i].isbn);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter book ISBN (%s): ", get_field (&catalog->books[i], FIELD_ISBN));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -907,13 +4382,11 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.isbn, books[i].isbn, MAX_FIELD_LEN);
-  else
-    strncpy (book.isbn, buffer, MAX_FIELD_LEN);
+  if (strcmp (buffer, "") && set_field (&book, FIELD_ISBN, buffer) != 0)
+    return IO_ERR;
 
-  printf ("Enter accession number (%s): ", books[i].accession_num);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter accession number (%s): ", get_field (&catalog->books[i], FIELD_ACCESSION_NUM));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -928,13 +4401,11 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.accession_num, books[i].accession_num, MAX_FIELD_LEN);
-  else
-    strncpy (book.accession_num, buffer, MAX_FIELD_LEN);
+  if (strcmp (buffer, "") && set_field (&book, FIELD_ACCESSION_NUM, buffer) != 0)
+    return IO_ERR;
 
-  printf ("Enter book genre (%s): ", books[i].genre);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter book genre (%s): ", get_field (&catalog->books[i], FIELD_GENRE));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -949,13 +4420,11 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.genre, books[i].genre, MAX_FIELD_LEN);
-  else
-    strncpy (book.genre, buffer, MAX_FIELD_LEN);
+  if (strcmp (buffer, "") && set_field (&book, FIELD_GENRE, buffer) != 0)
+    return IO_ERR;
 
-  printf ("Enter checked out by (%s): ", books[i].checked_out_by);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter checked out by (%s): ", get_field (&catalog->books[i], FIELD_CHECKED_OUT_BY));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -970,13 +4439,11 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.checked_out_by, books[i].checked_out_by, MAX_FIELD_LEN);
-  else
-    strncpy (book.checked_out_by, buffer, MAX_FIELD_LEN);
+  if (strcmp (buffer, "") && set_field (&book, FIELD_CHECKED_OUT_BY, buffer) != 0)
+    return IO_ERR;
 
-  printf ("Enter checked out date (%s): ", books[i].checked_out_date);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter checked out date (%s): ", get_field (&catalog->books[i], FIELD_CHECKED_OUT_DATE));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -991,13 +4458,11 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.checked_out_date, books[i].checked_out_date, MAX_FIELD_LEN);
-  else
-    strncpy (book.checked_out_date, buffer, MAX_FIELD_LEN);
+  if (strcmp (buffer, "") && set_field (&book, FIELD_CHECKED_OUT_DATE, buffer) != 0)
+    return IO_ERR;
 
-  printf ("Enter return date (%s): ", books[i].return_date);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter return date (%s): ", get_field (&catalog->books[i], FIELD_RETURN_DATE));
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -1012,12 +4477,17 @@ get_edit_confirmation:
     while ((d = getchar ()) != '\n' && d != EOF) {}
   buffer[strcspn(buffer, "\n")] = '\0';
 
-  if (!strcmp (buffer, ""))
-    strncpy (book.return_date, books[i].return_date, MAX_FIELD_LEN);
-  else
-    strncpy (book.return_date, buffer, MAX_FIELD_LEN);
-
-  books[i] = book;
+  if (strcmp (buffer, "") && set_field (&book, FIELD_RETURN_DATE, buffer) != 0)
+    return IO_ERR;
+
+  if (book.patron != catalog->books[i].patron)
+    loans_valid = 0;
+  TRACE_BEGIN ("mutate");
+  unindex_book (i);
+  catalog_put (catalog, i, &book);
+  index_book (i);
+  book_changes++;
+  TRACE_END ("mutate");
   puts ("Book edited successfully.");
   return 0;
 }
@@ -1042,31 +4512,11 @@ add_book (void)
   Book book;
   int i;
 
-  if (num_books >= max_books)
-    {
-      size_t new_max_books;
-      Book *new_books;
-
-      new_max_books =  max_books + 500;
-      new_books = (Book *) realloc (books, sizeof (Book) * new_max_books);
-
-      if (new_books == NULL)
-        {
-          fprintf (stderr, "Error: Failed to allocate additional memory for books.\n");
-          return IO_ERR;
-        }
-      else
-        {
-          books = new_books;
-          max_books = new_max_books;
-        }
-    }
-
   puts ("Adding book..");
 
 get_book_title:
   printf ("Enter book title: ");
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -1086,12 +4536,12 @@ get_book_title:
       puts ("Invalid book title. Try again.");
       goto get_book_title;
     }
-  else
-    strncpy (book.title, buffer, MAX_FIELD_LEN);
+  else if (set_field (&book, FIELD_TITLE, buffer) != 0)
+    return IO_ERR;
 
 get_book_author:
   printf ("Enter book author: ");
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -1111,12 +4561,12 @@ get_book_author:
       puts ("Invalid book author. Try again.");
       goto get_book_author;
     }
-  else
-    strncpy (book.author, buffer, MAX_FIELD_LEN);
+  else if (set_field (&book, FIELD_AUTHOR, buffer) != 0)
+    return IO_ERR;
 
 get_book_publisher:
   printf ("Enter book publisher: ");
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -1136,12 +4586,12 @@ get_book_publisher:
       puts ("Invalid book publisher. Try again.");
       goto get_book_publisher;
     }
-  else
-    strncpy (book.publisher, buffer, MAX_FIELD_LEN);
+  else if (set_field (&book, FIELD_PUBLISHER, buffer) != 0)
+    return IO_ERR;
 
 get_publication_year:
   printf ("Enter publication year: ");
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -1161,12 +4611,12 @@ get_publication_year:
       puts ("Invalid publication year. Try again.");
       goto get_publication_year;
     }
-  else
-    strncpy (book.publication_year, buffer, MAX_FIELD_LEN);
+  else if (set_field (&book, FIELD_PUBLICATION_YEAR, buffer) != 0)
+    return IO_ERR;
 
 get_book_isbn:
   printf ("Enter book ISBN: ");
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -1186,12 +4636,12 @@ get_book_isbn:
       puts ("Invalid ISBN. Try again.");
       goto get_book_isbn;
     }
-  else
-    strncpy (book.isbn, buffer, MAX_FIELD_LEN);
+  else if (set_field (&book, FIELD_ISBN, buffer) != 0)
+    return IO_ERR;
 
 get_accession_num:
-  printf ("Enter accession number (%d): ", num_books + 1);
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  printf ("Enter accession number (%d): ", catalog->num_books + 1);
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -1209,24 +4659,22 @@ get_accession_num:
 
   if (!strcmp (buffer, ""))
     {
-      sprintf (buffer, "%d", num_books + 1);
+      sprintf (buffer, "%d", catalog->num_books + 1);
     }
   else
     {
-      for (i = 0; i < num_books; i++)
+      if (find_accession_num (buffer) < catalog->num_books)
         {
-          if (!strcmp (buffer, books[i].accession_num))
-            {
-              puts ("Error: The entered accession number is not unique.");
-              goto get_accession_num;
-            }
+          puts ("Error: The entered accession number is not unique.");
+          goto get_accession_num;
         }
     }
-  strncpy (book.accession_num, buffer, MAX_FIELD_LEN);
+  if (set_field (&book, FIELD_ACCESSION_NUM, buffer) != 0)
+    return IO_ERR;
 
 get_book_genre:
   printf ("Enter book genre: ");
-  if (fgets (buffer, MAX_FIELD_LEN, stdin) == NULL)
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -1246,80 +4694,417 @@ get_book_genre:
       puts ("Invalid book genre. Try again.");
       goto get_book_genre;
     }
-  else
-    strncpy (book.genre, buffer, MAX_FIELD_LEN);
-
-  strncpy (book.checked_out_by, "", MAX_FIELD_LEN - 1);
-  strncpy (book.checked_out_date, "", MAX_FIELD_LEN - 1);
-  strncpy (book.return_date, "", MAX_FIELD_LEN - 1);
-
-  memcpy (&books[num_books], &book, sizeof (Book));
-  books[num_books].title[MAX_FIELD_LEN - 1] = '\0';
-  books[num_books].author[MAX_FIELD_LEN - 1] = '\0';
-  books[num_books].publisher[MAX_FIELD_LEN - 1] = '\0';
-  books[num_books].publication_year[MAX_FIELD_LEN - 1] = '\0';
-  books[num_books].isbn[MAX_FIELD_LEN - 1] = '\0';
-  books[num_books].accession_num[MAX_FIELD_LEN - 1] = '\0';
-  books[num_books].genre[MAX_FIELD_LEN - 1] = '\0';
-  books[num_books].checked_out_by[MAX_FIELD_LEN - 1] = '\0';
-  books[num_books].checked_out_date[MAX_FIELD_LEN - 1] = '\0';
-  books[num_books].return_date[MAX_FIELD_LEN - 1] = '\0';
-
-  num_books++;
+  else if (set_field (&book, FIELD_GENRE, buffer) != 0)
+    return IO_ERR;
+
+  if (set_field (&book, FIELD_CHECKED_OUT_BY, "") != 0
+      || set_field (&book, FIELD_CHECKED_OUT_DATE, "") != 0
+      || set_field (&book, FIELD_RETURN_DATE, "") != 0)
+    return IO_ERR;
+
+  TRACE_BEGIN ("mutate");
+  i = catalog_add (catalog, &book);
+  if (i < 0)
+    {
+      TRACE_END ("mutate");
+      fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+      return IO_ERR;
+    }
+  year_index_valid = 0;
+  index_book (i);
+  book_changes++;
+  TRACE_END ("mutate");
   puts ("Book added successfully.");
   return 0;
 }
 
-/* Function: save_catalog
- * ----------------------
- * Save the library's collection to a file.
+/* Function: import_books
+ * -----------------------
+ * Add the books of a MARC 21 file, as vendors deliver them.
+ *
+ * Records are read one at a time through a buffer of fixed size, so a
+ * file of any size is imported in the same memory, and each is added
+ * the way `add_book` adds a book, with the next free accession number.
+ * Records without a title or that are not well formed are skipped.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+import_books (void)
+{
+  char buffer[MAX_FIELD_LEN];
+  char accession_num[MAX_FIELD_LEN];
+  MarcReader reader;
+  Book book;
+  int i, status, next, num_added;
+
+  puts ("Importing books..");
+
+get_file_name:
+  printf ("Enter MARC file name: ");
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  if (!strcmp (buffer, ""))
+    {
+      puts ("Invalid file name. Try again.");
+      goto get_file_name;
+    }
+
+  if (marc_open (&reader, buffer) != 0)
+    {
+      fprintf (stderr, "Error: Failed to open file \"%s\" for reading.\n", buffer);
+      return 0;
+    }
+
+  next = catalog->num_books + 1;
+  num_added = 0;
+  TRACE_BEGIN ("mutate");
+  while ((status = marc_next (&reader)) > 0)
+    {
+      status = catalog_read_marc (catalog, &reader, &book);
+      if (status > 0)
+        {
+          reader.num_skipped++;
+          continue;
+        }
+
+      do
+        snprintf (accession_num, MAX_FIELD_LEN, "%d", next++);
+      while (find_accession_num (accession_num) < catalog->num_books);
+
+      if (status < 0 || catalog_set (catalog, &book, FIELD_ACCESSION_NUM, accession_num) != 0
+          || (i = catalog_add (catalog, &book)) < 0)
+        {
+          TRACE_END ("mutate");
+          fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+          marc_close (&reader);
+          stats_bytes_read += reader.bytes_read;
+          return IO_ERR;
+        }
+      index_book (i);
+      book_changes++;
+      num_added++;
+    }
+  TRACE_END ("mutate");
+  stats_records_scanned += reader.num_records;
+  if (num_added > 0)
+    year_index_valid = 0;
+
+  if (marc_close (&reader) != 0)
+    fprintf (stderr, "Error: Failed to read from file \"%s\".\n", buffer);
+  stats_bytes_read += reader.bytes_read;
+  printf ("Imported %d book/s from %s (%llu record/s skipped).\n", num_added, buffer, reader.num_skipped);
+  return 0;
+}
+
+/* Function: export_catalog
+ * ------------------------
+ * Export the library's collection to a JSON Lines, JSON or XML file,
+ * or to a paged catalog that other branches can search.
+ *
+ * The books are encoded one at a time into the exporter's buffer,
+ * so exporting holds no more memory for a large catalog than for
+ * a small one.  A file that cannot be written is reported,
+ * but leaves the catalog as it was.
+ *
+ * returns: An integer indicating the success of the function.
+ * If an error occurs, the appropriate error code is returned.
+ */
+static int
+export_catalog (void)
+{
+  char c;
+  char buffer[MAX_FIELD_LEN];
+  const char *values[MAX_NUM_FIELDS];
+  const char *ext;
+  char key;
+  Exporter exporter;
+  ExportFormat format;
+  int i, f, field, status;
+
+  puts ("Exporting catalog..");
+
+get_export_format:
+  puts (" b - back");
+  puts (" j - JSON array");
+  puts (" l - JSON Lines");
+  puts (" p - paged catalog");
+  puts (" s - sorted CSV of all branches");
+  puts (" x - XML");
+  printf (">> ");
+
+  if (read_choice (&c) == EOF)
+    return EOF_ERR;
+  while ((d = getchar ()) != '\n' && d != EOF) {}
+
+  switch (c)
+    {
+    case 'b':
+      return 0;
+
+    case 'j':
+      ext = ".json";
+      break;
+
+    case 'l':
+      ext = ".jsonl";
+      break;
+
+    case 'p':
+      ext = ".db";
+      break;
+
+    case 's':
+      ext = "-sorted.csv";
+      break;
+
+    case 'x':
+      ext = ".xml";
+      break;
+
+    default:
+      puts ("Invalid input. Try again.");
+      goto get_export_format;
+    }
+
+  field = FIELD_TITLE;
+  if (c != 's')
+    goto get_file_name;
+
+get_sort_field:
+  puts ("Sort by:");
+  puts (" a - author");
+  puts (" g - genre");
+  puts (" n - accession number");
+  puts (" p - publisher");
+  puts (" t - title");
+  puts (" y - publication year");
+  printf (">> ");
+
+  if (read_choice (&key) == EOF)
+    return EOF_ERR;
+  while ((d = getchar ()) != '\n' && d != EOF) {}
+
+  switch (key)
+    {
+    case 'a':
+      field = FIELD_AUTHOR;
+      break;
+
+    case 'g':
+      field = FIELD_GENRE;
+      break;
+
+    case 'n':
+      field = FIELD_ACCESSION_NUM;
+      break;
+
+    case 'p':
+      field = FIELD_PUBLISHER;
+      break;
+
+    case 't':
+      field = FIELD_TITLE;
+      break;
+
+    case 'y':
+      field = FIELD_PUBLICATION_YEAR;
+      break;
+
+    default:
+      puts ("Invalid input. Try again.");
+      goto get_sort_field;
+    }
+
+get_file_name:
+  printf ("Enter file name (%s%s): ", EXPORT_FILE_NAME, ext);
+  if (read_input (buffer, MAX_FIELD_LEN) == NULL)
+    {
+      if (feof (stdin))
+        return EOF_ERR;
+      else
+        {
+          fprintf (stderr, "Error: Failed to read input from stdin.\n");
+          return IO_ERR;
+        }
+    }
+  if (strchr (buffer, '\n') == NULL)
+    while ((d = getchar ()) != '\n' && d != EOF) {}
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  if (!strcmp (buffer, ""))
+    snprintf (buffer, MAX_FIELD_LEN, "%s%s", EXPORT_FILE_NAME, ext);
+
+  if (c == 's')
+    return export_sorted (buffer, field);
+
+  if (c == 'p')
+    {
+      if (catalog_write_pages (catalog, buffer) != 0)
+        {
+          fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+          return 0;
+        }
+      printf ("Exported %d book/s to %s.\n", catalog->num_books, buffer);
+      return 0;
+    }
+
+  /* Only the formats of the export module are left. */
+  format = c == 'j' ? EXPORT_JSON : c == 'x' ? EXPORT_XML : EXPORT_JSONL;
+
+  /* The file may be the terminal, as with /dev/stdout. */
+  fflush (stdout);
+  if (export_open (&exporter, buffer, format, field_keys, MAX_NUM_FIELDS) != 0)
+    {
+      fprintf (stderr, "Error: Failed to open file \"%s\" for writing.\n", buffer);
+      return 0;
+    }
+
+  TRACE_BEGIN ("format_output");
+  for (i = 0; i < catalog->num_books; i++)
+    {
+      for (f = 0; f < MAX_NUM_FIELDS; f++)
+        values[f] = get_field (&catalog->books[i], f);
+      if (export_record (&exporter, values) != 0)
+        break;
+    }
+  stats_records_scanned += i;
+  TRACE_END ("format_output");
+
+  status = export_close (&exporter);
+  stats_bytes_written += exporter.bytes_written;
+  if (status != 0)
+    {
+      fprintf (stderr, "Error: Failed to write to file \"%s\".\n", buffer);
+      return 0;
+    }
+
+  printf ("Exported %d book/s to %s.\n", catalog->num_books, buffer);
+  return 0;
+}
+
+/* Function: export_sorted
+ * ------------------------
+ * Export the books of every branch to one CSV file, sorted by a field,
+ * for shelf lists and vendors.
  *
- * This function saves the details of the books in the books array
- * to a file in CSV format.
+ * Each book is formatted as a line of the catalog file and handed to an
+ * external sort, which holds at most `sort_memory` bytes and writes the
+ * rest out in sorted runs to be merged.  The books of a paged branch are
+ * read from its file a page at a time, so the branches together may be
+ * far larger than memory.  Years and accession numbers sort as numbers,
+ * and books with equal keys keep the order of their branches.
  *
- * If an error occurs while saving the file,
- * an error message is printed to the console
- * and the appropriate error code is returned.
+ * file_name: The file to write, in the format of the catalog file.
+ * field: The field to sort by.
  *
  * returns: An integer indicating the success of the function.
  * If an error occurs, the appropriate error code is returned.
  */
 static int
-save_catalog (void)
+export_sorted (const char *file_name,
+               int         field)
 {
+  char record[MAX_LINE_LEN + 1];
+  const char *line;
+  Sorter sorter;
+  BTreeCursor cursor;
+  Catalog *cat;
   FILE *fp;
-  int i;
+  char *buf;
+  size_t len;
+  long num_books;
+  int status, s, i;
 
-  fp = fopen (FILE_NAME, "w");
-  if (fp == NULL)
+  if (sort_open (&sorter, field, field == FIELD_PUBLICATION_YEAR || field == FIELD_ACCESSION_NUM,
+                 sort_memory, NULL) != 0)
     {
-      fprintf (stderr, "Error: Failed to open file \"%s\" for writing.\n", FILE_NAME);
+      fprintf (stderr, "Error: Failed to allocate memory for sorting.\n");
       return IO_ERR;
     }
 
-  fprintf (fp, "Title,Author,Publisher,Publication Year,ISBN,Accession Number,Genre,Checked Out By,Checked Out Date,Return Date\n");
+  status = 0;
+  TRACE_BEGIN ("format_output");
+  for (s = -1; s < num_shards && status == 0; s++)
+    {
+      cat = s < 0 ? catalog : shards[s].catalog;
+      if (cat != NULL)
+        {
+          for (i = 0; i < cat->num_books && status == 0; i++)
+            status = sort_add (&sorter, record, catalog_format (cat, &cat->books[i], record, sizeof (record) - 1));
+          cat->records_scanned += i;
+        }
+      else if (shards[s].pages != NULL && btree_seek (shards[s].pages, NULL, &cursor) == 0)
+        {
+          while (status == 0 && (status = btree_next (&cursor, NULL, record, &len)) > 0)
+            status = sort_add (&sorter, record, len);
+        }
+      else
+        status = -1;
+    }
+  TRACE_END ("format_output");
 
-  for (i = 0; i < num_books; i++)
+  if (status != 0 || sort_finish (&sorter) != 0)
     {
-      fprintf(fp, "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
-              books[i].title,
-              books[i].author,
-              books[i].publisher,
-              books[i].publication_year,
-              books[i].isbn,
-              books[i].accession_num,
-              books[i].genre,
-              books[i].checked_out_by,
-              books[i].checked_out_date,
-              books[i].return_date);
+      fprintf (stderr, "Error: Failed to sort the books in \"%s\".\n", sorter.tmp_dir);
+      sort_close (&sorter);
+      stats_bytes_read += sorter.bytes_read;
+      stats_bytes_written += sorter.bytes_written;
+      return 0;
     }
 
-  if (fclose (fp) != 0)
+  /* The file may be the terminal, as with /dev/stdout. */
+  fflush (stdout);
+  fp = fopen (file_name, "w");
+  if (fp == NULL)
     {
-      fprintf (stderr, "Error: Failed to close file \"%s\".\n", FILE_NAME);
-      return IO_ERR;
+      fprintf (stderr, "Error: Failed to open file \"%s\" for writing.\n", file_name);
+      sort_close (&sorter);
+      stats_bytes_read += sorter.bytes_read;
+      stats_bytes_written += sorter.bytes_written;
+      return 0;
+    }
+  buf = (char *) mem_alloc (MEM_BUFFERS, EXPORT_BUF_LEN);
+  if (buf != NULL)
+    setvbuf (fp, buf, _IOFBF, EXPORT_BUF_LEN);
+
+  fprintf (fp, "%s\n", CATALOG_HEADER);
+  num_books = 0;
+  TRACE_BEGIN ("format_output");
+  while ((status = sort_next (&sorter, &line, &len)) > 0)
+    {
+      fwrite (line, 1, len, fp);
+      putc ('\n', fp);
+      stats_bytes_written += len + 1;
+      num_books++;
     }
+  TRACE_END ("format_output");
 
+  if (fclose (fp) != 0 || status < 0)
+    fprintf (stderr, "Error: Failed to write to file \"%s\".\n", file_name);
+  else
+    {
+      printf ("Exported %ld book/s to %s.\n", num_books, file_name);
+      if (sorter.total_files > 0)
+        printf ("Sorted in %d run/s with %d merge pass/es.\n", sorter.total_files, sorter.num_passes + 1);
+    }
+  mem_free (buf);
+  sort_close (&sorter);
+  stats_bytes_read += sorter.bytes_read;
+  stats_bytes_written += sorter.bytes_written;
   return 0;
 }
 
@@ -1338,14 +5123,24 @@ print_help (void)
 {
   puts (" a - add book");
   puts (" b - borrow book");
+  puts (" c - count books");
   puts (" d - delete book");
   puts (" e - edit book");
   puts (" f - find books");
   puts (" h - show program help");
+  puts (" i - import books");
+  puts (" k - run scan station");
   puts (" l - list books");
+  puts (" m - show memory usage");
+  puts (" o - show popular books");
+  puts (" p - find patron's loans");
   puts (" q - quit program");
   puts (" r - return book");
+  puts (" s - show command statistics");
+  puts (" t - show circulation history");
+  puts (" v - verify catalog files");
   puts (" w - show program warranty");
+  puts (" x - export catalog");
 }
 
 /* Function: print_info
@@ -1367,152 +5162,554 @@ print_info (void)
   puts ("For help type 'h'.");
 }
 
-/* Function: load_catalog
- * ----------------------
- * Load the library's collection from a file.
+/* Function: print_encoding
+ * ------------------------
+ * Print how compactly the loaded catalog is held in memory.
+ *
+ * The books array plus the memory held by the columns is compared
+ * with the field text read from the file and with the fixed-width
+ * records of MAX_NUM_FIELDS * MAX_FIELD_LEN bytes that held it before.
+ *
+ * text_bytes: The number of bytes of field text loaded.
+ */
+static void
+print_encoding (size_t text_bytes)
+{
+  size_t encoded_bytes, fixed_bytes;
+
+  encoded_bytes = catalog->num_books * sizeof (Book) + mem_live (MEM_STRINGS);
+  fixed_bytes = (size_t) catalog->num_books * MAX_NUM_FIELDS * MAX_FIELD_LEN;
+  if (encoded_bytes == 0)
+    return;
+
+  printf ("Encoded %d books in %zu bytes (%.2f:1 over %zu bytes of field text, %.2f:1 over fixed-width fields).\n",
+          catalog->num_books, encoded_bytes,
+          (double) text_bytes / (double) encoded_bytes, text_bytes,
+          (double) fixed_bytes / (double) encoded_bytes);
+}
+
+/* Function: write_checkpoint
+ * ---------------------------
+ * Write a checkpoint of the catalog from a child process.
  *
- * This function reads the contents of a file in CSV format
- * and populates the books array with the details of the books.
+ * Called with `catalog_lock` held, so that the child's copy of the
+ * catalog is taken between changes.  The child writes the catalog,
+ * its checksums and the patrons under their names with
+ * CHECKPOINT_SUFFIX added, and exits; what `catalog_sync` changes in
+ * its copy of the catalog is thrown away with it.  The lock is
+ * released while waiting for the child.
  *
- * If an error occurs while loading the file,
- * an error message is printed to the console
- * and the appropriate error code is returned.
+ * The journal is rotated before the lock is released, so the old
+ * journal holds exactly the loans and returns the checkpoint holds,
+ * and is removed once the checkpoint is written.
  *
- * returns: An integer indicating the number of books loaded from the file.
- * If an error occurs, the appropriate error code is returned.
+ * returns: 0 if the checkpoint was written, or -1 if it was not.
  */
 static int
-load_catalog (void)
+write_checkpoint (void)
 {
-  FILE *fp;
-  char line[MAX_LINE_LEN];
-  char *field;
+  pid_t pid;
+  int status;
 
-  fp = fopen (FILE_NAME, "r");
-  if (fp == NULL)
+  pid = fork ();
+  if (pid == 0)
     {
-      fp = fopen (FILE_NAME, "w");
-
-      if (fp == NULL)
+      trace_on = 0;
+      snprintf (catalog->file_name, sizeof (catalog->file_name), "%s", FILE_NAME CHECKPOINT_SUFFIX);
+      snprintf (catalog->patron_file_name, sizeof (catalog->patron_file_name), "%s", PATRON_FILE_NAME CHECKPOINT_SUFFIX);
+      if (catalog_sync (catalog) != 0)
         {
-          fprintf (stderr, "Error: Failed to create new catalog file \"%s\".\n", FILE_NAME);
-          return IO_ERR;
+          fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+          _exit (EXIT_FAILURE);
         }
+      _exit (EXIT_SUCCESS);
+    }
 
-      fprintf (fp, "Title,Author,Publisher,Publication Year,ISBN,Accession Number,Genre,Checked Out By,Checked Out Date,Return Date\n");
+  if (pid > 0)
+    rotate_journal ();
+  pthread_mutex_unlock (&catalog_lock);
+  TRACE_BEGIN ("checkpoint");
+  status = -1;
+  if (pid > 0)
+    while (waitpid (pid, &status, 0) < 0 && errno == EINTR) {}
+  TRACE_END ("checkpoint");
+  pthread_mutex_lock (&catalog_lock);
+
+  if (pid <= 0 || !WIFEXITED (status) || WEXITSTATUS (status) != EXIT_SUCCESS)
+    return -1;
+  remove (OLD_JOURNAL_FILE_NAME);
+  return 0;
+}
 
-      if (fclose (fp) != 0)
-        {
-          fprintf (stderr, "Error: Failed to close newly created catalog file \"%s\".\n", FILE_NAME);
-          return IO_ERR;
-        }
+/* Function: autosave_main
+ * -----------------------
+ * Write checkpoints of the catalog until `stop_autosave` is called.
+ *
+ * Runs on the autosave thread.  A checkpoint is written when the books
+ * changed since the last one, every `autosave_seconds` seconds or as
+ * soon as `autosave_changes` changes were made.  After a checkpoint
+ * fails, the next is only tried once the interval is up.
+ *
+ * returns: NULL.
+ */
+static void *
+autosave_main (void *arg)
+{
+  struct timespec deadline;
+  unsigned long long changes;
+  int failed;
+
+  (void) arg;
+  failed = 0;
+  pthread_mutex_lock (&catalog_lock);
+  while (!autosave_stop)
+    {
+      clock_gettime (CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += autosave_seconds;
+      while (!autosave_stop
+             && (failed || book_changes - checkpoint_changes < autosave_changes)
+             && pthread_cond_timedwait (&autosave_wake, &catalog_lock, &deadline) != ETIMEDOUT) {}
+
+      if (autosave_stop || book_changes == checkpoint_changes)
+        continue;
+
+      changes = book_changes;
+      failed = write_checkpoint () != 0;
+      if (failed)
+        fprintf (stderr, "Warning: Failed to write a checkpoint of the catalog to \"%s\".\n",
+                 FILE_NAME CHECKPOINT_SUFFIX);
+      else
+        checkpoint_changes = changes;
+    }
+  pthread_mutex_unlock (&catalog_lock);
 
-      if ((fp = fopen (FILE_NAME, "r")) == NULL)
-        {
-          fprintf (stderr, "Error: Failed to open newly created catalog file \"%s\" for reading.\n", FILE_NAME);
-          return IO_ERR;
-        }
+  return NULL;
+}
+
+/* Function: start_autosave
+ * ------------------------
+ * Start the autosave thread, unless autosave was turned off with -a 0.
+ *
+ * Called once the catalog is loaded, before the REPL takes
+ * `catalog_lock` for its first command.
+ */
+static void
+start_autosave (void)
+{
+  if (autosave_seconds <= 0)
+    return;
+
+  checkpoint_changes = book_changes;
+  if (pthread_create (&autosave_thread, NULL, autosave_main, NULL) != 0)
+    {
+      fprintf (stderr, "Warning: Failed to start the autosave thread.\n");
+      return;
     }
+  autosave_running = 1;
+}
+
+/* Function: stop_autosave
+ * -----------------------
+ * Stop the autosave thread, waiting for a checkpoint being written.
+ *
+ * Must be called without `catalog_lock`.
+ */
+static void
+stop_autosave (void)
+{
+  if (!autosave_running)
+    return;
+
+  pthread_mutex_lock (&catalog_lock);
+  autosave_stop = 1;
+  pthread_cond_signal (&autosave_wake);
+  pthread_mutex_unlock (&catalog_lock);
+
+  pthread_join (autosave_thread, NULL);
+  autosave_running = 0;
+}
+
+/* Function: begin_repl_command
+ * ----------------------------
+ * Take `catalog_lock` for a command.
+ */
+static void
+begin_repl_command (void)
+{
+  pthread_mutex_lock (&catalog_lock);
+  catalog_held = 1;
+}
+
+/* Function: end_repl_command
+ * --------------------------
+ * Release `catalog_lock` after a command, waking the autosave thread
+ * if the command brought the changes since the last checkpoint to
+ * `autosave_changes`.
+ */
+static void
+end_repl_command (void)
+{
+  if (autosave_running && book_changes - checkpoint_changes >= autosave_changes)
+    pthread_cond_signal (&autosave_wake);
+  catalog_held = 0;
+  pthread_mutex_unlock (&catalog_lock);
+}
+
+/* Function: begin_wait
+ * --------------------
+ * Release `catalog_lock`, if the REPL holds it, before waiting for input.
+ *
+ * returns: 1 if the lock was released, to be passed to `end_wait`.
+ */
+static int
+begin_wait (void)
+{
+  if (!catalog_held)
+    return 0;
+
+  end_repl_command ();
+  return 1;
+}
+
+/* Function: end_wait
+ * ------------------
+ * Take `catalog_lock` again after waiting for input.
+ *
+ * held: What `begin_wait` returned.
+ */
+static void
+end_wait (int held)
+{
+  if (held)
+    begin_repl_command ();
+}
 
-  if (fgets (line, MAX_LINE_LEN, fp) != NULL)
+/* Function: recover_checkpoint
+ * ----------------------------
+ * Put the checkpoint of a session that did not quit cleanly
+ * in place of the catalog files, if there is one.
+ *
+ * A checkpoint older than the catalog file, which was written
+ * after it, is removed instead.  Either way, the loans and returns
+ * made since are made again from the journal by `replay_journal`.
+ */
+static void
+recover_checkpoint (void)
+{
+  static const char *const names[][2] = {
+    { FILE_NAME CHECKPOINT_SUFFIX CATALOG_SUMS_SUFFIX, FILE_NAME CATALOG_SUMS_SUFFIX },
+    { PATRON_FILE_NAME CHECKPOINT_SUFFIX, PATRON_FILE_NAME },
+    { FILE_NAME CHECKPOINT_SUFFIX, FILE_NAME }
+  };
+  struct stat checkpoint, current;
+  size_t i;
+
+  if (stat (FILE_NAME CHECKPOINT_SUFFIX, &checkpoint) != 0)
+    return;
+
+  /* A catalog written after the checkpoint holds everything it does. */
+  if (stat (FILE_NAME, &current) == 0
+      && (checkpoint.st_mtim.tv_sec < current.st_mtim.tv_sec
+          || (checkpoint.st_mtim.tv_sec == current.st_mtim.tv_sec
+              && checkpoint.st_mtim.tv_nsec < current.st_mtim.tv_nsec)))
     {
-      if (strcmp (line, "Title,Author,Publisher,Publication Year,ISBN,Accession Number,Genre,Checked Out By,Checked Out Date,Return Date\n"))
-        {
-          fprintf (stderr, "Error: Invalid header in file \"%s\". Expected \"%s\" but found \"%s\".\n", FILE_NAME, "Title,Author,Publisher,Publication Year,ISBN,Accession Number,Genre,Checked Out By,Checked Out Date,Return Date", line);
-          return IO_ERR;
-        }
+      fprintf (stderr, "Warning: Removing the checkpoint \"%s\", which is older than the catalog.\n",
+               FILE_NAME CHECKPOINT_SUFFIX);
+      remove_checkpoint ();
+      return;
     }
 
-  num_books = 0;
-  while (fgets (line, MAX_LINE_LEN, fp) != NULL)
+  fprintf (stderr, "Warning: The last session did not quit cleanly. Recovering the catalog from \"%s\".\n",
+           FILE_NAME CHECKPOINT_SUFFIX);
+  /* The old journal is left while a checkpoint is written, so its files
+   * may come from two checkpoints, and the checksums of one would not
+   * match the books of the other.  They are written again on save. */
+  if (access (OLD_JOURNAL_FILE_NAME, F_OK) == 0)
     {
-      field = strtok (line, ",");
-      if (field != NULL)
-        {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].title, field, MAX_FIELD_LEN - 1);
-        }
+      remove (FILE_NAME CHECKPOINT_SUFFIX CATALOG_SUMS_SUFFIX);
+      remove (FILE_NAME CATALOG_SUMS_SUFFIX);
+    }
+  for (i = 0; i < sizeof (names) / sizeof (names[0]); i++)
+    if (access (names[i][0], F_OK) == 0 && rename (names[i][0], names[i][1]) != 0)
+      fprintf (stderr, "Warning: Failed to rename file \"%s\" to \"%s\".\n", names[i][0], names[i][1]);
+}
 
-      field = strtok (NULL, ",");
-      if (field != NULL)
-        {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].author, field, MAX_FIELD_LEN - 1);
-        }
+/* Function: remove_checkpoint
+ * ---------------------------
+ * Remove the checkpoint once the catalog is saved.
+ */
+static void
+remove_checkpoint (void)
+{
+  remove (FILE_NAME CHECKPOINT_SUFFIX);
+  remove (FILE_NAME CHECKPOINT_SUFFIX CATALOG_SUMS_SUFFIX);
+  remove (PATRON_FILE_NAME CHECKPOINT_SUFFIX);
+  /* Left by a checkpoint cut short. */
+  remove (FILE_NAME CHECKPOINT_SUFFIX CATALOG_TMP_SUFFIX);
+  remove (FILE_NAME CHECKPOINT_SUFFIX CATALOG_SUMS_SUFFIX CATALOG_TMP_SUFFIX);
+  remove (PATRON_FILE_NAME CHECKPOINT_SUFFIX CATALOG_TMP_SUFFIX);
+}
 
-      field = strtok (NULL, ",");
-      if (field != NULL)
-        {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].publisher, field, MAX_FIELD_LEN - 1);
-        }
+/* Function: end_command
+ * ----------------------
+ * Finish timing a command, counting the records and bytes that the
+ * catalogs tallied while it ran, then reset their tallies.
+ *
+ * command: the command that ran.
+ */
+static void
+end_command (StatsCommand command)
+{
+  Catalog *cat;
+  BTree *pages;
+  int s;
 
-      field = strtok (NULL, ",");
-      if (field != NULL)
+  for (s = 0; s <= num_shards; s++)
+    {
+      cat = s < num_shards ? shards[s].catalog : catalog;
+      if (cat != NULL)
         {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].publication_year, field, MAX_FIELD_LEN - 1);
+          stats_records_scanned += cat->records_scanned;
+          stats_bytes_read += cat->bytes_read;
+          stats_bytes_written += cat->bytes_written;
+          cat->records_scanned = 0;
+          cat->bytes_read = 0;
+          cat->bytes_written = 0;
         }
 
-      field = strtok (NULL, ",");
-      if (field != NULL)
+      pages = s < num_shards ? shards[s].pages : NULL;
+      if (pages != NULL)
         {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].isbn, field, MAX_FIELD_LEN - 1);
+          stats_records_scanned += pages->records_scanned;
+          stats_bytes_read += pages->bytes_read;
+          pages->records_scanned = 0;
+          pages->bytes_read = 0;
         }
+    }
+  stats_bytes_written += history.bytes_written + journal.bytes_written;
+  history.bytes_written = 0;
+  journal.bytes_written = 0;
+  stats_end (command);
+}
 
-      field = strtok (NULL, ",");
-      if (field != NULL)
-        {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].accession_num, field, MAX_FIELD_LEN - 1);
-        }
+/* Function: trace_phase
+ * ---------------------
+ * Trace a phase of a save, as told by the catalog.
+ */
+static void
+trace_phase (const char *name,
+             int         begin)
+{
+  if (begin)
+    TRACE_BEGIN (name);
+  else
+    TRACE_END (name);
+}
 
-      field = strtok (NULL, ",");
-      if (field != NULL)
-        {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].genre, field, MAX_FIELD_LEN - 1);
-        }
+/* Function: warn_damaged
+ * ----------------------
+ * Warn if a catalog file did not match its checksums when it was read.
+ */
+static void
+warn_damaged (const Catalog *cat)
+{
+  if (cat->damaged_offset >= 0)
+    fprintf (stderr, "Warning: \"%s\" does not match its checksums from byte %lld on; "
+             "it was damaged or changed by another program. Type 'v' to check it.\n",
+             cat->file_name, cat->damaged_offset);
+}
 
-      field = strtok (NULL, ",");
-      if (field != NULL)
-        {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].checked_out_by, field, MAX_FIELD_LEN - 1);
-        }
+/* Function: verify_file
+ * ---------------------
+ * Check a catalog file against its checksums and print every block
+ * that does not match.
+ */
+static void
+verify_file (Catalog *cat)
+{
+  CatalogVerify verify;
+  unsigned long long first, last, size;
+  size_t k;
 
-      field = strtok (NULL, ",");
-      if (field != NULL)
-        {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].checked_out_date, field, MAX_FIELD_LEN - 1);
-        }
+  if (catalog_verify (cat, &verify) != 0)
+    {
+      fprintf (stderr, "Error: %s\n", catalog_error (cat));
+      return;
+    }
+
+  if (!verify.has_sums)
+    {
+      printf ("%s: no checksums.\n", cat->file_name);
+      return;
+    }
+
+  size = verify.file_size > verify.saved_size ? verify.file_size : verify.saved_size;
+  for (k = 0; k < verify.num_bad; k++)
+    {
+      first = (unsigned long long) verify.bad_blocks[k] * verify.block_size;
+      last = first + verify.block_size < size ? first + verify.block_size - 1 : size - 1;
+      printf ("%s: block %zu (bytes %llu-%llu) does not match.\n",
+              cat->file_name, verify.bad_blocks[k], first, last);
+    }
+
+  if (verify.num_bad == 0)
+    printf ("%s: all %zu block/s of %zu bytes match.\n", cat->file_name, verify.num_blocks, verify.block_size);
+  else
+    printf ("%s: %zu of %zu block/s of %zu bytes do not match.\n",
+            cat->file_name, verify.num_bad, verify.num_blocks, verify.block_size);
+  if (verify.file_size != verify.saved_size)
+    printf ("%s: %llu bytes long, but %llu bytes when saved.\n", cat->file_name, verify.file_size, verify.saved_size);
+
+  catalog_verify_end (&verify);
+}
+
+/* Function: verify_catalogs
+ * -------------------------
+ * Check the catalog file and the files of the other branches
+ * against their checksums.
+ *
+ * Catalog files are checked against their checksum files a block at
+ * a time, and paged catalogs a page at a time, without reading the
+ * books they hold, so a damaged block or page is found quickly.
+ *
+ * returns: 0, the status of a command.
+ */
+static int
+verify_catalogs (void)
+{
+  BTree *tree;
+  unsigned int page, num_bad;
+  int s, r;
+
+  puts ("Verifying catalog files..");
+  verify_file (catalog);
 
-      field = strtok (NULL, ",");
-      if (field != NULL)
+  for (s = 0; s < num_shards; s++)
+    {
+      if (shards[s].catalog != NULL)
         {
-          field[strcspn (field, "\n")] = '\0';
-          strncpy (books[num_books].return_date, field, MAX_FIELD_LEN - 1);
+          verify_file (shards[s].catalog);
+          continue;
         }
 
-      num_books++;
+      tree = shards[s].pages;
+      num_bad = 0;
+      for (page = 1; page < tree->num_pages; page++)
+        if ((r = btree_check (tree, page)) != 0)
+          {
+            printf ("%s/%s.db: page %u %s.\n", BRANCH_DIR, shards[s].branch, page,
+                    r < 0 ? "could not be read" : "does not match");
+            num_bad++;
+          }
+
+      if (num_bad == 0)
+        printf ("%s/%s.db: all %u page/s match.\n", BRANCH_DIR, shards[s].branch, tree->num_pages - 1);
+      else
+        printf ("%s/%s.db: %u of %u page/s do not match.\n", BRANCH_DIR, shards[s].branch, num_bad, tree->num_pages - 1);
+    }
+
+  return 0;
+}
+
+/* Function: reload_catalog
+ * ------------------------
+ * Read the catalog file again if another program has written it,
+ * keeping the books whose lines are unchanged and updating the
+ * indexes for the books that were not.
+ *
+ * If every book kept its position, only the replaced books are taken
+ * out of the bitmaps and the new ones put in; otherwise the bitmaps
+ * are built again.  A failed reload keeps the books as they were.
+ */
+static void
+reload_catalog (void)
+{
+  CatalogReload reload;
+  const Book *old;
+  int k, row;
+
+  if (!catalog_changed (catalog))
+    return;
+
+  stats_begin ();
+  TRACE_BEGIN ("mutate");
+  if (catalog_reload (catalog, &reload) != 0)
+    {
+      TRACE_END ("mutate");
+      fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+      end_command (STATS_RELOAD_CATALOG);
+      return;
     }
 
-  if (ferror (fp))
+  if (reload.in_place && bitmaps_valid)
+    for (k = 0; k < reload.num_added && bitmaps_valid; k++)
+      {
+        row = reload.rows[k];
+        old = &reload.old_books[k];
+        if (old->fields[FIELD_GENRE] < num_genre_bitmaps)
+          bitmap_clear (&genre_bitmaps[old->fields[FIELD_GENRE]], row);
+        bitmap_clear (&available_books, row);
+        index_book (row);
+      }
+  else if (!reload.in_place && bitmaps_valid)
     {
-      fprintf (stderr, "Error: Failed to read from file \"%s\".\n", FILE_NAME);
-      fclose (fp);
-      return IO_ERR;
+      drop_bitmaps ();
+      build_bitmaps ();
     }
 
-  if (fclose (fp) != 0)
+  if (reload.num_added > 0 || !reload.in_place)
     {
-      fprintf (stderr, "Error: Failed to close file \"%s\".\n", FILE_NAME);
-      return IO_ERR;
+      if (year_index_valid)
+        {
+          year_index_valid = 0;
+          build_year_index ();
+        }
+      if (loans_valid)
+        {
+          loans_valid = 0;
+          build_loans ();
+        }
     }
+  TRACE_END ("mutate");
+
+  printf ("Reloaded %s: %d book/s unchanged, %d added or changed, %d removed or changed.\n",
+          FILE_NAME, reload.num_kept, reload.num_added, reload.num_removed);
+  if (reload.num_conflicts > 0)
+    fprintf (stderr, "Warning: %d book/s edited here were also changed in \"%s\"; the file's version was kept.\n",
+             reload.num_conflicts, FILE_NAME);
+  catalog_reload_end (&reload);
+  end_command (STATS_RELOAD_CATALOG);
+}
+
+/* Function: free_catalog
+ * ----------------------
+ * Release the catalog, the other branches and the indexes over them.
+ */
+static void
+free_catalog (void)
+{
+  int s;
+
+  catalog_close (catalog);
+  mem_free (year_index);
+  drop_bitmaps ();
+  cache_free (&query_cache);
+  history_close (&history);
+  journal_close (&journal);
+  mem_free (periods);
 
-  return num_books;
+  for (s = 0; s < num_shards; s++)
+    {
+      catalog_close (shards[s].catalog);
+      if (shards[s].pages != NULL)
+        {
+          btree_close (shards[s].pages);
+          mem_free (shards[s].pages);
+        }
+    }
+  mem_free (shards);
+  if (pool_threads > 0)
+    pool_free (&pool);
 }
 
 /* Function: verify_user
@@ -1536,7 +5733,7 @@ verify_user (void)
 
 get_password:
   printf ("Enter password: ");
-  if (fgets (entered_pass, MAX_LINE_LEN, stdin) == NULL)
+  if (read_input (entered_pass, MAX_LINE_LEN) == NULL)
     {
       if (feof (stdin))
         return EOF_ERR;
@@ -1573,98 +5770,258 @@ get_password:
  * The function also verifies the user's identity with a password
  * before allowing access to the program.
  *
+ * The latency of every command is recorded by the stats module.
+ * With the `-s FILE` option, the statistics are written to FILE
+ * in JSON format when the program exits.  With the `-t FILE` option,
+ * the phases of every command are traced and written to FILE
+ * as a Chrome trace when the program exits.
+ *
+ * A background thread writes checkpoints of the catalog while the
+ * program runs; `-a SECONDS` sets how often (0 turns it off) and
+ * `-c CHANGES` how many changes to the books start one early.
+ * A checkpoint left by a session that did not quit cleanly is
+ * recovered at startup.
+ *
  * returns: An integer indicating the success of the program.
  * If the program exits successfully, the function returns EXIT_SUCCESS.
  * Otherwise, it returns EXIT_FAILURE.
  */
 int
-main (void)
+main (int   argc,
+      char *argv[])
 {
+  const char *stats_file, *trace_file;
+  char error[MAX_LINE_LEN];
   char c;
-  int status;
+  int status, opt, i;
 
-  max_books = 1000;
-  books = (Book *) malloc (sizeof (Book) * max_books);
-  if (books == NULL)
+  stats_file = NULL;
+  trace_file = NULL;
+  while ((opt = getopt (argc, argv, "a:c:j:m:s:t:")) != -1)
     {
-      fprintf (stderr, "Failed to allocate memory.\n");
-      return EXIT_FAILURE;
+      switch (opt)
+        {
+        case 'a':
+          autosave_seconds = atoi (optarg);
+          if (autosave_seconds >= 0)
+            break;
+          fprintf (stderr, "Error: The autosave interval must not be negative.\n");
+          return EXIT_FAILURE;
+
+        case 'c':
+          if (atoi (optarg) >= 1)
+            {
+              autosave_changes = (unsigned long long) atoi (optarg);
+              break;
+            }
+          fprintf (stderr, "Error: The changes before a checkpoint must be at least 1.\n");
+          return EXIT_FAILURE;
+
+        case 'j':
+          max_threads = atoi (optarg);
+          if (max_threads >= 1 && max_threads <= POOL_MAX_THREADS)
+            break;
+          fprintf (stderr, "Error: The number of threads must be from 1 to %d.\n", POOL_MAX_THREADS);
+          return EXIT_FAILURE;
+
+        case 'm':
+          if (atoi (optarg) >= 1)
+            {
+              sort_memory = (size_t) atoi (optarg) << 20;
+              break;
+            }
+          fprintf (stderr, "Error: The memory for sorting must be at least 1 MiB.\n");
+          return EXIT_FAILURE;
+
+        case 's':
+          stats_file = optarg;
+          break;
+
+        case 't':
+          trace_file = optarg;
+          trace_start ();
+          break;
+
+        default:
+          fprintf (stderr, "Usage: %s [-a seconds] [-c changes] [-j threads] [-m sort-MiB] [-s stats.json] [-t trace.json]\n", argv[0]);
+          return EXIT_FAILURE;
+        }
     }
 
+  history_init (&history, HISTORY_DIR);
+  journal_init (&journal, JOURNAL_FILE_NAME);
+
   status = verify_user ();
   if (status < 0)
     goto quit;
 
-  if (system ("clear") != 0)
+  if (isatty (STDOUT_FILENO) && system ("clear") != 0)
     {
       if (system ("cls") != 0)
         {
           fprintf (stderr, "Warning: Failed to clear terminal screen.\n");
-          for (int i = 0; i < 50; i++)
+          for (i = 0; i < 50; i++)
             putchar ('\n');
         }
     }
 
   print_info ();
-  num_books = load_catalog ();
-  if (num_books < 0)
+  recover_checkpoint ();
+  stats_begin ();
+  catalog = catalog_open (FILE_NAME, PATRON_FILE_NAME, error, sizeof (error));
+  if (catalog == NULL)
     {
-      status = num_books;
-      goto quit;
+      fprintf (stderr, "Error: %s\n", error);
+      status = IO_ERR;
     }
+  else if (load_popularity () != 0)
+    status = IO_ERR;
+  else
+    {
+      catalog->on_phase = trace_phase;
+      /* Before the other branches add to the string heap. */
+      print_encoding (catalog->text_bytes);
+      warn_damaged (catalog);
+      replay_journal ();
+      status = load_shards ();
+    }
+  end_command (STATS_LOAD_CATALOG);
+  if (status < 0)
+    goto quit;
+
+  if (catalog_watch (catalog) != 0)
+    fprintf (stderr, "Warning: %s\n", catalog_error (catalog));
+  start_autosave ();
 
   while (1)
     {
       printf (">>> ");
-      if (scanf (" %c", &c) == EOF)
+      if (read_choice (&c) == EOF)
         goto quit;
       while ((d = getchar ()) != '\n' && d != EOF) {}
 
+      begin_repl_command ();
+      /* Changes by other programs are picked up between commands. */
+      reload_catalog ();
+
       switch (c)
         {
         case 'a':
+          stats_begin ();
           status = add_book ();
+          end_command (STATS_ADD_BOOK);
           break;
 
         case 'b':
+          stats_begin ();
           status = borrow_book ();
+          end_command (STATS_BORROW_BOOK);
+          break;
+
+        case 'c':
+          stats_begin ();
+          status = count_books ();
+          end_command (STATS_COUNT_BOOKS);
           break;
 
         case 'd':
+          stats_begin ();
           status = delete_book ();
+          end_command (STATS_DELETE_BOOK);
           break;
 
         case 'e':
+          stats_begin ();
           status = edit_book ();
+          end_command (STATS_EDIT_BOOK);
           break;
 
         case 'f':
+          stats_begin ();
           status = find_books ();
+          end_command (STATS_FIND_BOOKS);
           break;
 
         case 'h':
           print_help ();
           break;
 
+        case 'i':
+          stats_begin ();
+          status = import_books ();
+          end_command (STATS_IMPORT_BOOKS);
+          break;
+
+        case 'k':
+          stats_begin ();
+          status = scan_station ();
+          end_command (STATS_SCAN_STATION);
+          break;
+
         case 'l':
+          stats_begin ();
           status = list_books ();
+          end_command (STATS_LIST_BOOKS);
+          break;
+
+        case 'm':
+          print_memory ();
+          break;
+
+        case 'o':
+          stats_begin ();
+          status = show_popular ();
+          end_command (STATS_SHOW_POPULAR);
+          break;
+
+        case 'p':
+          stats_begin ();
+          status = find_patron ();
+          end_command (STATS_FIND_PATRON);
           break;
 
         case 'q':
+          end_repl_command ();
           goto quit;
 
         case 'r':
+          stats_begin ();
           status = return_book ();
+          end_command (STATS_RETURN_BOOK);
+          break;
+
+        case 's':
+          stats_print ();
+          break;
+
+        case 't':
+          stats_begin ();
+          status = show_history ();
+          end_command (STATS_SHOW_HISTORY);
+          break;
+
+        case 'v':
+          stats_begin ();
+          status = verify_catalogs ();
+          end_command (STATS_VERIFY_CATALOG);
           break;
 
         case 'w':
           print_warranty ();
           break;
 
+        case 'x':
+          stats_begin ();
+          status = export_catalog ();
+          end_command (STATS_EXPORT_CATALOG);
+          break;
+
         default:
           puts ("Invalid input. Type 'h' for help.");
+          end_repl_command ();
           continue;
         }
+      end_repl_command ();
 
       switch (status)
         {
@@ -1675,16 +6032,44 @@ main (void)
     }
 
 quit:
+  stop_autosave ();
   if (status < 0)
     {
-      free (books);
+      if (stats_file != NULL)
+        stats_write_json (stats_file);
+      if (trace_file != NULL)
+        trace_write_json (trace_file);
+      trace_free ();
+      free_catalog ();
       return EXIT_FAILURE;
     }
   else
     {
-      if (save_catalog () != 0)
-        fprintf (stderr, "Warning: Failed to save catalog to file \"%s\"\n", FILE_NAME);
-      free (books);
+      reload_catalog ();
+      stats_begin ();
+      /* The journal may only go once the catalog holding its changes is on disk. */
+      journal_close (&journal);
+      if ((access (JOURNAL_FILE_NAME, F_OK) == 0 || access (OLD_JOURNAL_FILE_NAME, F_OK) == 0
+           ? catalog_sync (catalog) : catalog_save (catalog)) != 0)
+        {
+          fprintf (stderr, "Error: %s\n", catalog_error (catalog));
+          fprintf (stderr, "Warning: Failed to save catalog to file \"%s\"\n", FILE_NAME);
+        }
+      else
+        {
+          remove_checkpoint ();
+          remove (OLD_JOURNAL_FILE_NAME);
+          remove (JOURNAL_FILE_NAME);
+        }
+      if (save_popularity () != 0)
+        fprintf (stderr, "Warning: Failed to save popularity reports to file \"%s\"\n", POPULARITY_FILE_NAME);
+      end_command (STATS_SAVE_CATALOG);
+      if (stats_file != NULL)
+        stats_write_json (stats_file);
+      if (trace_file != NULL)
+        trace_write_json (trace_file);
+      trace_free ();
+      free_catalog ();
       return EXIT_SUCCESS;
     }
 }
@@ -0,0 +1,316 @@
+/* marc.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include <string.h>
+
+#include "marc.h"
+#include "mem.h"
+
+/* Function: parse_digits
+ * ----------------------
+ * Read a fixed-width decimal number.
+ *
+ * returns: The number, or -1 if any of the n bytes is not a digit.
+ */
+static long
+parse_digits (const unsigned char *s,
+              int                  n)
+{
+  long value;
+  int i;
+
+  value = 0;
+  for (i = 0; i < n; i++)
+    {
+      if (s[i] < '0' || s[i] > '9')
+        return -1;
+      value = value * 10 + (s[i] - '0');
+    }
+  return value;
+}
+
+/* Function: fill
+ * --------------
+ * Read until at least n unread bytes are in the buffer,
+ * moving the unread bytes to its start first if they would not fit.
+ *
+ * returns: Nonzero if n bytes are available, or 0 at the end of the file.
+ */
+static int
+fill (MarcReader *reader,
+      size_t      n)
+{
+  size_t got;
+
+  while (reader->len - reader->pos < n)
+    {
+      if (reader->eof)
+        return 0;
+
+      if (reader->pos + n > MARC_BUF_LEN)
+        {
+          memmove (reader->buf, reader->buf + reader->pos, reader->len - reader->pos);
+          reader->len -= reader->pos;
+          reader->pos = 0;
+        }
+
+      got = fread (reader->buf + reader->len, 1, MARC_BUF_LEN - reader->len, reader->fp);
+      reader->bytes_read += got;
+      reader->len += got;
+      if (got == 0)
+        {
+          reader->eof = 1;
+          if (ferror (reader->fp))
+            reader->error = 1;
+        }
+    }
+  return 1;
+}
+
+/* Function: resync
+ * ----------------
+ * Skip the bytes up to and including the next record terminator.
+ */
+static void
+resync (MarcReader *reader)
+{
+  unsigned char *end;
+
+  reader->num_skipped++;
+  for (;;)
+    {
+      end = (unsigned char *) memchr (reader->buf + reader->pos, MARC_RECORD_END, reader->len - reader->pos);
+      if (end != NULL)
+        {
+          reader->pos = end - reader->buf + 1;
+          return;
+        }
+      reader->pos = reader->len;
+      if (!fill (reader, 1))
+        return;
+    }
+}
+
+/* Function: marc_open
+ * -------------------
+ * Open a MARC 21 file for reading.
+ *
+ * returns: 0 on success, or -1 if the buffer could not be allocated
+ *          or the file could not be opened.
+ */
+int
+marc_open (MarcReader *reader,
+           const char *path)
+{
+  memset (reader, 0, sizeof (MarcReader));
+
+  reader->buf = (unsigned char *) mem_alloc (MEM_BUFFERS, MARC_BUF_LEN);
+  if (reader->buf == NULL)
+    return -1;
+
+  reader->fp = fopen (path, "rb");
+  if (reader->fp == NULL)
+    {
+      mem_free (reader->buf);
+      return -1;
+    }
+  /* Reads are already batched, so stdio needs no buffer of its own. */
+  setvbuf (reader->fp, NULL, _IONBF, 0);
+
+  return 0;
+}
+
+/* Function: marc_next
+ * -------------------
+ * Read the next record, checking its leader and directory
+ * so that `marc_field` can trust them.
+ *
+ * Line breaks between records, which some vendors add, are ignored.
+ *
+ * returns: 1 if a record was read, 0 at the end of the file,
+ *          or -1 if the file could not be read.
+ */
+int
+marc_next (MarcReader *reader)
+{
+  const unsigned char *record, *entry;
+  long length, base, field_len, field_start;
+  int i;
+
+  reader->record = NULL;
+  for (;;)
+    {
+      while (fill (reader, 1)
+             && (reader->buf[reader->pos] == '\n' || reader->buf[reader->pos] == '\r'))
+        reader->pos++;
+      if (reader->error)
+        return -1;
+      if (reader->pos == reader->len)
+        return 0;
+
+      if (!fill (reader, 5))
+        {
+          resync (reader);
+          continue;
+        }
+      length = parse_digits (reader->buf + reader->pos, 5);
+      if (length < MARC_LEADER_LEN + 2)
+        {
+          resync (reader);
+          continue;
+        }
+      if (!fill (reader, length))
+        {
+          resync (reader);
+          continue;
+        }
+
+      record = reader->buf + reader->pos;
+      base = parse_digits (record + 12, 5);
+      if (record[length - 1] != MARC_RECORD_END || base <= MARC_LEADER_LEN || base >= length
+          || record[base - 1] != MARC_FIELD_END || (base - 1 - MARC_LEADER_LEN) % MARC_ENTRY_LEN != 0)
+        {
+          resync (reader);
+          continue;
+        }
+
+      reader->num_entries = (base - 1 - MARC_LEADER_LEN) / MARC_ENTRY_LEN;
+      for (i = 0; i < reader->num_entries; i++)
+        {
+          entry = record + MARC_LEADER_LEN + i * MARC_ENTRY_LEN;
+          field_len = parse_digits (entry + 3, 4);
+          field_start = parse_digits (entry + 7, 5);
+          if (field_len < 1 || field_start < 0 || base + field_start + field_len > length - 1
+              || record[base + field_start + field_len - 1] != MARC_FIELD_END)
+            break;
+        }
+      if (i < reader->num_entries)
+        {
+          /* The record terminator ends this record, not a later one. */
+          reader->pos += length;
+          reader->num_skipped++;
+          continue;
+        }
+
+      reader->record = record;
+      reader->record_len = length;
+      reader->base = base;
+      reader->pos += length;
+      reader->num_records++;
+      return 1;
+    }
+}
+
+/* Function: marc_field
+ * --------------------
+ * Find a field of the current record.
+ *
+ * tag: The tag of the field, as in "245".
+ * n: Which of the fields with that tag, counting from 0.
+ * field: Set to the field, if it is found.
+ *
+ * returns: 0 if the field was found, or -1 if it was not.
+ */
+int
+marc_field (const MarcReader *reader,
+            const char       *tag,
+            int               n,
+            MarcField        *field)
+{
+  const unsigned char *entry;
+  int i;
+
+  for (i = 0; i < reader->num_entries; i++)
+    {
+      entry = reader->record + MARC_LEADER_LEN + i * MARC_ENTRY_LEN;
+      if (memcmp (entry, tag, 3) != 0 || n-- > 0)
+        continue;
+
+      memcpy (field->tag, entry, 3);
+      field->tag[3] = '\0';
+      field->data = reader->record + reader->base + parse_digits (entry + 7, 5);
+      field->len = parse_digits (entry + 3, 4) - 1;
+      return 0;
+    }
+  return -1;
+}
+
+/* Function: marc_subfields
+ * ------------------------
+ * Join the subfields of a data field that have one of the given codes,
+ * separated by a space, in the order they appear.
+ *
+ * codes: The codes of the subfields to join, as in "ab".
+ * out: The buffer to join into, truncated to out_len - 1 bytes.
+ *
+ * returns: The length of the joined text.
+ */
+size_t
+marc_subfields (const MarcField *field,
+                const char      *codes,
+                char            *out,
+                size_t           out_len)
+{
+  const unsigned char *p, *end, *next;
+  size_t len, n;
+
+  len = 0;
+  out[0] = '\0';
+  end = field->data + field->len;
+  p = memchr (field->data, MARC_SUBFIELD, field->len);
+
+  while (p != NULL && p + 1 < end)
+    {
+      next = memchr (p + 1, MARC_SUBFIELD, end - p - 1);
+      if (next == NULL)
+        next = end;
+
+      if (p[1] != '\0' && strchr (codes, p[1]) != NULL)
+        {
+          if (len > 0 && len < out_len - 1)
+            out[len++] = ' ';
+          n = next - p - 2;
+          if (n > out_len - 1 - len)
+            n = out_len - 1 - len;
+          memcpy (out + len, p + 2, n);
+          len += n;
+          out[len] = '\0';
+        }
+      p = next < end ? next : NULL;
+    }
+
+  return len;
+}
+
+/* Function: marc_close
+ * --------------------
+ * Close the file and release the buffer.
+ *
+ * returns: 0 on success, or -1 if any read has failed.
+ */
+int
+marc_close (MarcReader *reader)
+{
+  fclose (reader->fp);
+  mem_free (reader->buf);
+
+  return reader->error ? -1 : 0;
+}
@@ -0,0 +1,90 @@
+/* marc.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef MARC_H
+#define MARC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* The longest record the five digits of a leader can describe. */
+#define MARC_MAX_RECORD 99999
+
+/* The size of the buffer records are read through.
+ * It holds at least one record of any length. */
+#define MARC_BUF_LEN (1 << 20)
+
+/* The length of a leader and of a directory entry. */
+#define MARC_LEADER_LEN 24
+#define MARC_ENTRY_LEN 12
+
+/* The separators of ISO 2709. */
+#define MARC_SUBFIELD   0x1f  /* Starts a subfield, followed by its code. */
+#define MARC_FIELD_END  0x1e  /* Ends the directory and each field. */
+#define MARC_RECORD_END 0x1d  /* Ends a record. */
+
+/* A field of the current record. */
+typedef struct
+{
+  char                 tag[4];  /* The tag, as in "245". */
+  const unsigned char *data;    /* The contents, without the field terminator.
+                                   A data field starts with its two indicators. */
+  size_t               len;     /* The length of the contents. */
+} MarcField;
+
+/* A MARC 21 file being read, one record at a time.
+ *
+ * The file is read into a buffer of MARC_BUF_LEN bytes and each record
+ * is parsed where it lies, so memory use does not depend on the size of
+ * the file.  A record that is cut short or whose leader or directory is
+ * not well formed is skipped: reading starts again after the next record
+ * terminator. */
+typedef struct
+{
+  FILE                *fp;           /* The file read from. */
+  unsigned char       *buf;          /* The buffer, MARC_BUF_LEN bytes long. */
+  size_t               pos;          /* The start of the unread bytes in the buffer. */
+  size_t               len;          /* The end of the bytes in the buffer. */
+  int                  eof;          /* Whether the end of the file has been read. */
+  int                  error;        /* Nonzero once a read has failed. */
+  const unsigned char *record;       /* The current record, valid until the next is read. */
+  size_t               record_len;   /* The length of the current record. */
+  size_t               base;         /* The offset of the current record's first field. */
+  int                  num_entries;  /* The number of fields of the current record. */
+  unsigned long long   num_records;  /* The number of records read. */
+  unsigned long long   num_skipped;  /* The number of records skipped. */
+  unsigned long long   bytes_read;   /* The bytes read from the file. */
+} MarcReader;
+
+int    marc_open      (MarcReader      *reader,
+                       const char      *path);
+int    marc_next      (MarcReader      *reader);
+int    marc_field     (const MarcReader *reader,
+                       const char      *tag,
+                       int              n,
+                       MarcField       *field);
+size_t marc_subfields (const MarcField *field,
+                       const char      *codes,
+                       char            *out,
+                       size_t           out_len);
+int    marc_close     (MarcReader      *reader);
+
+#endif
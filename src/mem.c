@@ -0,0 +1,249 @@
+/* mem.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+
+/* A header placed in front of every allocation.
+ * The union keeps the memory handed out suitably aligned for any type. */
+typedef union
+{
+  struct
+  {
+    size_t size;   /* The size requested by the caller. */
+    MemTag tag;    /* The subsystem the allocation is charged to. */
+  } info;
+  max_align_t align;
+} MemHeader;
+
+static const char *tag_names[MEM_NUM_TAGS] = {
+  "records",
+  "string heap",
+  "indexes",
+  "I/O buffers"
+};
+
+/* Indexed by tag, with the totals of all subsystems at MEM_NUM_TAGS. */
+static size_t live_bytes[MEM_NUM_TAGS + 1];
+static size_t peak_bytes[MEM_NUM_TAGS + 1];
+
+/* Function: charge_one
+ * --------------------
+ * Add to or subtract from one live byte counter
+ * and raise its peak if needed.
+ *
+ * The counters are updated atomically so that worker threads
+ * may allocate too.
+ *
+ * tag: The subsystem, or MEM_NUM_TAGS for the total.
+ * size: The number of bytes.
+ * sign: 1 to charge the bytes, -1 to release them.
+ */
+static void
+charge_one (int    tag,
+            size_t size,
+            int    sign)
+{
+  size_t live, peak;
+
+  if (sign < 0)
+    {
+      __atomic_sub_fetch (&live_bytes[tag], size, __ATOMIC_RELAXED);
+      return;
+    }
+
+  live = __atomic_add_fetch (&live_bytes[tag], size, __ATOMIC_RELAXED);
+  peak = __atomic_load_n (&peak_bytes[tag], __ATOMIC_RELAXED);
+  while (live > peak
+         && !__atomic_compare_exchange_n (&peak_bytes[tag], &peak, live, 0,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {}
+}
+
+/* Function: charge
+ * ----------------
+ * Charge or release bytes for a subsystem and for the total.
+ *
+ * tag: The subsystem.
+ * size: The number of bytes.
+ * sign: 1 to charge the bytes, -1 to release them.
+ */
+static void
+charge (MemTag tag,
+        size_t size,
+        int    sign)
+{
+  charge_one (tag, size, sign);
+  charge_one (MEM_NUM_TAGS, size, sign);
+}
+
+/* Function: mem_alloc
+ * -------------------
+ * Allocate memory and charge it to a subsystem.
+ *
+ * tag: The subsystem the memory belongs to.
+ * size: The number of bytes to allocate.
+ *
+ * returns: A pointer to the memory, or NULL if the allocation failed.
+ *          The memory must be released with `mem_free`.
+ */
+void *
+mem_alloc (MemTag tag,
+           size_t size)
+{
+  MemHeader *header;
+
+  header = (MemHeader *) malloc (sizeof (MemHeader) + size);
+  if (header == NULL)
+    return NULL;
+
+  header->info.size = size;
+  header->info.tag = tag;
+  charge (tag, size, 1);
+
+  return header + 1;
+}
+
+/* Function: mem_calloc
+ * --------------------
+ * Allocate zero-filled memory for an array and charge it to a subsystem.
+ *
+ * tag: The subsystem the memory belongs to.
+ * num: The number of elements.
+ * size: The size of each element.
+ *
+ * returns: A pointer to the memory, or NULL if the allocation failed.
+ */
+void *
+mem_calloc (MemTag tag,
+            size_t num,
+            size_t size)
+{
+  void *ptr;
+
+  if (size != 0 && num > ((size_t) -1 - sizeof (MemHeader)) / size)
+    return NULL;
+
+  ptr = mem_alloc (tag, num * size);
+  if (ptr != NULL)
+    memset (ptr, 0, num * size);
+
+  return ptr;
+}
+
+/* Function: mem_realloc
+ * ---------------------
+ * Resize memory obtained from `mem_alloc` and update the accounting.
+ *
+ * tag: The subsystem the memory belongs to. Used when ptr is NULL.
+ * ptr: The memory to resize, or NULL to allocate new memory.
+ * size: The new size in bytes.
+ *
+ * returns: A pointer to the resized memory, or NULL if the allocation
+ *          failed, in which case the original memory is left untouched.
+ */
+void *
+mem_realloc (MemTag  tag,
+             void   *ptr,
+             size_t  size)
+{
+  MemHeader *header, *new_header;
+  size_t old_size;
+
+  if (ptr == NULL)
+    return mem_alloc (tag, size);
+
+  header = (MemHeader *) ptr - 1;
+  old_size = header->info.size;
+  tag = header->info.tag;
+
+  new_header = (MemHeader *) realloc (header, sizeof (MemHeader) + size);
+  if (new_header == NULL)
+    return NULL;
+
+  new_header->info.size = size;
+  charge (tag, old_size, -1);
+  charge (tag, size, 1);
+
+  return new_header + 1;
+}
+
+/* Function: mem_free
+ * ------------------
+ * Release memory obtained from `mem_alloc`, `mem_calloc` or `mem_realloc`.
+ *
+ * ptr: The memory to release. Does nothing if NULL.
+ */
+void
+mem_free (void *ptr)
+{
+  MemHeader *header;
+
+  if (ptr == NULL)
+    return;
+
+  header = (MemHeader *) ptr - 1;
+  charge (header->info.tag, header->info.size, -1);
+  free (header);
+}
+
+/* Function: mem_live
+ * ------------------
+ * Get the bytes currently allocated by a subsystem.
+ *
+ * tag: The subsystem, or MEM_NUM_TAGS for all subsystems together.
+ *
+ * returns: The number of live bytes.
+ */
+size_t
+mem_live (MemTag tag)
+{
+  return __atomic_load_n (&live_bytes[tag], __ATOMIC_RELAXED);
+}
+
+/* Function: mem_peak
+ * ------------------
+ * Get the largest number of bytes a subsystem has held at once.
+ *
+ * tag: The subsystem, or MEM_NUM_TAGS for all subsystems together.
+ *
+ * returns: The peak number of bytes.
+ */
+size_t
+mem_peak (MemTag tag)
+{
+  return __atomic_load_n (&peak_bytes[tag], __ATOMIC_RELAXED);
+}
+
+/* Function: mem_tag_name
+ * ----------------------
+ * Get the name of a subsystem.
+ *
+ * tag: The subsystem, or MEM_NUM_TAGS for all subsystems together.
+ *
+ * returns: The name, such as "records" or "total".
+ */
+const char *
+mem_tag_name (MemTag tag)
+{
+  return tag < MEM_NUM_TAGS ? tag_names[tag] : "total";
+}
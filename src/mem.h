@@ -0,0 +1,49 @@
+/* mem.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+
+/* The subsystems that memory is charged to. */
+typedef enum
+{
+  MEM_RECORDS,  /* The books array. */
+  MEM_STRINGS,  /* Interned and encoded field values. */
+  MEM_INDEXES,  /* Lookup structures over the records. */
+  MEM_BUFFERS,  /* File and I/O buffers. */
+  MEM_NUM_TAGS
+} MemTag;
+
+void       *mem_alloc    (MemTag  tag,
+                          size_t  size);
+void       *mem_calloc   (MemTag  tag,
+                          size_t  num,
+                          size_t  size);
+void       *mem_realloc  (MemTag  tag,
+                          void   *ptr,
+                          size_t  size);
+void        mem_free     (void   *ptr);
+size_t      mem_live     (MemTag  tag);
+size_t      mem_peak     (MemTag  tag);
+const char *mem_tag_name (MemTag  tag);
+
+#endif
@@ -0,0 +1,291 @@
+/* patron.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "mem.h"
+#include "patron.h"
+
+/* Function: normalize_name
+ * ------------------------
+ * Fold a name to lowercase, drop leading and trailing white space
+ * and collapse every other run of white space to one space.
+ *
+ * name: The name.
+ * key: Receives the normalized name. Must hold PATRON_MAX_NAME + 1 bytes.
+ */
+static void
+normalize_name (const char *name,
+                char       *key)
+{
+  size_t n;
+
+  n = 0;
+  while (isspace ((unsigned char) *name))
+    name++;
+
+  while (*name != '\0' && n < PATRON_MAX_NAME)
+    {
+      if (isspace ((unsigned char) *name))
+        {
+          while (isspace ((unsigned char) *name))
+            name++;
+          if (*name != '\0')
+            key[n++] = ' ';
+          continue;
+        }
+      key[n++] = tolower ((unsigned char) *name++);
+    }
+
+  key[n] = '\0';
+}
+
+/* Function: patron_init
+ * ---------------------
+ * Initialize an empty patron table.
+ *
+ * table: The table to initialize.
+ */
+void
+patron_init (PatronTable *table)
+{
+  dict_init (&table->keys);
+  dict_init (&table->names);
+  table->loans = NULL;
+  table->loans_cap = 0;
+}
+
+/* Function: patron_free
+ * ---------------------
+ * Release the memory held by a patron table and leave it empty.
+ *
+ * table: The table to free.
+ */
+void
+patron_free (PatronTable *table)
+{
+  unsigned int id;
+
+  for (id = 0; id < table->loans_cap; id++)
+    mem_free (table->loans[id].books);
+  mem_free (table->loans);
+  dict_free (&table->keys);
+  dict_free (&table->names);
+  patron_init (table);
+}
+
+/* Function: patron_find
+ * ---------------------
+ * Find a patron by name.
+ *
+ * table: The table.
+ * name: The name, matched ignoring case and runs of white space.
+ *
+ * returns: The id of the patron, or PATRON_NONE if there is none.
+ */
+unsigned int
+patron_find (const PatronTable *table,
+             const char        *name)
+{
+  char key[PATRON_MAX_NAME + 1];
+  unsigned int id;
+
+  normalize_name (name, key);
+  id = dict_lookup (&table->keys, key);
+
+  return id == DICT_NONE ? PATRON_NONE : id;
+}
+
+/* Function: patron_add
+ * --------------------
+ * Get the id of a patron, adding the patron if the name is new.
+ *
+ * table: The table.
+ * name: The name. An empty or blank name is never added.
+ *
+ * returns: The id of the patron, or PATRON_NONE if the name
+ *          is blank or memory could not be allocated.
+ */
+unsigned int
+patron_add (PatronTable *table,
+            const char  *name)
+{
+  char key[PATRON_MAX_NAME + 1];
+  unsigned int id, count;
+
+  normalize_name (name, key);
+  if (key[0] == '\0')
+    return PATRON_NONE;
+
+  count = table->keys.count;
+  id = dict_put (&table->keys, key);
+  if (id == DICT_NONE)
+    return PATRON_NONE;
+  if (id < count)
+    return id;
+
+  /* Names with distinct keys are distinct, so both dictionaries hand out the same id. */
+  if (dict_put (&table->names, name) == DICT_NONE)
+    return PATRON_NONE;
+
+  return id;
+}
+
+/* Function: patron_name
+ * ---------------------
+ * Get the name of a patron.
+ *
+ * The name stays valid until the next patron is added.
+ *
+ * table: The table.
+ * id: An id returned by `patron_add`.
+ *
+ * returns: The name as first written.
+ */
+const char *
+patron_name (const PatronTable *table,
+             unsigned int       id)
+{
+  return dict_get (&table->names, id);
+}
+
+/* Function: patron_loans
+ * ----------------------
+ * Get the books a patron has out.
+ *
+ * table: The table.
+ * id: The id of the patron.
+ *
+ * returns: The loans of the patron, which stay valid
+ *          until loans are next added or removed.
+ */
+const PatronLoans *
+patron_loans (const PatronTable *table,
+              unsigned int       id)
+{
+  static const PatronLoans none;
+
+  return id < table->loans_cap ? &table->loans[id] : &none;
+}
+
+/* Function: patron_count
+ * ----------------------
+ * Get the number of patrons in a table.
+ *
+ * table: The table.
+ *
+ * returns: The number of patrons; every id is less than this.
+ */
+unsigned int
+patron_count (const PatronTable *table)
+{
+  return table->names.count;
+}
+
+/* Function: patron_lend
+ * ---------------------
+ * Add a book to the loans of a patron.
+ *
+ * table: The table.
+ * id: The id of the patron.
+ * book: The position of the book in the books array.
+ *
+ * returns: 0 on success, or -1 if memory could not be allocated.
+ */
+int
+patron_lend (PatronTable  *table,
+             unsigned int  id,
+             int           book)
+{
+  PatronLoans *loans;
+  unsigned int cap;
+  int *books;
+
+  if (id >= table->loans_cap)
+    {
+      cap = table->loans_cap ? table->loans_cap : 16;
+      while (cap <= id)
+        cap *= 2;
+      loans = (PatronLoans *) mem_realloc (MEM_INDEXES, table->loans, sizeof (PatronLoans) * cap);
+      if (loans == NULL)
+        return -1;
+      memset (&loans[table->loans_cap], 0, sizeof (PatronLoans) * (cap - table->loans_cap));
+      table->loans = loans;
+      table->loans_cap = cap;
+    }
+
+  loans = &table->loans[id];
+  if (loans->count == loans->cap)
+    {
+      cap = loans->cap ? loans->cap * 2 : 4;
+      books = (int *) mem_realloc (MEM_INDEXES, loans->books, sizeof (int) * cap);
+      if (books == NULL)
+        return -1;
+      loans->books = books;
+      loans->cap = cap;
+    }
+
+  loans->books[loans->count++] = book;
+  return 0;
+}
+
+/* Function: patron_unlend
+ * -----------------------
+ * Remove a book from the loans of a patron, if it is there.
+ *
+ * table: The table.
+ * id: The id of the patron.
+ * book: The position of the book in the books array.
+ */
+void
+patron_unlend (PatronTable  *table,
+               unsigned int  id,
+               int           book)
+{
+  PatronLoans *loans;
+  unsigned int i;
+
+  if (id >= table->loans_cap)
+    return;
+
+  loans = &table->loans[id];
+  for (i = 0; i < loans->count && loans->books[i] != book; i++) {}
+  if (i == loans->count)
+    return;
+
+  memmove (&loans->books[i], &loans->books[i + 1], sizeof (int) * (loans->count - i - 1));
+  loans->count--;
+}
+
+/* Function: patron_clear_loans
+ * ----------------------------
+ * Empty the loans of every patron, keeping the patrons.
+ *
+ * table: The table.
+ */
+void
+patron_clear_loans (PatronTable *table)
+{
+  unsigned int id;
+
+  for (id = 0; id < table->loans_cap; id++)
+    table->loans[id].count = 0;
+}
@@ -0,0 +1,72 @@
+/* patron.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PATRON_H
+#define PATRON_H
+
+#include "dict.h"
+
+/* The id returned when a patron is not in a table. */
+#define PATRON_NONE ((unsigned int) -1)
+
+/* The longest name a patron can have, excluding the terminator. */
+#define PATRON_MAX_NAME 255
+
+/* The books a patron has out. */
+typedef struct
+{
+  int          *books;  /* Positions in the books array, in the order borrowed. */
+  unsigned int  count;  /* The number of books. */
+  unsigned int  cap;    /* The capacity of books. */
+} PatronLoans;
+
+/* A table of library patrons with dense integer ids.
+ *
+ * Names are matched ignoring case and runs of white space, so that
+ * "ana  cruz" finds the patron first written as "Ana Cruz". Ids are
+ * handed out in the order patrons are added, starting at 0. */
+typedef struct
+{
+  Dict          keys;       /* The normalized name of each patron, coded by id. */
+  Dict          names;      /* The name of each patron as first written, coded by id. */
+  PatronLoans  *loans;      /* The loans of each patron, indexed by id. */
+  unsigned int  loans_cap;  /* The number of loan lists allocated. */
+} PatronTable;
+
+void          patron_init        (PatronTable       *table);
+void          patron_free        (PatronTable       *table);
+unsigned int  patron_find        (const PatronTable *table,
+                                  const char        *name);
+unsigned int  patron_add         (PatronTable       *table,
+                                  const char        *name);
+const char   *patron_name        (const PatronTable *table,
+                                  unsigned int       id);
+const PatronLoans *patron_loans  (const PatronTable *table,
+                                  unsigned int       id);
+unsigned int  patron_count       (const PatronTable *table);
+int           patron_lend        (PatronTable       *table,
+                                  unsigned int       id,
+                                  int                book);
+void          patron_unlend      (PatronTable       *table,
+                                  unsigned int       id,
+                                  int                book);
+void          patron_clear_loans (PatronTable       *table);
+
+#endif
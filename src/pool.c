@@ -0,0 +1,174 @@
+/* pool.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <unistd.h>
+
+#include "pool.h"
+
+/* Function: work
+ * --------------
+ * Run the tasks of each job posted to a pool until it stops.
+ */
+static void *
+work (void *arg)
+{
+  Pool *pool = (Pool *) arg;
+  int task;
+
+  pthread_mutex_lock (&pool->lock);
+  for (;;)
+    {
+      while (!pool->stopping && pool->next_task >= pool->num_tasks)
+        pthread_cond_wait (&pool->work, &pool->lock);
+      if (pool->stopping)
+        break;
+
+      task = pool->next_task++;
+      pthread_mutex_unlock (&pool->lock);
+      pool->task (pool->arg, task);
+      pthread_mutex_lock (&pool->lock);
+
+      if (++pool->num_done == pool->num_tasks)
+        pthread_cond_signal (&pool->done);
+    }
+  pthread_mutex_unlock (&pool->lock);
+
+  return NULL;
+}
+
+/* Function: pool_init
+ * -------------------
+ * Start the workers of a pool.
+ *
+ * pool: The pool.
+ * num_threads: The number of threads to run jobs on, including
+ *              the caller of `pool_run`, at most POOL_MAX_THREADS.
+ *
+ * returns: The number of threads the pool runs jobs on.  It is less
+ *          than asked for if some workers could not be started,
+ *          and at least 1, since the caller always takes part.
+ */
+int
+pool_init (Pool *pool,
+           int   num_threads)
+{
+  if (num_threads > POOL_MAX_THREADS)
+    num_threads = POOL_MAX_THREADS;
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->work, NULL);
+  pthread_cond_init (&pool->done, NULL);
+  pool->num_tasks = 0;
+  pool->next_task = 0;
+  pool->num_done = 0;
+  pool->stopping = 0;
+
+  for (pool->num_threads = 0; pool->num_threads < num_threads - 1; pool->num_threads++)
+    if (pthread_create (&pool->threads[pool->num_threads], NULL, work, pool) != 0)
+      break;
+
+  return pool->num_threads + 1;
+}
+
+/* Function: pool_run
+ * ------------------
+ * Run a job on a pool and wait for it to finish.
+ *
+ * The calling thread runs tasks too, so a pool without workers
+ * runs the tasks one after another.  Tasks may run in any order
+ * and at the same time, so each must write only its own results.
+ *
+ * pool: The pool.
+ * task: The function to call for each task.
+ * arg: The argument passed to every call.
+ * num_tasks: The number of tasks, numbered from 0.
+ */
+void
+pool_run (Pool     *pool,
+          PoolTask  task,
+          void     *arg,
+          int       num_tasks)
+{
+  int t;
+
+  if (num_tasks <= 0)
+    return;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->task = task;
+  pool->arg = arg;
+  pool->next_task = 0;
+  pool->num_done = 0;
+  pool->num_tasks = num_tasks;
+  pthread_cond_broadcast (&pool->work);
+
+  while (pool->next_task < pool->num_tasks)
+    {
+      t = pool->next_task++;
+      pthread_mutex_unlock (&pool->lock);
+      task (arg, t);
+      pthread_mutex_lock (&pool->lock);
+      pool->num_done++;
+    }
+
+  while (pool->num_done < pool->num_tasks)
+    pthread_cond_wait (&pool->done, &pool->lock);
+  pool->num_tasks = 0;
+  pool->next_task = 0;
+  pthread_mutex_unlock (&pool->lock);
+}
+
+/* Function: pool_free
+ * -------------------
+ * Stop the workers of a pool and wait for them to exit.
+ */
+void
+pool_free (Pool *pool)
+{
+  int i;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast (&pool->work);
+  pthread_mutex_unlock (&pool->lock);
+
+  for (i = 0; i < pool->num_threads; i++)
+    pthread_join (pool->threads[i], NULL);
+  pool->num_threads = 0;
+
+  pthread_cond_destroy (&pool->done);
+  pthread_cond_destroy (&pool->work);
+  pthread_mutex_destroy (&pool->lock);
+}
+
+/* Function: pool_cpus
+ * -------------------
+ * Get the number of processors online, at most POOL_MAX_THREADS.
+ */
+int
+pool_cpus (void)
+{
+  long n;
+
+  n = sysconf (_SC_NPROCESSORS_ONLN);
+  if (n < 1)
+    return 1;
+  return n > POOL_MAX_THREADS ? POOL_MAX_THREADS : (int) n;
+}
@@ -0,0 +1,62 @@
+/* pool.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+
+/* The most threads a pool runs, including the caller. */
+#define POOL_MAX_THREADS 64
+
+/* A task of a job, given the job's argument and the number of the task. */
+typedef void (*PoolTask) (void *arg,
+                          int   task);
+
+/* A set of worker threads that live as long as the pool,
+ * so a job costs a wakeup rather than a thread creation.
+ *
+ * A job is a number of tasks handed out one at a time to whichever
+ * thread is free, the caller of `pool_run` included. */
+typedef struct
+{
+  pthread_t       threads[POOL_MAX_THREADS];  /* The workers. */
+  int             num_threads;                /* The number of workers, not counting the caller. */
+  pthread_mutex_t lock;                       /* Guards the fields below. */
+  pthread_cond_t  work;                       /* Signalled when a job is posted or the pool stops. */
+  pthread_cond_t  done;                       /* Signalled when the last task of a job finishes. */
+  PoolTask        task;                       /* The task of the current job. */
+  void           *arg;                        /* The argument of the current job. */
+  int             num_tasks;                  /* The number of tasks in the current job. */
+  int             next_task;                  /* The next task to hand out. */
+  int             num_done;                   /* The number of tasks finished. */
+  int             stopping;                   /* Whether the workers should exit. */
+} Pool;
+
+int  pool_init (Pool     *pool,
+                int       num_threads);
+void pool_run  (Pool     *pool,
+                PoolTask  task,
+                void     *arg,
+                int       num_tasks);
+void pool_free (Pool     *pool);
+int  pool_cpus (void);
+
+#endif
@@ -0,0 +1,314 @@
+/* query.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "query.h"
+#include "utils.h"
+
+/* The names of the fields a term can compare, in the order of the catalog file. */
+static const char *field_names[] = {
+  "title",
+  "author",
+  "publisher",
+  "year",
+  "isbn",
+  "accession",
+  "genre",
+  "borrower",
+  "checked_out_date",
+  "return_date"
+};
+
+#define NUM_FIELDS ((int) (sizeof (field_names) / sizeof (field_names[0])))
+
+/* The position of the year among the fields. */
+#define YEAR_FIELD 3
+
+/* The operators of a comparison, longest first so that
+ * "<=" is not read as "<". */
+static const struct
+{
+  const char *text;
+  QueryOp     op;
+} operators[] = {
+  { "!=", QUERY_NE },
+  { "<=", QUERY_LE },
+  { ">=", QUERY_GE },
+  { "=",  QUERY_EQ },
+  { "<",  QUERY_LT },
+  { ">",  QUERY_GT }
+};
+
+#define NUM_OPERATORS ((int) (sizeof (operators) / sizeof (operators[0])))
+
+/* Function: read_word
+ * -------------------
+ * Read a run of letters, digits and underscores.
+ *
+ * p: A pointer to the position in the text. Advanced past the word.
+ * word: Receives the word, truncated to len - 1 characters.
+ * len: The size of word.
+ *
+ * returns: The length of the word, which is 0 if there is none.
+ */
+static size_t
+read_word (const char **p,
+           char        *word,
+           size_t       len)
+{
+  size_t n;
+
+  n = 0;
+  while (isalnum ((unsigned char) **p) || **p == '_')
+    {
+      if (n < len - 1)
+        word[n] = **p;
+      n++;
+      (*p)++;
+    }
+  word[n < len - 1 ? n : len - 1] = '\0';
+
+  return n;
+}
+
+/* Function: skip_space
+ * --------------------
+ * Advance past any white space.
+ */
+static void
+skip_space (const char **p)
+{
+  while (isspace ((unsigned char) **p))
+    (*p)++;
+}
+
+/* Function: read_value
+ * --------------------
+ * Read the value of a comparison: either a double-quoted string,
+ * which may hold spaces, or a run of characters up to the next space.
+ *
+ * p: A pointer to the position in the text. Advanced past the value.
+ * value: Receives the value. Must hold QUERY_MAX_VALUE + 1 characters.
+ *
+ * returns: 0 on success, or -1 if the value is missing,
+ *          unterminated or too long.
+ */
+static int
+read_value (const char **p,
+            char        *value)
+{
+  size_t n;
+
+  n = 0;
+  if (**p == '"')
+    {
+      (*p)++;
+      while (**p != '"')
+        {
+          if (**p == '\0' || n == QUERY_MAX_VALUE)
+            return -1;
+          value[n++] = *(*p)++;
+        }
+      (*p)++;
+    }
+  else
+    {
+      while (**p != '\0' && !isspace ((unsigned char) **p))
+        {
+          if (n == QUERY_MAX_VALUE)
+            return -1;
+          value[n++] = *(*p)++;
+        }
+      if (n == 0)
+        return -1;
+    }
+
+  value[n] = '\0';
+  return 0;
+}
+
+/* Function: is_year
+ * -----------------
+ * Check that a value is a year: 1 to 4 decimal digits and nothing else.
+ */
+static int
+is_year (const char *value)
+{
+  size_t n;
+
+  n = strspn (value, "0123456789");
+  return n > 0 && n <= 4 && value[n] == '\0';
+}
+
+/* Function: query_parse
+ * ---------------------
+ * Parse a filter expression such as
+ *
+ *   genre=Fiction AND year>=1900 AND available
+ *
+ * A query is one or more terms joined by AND.  A term is a comparison
+ * of a field with a value, or `available` or `checked_out`, and may be
+ * preceded by NOT.  Keywords and field names are not case-sensitive.
+ * The year is compared as a number, and is the only field
+ * that can be compared with <, <=, > and >=.
+ *
+ * text: The expression.
+ * query: Receives the parsed query.
+ * error: Receives a message describing the first error, if any.
+ * error_len: The size of error.
+ *
+ * returns: 0 on success, or -1 if the expression is invalid.
+ */
+int
+query_parse (const char *text,
+             Query      *query,
+             char       *error,
+             size_t      error_len)
+{
+  char word[32];
+  QueryTerm *term;
+  const char *p;
+  int i;
+
+  query->num_terms = 0;
+  p = text;
+
+  for (;;)
+    {
+      skip_space (&p);
+      if (query->num_terms == QUERY_MAX_TERMS)
+        {
+          snprintf (error, error_len, "at most %d terms are allowed", QUERY_MAX_TERMS);
+          return -1;
+        }
+      term = &query->terms[query->num_terms];
+      memset (term, 0, sizeof (QueryTerm));
+
+      if (read_word (&p, word, sizeof (word)) == 0)
+        {
+          snprintf (error, error_len, "expected a field at \"%s\"", p);
+          return -1;
+        }
+
+      if (!strcasecmp (word, "not"))
+        {
+          term->negated = 1;
+          skip_space (&p);
+          if (read_word (&p, word, sizeof (word)) == 0)
+            {
+              snprintf (error, error_len, "expected a field after NOT");
+              return -1;
+            }
+        }
+
+      if (!strcasecmp (word, "available") || !strcasecmp (word, "checked_out"))
+        {
+          term->field = QUERY_STATUS;
+          term->op = !strcasecmp (word, "available") ? QUERY_AVAILABLE : QUERY_CHECKED_OUT;
+        }
+      else
+        {
+          for (i = 0; i < NUM_FIELDS && strcasecmp (word, field_names[i]); i++)
+            {}
+          if (i == NUM_FIELDS)
+            {
+              snprintf (error, error_len, "unknown field \"%s\"", word);
+              return -1;
+            }
+          term->field = i;
+
+          skip_space (&p);
+          for (i = 0; i < NUM_OPERATORS && strncmp (p, operators[i].text, strlen (operators[i].text)); i++)
+            {}
+          if (i == NUM_OPERATORS)
+            {
+              snprintf (error, error_len, "expected =, !=, <, <=, > or >= after \"%s\"", word);
+              return -1;
+            }
+          term->op = operators[i].op;
+          p += strlen (operators[i].text);
+
+          if (term->op != QUERY_EQ && term->op != QUERY_NE && term->field != YEAR_FIELD)
+            {
+              snprintf (error, error_len, "only the year can be compared with %s", operators[i].text);
+              return -1;
+            }
+
+          skip_space (&p);
+          if (read_value (&p, term->value) != 0)
+            {
+              snprintf (error, error_len, "expected a value after \"%s%s\"", word, operators[i].text);
+              return -1;
+            }
+
+          if (term->field == YEAR_FIELD && !is_year (term->value))
+            {
+              snprintf (error, error_len, "\"%s\" is not a year", term->value);
+              return -1;
+            }
+        }
+      query->num_terms++;
+
+      skip_space (&p);
+      if (*p == '\0')
+        return 0;
+
+      if (read_word (&p, word, sizeof (word)) == 0 || strcasecmp (word, "and"))
+        {
+          snprintf (error, error_len, "expected AND before \"%s\"", p);
+          return -1;
+        }
+    }
+}
+
+/* Function: query_format_term
+ * ---------------------------
+ * Write a term back in the syntax of the query language.
+ *
+ * term: The term.
+ * buf: Receives the text.
+ * len: The size of buf.
+ */
+void
+query_format_term (const QueryTerm *term,
+                   char            *buf,
+                   size_t           len)
+{
+  const char *op;
+  int i;
+
+  if (term->field == QUERY_STATUS)
+    {
+      snprintf (buf, len, "%s%s", term->negated ? "NOT " : "",
+                term->op == QUERY_AVAILABLE ? "available" : "checked_out");
+      return;
+    }
+
+  op = "=";
+  for (i = 0; i < NUM_OPERATORS; i++)
+    if (operators[i].op == term->op)
+      op = operators[i].text;
+
+  snprintf (buf, len, strchr (term->value, ' ') ? "%s%s%s\"%s\"" : "%s%s%s%s",
+            term->negated ? "NOT " : "", field_names[term->field], op, term->value);
+}
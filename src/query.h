@@ -0,0 +1,74 @@
+/* query.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+
+/* The most terms a query can hold. */
+#define QUERY_MAX_TERMS 16
+
+/* The longest value a term can compare against, excluding the terminator. */
+#define QUERY_MAX_VALUE 255
+
+/* The field of a term that tests whether a book is checked out
+ * rather than comparing a field.  Other fields are numbered in the
+ * order of the catalog file, from 0 for the title. */
+#define QUERY_STATUS -1
+
+/* How a term compares a field with its value. */
+typedef enum
+{
+  QUERY_EQ,          /* field=value */
+  QUERY_NE,          /* field!=value */
+  QUERY_LT,          /* year<value */
+  QUERY_LE,          /* year<=value */
+  QUERY_GT,          /* year>value */
+  QUERY_GE,          /* year>=value */
+  QUERY_AVAILABLE,   /* available */
+  QUERY_CHECKED_OUT  /* checked_out */
+} QueryOp;
+
+/* One condition of a query. */
+typedef struct
+{
+  int     field;                        /* The field compared, or QUERY_STATUS. */
+  QueryOp op;                           /* The comparison. */
+  int     negated;                      /* Whether the term was written after NOT. */
+  char    value[QUERY_MAX_VALUE + 1];   /* The value compared against. */
+} QueryTerm;
+
+/* A parsed query: books match when they satisfy every term. */
+typedef struct
+{
+  QueryTerm terms[QUERY_MAX_TERMS];  /* The terms, in the order written. */
+  int       num_terms;               /* The number of terms. */
+} Query;
+
+int  query_parse       (const char      *text,
+                        Query           *query,
+                        char            *error,
+                        size_t           error_len);
+void query_format_term (const QueryTerm *term,
+                        char            *buf,
+                        size_t           len);
+
+#endif
@@ -0,0 +1,246 @@
+/* sketch.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sketch.h"
+
+/* Function: hash_key
+ * ------------------
+ * Hash a key with 64-bit FNV-1a.
+ */
+static unsigned long long
+hash_key (const char *key)
+{
+  unsigned long long h;
+
+  h = 14695981039346656037ULL;
+  while (*key != '\0')
+    {
+      h ^= (unsigned char) *key++;
+      h *= 1099511628211ULL;
+    }
+
+  return h;
+}
+
+/* Function: column_of
+ * -------------------
+ * Get the counter of a key in a row.
+ *
+ * The rows' hashes are derived from the two halves of one hash,
+ * which is as good as independent hashes for a count-min sketch.
+ */
+static unsigned int
+column_of (unsigned long long h,
+           int                row)
+{
+  unsigned int h1, h2;
+
+  h1 = (unsigned int) h;
+  h2 = (unsigned int) (h >> 32) | 1;
+
+  return (h1 + (unsigned int) row * h2) % SKETCH_WIDTH;
+}
+
+/* Function: sift_down
+ * -------------------
+ * Restore the heap order below an item whose count grew.
+ */
+static void
+sift_down (Sketch       *sketch,
+           unsigned int  i)
+{
+  SketchItem item;
+  unsigned int child;
+
+  item = sketch->top[i];
+  for (;;)
+    {
+      child = 2 * i + 1;
+      if (child >= sketch->num_top)
+        break;
+      if (child + 1 < sketch->num_top && sketch->top[child + 1].count < sketch->top[child].count)
+        child++;
+      if (sketch->top[child].count >= item.count)
+        break;
+      sketch->top[i] = sketch->top[child];
+      i = child;
+    }
+  sketch->top[i] = item;
+}
+
+/* Function: sift_up
+ * -----------------
+ * Restore the heap order above a newly added item.
+ */
+static void
+sift_up (Sketch       *sketch,
+         unsigned int  i)
+{
+  SketchItem item;
+  unsigned int parent;
+
+  item = sketch->top[i];
+  while (i > 0)
+    {
+      parent = (i - 1) / 2;
+      if (sketch->top[parent].count <= item.count)
+        break;
+      sketch->top[i] = sketch->top[parent];
+      i = parent;
+    }
+  sketch->top[i] = item;
+}
+
+/* Function: compare_items
+ * -----------------------
+ * Order items by descending count, then by key.
+ */
+static int
+compare_items (const void *a,
+               const void *b)
+{
+  const SketchItem *x = (const SketchItem *) a;
+  const SketchItem *y = (const SketchItem *) b;
+
+  if (x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+
+  return strcmp (x->key, y->key);
+}
+
+/* Function: sketch_init
+ * ---------------------
+ * Initialize an empty sketch.
+ *
+ * sketch: The sketch to initialize.
+ */
+void
+sketch_init (Sketch *sketch)
+{
+  memset (sketch, 0, sizeof (Sketch));
+}
+
+/* Function: sketch_add
+ * --------------------
+ * Count one occurrence of a key.
+ *
+ * sketch: The sketch.
+ * key: The key. Only its first SKETCH_MAX_KEY bytes are kept in the heap.
+ */
+void
+sketch_add (Sketch     *sketch,
+            const char *key)
+{
+  unsigned long long h;
+  unsigned int estimate, i;
+  int row;
+
+  h = hash_key (key);
+  estimate = (unsigned int) -1;
+  for (row = 0; row < SKETCH_DEPTH; row++)
+    {
+      i = column_of (h, row);
+      sketch->counts[row][i]++;
+      if (sketch->counts[row][i] < estimate)
+        estimate = sketch->counts[row][i];
+    }
+  sketch->total++;
+
+  for (i = 0; i < sketch->num_top; i++)
+    if (!strncmp (sketch->top[i].key, key, SKETCH_MAX_KEY))
+      {
+        sketch->top[i].count = estimate;
+        sift_down (sketch, i);
+        return;
+      }
+
+  if (sketch->num_top < SKETCH_TOP)
+    i = sketch->num_top++;
+  else if (estimate > sketch->top[0].count)
+    i = 0;
+  else
+    return;
+
+  strncpy (sketch->top[i].key, key, SKETCH_MAX_KEY);
+  sketch->top[i].key[SKETCH_MAX_KEY] = '\0';
+  sketch->top[i].count = estimate;
+  if (i == 0 && sketch->num_top == SKETCH_TOP)
+    sift_down (sketch, 0);
+  else
+    sift_up (sketch, i);
+}
+
+/* Function: sketch_estimate
+ * -------------------------
+ * Estimate how many times a key was added.
+ *
+ * sketch: The sketch.
+ * key: The key.
+ *
+ * returns: The estimate, which is never less than the true count.
+ */
+unsigned int
+sketch_estimate (const Sketch *sketch,
+                 const char   *key)
+{
+  unsigned long long h;
+  unsigned int estimate, count;
+  int row;
+
+  h = hash_key (key);
+  estimate = (unsigned int) -1;
+  for (row = 0; row < SKETCH_DEPTH; row++)
+    {
+      count = sketch->counts[row][column_of (h, row)];
+      if (count < estimate)
+        estimate = count;
+    }
+
+  return estimate;
+}
+
+/* Function: sketch_top
+ * --------------------
+ * Get the heaviest keys of a sketch, heaviest first.
+ *
+ * sketch: The sketch.
+ * items: Receives the keys and their estimates.
+ * max_items: The size of items.
+ *
+ * returns: The number of items stored, at most SKETCH_TOP.
+ */
+unsigned int
+sketch_top (const Sketch *sketch,
+            SketchItem   *items,
+            unsigned int  max_items)
+{
+  SketchItem sorted[SKETCH_TOP];
+  unsigned int n;
+
+  memcpy (sorted, sketch->top, sizeof (SketchItem) * sketch->num_top);
+  qsort (sorted, sketch->num_top, sizeof (SketchItem), compare_items);
+
+  n = sketch->num_top < max_items ? sketch->num_top : max_items;
+  memcpy (items, sorted, sizeof (SketchItem) * n);
+  return n;
+}
@@ -0,0 +1,66 @@
+/* sketch.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+/* The number of rows of counters, each with its own hash. */
+#define SKETCH_DEPTH 4
+
+/* The number of counters in a row. */
+#define SKETCH_WIDTH 2048
+
+/* The number of heavy hitters tracked. */
+#define SKETCH_TOP 32
+
+/* The longest key tracked, excluding the terminator. */
+#define SKETCH_MAX_KEY 255
+
+/* A key and its estimated count. */
+typedef struct
+{
+  char         key[SKETCH_MAX_KEY + 1];  /* The key. */
+  unsigned int count;                    /* The estimated number of times it was added. */
+} SketchItem;
+
+/* A count-min sketch with a heap of its heaviest keys.
+ *
+ * The estimate of a key is the smallest of its counters, one per row,
+ * so it never undercounts and overcounts by at most a small fraction
+ * of the total.  The heap keeps the SKETCH_TOP keys with the largest
+ * estimates, so the top keys can be read without scanning anything. */
+typedef struct
+{
+  unsigned int       counts[SKETCH_DEPTH][SKETCH_WIDTH];  /* The counters. */
+  SketchItem         top[SKETCH_TOP];                     /* A min-heap of the heaviest keys. */
+  unsigned int       num_top;                             /* The number of keys in top. */
+  unsigned long long total;                               /* The number of keys added. */
+} Sketch;
+
+void         sketch_init     (Sketch       *sketch);
+void         sketch_add      (Sketch       *sketch,
+                              const char   *key);
+unsigned int sketch_estimate (const Sketch *sketch,
+                              const char   *key);
+unsigned int sketch_top      (const Sketch *sketch,
+                              SketchItem   *items,
+                              unsigned int  max_items);
+
+#endif
@@ -0,0 +1,563 @@
+/* sort.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mem.h"
+#include "sort.h"
+
+/* The memory a run takes while it is merged: its stdio buffer and its line. */
+#define RUN_SLOT_LEN (SORT_RUN_BUF_LEN + SORT_MAX_RECORD + 2)
+
+/* Function: find_key
+ * ------------------
+ * Find the key of a record and, for a numeric sort, its value.
+ * A key that is not a number sorts before every number.
+ */
+static void
+find_key (const Sorter *sorter,
+          SortRecord   *record)
+{
+  const char *p, *end, *key;
+  long number;
+  int f;
+
+  p = record->data;
+  end = p + record->len;
+  for (f = 0; f < sorter->field && p < end; f++)
+    {
+      p = memchr (p, ',', end - p);
+      p = p != NULL ? p + 1 : end;
+    }
+  key = p;
+  while (p < end && *p != ',')
+    p++;
+
+  record->key_off = key - record->data;
+  record->key_len = p - key;
+  record->number = 0;
+  if (!sorter->numeric)
+    return;
+
+  number = -1;
+  for (p = key; p < key + record->key_len && isdigit ((unsigned char) *p); p++)
+    number = (number < 0 ? 0 : number * 10) + (*p - '0');
+  record->number = number;
+}
+
+/* Function: compare_keys
+ * ----------------------
+ * Compare the keys of two records: as numbers first, then as text
+ * without regard to case.
+ */
+static int
+compare_keys (const SortRecord *a,
+              const SortRecord *b)
+{
+  const unsigned char *p, *q;
+  unsigned int i, n;
+  int c;
+
+  if (a->number != b->number)
+    return a->number < b->number ? -1 : 1;
+
+  p = (const unsigned char *) a->data + a->key_off;
+  q = (const unsigned char *) b->data + b->key_off;
+  n = a->key_len < b->key_len ? a->key_len : b->key_len;
+  for (i = 0; i < n; i++)
+    {
+      c = tolower (p[i]) - tolower (q[i]);
+      if (c != 0)
+        return c;
+    }
+  return (a->key_len > n) - (b->key_len > n);
+}
+
+/* Function: compare_records
+ * -------------------------
+ * Order records in the buffer by key, and records with equal keys
+ * by where they lie, which is the order they were added in.
+ */
+static int
+compare_records (const void *a,
+                 const void *b)
+{
+  const SortRecord *x = (const SortRecord *) a;
+  const SortRecord *y = (const SortRecord *) b;
+  int c;
+
+  c = compare_keys (x, y);
+  if (c != 0)
+    return c;
+  return (x->data > y->data) - (x->data < y->data);
+}
+
+/* Function: new_run
+ * -----------------
+ * Create a temporary file for a run.  Its name is removed at once,
+ * so the file goes away when it is closed, even if the program dies.
+ *
+ * returns: The descriptor of the file, or -1 on failure.
+ */
+static int
+new_run (Sorter *sorter)
+{
+  char path[sizeof (sorter->tmp_dir) + 32];
+  int fd;
+
+  snprintf (path, sizeof (path), "%s/librlog-sort.XXXXXX", sorter->tmp_dir);
+  fd = mkstemp (path);
+  if (fd >= 0)
+    unlink (path);
+  sorter->total_files++;
+  return fd;
+}
+
+/* Function: spill
+ * ---------------
+ * Sort the records in the buffer and write them out as a run.
+ *
+ * returns: 0 on success, or -1 if the run could not be written.
+ */
+static int
+spill (Sorter *sorter)
+{
+  FILE *fp;
+  int *files;
+  size_t i;
+  int fd;
+
+  if (sorter->num_files == sorter->max_files)
+    {
+      files = (int *) mem_realloc (MEM_BUFFERS, sorter->files, sizeof (int) * (sorter->max_files * 2 + 16));
+      if (files == NULL)
+        return -1;
+      sorter->files = files;
+      sorter->max_files = sorter->max_files * 2 + 16;
+    }
+
+  qsort (sorter->records, sorter->num_records, sizeof (SortRecord), compare_records);
+
+  fd = new_run (sorter);
+  if (fd < 0)
+    return -1;
+  sorter->files[sorter->num_files++] = fd;
+
+  /* Write through a duplicate, so that closing the stream keeps the run. */
+  fd = dup (fd);
+  fp = fd >= 0 ? fdopen (fd, "w") : NULL;
+  if (fp == NULL)
+    {
+      if (fd >= 0)
+        close (fd);
+      return -1;
+    }
+  for (i = 0; i < sorter->num_records; i++)
+    {
+      fwrite (sorter->records[i].data, 1, sorter->records[i].len, fp);
+      putc ('\n', fp);
+      sorter->bytes_written += sorter->records[i].len + 1;
+    }
+  if (fclose (fp) != 0)
+    return -1;
+
+  sorter->used = 0;
+  sorter->num_records = 0;
+  sorter->records = (SortRecord *) (sorter->buf + sorter->buf_len);
+  return 0;
+}
+
+/* Function: read_run
+ * ------------------
+ * Read the next record of a run, closing the run after its last.
+ */
+static void
+read_run (Sorter  *sorter,
+          SortRun *run)
+{
+  size_t len;
+
+  if (fgets (run->line, SORT_MAX_RECORD + 2, run->fp) == NULL)
+    {
+      if (ferror (run->fp))
+        sorter->error = 1;
+      fclose (run->fp);
+      run->fp = NULL;
+      return;
+    }
+
+  len = strlen (run->line);
+  sorter->bytes_read += len;
+  if (len > 0 && run->line[len - 1] == '\n')
+    len--;
+  run->record.data = run->line;
+  run->record.len = len;
+  find_key (sorter, &run->record);
+}
+
+/* Function: run_before
+ * --------------------
+ * Whether the current record of run a comes before that of run b.
+ * A run that is used up comes after every other, and of records with
+ * equal keys, the one from the earlier run comes first.
+ */
+static int
+run_before (const Sorter *sorter,
+            int           a,
+            int           b)
+{
+  int c;
+
+  if (sorter->runs[a].fp == NULL || sorter->runs[b].fp == NULL)
+    return sorter->runs[b].fp == NULL && (sorter->runs[a].fp != NULL || a < b);
+
+  c = compare_keys (&sorter->runs[a].record, &sorter->runs[b].record);
+  return c < 0 || (c == 0 && a < b);
+}
+
+/* Function: build_tree
+ * --------------------
+ * Play off the runs below a node of the loser tree, leaving the loser
+ * of each match at its node.  Nodes 1 to num_runs - 1 are matches and
+ * node num_runs + i is run i, as in a binary heap.
+ *
+ * returns: The winning run.
+ */
+static int
+build_tree (Sorter *sorter,
+            int     node)
+{
+  int a, b;
+
+  if (node >= sorter->num_runs)
+    return node - sorter->num_runs;
+
+  a = build_tree (sorter, 2 * node);
+  b = build_tree (sorter, 2 * node + 1);
+  if (run_before (sorter, b, a))
+    {
+      sorter->tree[node] = a;
+      return b;
+    }
+  sorter->tree[node] = b;
+  return a;
+}
+
+/* Function: replay
+ * ----------------
+ * Replay the matches on the path from a run to the root
+ * after the run has moved on to its next record.
+ */
+static void
+replay (Sorter *sorter,
+        int     run)
+{
+  int node, loser;
+
+  for (node = (run + sorter->num_runs) / 2; node > 0; node /= 2)
+    if (run_before (sorter, sorter->tree[node], run))
+      {
+        loser = run;
+        run = sorter->tree[node];
+        sorter->tree[node] = loser;
+      }
+  sorter->tree[0] = run;
+}
+
+/* Function: open_runs
+ * -------------------
+ * Start merging n runs from the first given, each read through its own
+ * slot of the buffer.
+ */
+static void
+open_runs (Sorter *sorter,
+           int     first,
+           int     n)
+{
+  SortRun *run;
+  char *slot;
+  int i;
+
+  sorter->num_runs = n;
+  for (i = 0; i < n; i++)
+    {
+      run = &sorter->runs[i];
+      slot = sorter->buf + (size_t) i * RUN_SLOT_LEN;
+      run->line = slot + SORT_RUN_BUF_LEN;
+
+      lseek (sorter->files[first + i], 0, SEEK_SET);
+      run->fp = fdopen (sorter->files[first + i], "r");
+      if (run->fp == NULL)
+        {
+          close (sorter->files[first + i]);
+          sorter->error = 1;
+        }
+      sorter->files[first + i] = -1;
+      if (run->fp == NULL)
+        continue;
+
+      setvbuf (run->fp, slot, _IOFBF, SORT_RUN_BUF_LEN);
+      read_run (sorter, run);
+    }
+  sorter->tree[0] = build_tree (sorter, 1);
+  sorter->last = -1;
+}
+
+/* Function: sort_open
+ * -------------------
+ * Start a sort.
+ *
+ * field: The field to sort by, counting from 0.
+ * numeric: Whether to compare the keys as numbers.
+ * memory: The bytes the sort may hold, at least SORT_MIN_MEMORY.
+ * tmp_dir: The directory to write runs to, or NULL for $TMPDIR or /tmp.
+ *
+ * returns: 0 on success, or -1 if the buffer could not be allocated.
+ */
+int
+sort_open (Sorter     *sorter,
+           int         field,
+           int         numeric,
+           size_t      memory,
+           const char *tmp_dir)
+{
+  memset (sorter, 0, sizeof (Sorter));
+  sorter->field = field;
+  sorter->numeric = numeric;
+  sorter->last = -1;
+
+  if (tmp_dir == NULL)
+    tmp_dir = getenv ("TMPDIR");
+  if (tmp_dir == NULL || *tmp_dir == '\0')
+    tmp_dir = "/tmp";
+  snprintf (sorter->tmp_dir, sizeof (sorter->tmp_dir), "%s", tmp_dir);
+
+  if (memory < SORT_MIN_MEMORY)
+    memory = SORT_MIN_MEMORY;
+  sorter->buf_len = memory - memory % sizeof (SortRecord);
+  sorter->buf = (char *) mem_alloc (MEM_BUFFERS, sorter->buf_len);
+  if (sorter->buf == NULL)
+    return -1;
+  sorter->records = (SortRecord *) (sorter->buf + sorter->buf_len);
+
+  return 0;
+}
+
+/* Function: sort_add
+ * ------------------
+ * Add a record, writing out a run first if the buffer is full.
+ *
+ * record: The record, without a line terminator.
+ *         It is cut to SORT_MAX_RECORD bytes.
+ *
+ * returns: 0 on success, or -1 if a run could not be written.
+ */
+int
+sort_add (Sorter     *sorter,
+          const char *record,
+          size_t      len)
+{
+  SortRecord *r;
+
+  if (len > SORT_MAX_RECORD)
+    len = SORT_MAX_RECORD;
+
+  if (sorter->used + len + (sorter->num_records + 1) * sizeof (SortRecord) > sorter->buf_len
+      && spill (sorter) != 0)
+    {
+      sorter->error = 1;
+      return -1;
+    }
+
+  memcpy (sorter->buf + sorter->used, record, len);
+  r = --sorter->records;
+  r->data = sorter->buf + sorter->used;
+  r->len = len;
+  find_key (sorter, r);
+  sorter->used += len;
+  sorter->num_records++;
+
+  return 0;
+}
+
+/* Function: sort_finish
+ * ---------------------
+ * Stop adding records and get ready to return them in order.
+ *
+ * If runs were written, the rest of the records are written out too.
+ * While there are more runs than the buffer has room to merge at once,
+ * each group of that many is merged into one longer run.
+ *
+ * returns: 0 on success, or -1 if a run could not be written.
+ */
+int
+sort_finish (Sorter *sorter)
+{
+  FILE *fp;
+  SortRun *run;
+  int first, n, m, fd;
+
+  if (sorter->num_files == 0)
+    {
+      qsort (sorter->records, sorter->num_records, sizeof (SortRecord), compare_records);
+      sorter->next = 0;
+      return sorter->error ? -1 : 0;
+    }
+
+  if (sorter->num_records > 0 && spill (sorter) != 0)
+    sorter->error = 1;
+  if (sorter->error)
+    return -1;
+
+  sorter->fan_in = sorter->buf_len / RUN_SLOT_LEN;
+  if (sorter->fan_in > sorter->num_files)
+    sorter->fan_in = sorter->num_files;
+  sorter->runs = (SortRun *) mem_alloc (MEM_BUFFERS, sizeof (SortRun) * sorter->fan_in);
+  sorter->tree = (int *) mem_alloc (MEM_BUFFERS, sizeof (int) * sorter->fan_in);
+  if (sorter->runs == NULL || sorter->tree == NULL)
+    return -1;
+
+  while (sorter->num_files > sorter->fan_in && !sorter->error)
+    {
+      /* The merged runs replace their groups in order, so equal keys
+       * keep the order they were added in. */
+      m = 0;
+      for (first = 0; first < sorter->num_files; first += n)
+        {
+          n = sorter->num_files - first;
+          if (n > sorter->fan_in)
+            n = sorter->fan_in;
+          if (n == 1)
+            {
+              sorter->files[m++] = sorter->files[first];
+              continue;
+            }
+
+          fd = new_run (sorter);
+          fp = fd >= 0 ? fdopen (dup (fd), "w") : NULL;
+          if (fp == NULL)
+            {
+              if (fd >= 0)
+                close (fd);
+              sorter->error = 1;
+              break;
+            }
+
+          open_runs (sorter, first, n);
+          for (run = &sorter->runs[sorter->tree[0]]; run->fp != NULL; run = &sorter->runs[sorter->tree[0]])
+            {
+              fwrite (run->record.data, 1, run->record.len, fp);
+              putc ('\n', fp);
+              sorter->bytes_written += run->record.len + 1;
+              read_run (sorter, run);
+              replay (sorter, run - sorter->runs);
+            }
+          if (fclose (fp) != 0)
+            sorter->error = 1;
+          sorter->files[m++] = fd;
+        }
+      /* After an error, keep the runs not merged so they are closed. */
+      for (; first < sorter->num_files; first++)
+        if (sorter->files[first] >= 0)
+          sorter->files[m++] = sorter->files[first];
+      sorter->num_files = m;
+      sorter->num_passes++;
+    }
+  if (sorter->error)
+    return -1;
+
+  open_runs (sorter, 0, sorter->num_files);
+  sorter->num_files = 0;
+  return sorter->error ? -1 : 0;
+}
+
+/* Function: sort_next
+ * -------------------
+ * Get the next record in order.
+ *
+ * record: Set to the record, without a line terminator.
+ *         It stays valid until the next call.
+ * len: Set to the length of the record.
+ *
+ * returns: 1 if a record was returned, 0 after the last,
+ *          or -1 if a run could not be read.
+ */
+int
+sort_next (Sorter      *sorter,
+           const char **record,
+           size_t      *len)
+{
+  SortRun *run;
+
+  if (sorter->runs == NULL)
+    {
+      if (sorter->next >= sorter->num_records)
+        return 0;
+      *record = sorter->records[sorter->next].data;
+      *len = sorter->records[sorter->next].len;
+      sorter->next++;
+      return 1;
+    }
+
+  if (sorter->last >= 0)
+    {
+      read_run (sorter, &sorter->runs[sorter->last]);
+      replay (sorter, sorter->last);
+    }
+
+  run = &sorter->runs[sorter->tree[0]];
+  if (run->fp == NULL || sorter->error)
+    {
+      sorter->last = -1;
+      return sorter->error ? -1 : 0;
+    }
+
+  *record = run->record.data;
+  *len = run->record.len;
+  sorter->last = sorter->tree[0];
+  return 1;
+}
+
+/* Function: sort_close
+ * --------------------
+ * Release the buffer and remove any runs left.
+ */
+void
+sort_close (Sorter *sorter)
+{
+  int i;
+
+  for (i = 0; i < sorter->num_files; i++)
+    if (sorter->files[i] >= 0)
+      close (sorter->files[i]);
+  if (sorter->runs != NULL)
+    for (i = 0; i < sorter->num_runs; i++)
+      if (sorter->runs[i].fp != NULL)
+        fclose (sorter->runs[i].fp);
+
+  mem_free (sorter->files);
+  mem_free (sorter->runs);
+  mem_free (sorter->tree);
+  mem_free (sorter->buf);
+}
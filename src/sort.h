@@ -0,0 +1,107 @@
+/* sort.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* The longest record that can be sorted, in bytes. */
+#define SORT_MAX_RECORD 4096
+
+/* The least memory a sort may be given. */
+#define SORT_MIN_MEMORY (1 << 20)
+
+/* The buffer each run is read through while merging. */
+#define SORT_RUN_BUF_LEN 65536
+
+/* A record held in memory while a run is formed. */
+typedef struct
+{
+  const char   *data;     /* The record, without a line terminator. */
+  long          number;   /* The key as a number for a numeric sort, or 0. */
+  unsigned int  len;      /* The length of the record. */
+  unsigned int  key_off;  /* The offset of the key in the record. */
+  unsigned int  key_len;  /* The length of the key. */
+} SortRecord;
+
+/* A run being merged. */
+typedef struct
+{
+  FILE       *fp;      /* The run's temporary file, or NULL once it is used up. */
+  char       *line;    /* The buffer records are read into, SORT_MAX_RECORD + 2 bytes. */
+  SortRecord  record;  /* The run's current record, in line. */
+} SortRun;
+
+/* Comma-separated records being sorted by one of their fields.
+ *
+ * Records are gathered into a buffer of a fixed size.  When it fills,
+ * they are sorted and written out as a run to a temporary file, so a
+ * sort holds no more memory however many records it is given.  The runs
+ * are then merged through a loser tree, which finds the next record
+ * with one comparison per level of the tree.  When there are more runs
+ * than fit in memory at once, groups of them are first merged into
+ * longer runs.  If every record fits in the buffer, nothing is written.
+ *
+ * Keys are compared without regard to case, or as numbers for a numeric
+ * sort, and records with equal keys keep the order they were added in. */
+typedef struct
+{
+  int                 field;          /* The field sorted by, counting from 0. */
+  int                 numeric;        /* Whether the keys are compared as numbers. */
+  char                tmp_dir[256];   /* The directory runs are written to. */
+  char               *buf;            /* The buffer runs are formed in. */
+  size_t              buf_len;        /* The size of the buffer. */
+  size_t              used;           /* The bytes of records at the start of the buffer. */
+  SortRecord         *records;        /* The records of the run being formed, which end the buffer. */
+  size_t              num_records;    /* The number of records in the buffer. */
+  size_t              next;           /* The next record to return from the buffer. */
+  int                *files;          /* The descriptors of the runs written and not yet merged. */
+  int                 num_files;      /* The number of runs written and not yet merged. */
+  int                 max_files;      /* The capacity of files. */
+  int                 total_files;    /* The number of runs ever written, merged ones included. */
+  SortRun            *runs;           /* The runs being merged. */
+  int                *tree;           /* The loser tree; tree[0] is the winning run. */
+  int                 num_runs;       /* The number of runs being merged. */
+  int                 fan_in;         /* The most runs merged at once. */
+  int                 num_passes;     /* The number of passes that merged runs into longer ones. */
+  int                 last;           /* The run of the record last returned, or -1. */
+  int                 error;          /* Nonzero once a run could not be written or read. */
+  unsigned long long  bytes_read;     /* The bytes of runs read back. */
+  unsigned long long  bytes_written;  /* The bytes of runs written. */
+} Sorter;
+
+int  sort_open   (Sorter      *sorter,
+                  int          field,
+                  int          numeric,
+                  size_t       memory,
+                  const char  *tmp_dir);
+int  sort_add    (Sorter      *sorter,
+                  const char  *record,
+                  size_t       len);
+int  sort_finish (Sorter      *sorter);
+int  sort_next   (Sorter      *sorter,
+                  const char **record,
+                  size_t      *len);
+void sort_close  (Sorter      *sorter);
+
+#endif
@@ -0,0 +1,323 @@
+/* stats.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "stats.h"
+#include "trace.h"
+
+/* Each power of two is split into 2^SUB_BITS linear buckets, which keeps
+ * the relative error of a reported percentile below 12.5%. */
+#define SUB_BITS 3
+#define NUM_BUCKETS ((64 - SUB_BITS + 1) << SUB_BITS)
+
+/* Latency and I/O totals of one command. */
+typedef struct
+{
+  unsigned long long count;                /* The number of calls. */
+  unsigned long long total_ns;             /* The sum of all latencies. */
+  unsigned long long max_ns;               /* The largest latency. */
+  unsigned long long records_scanned;      /* Records examined by all calls. */
+  unsigned long long bytes_read;           /* Bytes read by all calls. */
+  unsigned long long bytes_written;        /* Bytes written by all calls. */
+  unsigned long long cache_hits;           /* Results found in a cache by all calls. */
+  unsigned long long cache_misses;         /* Results not found in a cache by all calls. */
+  unsigned long long buckets[NUM_BUCKETS]; /* Latency histogram. */
+} CommandStats;
+
+static const char *command_names[STATS_NUM_COMMANDS] = {
+  "add_book",
+  "borrow_book",
+  "count_books",
+  "delete_book",
+  "edit_book",
+  "export_catalog",
+  "find_books",
+  "find_patron",
+  "import_books",
+  "list_books",
+  "load_catalog",
+  "reload_catalog",
+  "return_book",
+  "save_catalog",
+  "scan_station",
+  "show_history",
+  "show_popular",
+  "verify_catalog"
+};
+
+unsigned long long stats_records_scanned;
+unsigned long long stats_bytes_read;
+unsigned long long stats_bytes_written;
+unsigned long long stats_cache_hits;
+unsigned long long stats_cache_misses;
+
+static CommandStats commands[STATS_NUM_COMMANDS];
+static unsigned long long start_ns;
+static unsigned long long start_scanned;
+static unsigned long long start_read;
+static unsigned long long start_written;
+static unsigned long long start_hits;
+static unsigned long long start_misses;
+
+/* Function: now_ns
+ * ----------------
+ * Read the monotonic clock.
+ *
+ * returns: The current monotonic time in nanoseconds.
+ */
+static unsigned long long
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+}
+
+/* Function: bucket_of
+ * -------------------
+ * Map a latency to its histogram bucket.
+ *
+ * Values below 2^SUB_BITS get a bucket each. Larger values are grouped by
+ * their most significant bit and the SUB_BITS bits that follow it.
+ *
+ * ns: A latency in nanoseconds.
+ *
+ * returns: The bucket index.
+ */
+static int
+bucket_of (unsigned long long ns)
+{
+  int msb;
+
+  if (ns < (1ULL << SUB_BITS))
+    return (int) ns;
+
+  msb = 63 - __builtin_clzll (ns);
+  return ((msb - SUB_BITS + 1) << SUB_BITS)
+         | (int) ((ns >> (msb - SUB_BITS)) & ((1ULL << SUB_BITS) - 1));
+}
+
+/* Function: bucket_limit
+ * ----------------------
+ * Get the largest latency that falls into a bucket.
+ *
+ * bucket: A bucket index.
+ *
+ * returns: The upper bound of the bucket in nanoseconds.
+ */
+static unsigned long long
+bucket_limit (int bucket)
+{
+  int shift;
+
+  if (bucket < (1 << SUB_BITS))
+    return (unsigned long long) bucket;
+
+  shift = (bucket >> SUB_BITS) - 1;
+  return ((((unsigned long long) (bucket & ((1 << SUB_BITS) - 1)) | (1ULL << SUB_BITS)) + 1) << shift) - 1;
+}
+
+/* Function: percentile
+ * --------------------
+ * Estimate a latency percentile of a command from its histogram.
+ *
+ * cs: The command statistics.
+ * p: The percentile, between 0 and 100.
+ *
+ * returns: The upper bound of the bucket holding the percentile,
+ *          never more than the largest recorded latency.
+ */
+static unsigned long long
+percentile (const CommandStats *cs,
+            double              p)
+{
+  unsigned long long rank, seen;
+  int i;
+
+  if (cs->count == 0)
+    return 0;
+
+  rank = (unsigned long long) (p / 100.0 * (double) cs->count + 0.999999);
+  if (rank < 1)
+    rank = 1;
+
+  seen = 0;
+  for (i = 0; i < NUM_BUCKETS; i++)
+    {
+      seen += cs->buckets[i];
+      if (seen >= rank)
+        return bucket_limit (i) < cs->max_ns ? bucket_limit (i) : cs->max_ns;
+    }
+
+  return cs->max_ns;
+}
+
+/* Function: stats_begin
+ * ---------------------
+ * Mark the start of a command.
+ *
+ * The current time and I/O totals are remembered
+ * so that `stats_end` can charge the difference to the command.
+ */
+void
+stats_begin (void)
+{
+  start_scanned = stats_records_scanned;
+  start_read = stats_bytes_read;
+  start_written = stats_bytes_written;
+  start_hits = stats_cache_hits;
+  start_misses = stats_cache_misses;
+  start_ns = now_ns ();
+}
+
+/* Function: stats_end
+ * -------------------
+ * Mark the end of a command and record its latency and I/O, and its span
+ * in the trace when tracing.
+ *
+ * command: The command started by the last call to `stats_begin`.
+ */
+void
+stats_end (StatsCommand command)
+{
+  CommandStats *cs;
+  unsigned long long end_ns, ns;
+
+  end_ns = now_ns ();
+  ns = end_ns - start_ns;
+  cs = &commands[command];
+  TRACE_SPAN (command_names[command], start_ns, end_ns);
+
+  cs->count++;
+  cs->total_ns += ns;
+  if (ns > cs->max_ns)
+    cs->max_ns = ns;
+  cs->buckets[bucket_of (ns)]++;
+  cs->records_scanned += stats_records_scanned - start_scanned;
+  cs->bytes_read += stats_bytes_read - start_read;
+  cs->bytes_written += stats_bytes_written - start_written;
+  cs->cache_hits += stats_cache_hits - start_hits;
+  cs->cache_misses += stats_cache_misses - start_misses;
+}
+
+/* Function: stats_print
+ * ---------------------
+ * Print the statistics of every command that has run to the console.
+ *
+ * Latencies are printed in microseconds.
+ */
+void
+stats_print (void)
+{
+  const CommandStats *cs;
+  unsigned long long hits, lookups;
+  int i, num_printed;
+
+  printf ("%-15s %8s %10s %10s %10s %12s %12s %12s\n",
+          "command", "count", "p50 us", "p99 us", "max us",
+          "scanned", "read", "written");
+
+  num_printed = 0;
+  hits = lookups = 0;
+  for (i = 0; i < STATS_NUM_COMMANDS; i++)
+    {
+      cs = &commands[i];
+      if (cs->count == 0)
+        continue;
+
+      num_printed++;
+      hits += cs->cache_hits;
+      lookups += cs->cache_hits + cs->cache_misses;
+      printf ("%-15s %8llu %10.1f %10.1f %10.1f %12llu %12llu %12llu\n",
+              command_names[i], cs->count,
+              (double) percentile (cs, 50) / 1e3,
+              (double) percentile (cs, 99) / 1e3,
+              (double) cs->max_ns / 1e3,
+              cs->records_scanned, cs->bytes_read, cs->bytes_written);
+    }
+
+  if (num_printed < 1)
+    puts ("No commands recorded yet.");
+  else if (lookups > 0)
+    printf ("Query cache: %llu of %llu lookups hit (%.1f%%).\n", hits, lookups, 100.0 * hits / lookups);
+}
+
+/* Function: stats_write_json
+ * --------------------------
+ * Write the statistics of every command to a file in JSON format.
+ *
+ * Besides the summary figures, the non-empty histogram buckets are written
+ * as [upper bound in nanoseconds, count] pairs.
+ *
+ * file_name: The path of the file to write.
+ *
+ * returns: 0 on success, or -1 if the file could not be written.
+ */
+int
+stats_write_json (const char *file_name)
+{
+  const CommandStats *cs;
+  FILE *fp;
+  int i, j, first;
+
+  fp = fopen (file_name, "w");
+  if (fp == NULL)
+    {
+      fprintf (stderr, "Error: Failed to open file \"%s\" for writing.\n", file_name);
+      return -1;
+    }
+
+  fprintf (fp, "{\"commands\":[");
+  for (i = 0; i < STATS_NUM_COMMANDS; i++)
+    {
+      cs = &commands[i];
+      fprintf (fp, "%s\n{\"name\":\"%s\",\"count\":%llu,\"total_ns\":%llu,"
+               "\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,"
+               "\"records_scanned\":%llu,\"bytes_read\":%llu,\"bytes_written\":%llu,"
+               "\"cache_hits\":%llu,\"cache_misses\":%llu,"
+               "\"histogram\":[",
+               i > 0 ? "," : "", command_names[i], cs->count, cs->total_ns,
+               percentile (cs, 50), percentile (cs, 99), cs->max_ns,
+               cs->records_scanned, cs->bytes_read, cs->bytes_written,
+               cs->cache_hits, cs->cache_misses);
+
+      first = 1;
+      for (j = 0; j < NUM_BUCKETS; j++)
+        {
+          if (cs->buckets[j] == 0)
+            continue;
+          fprintf (fp, "%s[%llu,%llu]", first ? "" : ",", bucket_limit (j), cs->buckets[j]);
+          first = 0;
+        }
+      fprintf (fp, "]}");
+    }
+  fprintf (fp, "\n]}\n");
+
+  if (fclose (fp) != 0)
+    {
+      fprintf (stderr, "Error: Failed to close file \"%s\".\n", file_name);
+      return -1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+/* stats.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+/* The commands whose latencies are recorded. */
+typedef enum
+{
+  STATS_ADD_BOOK,
+  STATS_BORROW_BOOK,
+  STATS_COUNT_BOOKS,
+  STATS_DELETE_BOOK,
+  STATS_EDIT_BOOK,
+  STATS_EXPORT_CATALOG,
+  STATS_FIND_BOOKS,
+  STATS_FIND_PATRON,
+  STATS_IMPORT_BOOKS,
+  STATS_LIST_BOOKS,
+  STATS_LOAD_CATALOG,
+  STATS_RELOAD_CATALOG,
+  STATS_RETURN_BOOK,
+  STATS_SAVE_CATALOG,
+  STATS_SCAN_STATION,
+  STATS_SHOW_HISTORY,
+  STATS_SHOW_POPULAR,
+  STATS_VERIFY_CATALOG,
+  STATS_NUM_COMMANDS
+} StatsCommand;
+
+/* Running totals, charged to the command that is in progress
+ * when `stats_end` is called. */
+extern unsigned long long stats_records_scanned;
+extern unsigned long long stats_bytes_read;
+extern unsigned long long stats_bytes_written;
+extern unsigned long long stats_cache_hits;
+extern unsigned long long stats_cache_misses;
+
+void stats_begin      (void);
+void stats_end        (StatsCommand  command);
+void stats_print      (void);
+int  stats_write_json (const char   *file_name);
+
+#endif
@@ -0,0 +1,218 @@
+/* trace.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "mem.h"
+#include "trace.h"
+
+/* An event, as Chrome's trace format has it: the start ('B') or end ('E')
+ * of a phase, or a whole phase ('X'). */
+typedef struct
+{
+  const char         *name;   /* The phase. */
+  unsigned long long  ts_ns;  /* When it happened, or when an 'X' phase started. */
+  unsigned long long  dur_ns; /* How long an 'X' phase ran, or 0. */
+  char                phase;  /* 'B', 'E' or 'X'. */
+} TraceEvent;
+
+/* The events of one thread.
+ *
+ * Only its thread writes to a ring, so recording an event takes no lock;
+ * the rings are read once the other threads are idle. */
+typedef struct TraceRing
+{
+  TraceEvent        events[TRACE_RING_EVENTS];  /* The events, oldest at `next` once the ring is full. */
+  unsigned long long num_events;                /* The events ever recorded. */
+  int                tid;                       /* The number of the thread, from 1 in order of its first event. */
+  struct TraceRing  *next;                      /* The ring of the thread that started tracing after this one. */
+} TraceRing;
+
+int trace_on;
+
+static unsigned long long   origin_ns;
+static __thread TraceRing  *ring;
+static TraceRing           *rings;
+static TraceRing          **last_ring = &rings;
+static int                  num_rings;
+static pthread_mutex_t      rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Function: trace_now
+ * -------------------
+ * Read the monotonic clock, as events are stamped with.
+ *
+ * returns: The current monotonic time in nanoseconds.
+ */
+unsigned long long
+trace_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Function: trace_start
+ * ---------------------
+ * Start recording events.  Times in the trace count from now.
+ */
+void
+trace_start (void)
+{
+  origin_ns = trace_now ();
+  trace_on = 1;
+}
+
+/* Function: add_ring
+ * ------------------
+ * Give the calling thread a ring of its own.
+ *
+ * returns: The ring, or NULL if memory could not be allocated.
+ */
+static TraceRing *
+add_ring (void)
+{
+  TraceRing *r;
+
+  r = (TraceRing *) mem_calloc (MEM_BUFFERS, 1, sizeof (TraceRing));
+  if (r == NULL)
+    return NULL;
+
+  pthread_mutex_lock (&rings_lock);
+  r->tid = ++num_rings;
+  *last_ring = r;
+  last_ring = &r->next;
+  pthread_mutex_unlock (&rings_lock);
+
+  return r;
+}
+
+/* Function: trace_event
+ * ---------------------
+ * Record an event in the calling thread's ring, through the TRACE_*
+ * macros.  An event is dropped if the thread's ring cannot be allocated.
+ *
+ * start_ns, end_ns: The times of an 'X' phase, or 0 to stamp the event now.
+ */
+void
+trace_event (const char         *name,
+             char                phase,
+             unsigned long long  start_ns,
+             unsigned long long  end_ns)
+{
+  TraceEvent *event;
+
+  if (ring == NULL && (ring = add_ring ()) == NULL)
+    return;
+
+  event = &ring->events[ring->num_events++ % TRACE_RING_EVENTS];
+  event->name = name;
+  event->phase = phase;
+  if (phase == 'X')
+    {
+      event->ts_ns = start_ns;
+      event->dur_ns = end_ns - start_ns;
+    }
+  else
+    {
+      event->ts_ns = trace_now ();
+      event->dur_ns = 0;
+    }
+}
+
+/* Function: trace_write_json
+ * --------------------------
+ * Write the recorded events as a Chrome trace, which trace viewers such
+ * as Perfetto and chrome://tracing open.  Each thread is one track;
+ * the first to record an event is named "main" and the others "worker".
+ *
+ * No other thread may record events meanwhile.
+ *
+ * returns: 0 on success, or -1 if the file could not be written.
+ */
+int
+trace_write_json (const char *file_name)
+{
+  const TraceRing *r;
+  const TraceEvent *event;
+  unsigned long long first, i;
+  FILE *fp;
+  int comma;
+
+  fp = fopen (file_name, "w");
+  if (fp == NULL)
+    {
+      fprintf (stderr, "Error: Failed to open file \"%s\" for writing.\n", file_name);
+      return -1;
+    }
+
+  fprintf (fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  comma = 0;
+  for (r = rings; r != NULL; r = r->next)
+    {
+      fprintf (fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+               comma ? "," : "", r->tid, r == rings ? "main" : "worker");
+      comma = 1;
+
+      first = r->num_events > TRACE_RING_EVENTS ? r->num_events - TRACE_RING_EVENTS : 0;
+      for (i = first; i < r->num_events; i++)
+        {
+          event = &r->events[i % TRACE_RING_EVENTS];
+          fprintf (fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,", event->name, event->phase,
+                   (double) (event->ts_ns - origin_ns) / 1000.0);
+          if (event->phase == 'X')
+            fprintf (fp, "\"dur\":%.3f,", (double) event->dur_ns / 1000.0);
+          fprintf (fp, "\"pid\":1,\"tid\":%d}", r->tid);
+        }
+    }
+  fprintf (fp, "\n]}\n");
+
+  if (fclose (fp) != 0)
+    {
+      fprintf (stderr, "Error: Failed to close file \"%s\".\n", file_name);
+      return -1;
+    }
+
+  return 0;
+}
+
+/* Function: trace_free
+ * --------------------
+ * Stop recording and release every ring.
+ */
+void
+trace_free (void)
+{
+  TraceRing *r, *next;
+
+  trace_on = 0;
+  for (r = rings; r != NULL; r = next)
+    {
+      next = r->next;
+      mem_free (r);
+    }
+  rings = NULL;
+  last_ring = &rings;
+  num_rings = 0;
+  ring = NULL;
+}
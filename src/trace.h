@@ -0,0 +1,56 @@
+/* trace.h
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/* The events each thread keeps; older ones are overwritten. */
+#define TRACE_RING_EVENTS 16384
+
+/* Mark the start and end of a phase on the calling thread.
+ *
+ * name: The phase, a string that lives as long as the program,
+ *       since only the pointer is kept.
+ *
+ * When tracing is off, each costs one test of `trace_on`,
+ * which is expected to fail. */
+#define TRACE_BEGIN(name) \
+  do { if (__builtin_expect (trace_on, 0)) trace_event ((name), 'B', 0, 0); } while (0)
+#define TRACE_END(name) \
+  do { if (__builtin_expect (trace_on, 0)) trace_event ((name), 'E', 0, 0); } while (0)
+
+/* Record a phase that ran from start_ns to end_ns, as read by `trace_now`. */
+#define TRACE_SPAN(name, start_ns, end_ns) \
+  do { if (__builtin_expect (trace_on, 0)) trace_event ((name), 'X', (start_ns), (end_ns)); } while (0)
+
+/* Whether events are recorded; set by `trace_start`. */
+extern int trace_on;
+
+void               trace_start      (void);
+unsigned long long trace_now        (void);
+void               trace_event      (const char         *name,
+                                     char                phase,
+                                     unsigned long long  start_ns,
+                                     unsigned long long  end_ns);
+int                trace_write_json (const char         *file_name);
+void               trace_free       (void);
+
+#endif
@@ -42,6 +42,8 @@
  *
  * Note:
  *   This function treats uppercase and lowercase letters as equal.
+ *   Characters are compared as unsigned bytes, so bytes of 0x80
+ *   and above sort after ASCII.
  */
 int
 strcasecmp (const char *s1,
@@ -51,12 +53,12 @@ strcasecmp (const char *s1,
 
   while (s1[i] && s2[i])
     {
-      if (tolower (s1[i]) != tolower (s2[i]))
-        return tolower (s1[i]) - tolower (s2[i]);
+      if (tolower ((unsigned char) s1[i]) != tolower ((unsigned char) s2[i]))
+        return tolower ((unsigned char) s1[i]) - tolower ((unsigned char) s2[i]);
       i++;
     }
 
-  return tolower (s1[i]) - tolower (s2[i]);
+  return tolower ((unsigned char) s1[i]) - tolower ((unsigned char) s2[i]);
 }
 
 /* Function: get_current_date
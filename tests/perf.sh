@@ -0,0 +1,85 @@
+#!/bin/sh
+#
+# perf.sh
+#
+# Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Check the tracked operations against stored timing baselines.
+#
+# Usage: perf.sh BIN_DIR [--update]
+#
+# The benchmark (bench/bench.sh) is run on one generated catalog of
+# PERF_ROWS rows, and the time per operation of every tracked operation is
+# compared with tests/perf/baseline.jsonl.  An operation regresses when it
+# is more than PERF_TOLERANCE (a fraction, default 0.5) slower than its
+# baseline and also more than PERF_FLOOR_US microseconds (default 100)
+# slower, which keeps timer noise on very fast operations from failing
+# the check.  tests/perf/tolerance gives some operations a tolerance of
+# their own, or reports them without checking them.
+#
+# Baselines depend on the machine.  Run with --update to record new ones.
+
+set -u
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 BIN_DIR [--update]" >&2
+  exit 1
+fi
+
+bin_dir=$1
+update=${2:-}
+tests_dir=$(cd "$(dirname "$0")" && pwd)
+baseline="$tests_dir/perf/baseline.jsonl"
+tolerance="$tests_dir/perf/tolerance"
+current=$(mktemp /tmp/librlog-perf.XXXXXX)
+
+BENCH_SIZES=${PERF_ROWS:-50000} BENCH_QUERIES=10 BENCH_LOANS=200 BENCH_REPEAT=5 \
+  sh "$tests_dir/../bench/bench.sh" "$bin_dir" > "$current" 2> /dev/null
+
+if [ "$update" = "--update" ]; then
+  cp "$current" "$baseline"
+  rm -f "$current"
+  echo "UPDATED $baseline"
+  exit 0
+fi
+
+awk -v tol="${PERF_TOLERANCE:-0.5}" -v floor="${PERF_FLOOR_US:-100}" '
+  # Pull "key":value out of a bench JSON line.
+  function field(line, key,    s) {
+    s = substr(line, index(line, "\"" key "\":") + length(key) + 3);
+    sub(/[,}].*/, "", s);
+    gsub(/"/, "", s);
+    return s;
+  }
+  FILENAME == ARGV[1] { if ($0 !~ /^#/ && NF == 2) op_tol[$1] = $2; next }
+  FILENAME == ARGV[2] { base[field($0, "op")] = field($0, "us_per_op") + 0; next }
+  {
+    op = field($0, "op");
+    now = field($0, "us_per_op") + 0;
+    if (!(op in base)) {
+      printf "SKIP %-16s no baseline\n", op;
+      next;
+    }
+    if (field($0, "status") != "ok") {
+      printf "FAIL %-16s run failed\n", op;
+      failed++;
+      next;
+    }
+    t = op in op_tol ? op_tol[op] : tol;
+    if (t == "-") {
+      printf "INFO %-16s %12.1f us/op, baseline %12.1f us/op\n", op, now, base[op];
+    } else if (now > base[op] * (1 + t) && now - base[op] > floor) {
+      printf "FAIL %-16s %12.1f us/op, baseline %12.1f us/op\n", op, now, base[op];
+      failed++;
+    } else {
+      printf "PASS %-16s %12.1f us/op, baseline %12.1f us/op\n", op, now, base[op];
+    }
+  }
+  END { exit failed > 0 }
+' "$tolerance" "$baseline" "$current"
+status=$?
+
+rm -f "$current"
+exit $status
@@ -0,0 +1,113 @@
+#!/bin/sh
+#
+# run.sh
+#
+# Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Replay the golden-output tests.
+#
+# Usage: run.sh BIN_DIR [--update]
+#
+# Every tests/golden/FIXTURE-NAME.in is a session script fed to librlog on
+# stdin, run against a fresh copy of tests/fixtures/FIXTURE.csv.  The
+# program's stdout must match FIXTURE-NAME.out byte for byte, its stderr
+# must match FIXTURE-NAME.err (empty if that file does not exist), and the
+# catalog it leaves behind must match FIXTURE-NAME.saved.csv.  If the
+# directory tests/fixtures/FIXTURE exists, it is copied to data/branches
+# as the catalogs of the other branches, if tests/fixtures/FIXTURE.mrc
+# exists, it is copied to data/import.mrc as a file of MARC records, and
+# tests/fixtures/FIXTURE.csv.crc, FIXTURE.csv.ckpt and FIXTURE.csv.journal
+# are copied beside the catalog if they exist: its checksum file, and the
+# checkpoint and journal left by a session that did not quit cleanly.
+# Files the session writes to data/out are appended to its stdout,
+# each after a line with its name.
+#
+# Today's date is replaced with YYYY-MM-DD in the output and the catalog
+# before comparing, since the borrow and return prompts offer it as a
+# default.
+#
+# With --update, the expected files are rewritten from the current output.
+
+set -u
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 BIN_DIR [--update]" >&2
+  exit 1
+fi
+
+prog="$(cd "$1" && pwd)/librlog"
+update=${2:-}
+tests_dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d /tmp/librlog-check.XXXXXX)
+today=$(date +%Y-%m-%d)
+passed=0
+failed=0
+
+for script in "$tests_dir"/golden/*.in; do
+  name=$(basename "$script" .in)
+  fixture="$tests_dir/fixtures/${name%%-*}.csv"
+  expected="$tests_dir/golden/$name"
+
+  rm -rf "$work/run"
+  mkdir -p "$work/run/data/out"
+  cp "$fixture" "$work/run/data/library_catalog.csv" || exit 1
+  if [ -d "${fixture%.csv}" ]; then
+    cp -R "${fixture%.csv}" "$work/run/data/branches" || exit 1
+  fi
+  if [ -f "${fixture%.csv}.mrc" ]; then
+    cp "${fixture%.csv}.mrc" "$work/run/data/import.mrc" || exit 1
+  fi
+  for ext in crc ckpt journal; do
+    if [ -f "$fixture.$ext" ]; then
+      cp "$fixture.$ext" "$work/run/data/library_catalog.csv.$ext" || exit 1
+    fi
+  done
+
+  (cd "$work/run" && "$prog" < "$script" > "$work/stdout" 2> "$work/stderr")
+  for file in "$work/run/data/out"/*; do
+    if [ -f "$file" ]; then
+      echo "==> ${file#$work/run/} <=="
+      cat "$file"
+    fi
+  done >> "$work/stdout"
+  sed "s/$today/YYYY-MM-DD/g" "$work/stdout" > "$work/out"
+  sed "s/$today/YYYY-MM-DD/g" "$work/stderr" > "$work/err"
+  sed "s/$today/YYYY-MM-DD/g" "$work/run/data/library_catalog.csv" > "$work/saved"
+
+  if [ "$update" = "--update" ]; then
+    cp "$work/out" "$expected.out"
+    if [ -s "$work/err" ]; then
+      cp "$work/err" "$expected.err"
+    else
+      rm -f "$expected.err"
+    fi
+    cp "$work/saved" "$expected.saved.csv"
+    echo "UPDATED $name"
+    continue
+  fi
+
+  [ -f "$expected.err" ] || : > "$work/expected.err"
+  [ -f "$expected.err" ] && cp "$expected.err" "$work/expected.err"
+
+  if cmp -s "$work/out" "$expected.out" \
+     && cmp -s "$work/err" "$work/expected.err" \
+     && cmp -s "$work/saved" "$expected.saved.csv"; then
+    passed=$((passed + 1))
+    echo "PASS $name"
+  else
+    failed=$((failed + 1))
+    echo "FAIL $name"
+    diff -u "$expected.out" "$work/out"
+    diff -u "$work/expected.err" "$work/err"
+    diff -u "$expected.saved.csv" "$work/saved"
+  fi
+done
+
+rm -rf "$work"
+
+if [ "$update" != "--update" ]; then
+  echo "$passed passed, $failed failed"
+fi
+[ "$failed" -eq 0 ]
@@ -0,0 +1,140 @@
+/* unit.c
+ *
+ * Copyright 2023 Francis John Baldon <francisjohnt.baldon@bisu.edu.ph>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "column.h"
+#include "mem.h"
+
+/* Values that sort apart only after their first 8 bytes,
+ * and values that start with bytes of 0x80 and above. */
+static const char *const values[] = {
+  "Harry Potter and the Goblet of Fire",
+  "\xc3\x89mile",
+  "harry potter and the Chamber of Secrets",
+  "Zorba the Greek",
+  "\xc3\x81ngel",
+  "Harry Potter and the Chamber of Secrets",
+  "animal farm",
+  "Animal Farm",
+  "\xff",
+  ""
+};
+
+#define NUM_VALUES (sizeof (values) / sizeof (values[0]))
+
+static int failures;
+
+/* Function: check
+ * ---------------
+ * Report a failed check.
+ */
+static void
+check (int         ok,
+       const char *what,
+       const char *value)
+{
+  if (!ok)
+    {
+      printf ("FAIL %s: \"%s\"\n", what, value);
+      failures++;
+    }
+}
+
+/* Function: check_column
+ * ----------------------
+ * Check that every value of a column is found by its code,
+ * that the sorted values are in `frontcode_compare` order
+ * and that decoding the whole column gives the same values.
+ */
+static void
+check_column (const Column *column)
+{
+  char buf[FRONTCODE_MAX_LEN + 1], prev[FRONTCODE_MAX_LEN + 1];
+  const char **decoded;
+  char *heap;
+  unsigned int *codes;
+  unsigned int code, i;
+  size_t num_codes;
+
+  for (i = 0; i < NUM_VALUES; i++)
+    {
+      code = column_lookup (column, values[i]);
+      check (code != COLUMN_NONE && !strcmp (column_get (column, code, buf), values[i]),
+             "lookup", values[i]);
+
+      codes = column_match (column, values[i], &num_codes);
+      check (codes != NULL && num_codes >= 1, "match", values[i]);
+      mem_free (codes);
+    }
+
+  for (i = 1; i < column->sorted.count; i++)
+    {
+      strcpy (prev, frontcode_get (&column->sorted, i - 1, buf));
+      check (frontcode_compare (prev, frontcode_get (&column->sorted, i, buf)) < 0,
+             "order", prev);
+    }
+
+  decoded = column_decode (column, &heap);
+  check (decoded != NULL, "decode", "");
+  if (decoded == NULL)
+    return;
+  for (code = 0; code < column_size (column); code++)
+    check (!strcmp (decoded[code], column_get (column, code, buf)), "decode", buf);
+  mem_free (decoded);
+  mem_free (heap);
+}
+
+int
+main (void)
+{
+  char value[32];
+  unsigned int *remap;
+  Column column;
+  unsigned int i;
+
+  column_init (&column, 1);
+  for (i = 0; i < NUM_VALUES; i++)
+    check (column_put (&column, values[i]) != COLUMN_NONE, "put", values[i]);
+  /* Enough shared prefixes to fill several blocks. */
+  for (i = 0; i < 40; i++)
+    {
+      sprintf (value, "Volume %u of the Series", i);
+      check (column_put (&column, value) != COLUMN_NONE, "put", value);
+    }
+  check_column (&column);
+
+  check (column_seal (&column, &remap) == 0, "seal", "");
+  mem_free (remap);
+  check (column.sorted.count == NUM_VALUES + 40, "sealed count", "");
+  check_column (&column);
+
+  /* Values added after sealing are found alongside the sorted ones. */
+  check (column_put (&column, "\xc3\xa9mile") != COLUMN_NONE, "put", "\xc3\xa9mile");
+  check (column_seal (&column, &remap) == 0, "seal", "");
+  mem_free (remap);
+  check (column_lookup (&column, "\xc3\xa9mile") != COLUMN_NONE, "lookup", "\xc3\xa9mile");
+  check_column (&column);
+
+  column_free (&column);
+  printf ("column: %s\n", failures ? "FAIL" : "PASS");
+  return failures ? 1 : 0;
+}